@@ -0,0 +1,556 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <error.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+
+#include "rbh-find/actions.h"
+#include "rbh-find/core.h"
+#include "rbh-find/find_cb.h"
+#include "rbh-find/json.h"
+#include "rbh-find/output.h"
+#include "rbh-find/stats.h"
+#include "rbh-find/utils.h"
+
+#include "mock.h"
+
+#ifndef RBH_FIND_VERSION
+# define RBH_FIND_VERSION "unknown"
+#endif
+
+/* What the fsentries of the mock backend look like */
+static struct mock_options mock = {
+    .count = 100000,
+    .fanout = 16,
+    .depth = 4,
+    .name_length = 16,
+};
+
+/* The number of predicates of the command line parse_expression() parses */
+static size_t predicate_count = 10000;
+
+/* How many batches _find() prefetches, as rbh-find does by default */
+static size_t prefetch = 1;
+
+/* The number of fsentries the formatting benchmarks go through */
+#define FSENTRY_COUNT 1024
+
+/*----------------------------------------------------------------------------*
+ |                                 benchmarks                                 |
+ *----------------------------------------------------------------------------*/
+
+/* Each benchmark runs its workload a number of times and returns how many items
+ * it processed
+ */
+struct benchmark {
+    const char *name;
+    /* What the items a benchmark processes are, for their rate */
+    const char *unit;
+    void (*setup)(void);
+    uint64_t (*run)(size_t iterations);
+    void (*teardown)(void);
+};
+
+static const char *PATTERNS[] = {
+    "*.c", "file-[0-9]*", "a?b*c[!d]e", "*/deep/*/path*", "\\*literal\\?",
+    "[[:alpha:]]*.tar.gz", "core.[0-9][0-9][0-9]*", "*",
+};
+
+static uint64_t
+bench_shell2pcre(size_t iterations)
+{
+    const size_t count = sizeof(PATTERNS) / sizeof(*PATTERNS);
+
+    for (size_t i = 0; i < iterations; i++) {
+        for (size_t j = 0; j < count; j++)
+            free(shell2pcre(PATTERNS[j]));
+    }
+
+    return iterations * count;
+}
+
+static char **arguments;
+static int argument_count;
+
+/* Generate a command line of `predicate_count' predicates, mostly ANDed, with
+ * an -o every so often to exercise the recursive descent
+ */
+static void
+setup_parse_expression(void)
+{
+    static const char *PREDICATES[][2] = {
+        { "-name", "file-*" },
+        { "-size", "+1k" },
+        { "-type", "f" },
+        { "-mmin", "-60" },
+        { "-perm", "/022" },
+        { "-iname", "*.TXT" },
+    };
+    const size_t count = sizeof(PREDICATES) / sizeof(*PREDICATES);
+
+    arguments = malloc(predicate_count * 3 * sizeof(*arguments));
+    if (arguments == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+
+    argument_count = 0;
+    for (size_t i = 0; i < predicate_count; i++) {
+        if (i > 0)
+            arguments[argument_count++] = i % 100 == 0 ? "-o" : "-a";
+        arguments[argument_count++] = (char *)PREDICATES[i % count][0];
+        arguments[argument_count++] = (char *)PREDICATES[i % count][1];
+    }
+}
+
+static uint64_t
+bench_parse_expression(size_t iterations)
+{
+    struct find_context ctx = {
+        .argc = argument_count,
+        .argv = arguments,
+        .parse_predicate_callback = &find_parse_predicate,
+        .pred_or_action_callback = &find_predicate_or_action,
+    };
+
+    for (size_t i = 0; i < iterations; i++) {
+        struct rbh_filter_sort *sorts = NULL;
+        size_t sorts_count = 0;
+        int index = 0;
+
+        parse_expression(&ctx, &index, NULL, &sorts, &sorts_count);
+        /* The whole filter is freed along with its arena */
+        filter_arena_destroy(ctx.filters);
+        ctx.filters = NULL;
+        ctx.token = CLT_URI;
+    }
+
+    return iterations * predicate_count;
+}
+
+static void
+teardown_parse_expression(void)
+{
+    free(arguments);
+}
+
+static struct rbh_fsentry *fsentries[FSENTRY_COUNT];
+static struct printf_format *format;
+static struct output *sink;
+static struct ls_format *ls;
+
+static void
+setup_fsentries(void)
+{
+    for (size_t i = 0; i < FSENTRY_COUNT; i++) {
+        fsentries[i] = mock_fsentry_new(&mock, i);
+        fsentry_index_path(fsentries[i]);
+    }
+
+    format = printf_format_compile("%p %s %u %g %m %TY-%Tm-%Td %TT\\n");
+    sink = output_open("/dev/null");
+    ls = ls_format_new();
+}
+
+static uint64_t
+bench_printf(size_t iterations)
+{
+    for (size_t i = 0; i < iterations; i++) {
+        for (size_t j = 0; j < FSENTRY_COUNT; j++)
+            fsentry_printf_format(sink, fsentries[j], format);
+    }
+
+    return iterations * FSENTRY_COUNT;
+}
+
+static uint64_t
+bench_ls(size_t iterations)
+{
+    for (size_t i = 0; i < iterations; i++) {
+        for (size_t j = 0; j < FSENTRY_COUNT; j++)
+            fsentry_print_ls_dils(sink, ls, fsentries[j]);
+    }
+
+    return iterations * FSENTRY_COUNT;
+}
+
+static uint64_t
+bench_json(size_t iterations)
+{
+    for (size_t i = 0; i < iterations; i++) {
+        for (size_t j = 0; j < FSENTRY_COUNT; j++)
+            fsentry_print_json(sink, fsentries[j]);
+    }
+
+    return iterations * FSENTRY_COUNT;
+}
+
+static void
+teardown_fsentries(void)
+{
+    output_close(sink);
+    ls_format_destroy(ls);
+    printf_format_destroy(format);
+    for (size_t i = 0; i < FSENTRY_COUNT; i++)
+        free(fsentries[i]);
+}
+
+static struct find_context ctx;
+
+static void
+setup_find(void)
+{
+    ctx = (struct find_context) {
+        .backend_count = 1,
+        .exec_action_callback = &find_exec_action,
+        .exec_batch_callback = &find_exec_batch,
+        .action_projection_callback = &find_action_projection,
+        .prefetch = prefetch,
+    };
+
+    ctx.backends = malloc(sizeof(*ctx.backends));
+    if (ctx.backends == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+    ctx.backends[0] = mock_backend_new(&mock);
+
+    /* find_exec_action() prints to `ctx.output' when there is one */
+    ctx.output = output_open("/dev/null");
+}
+
+static uint64_t
+find_run(enum action action, size_t iterations)
+{
+    /* _find() only counts the fsentries of -count */
+    for (size_t i = 0; i < iterations; i++)
+        _find(&ctx, 0, action, NULL, NULL, 0);
+
+    return iterations * mock.count;
+}
+
+static uint64_t
+bench_find_print(size_t iterations)
+{
+    return find_run(ACT_PRINT, iterations);
+}
+
+static uint64_t
+bench_find_ls(size_t iterations)
+{
+    return find_run(ACT_LS, iterations);
+}
+
+static void
+teardown_find(void)
+{
+    ctx_finish(&ctx);
+}
+
+static const struct benchmark BENCHMARKS[] = {
+    {
+        .name = "shell2pcre",
+        .unit = "patterns",
+        .run = bench_shell2pcre,
+    }, {
+        .name = "parse_expression",
+        .unit = "predicates",
+        .setup = setup_parse_expression,
+        .run = bench_parse_expression,
+        .teardown = teardown_parse_expression,
+    }, {
+        .name = "fsentry_printf_format",
+        .unit = "entries",
+        .setup = setup_fsentries,
+        .run = bench_printf,
+        .teardown = teardown_fsentries,
+    }, {
+        .name = "fsentry_print_ls_dils",
+        .unit = "entries",
+        .setup = setup_fsentries,
+        .run = bench_ls,
+        .teardown = teardown_fsentries,
+    }, {
+        .name = "fsentry_print_json",
+        .unit = "entries",
+        .setup = setup_fsentries,
+        .run = bench_json,
+        .teardown = teardown_fsentries,
+    }, {
+        .name = "_find-print",
+        .unit = "entries",
+        .setup = setup_find,
+        .run = bench_find_print,
+        .teardown = teardown_find,
+    }, {
+        .name = "_find-ls",
+        .unit = "entries",
+        .setup = setup_find,
+        .run = bench_find_ls,
+        .teardown = teardown_find,
+    },
+};
+
+/*----------------------------------------------------------------------------*
+ |                                  harness                                   |
+ *----------------------------------------------------------------------------*/
+
+struct result {
+    const struct benchmark *benchmark;
+    size_t iterations;
+    uint64_t items;
+    uint64_t elapsed;
+};
+
+/* Run a benchmark for at least \p min_time nanoseconds */
+static void
+measure(const struct benchmark *benchmark, uint64_t min_time,
+        struct result *result)
+{
+    size_t iterations = 1;
+
+    if (benchmark->setup)
+        benchmark->setup();
+
+    /* Warm caches up */
+    benchmark->run(1);
+
+    while (true) {
+        uint64_t start = stats_clock();
+        uint64_t items = benchmark->run(iterations);
+        uint64_t elapsed = stats_clock() - start;
+
+        result->benchmark = benchmark;
+        result->iterations = iterations;
+        result->items = items;
+        result->elapsed = elapsed;
+
+        if (elapsed >= min_time)
+            break;
+
+        /* Aim a little past `min_time', but do not grow too fast on runs too
+         * short to be measured reliably
+         */
+        if (elapsed < min_time / 100)
+            iterations *= 100;
+        else
+            iterations = iterations * 1.2 * min_time / elapsed + 1;
+    }
+
+    if (benchmark->teardown)
+        benchmark->teardown();
+}
+
+static void
+print_text(const struct result *results, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        const struct result *result = &results[i];
+
+        printf("%-24s %10zu iterations %14.1f ns/iteration %14.1f %s/s\n",
+               result->benchmark->name, result->iterations,
+               (double)result->elapsed / result->iterations,
+               result->items * 1e9 / result->elapsed,
+               result->benchmark->unit);
+    }
+}
+
+static void
+print_json(const struct result *results, size_t count)
+{
+    printf("{\"version\": \"%s\", \"benchmarks\": [", RBH_FIND_VERSION);
+    for (size_t i = 0; i < count; i++) {
+        const struct result *result = &results[i];
+
+        printf("%s{\"name\": \"%s\", \"iterations\": %zu, \"time\": %.9f, \"ns_per_iteration\": %.1f, \"items\": %" PRIu64 ", \"unit\": \"%s\", \"items_per_second\": %.1f}",
+               i ? ", " : "", result->benchmark->name, result->iterations,
+               result->elapsed / 1e9,
+               (double)result->elapsed / result->iterations, result->items,
+               result->benchmark->unit,
+               result->items * 1e9 / result->elapsed);
+    }
+    printf("]}\n");
+}
+
+static void
+usage(void)
+{
+    const size_t count = sizeof(BENCHMARKS) / sizeof(*BENCHMARKS);
+
+    printf("usage: rbh-find-bench [OPTION...] [BENCHMARK...]\n"
+           "\n"
+           "Run rbh-find's microbenchmarks, all of them if no BENCHMARK is given.\n"
+           "\n"
+           "Options:\n"
+           "    -f, --format FORMAT      either text (the default) or json\n"
+           "    -t, --min-time MS        run each benchmark for at least MS milliseconds\n"
+           "    -n, --entries N          the number of entries of the mock backend\n"
+           "    -r, --rate N             yield at most N entries per second\n"
+           "    -F, --fanout N           the number of entries per directory\n"
+           "    -d, --depth N            the number of directories above each entry\n"
+           "    -l, --name-length N      the length of the names of entries\n"
+           "    -R, --retry-every N      fail one in N iterations with EAGAIN\n"
+           "    -p, --predicates N       the number of predicates to parse\n"
+           "    -P, --prefetch N         the number of batches _find() prefetches\n"
+           "    -h, --help               print this message and exit\n"
+           "\n"
+           "Benchmarks:\n");
+    for (size_t i = 0; i < count; i++)
+        printf("    %s\n", BENCHMARKS[i].name);
+}
+
+static uint64_t
+option2uint64(const char *name, const char *value)
+{
+    uint64_t result;
+
+    if (str2uint64_t(value, &result))
+        error(EX_USAGE, 0, "invalid argument `%s' to `%s'", value, name);
+    return result;
+}
+
+/* The numeric options, <getopt.h>'s `struct option' would clash with
+ * rbh-find's `enum option'
+ */
+static const struct {
+    const char *name;
+    char short_name;
+} OPTIONS[] = {
+    { "--min-time",     't' },
+    { "--entries",      'n' },
+    { "--rate",         'r' },
+    { "--fanout",       'F' },
+    { "--depth",        'd' },
+    { "--name-length",  'l' },
+    { "--retry-every",  'R' },
+    { "--predicates",   'p' },
+    { "--prefetch",     'P' },
+};
+
+int
+main(int argc, char *argv[])
+{
+    const size_t count = sizeof(BENCHMARKS) / sizeof(*BENCHMARKS);
+    enum stats_format output_format = STATS_TEXT;
+    uint64_t min_time = 500;
+    struct result *results;
+    size_t result_count = 0;
+    bool *selected;
+    bool all = true;
+
+    selected = calloc(count, sizeof(*selected));
+    if (selected == NULL)
+        error(EXIT_FAILURE, errno, "calloc");
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        uint64_t value;
+        size_t j;
+
+        if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
+            usage();
+            return EXIT_SUCCESS;
+        }
+
+        if (strcmp(arg, "-f") == 0 || strcmp(arg, "--format") == 0) {
+            if (++i == argc)
+                error(EX_USAGE, 0, "missing argument to `%s'", arg);
+            if (str2stats_format(argv[i], &output_format))
+                error(EX_USAGE, 0, "invalid argument `%s' to `%s'", argv[i],
+                      arg);
+            continue;
+        }
+
+        for (j = 0; j < sizeof(OPTIONS) / sizeof(*OPTIONS); j++) {
+            if (strcmp(arg, OPTIONS[j].name) == 0 ||
+                (arg[0] == '-' && arg[1] == OPTIONS[j].short_name &&
+                 arg[2] == '\0'))
+                break;
+        }
+
+        if (j < sizeof(OPTIONS) / sizeof(*OPTIONS)) {
+            if (++i == argc)
+                error(EX_USAGE, 0, "missing argument to `%s'", arg);
+            value = option2uint64(arg, argv[i]);
+
+            switch (OPTIONS[j].short_name) {
+            case 't':
+                min_time = value;
+                break;
+            case 'n':
+                mock.count = value;
+                break;
+            case 'r':
+                mock.rate = value;
+                break;
+            case 'F':
+                mock.fanout = value;
+                break;
+            case 'd':
+                mock.depth = value;
+                break;
+            case 'l':
+                mock.name_length = value;
+                break;
+            case 'R':
+                mock.retry_every = value;
+                break;
+            case 'p':
+                if (value == 0)
+                    error(EX_USAGE, 0, "invalid argument `%s' to `%s'",
+                          argv[i], arg);
+                predicate_count = value;
+                break;
+            case 'P':
+                prefetch = value;
+                break;
+            }
+            continue;
+        }
+
+        if (arg[0] == '-')
+            error(EX_USAGE, 0, "unknown option `%s'", arg);
+
+        for (j = 0; j < count; j++) {
+            if (strcmp(arg, BENCHMARKS[j].name) == 0)
+                break;
+        }
+        if (j == count)
+            error(EX_USAGE, 0, "unknown benchmark `%s'", arg);
+
+        selected[j] = true;
+        all = false;
+    }
+
+    results = malloc(count * sizeof(*results));
+    if (results == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+
+    for (size_t i = 0; i < count; i++) {
+        if (all || selected[i])
+            measure(&BENCHMARKS[i], min_time * 1000000,
+                    &results[result_count++]);
+    }
+
+    switch (output_format) {
+    case STATS_TEXT:
+        print_text(results, result_count);
+        break;
+    case STATS_JSON:
+        print_json(results, result_count);
+        break;
+    }
+
+    free(selected);
+    free(results);
+    return EXIT_SUCCESS;
+}
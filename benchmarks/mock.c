@@ -0,0 +1,235 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <error.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/stat.h>
+
+#include "mock.h"
+
+/* An ID no actual backend uses */
+#define MOCK_BACKEND_ID 255
+
+/* An arbitrary date (2022-01-01T00:00:00Z) entries are modified after */
+#define MOCK_EPOCH 1640995200
+
+static uint64_t
+mock_clock(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/* Write the path of the entry at \p index in \p path, return its name */
+static const char *
+mock_path(const struct mock_options *options, size_t index,
+          char path[PATH_MAX])
+{
+    size_t fanout = options->fanout ? options->fanout : 1;
+    size_t length = 0;
+    size_t divisor = 1;
+
+    for (size_t i = 0; i < options->depth; i++)
+        divisor *= fanout;
+
+    for (size_t i = 0; i < options->depth; i++, divisor /= fanout)
+        length += snprintf(path + length, PATH_MAX - length, "/dir-%zu",
+                           index / divisor % fanout);
+
+    snprintf(path + length, PATH_MAX - length, "/entry-%0*zu",
+             (int)(options->name_length > 6 ? options->name_length - 6 : 0),
+             index);
+    return path + length + 1;
+}
+
+struct rbh_fsentry *
+mock_fsentry_new(const struct mock_options *options, size_t index)
+{
+    size_t fanout = options->fanout ? options->fanout : 1;
+    uint64_t parent = index / fanout;
+    uint64_t self = index + 1;
+    const struct rbh_id id = {
+        .data = (const char *)&self,
+        .size = sizeof(self),
+    };
+    const struct rbh_id parent_id = {
+        .data = (const char *)&parent,
+        .size = sizeof(parent),
+    };
+    bool directory = index % fanout == 0;
+    struct rbh_value path_value = {
+        .type = RBH_VT_STRING,
+    };
+    const struct rbh_value_pair pair = {
+        .key = "path",
+        .value = &path_value,
+    };
+    const struct rbh_value_map ns_xattrs = {
+        .pairs = &pair,
+        .count = 1,
+    };
+    struct rbh_statx statx = {
+        .stx_mask = RBH_STATX_ALL,
+        .stx_blksize = 4096,
+        .stx_nlink = directory ? 2 : 1,
+        .stx_uid = index % 2 ? 1000 : 0,
+        .stx_gid = index % 3 ? 1000 : 0,
+        .stx_mode = directory ? S_IFDIR | 0755 : S_IFREG | 0644,
+        .stx_ino = self,
+        /* Sizes spread over a few orders of magnitude */
+        .stx_size = directory ? 4096 : (index * UINT64_C(2654435761)) % (1 << 24),
+        .stx_atime = { .tv_sec = MOCK_EPOCH + index * 7, },
+        .stx_btime = { .tv_sec = MOCK_EPOCH, },
+        .stx_ctime = { .tv_sec = MOCK_EPOCH + index * 3, },
+        .stx_mtime = { .tv_sec = MOCK_EPOCH + index * 3, },
+    };
+    struct rbh_fsentry *fsentry;
+    char path[PATH_MAX];
+    const char *name;
+
+    statx.stx_blocks = (statx.stx_size + 511) / 512;
+    name = mock_path(options, index, path);
+    path_value.string = path;
+
+    fsentry = rbh_fsentry_new(&id, &parent_id, name, &statx, &ns_xattrs, NULL,
+                              NULL);
+    if (fsentry == NULL)
+        error(EXIT_FAILURE, errno, "rbh_fsentry_new");
+
+    return fsentry;
+}
+
+/*----------------------------------------------------------------------------*
+ |                                mock_iterator                               |
+ *----------------------------------------------------------------------------*/
+
+struct mock_iterator {
+    struct rbh_mut_iterator iterator;
+    const struct mock_options *options;
+
+    size_t index;
+    size_t count;
+    unsigned int calls;
+    /* When the query was sent, for rate limiting */
+    uint64_t start;
+};
+
+static void *
+mock_iter_next(void *_iterator)
+{
+    struct mock_iterator *iterator = _iterator;
+    const struct mock_options *options = iterator->options;
+
+    if (iterator->index == iterator->count) {
+        errno = ENODATA;
+        return NULL;
+    }
+
+    if (options->retry_every && ++iterator->calls % options->retry_every == 0) {
+        errno = EAGAIN;
+        return NULL;
+    }
+
+    if (options->rate) {
+        uint64_t deadline = iterator->start
+                          + (double)iterator->index * 1e9 / options->rate;
+        struct timespec until = {
+            .tv_sec = deadline / 1000000000,
+            .tv_nsec = deadline % 1000000000,
+        };
+
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL)
+                == EINTR);
+    }
+
+    return mock_fsentry_new(options, iterator->index++);
+}
+
+static void
+mock_iter_destroy(void *iterator)
+{
+    free(iterator);
+}
+
+static const struct rbh_mut_iterator_operations MOCK_ITER_OPS = {
+    .next = mock_iter_next,
+    .destroy = mock_iter_destroy,
+};
+
+/*----------------------------------------------------------------------------*
+ |                                mock_backend                                |
+ *----------------------------------------------------------------------------*/
+
+struct mock_backend {
+    struct rbh_backend backend;
+    struct mock_options options;
+};
+
+static struct rbh_mut_iterator *
+mock_backend_filter(void *_backend, const struct rbh_filter *filter,
+                    const struct rbh_filter_options *options)
+{
+    struct mock_backend *backend = _backend;
+    struct mock_iterator *iterator;
+
+    (void) filter;
+
+    iterator = malloc(sizeof(*iterator));
+    if (iterator == NULL)
+        return NULL;
+
+    iterator->iterator.ops = &MOCK_ITER_OPS;
+    iterator->options = &backend->options;
+    iterator->index = 0;
+    iterator->count = backend->options.count;
+    if (options->limit && options->limit < iterator->count)
+        iterator->count = options->limit;
+    iterator->calls = 0;
+    iterator->start = mock_clock();
+
+    return &iterator->iterator;
+}
+
+static void
+mock_backend_destroy(void *backend)
+{
+    free(backend);
+}
+
+static const struct rbh_backend_operations MOCK_BACKEND_OPS = {
+    .filter = mock_backend_filter,
+    .destroy = mock_backend_destroy,
+};
+
+struct rbh_backend *
+mock_backend_new(const struct mock_options *options)
+{
+    struct mock_backend *backend;
+
+    backend = malloc(sizeof(*backend));
+    if (backend == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+
+    backend->backend.id = MOCK_BACKEND_ID;
+    backend->backend.name = "mock";
+    backend->backend.ops = &MOCK_BACKEND_OPS;
+    backend->options = *options;
+
+    return &backend->backend;
+}
@@ -0,0 +1,68 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifndef RBH_FIND_BENCHMARKS_MOCK_H
+#define RBH_FIND_BENCHMARKS_MOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <robinhood.h>
+
+/**
+ * What the fsentries of a mock backend look like, and how fast they come
+ */
+struct mock_options {
+    /** The number of fsentries each query yields */
+    size_t count;
+
+    /** The number of entries in each directory, one of which is a directory */
+    size_t fanout;
+    /** The number of directories above each entry */
+    size_t depth;
+    /** The length of the names of entries */
+    size_t name_length;
+
+    /** The maximum number of fsentries yielded per second, 0 for no limit */
+    uint64_t rate;
+    /** One in how many calls to rbh_mut_iter_next() fails with EAGAIN, 0 for
+     * none
+     */
+    unsigned int retry_every;
+};
+
+/**
+ * Create an in-memory backend that yields synthetic fsentries
+ *
+ * @param options   what the fsentries look like (copied)
+ *
+ * @return          a pointer to a newly allocated backend
+ *
+ * Every query yields the same fsentries, whatever its filter: each has an ID,
+ * a parent ID, a name, a path, and every statx field. Queries honor the limit
+ * of their options, but not their projection or sort criteria.
+ *
+ * Exit on error
+ */
+struct rbh_backend *
+mock_backend_new(const struct mock_options *options);
+
+/**
+ * Build the fsentry a mock backend yields at a given index
+ *
+ * @param options   what the fsentries look like
+ * @param index     the index of the fsentry
+ *
+ * @return          a pointer to a newly allocated fsentry, to be freed with
+ *                  free()
+ *
+ * Exit on error
+ */
+struct rbh_fsentry *
+mock_fsentry_new(const struct mock_options *options, size_t index);
+
+#endif
@@ -3,18 +3,118 @@
 #ifndef RBH_FIND_ACTION_H
 #define RBH_FIND_ACTION_H
 
-#include <stdio.h>
-
+#include <robinhood/filter.h>
 #include <robinhood/fsentry.h>
+#include <robinhood/statx.h>
+
+#include "rbh-find/output.h"
+
+/** The statx fields fsentry_print_ls_dils() prints */
+#define LS_DILS_STATX_MASK (RBH_STATX_INO | RBH_STATX_BLOCKS | RBH_STATX_TYPE \
+                          | RBH_STATX_MODE | RBH_STATX_NLINK | RBH_STATX_UID  \
+                          | RBH_STATX_GID | RBH_STATX_SIZE                    \
+                          | RBH_STATX_MTIME_SEC)
+
+/**
+ * What -ls remembers from one fsentry to the next: the width of its columns,
+ * which grow to fit the widest value printed so far, and the current year
+ */
+struct ls_format;
 
+/**
+ * Create the state of -ls
+ *
+ * @return          a pointer to a newly allocated struct ls_format
+ *
+ * Exit on error
+ */
+struct ls_format *
+ls_format_new(void);
+
+/**
+ * Free the state of -ls
+ *
+ * @param ls        the state to free
+ */
+void
+ls_format_destroy(struct ls_format *ls);
+
+/**
+ * Print an fsentry like find's -ls does
+ *
+ * @param output    the output to print to
+ * @param ls        the state of -ls, which is updated
+ * @param fsentry   the fsentry to print
+ *
+ * Exit on error
+ */
 void
-fsentry_print_ls_dils(FILE *file, const struct rbh_fsentry *fsentry);
+fsentry_print_ls_dils(struct output *output, struct ls_format *ls,
+                      const struct rbh_fsentry *fsentry);
 
 const char *
 fsentry_path(const struct rbh_fsentry *fsentry);
 
+/**
+ * Move the path of an fsentry first among its namespace xattrs
+ *
+ * @param fsentry   the fsentry to update
+ *
+ * fsentry_path() looks there first, which makes it O(1) on fsentries this
+ * function was called on. The other namespace xattrs keep their order.
+ */
+void
+fsentry_index_path(struct rbh_fsentry *fsentry);
+
+/**
+ * A -printf format string, compiled
+ */
+struct printf_format;
+
+/**
+ * Compile a -printf format string
+ *
+ * @param string    the format string to compile
+ *
+ * @return          a pointer to a newly allocated struct printf_format
+ *
+ * The directives and escapes are those of GNU find's -printf, except for the
+ * ones about the starting points and the target of symlinks.
+ *
+ * Exit on error, including when \p string is invalid
+ */
+struct printf_format *
+printf_format_compile(const char *string);
+
+/**
+ * Add the fields the directives of a format use to a projection
+ *
+ * @param format        a compiled format
+ * @param projection    the projection to update
+ */
+void
+printf_format_projection(const struct printf_format *format,
+                         struct rbh_filter_projection *projection);
+
+/**
+ * Free a compiled format
+ *
+ * @param format    the format to free
+ */
+void
+printf_format_destroy(struct printf_format *format);
+
+/**
+ * Print an fsentry according to a compiled format
+ *
+ * @param output    the output to print to
+ * @param fsentry   the fsentry to print
+ * @param format    the format to print \p fsentry with
+ *
+ * Exit on error
+ */
 void
-fsentry_printf_format(FILE *file, const struct rbh_fsentry *fsentry,
-                      const char *format_string);
+fsentry_printf_format(struct output *output, const struct rbh_fsentry *fsentry,
+                      const struct printf_format *format);
 
 #endif
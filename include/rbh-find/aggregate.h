@@ -0,0 +1,157 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifndef RBH_FIND_AGGREGATE_H
+#define RBH_FIND_AGGREGATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <robinhood/filter.h>
+#include <robinhood/fsentry.h>
+
+#include "rbh-find/output.h"
+
+enum aggregate_function {
+    AGG_COUNT,
+    AGG_SUM,
+    AGG_HISTOGRAM,
+};
+
+/* Bucket 0 holds 0, bucket n > 0 holds values in [2^(n-1), 2^n) */
+#define HISTOGRAM_BUCKETS 65
+
+struct aggregate_row {
+    /** The value of the group field, 0 if fsentries are not grouped */
+    uint64_t group;
+    /** The histogram bucket, 0 for other functions */
+    unsigned int bucket;
+    /** The number of fsentries in this row */
+    uint64_t count;
+    /** The sum of the aggregated field of those fsentries (AGG_SUM only) */
+    uint64_t sum;
+    /** The sum of the squares of that field, for the estimates of a sample
+     * (AGG_SUM only, and not for pre-aggregated fsentries)
+     */
+    double squares;
+};
+
+/**
+ * The result of an aggregating action: -count, -sum or -histogram
+ */
+struct aggregate {
+    enum aggregate_function function;
+
+    /** The field to sum or to build a histogram of */
+    struct rbh_filter_field field;
+
+    /** Whether to aggregate fsentries by the value of `group' */
+    bool grouped;
+    struct rbh_filter_field group;
+
+    /** Rows sorted by group, then by bucket */
+    struct aggregate_row *rows;
+    size_t row_count;
+
+    /** The total number of fsentries aggregated */
+    uint64_t count;
+
+    /** The fraction of fsentries the aggregated ones were sampled from, 0 if
+     * every fsentry was aggregated. Rows are then printed as estimates.
+     */
+    double rate;
+};
+
+/**
+ * Create an aggregate
+ *
+ * @param function  the aggregating function
+ * @param field     the field to aggregate (ignored for AGG_COUNT)
+ * @param group     the field to group fsentries by, or NULL
+ *
+ * @return          a pointer to a newly allocated struct aggregate
+ *
+ * Exit on error
+ */
+struct aggregate *
+aggregate_new(enum aggregate_function function,
+              const struct rbh_filter_field *field,
+              const struct rbh_filter_field *group);
+
+/**
+ * Get the histogram bucket of a value
+ *
+ * @param value     a value
+ *
+ * @return          the index of the bucket \p value belongs in
+ */
+unsigned int
+histogram_bucket(uint64_t value);
+
+/**
+ * Add pre-aggregated fsentries to an aggregate
+ *
+ * @param aggregate the aggregate to update
+ * @param group     the value of the group field of the fsentries
+ * @param bucket    the histogram bucket of the fsentries
+ * @param count     the number of fsentries
+ * @param sum       the sum of the aggregated field of the fsentries
+ *
+ * Backends that aggregate fsentries themselves report their results with this.
+ *
+ * Exit on error
+ */
+void
+aggregate_add(struct aggregate *aggregate, uint64_t group, unsigned int bucket,
+              uint64_t count, uint64_t sum);
+
+/**
+ * Add an fsentry to an aggregate
+ *
+ * @param aggregate the aggregate to update
+ * @param fsentry   the fsentry to add
+ *
+ * Fsentries that miss the aggregated or the group field, or whose value is not
+ * a positive integer, are ignored.
+ *
+ * Exit on error
+ */
+void
+aggregate_fsentry(struct aggregate *aggregate,
+                  const struct rbh_fsentry *fsentry);
+
+/**
+ * Add the fields an aggregate needs to a projection
+ *
+ * @param aggregate     an aggregate
+ * @param projection    the projection to update
+ */
+void
+aggregate_projection(const struct aggregate *aggregate,
+                     struct rbh_filter_projection *projection);
+
+/**
+ * Print an aggregate, one row per line
+ *
+ * @param output    the output to print to
+ * @param aggregate the aggregate to print
+ *
+ * If `aggregate->rate' is set, each count and sum is printed as an estimate,
+ * with its 95% confidence interval, see sample_estimate().
+ */
+void
+aggregate_print(struct output *output, const struct aggregate *aggregate);
+
+/**
+ * Free an aggregate
+ *
+ * @param aggregate the aggregate to free
+ */
+void
+aggregate_destroy(struct aggregate *aggregate);
+
+#endif
@@ -0,0 +1,152 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifndef RBH_FIND_BINARY_H
+#define RBH_FIND_BINARY_H
+
+#include <stdint.h>
+
+#include <robinhood/fsentry.h>
+#include <robinhood/statx.h>
+
+#include "rbh-find/output.h"
+
+/**
+ * The stream -fprintbin writes
+ *
+ * A stream is a struct binary_header followed by struct binary_record's, back
+ * to back. Integers are written in the byte order of the host that wrote the
+ * stream, which \p byte_order tells. Both structures only hold fixed-size
+ * fields at their natural alignment, so that a stream can be memory-mapped and
+ * its records scanned in place.
+ */
+
+#define BINARY_MAGIC "RBHFBIN"
+#define BINARY_VERSION 1
+/** What \p byte_order reads as on a host with the same byte order */
+#define BINARY_BYTE_ORDER 0x01020304
+
+/** The statx fields a record may hold */
+#define BINARY_STATX_MASK (RBH_STATX_TYPE | RBH_STATX_MODE | RBH_STATX_NLINK   \
+                         | RBH_STATX_UID | RBH_STATX_GID | RBH_STATX_ATIME     \
+                         | RBH_STATX_BTIME | RBH_STATX_CTIME | RBH_STATX_MTIME \
+                         | RBH_STATX_INO | RBH_STATX_SIZE | RBH_STATX_BLOCKS   \
+                         | RBH_STATX_BLKSIZE | RBH_STATX_ATTRIBUTES            \
+                         | RBH_STATX_RDEV_MAJOR | RBH_STATX_RDEV_MINOR         \
+                         | RBH_STATX_DEV_MAJOR | RBH_STATX_DEV_MINOR)
+
+struct binary_header {
+    /** BINARY_MAGIC, null-terminated */
+    char magic[8];
+    /** BINARY_VERSION, incremented whenever the layout of records changes */
+    uint32_t version;
+    /** BINARY_BYTE_ORDER, in the byte order of the stream */
+    uint32_t byte_order;
+};
+
+struct binary_timestamp {
+    int64_t sec;
+    uint32_t nsec;
+    uint32_t padding;
+};
+
+struct binary_record {
+    /** The size of the record, trailing data and padding included, a multiple
+     * of 8
+     */
+    uint32_t length;
+    /** Which fields below are set, RBH_STATX_* bits */
+    uint32_t statx_mask;
+
+    /** The size of the ID and parent ID that follow the record, 0 if unknown */
+    uint32_t id_size;
+    uint32_t parent_id_size;
+    /** The size of the name and path that follow the IDs, null byte included,
+     * 0 if unknown
+     */
+    uint32_t name_size;
+    uint32_t path_size;
+
+    uint32_t blksize;
+    uint32_t nlink;
+    uint32_t uid;
+    uint32_t gid;
+    uint16_t mode;
+    uint16_t padding;
+    uint32_t rdev_major;
+    uint32_t rdev_minor;
+    uint32_t dev_major;
+    uint32_t dev_minor;
+    uint32_t reserved;
+
+    uint64_t attributes;
+    uint64_t ino;
+    uint64_t size;
+    uint64_t blocks;
+
+    struct binary_timestamp atime;
+    struct binary_timestamp btime;
+    struct binary_timestamp ctime;
+    struct binary_timestamp mtime;
+
+    /** The ID, parent ID, name and path, in that order */
+    char data[];
+};
+
+/**
+ * Get the path in a record
+ *
+ * @param record    a record
+ *
+ * @return          the null-terminated path in \p record, NULL if it is unknown
+ */
+static inline const char *
+binary_record_path(const struct binary_record *record)
+{
+    return record->path_size == 0 ? NULL :
+        &record->data[record->id_size + record->parent_id_size
+                                      + record->name_size];
+}
+
+/**
+ * Get the record after a record
+ *
+ * @param record    a record
+ *
+ * @return          a pointer to the record that follows \p record in its
+ *                  stream (or to the end of the stream)
+ */
+static inline const struct binary_record *
+binary_record_next(const struct binary_record *record)
+{
+    return (const void *)((const char *)record + record->length);
+}
+
+/**
+ * Start a stream of records
+ *
+ * @param output    the output to write a struct binary_header to
+ *
+ * Exit on error
+ */
+void
+binary_print_header(struct output *output);
+
+/**
+ * Write an fsentry as a record
+ *
+ * @param output    the output to write the record to
+ * @param fsentry   the fsentry to write
+ *
+ * The fields \p fsentry does not have are left unset in the record.
+ *
+ * Exit on error
+ */
+void
+fsentry_print_binary(struct output *output, const struct rbh_fsentry *fsentry);
+
+#endif
@@ -0,0 +1,88 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifndef RBH_FIND_CACHE_H
+#define RBH_FIND_CACHE_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include <robinhood.h>
+
+/**
+ * A local cache of the fsentries backends returned for queries
+ *
+ * Each query is identified by the URI of the backend, its (optimized) filter,
+ * its sort criteria, projection, skip and limit. The fsentries the backend
+ * returned for it are serialized in a file of the cache's directory, which is
+ * memory-mapped and streamed from when the same query is sent again, until the
+ * results expire.
+ */
+struct result_cache {
+    /** The directory cached results are stored in */
+    char *directory;
+    /** How long cached results are valid for, in seconds */
+    time_t ttl;
+};
+
+/**
+ * Create a result cache
+ *
+ * @param directory the directory to store results in, NULL for the default:
+ *                  $RBH_FIND_CACHE_DIR, $XDG_CACHE_HOME/rbh-find, or
+ *                  $HOME/.cache/rbh-find
+ * @param ttl       how long cached results are valid for, in seconds
+ *
+ * @return          a pointer to a newly allocated struct result_cache
+ *
+ * \p directory is created if need be.
+ *
+ * Exit on error
+ */
+struct result_cache *
+result_cache_new(const char *directory, time_t ttl);
+
+/**
+ * Free a result cache
+ *
+ * @param cache     the cache to free
+ *
+ * Cached results are kept on disk.
+ */
+void
+result_cache_destroy(struct result_cache *cache);
+
+/**
+ * Query a backend, through a result cache
+ *
+ * @param cache         the cache to go through
+ * @param uri           the URI of \p backend, which identifies it in the cache
+ * @param backend       the backend to query
+ * @param filter        the filter to apply to each fsentry
+ * @param options       the options of the query
+ * @param generation    a marker the backend changes whenever its content does
+ *                      (a sync number for instance), or NULL if there is none
+ *
+ * @return              an iterator over the fsentries of the query on success,
+ *                      NULL on error and errno is set appropriately
+ *
+ * If the results of the query are cached, have not expired, and were cached
+ * with the same \p generation, they are streamed from the cache. Otherwise,
+ * the backend is queried and its results are cached as they are iterated
+ * over, once all of them (or `options->limit' of them) were. Failing to cache
+ * results is reported, but does not fail the query.
+ *
+ * This function may be called concurrently from several threads.
+ */
+struct rbh_mut_iterator *
+result_cache_filter(struct result_cache *cache, const char *uri,
+                    struct rbh_backend *backend,
+                    const struct rbh_filter *filter,
+                    const struct rbh_filter_options *options,
+                    const uint64_t *generation);
+
+#endif
@@ -0,0 +1,80 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifndef RBH_FIND_CHECKPOINT_H
+#define RBH_FIND_CHECKPOINT_H
+
+#include <stdint.h>
+
+#include <robinhood.h>
+
+/**
+ * A high-water mark of the changes a periodic run of rbh-find already saw
+ *
+ * The mark is the largest ctime of the fsentries the actions were executed
+ * on, it is stored in a file as a decimal number of seconds. The next run only
+ * looks at fsentries whose ctime is not lower than that.
+ */
+struct checkpoint {
+    /** The file the mark is stored in */
+    char *path;
+    /** The filter on the ctime of fsentries, NULL if there is no mark yet */
+    struct rbh_filter *filter;
+    /** The mark read from `path' */
+    uint64_t mark;
+    /** The largest ctime seen so far, at least `mark' */
+    uint64_t seen;
+};
+
+/**
+ * Load a checkpoint
+ *
+ * @param path      the file the mark is stored in, which need not exist
+ *
+ * @return          a pointer to a newly allocated struct checkpoint
+ *
+ * Exit on error
+ */
+struct checkpoint *
+checkpoint_new(const char *path);
+
+/**
+ * Record the ctime of an fsentry an action was executed on
+ *
+ * @param checkpoint    the checkpoint to update
+ * @param fsentry       the fsentry to record the ctime of
+ *
+ * This function may be called concurrently from several threads.
+ */
+void
+checkpoint_see(struct checkpoint *checkpoint,
+               const struct rbh_fsentry *fsentry);
+
+/**
+ * Store the largest ctime seen so far, if it moved the mark forward
+ *
+ * @param checkpoint    the checkpoint to store
+ *
+ * The file is replaced atomically: a run that is interrupted, or one that
+ * starts meanwhile, either sees the previous mark or the new one. Failing to
+ * store the mark is reported, but is not fatal: the next run only sees more
+ * fsentries.
+ */
+void
+checkpoint_save(struct checkpoint *checkpoint);
+
+/**
+ * Free a checkpoint
+ *
+ * @param checkpoint    the checkpoint to free
+ *
+ * The mark is not saved, see checkpoint_save().
+ */
+void
+checkpoint_destroy(struct checkpoint *checkpoint);
+
+#endif
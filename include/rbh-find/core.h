@@ -17,8 +17,60 @@
 #include <robinhood/utils.h>
 
 #include "rbh-find/actions.h"
+#include "rbh-find/aggregate.h"
+#include "rbh-find/cache.h"
+#include "rbh-find/checkpoint.h"
+#include "rbh-find/delete.h"
+#include "rbh-find/evaluator.h"
+#include "rbh-find/exec.h"
 #include "rbh-find/filters.h"
+#include "rbh-find/optimizer.h"
+#include "rbh-find/output.h"
 #include "rbh-find/parser.h"
+#include "rbh-find/projection.h"
+#include "rbh-find/sample.h"
+#include "rbh-find/stats.h"
+
+/**
+ * Debug output selected with the -D option
+ */
+enum debug_option {
+    DEBUG_PROJECTION    = 0x0001,
+    DEBUG_TREE          = 0x0002,
+};
+
+/**
+ * An action recorded to be executed during a single scan of the backends
+ */
+struct plan_action {
+    /** The type of action to execute */
+    enum action action;
+
+    /** The command line index to give to `post_action_callback' */
+    int index;
+
+    /** The entries to execute the action on, as returned by filter_optimize() */
+    struct rbh_filter *filter;
+    struct filter_evaluator *evaluator;
+
+    /** The maximum number of entries to execute the action on (0 if none),
+     * and how many it was executed on so far
+     */
+    size_t limit;
+    size_t matched;
+
+    /** The `action_file', `format', `aggregate', `command' and `deletion' the
+     * action was prepared with
+     */
+    struct output *action_file;
+    struct printf_format *format;
+    struct aggregate *aggregate;
+    struct command *command;
+    struct deletion *deletion;
+
+    /** The number of entries found for this action */
+    size_t count;
+};
 
 /**
  * Find's library context
@@ -32,16 +84,132 @@ struct find_context {
     int argc;
     char **argv;
 
+    /** The last command line token parse_expression() parsed */
+    enum command_line_token token;
+
+    /** The arena the filters parse_expression() builds are allocated in,
+     * created when first needed and freed by ctx_finish()
+     */
+    struct filter_arena *filters;
+
     /** If an action was already executed in this specific execution */
     bool action_done;
 
     /** The file that should contain the results of an action, if specified */
-    FILE *action_file;
+    struct output *action_file;
+
+    /** Where the results of actions go by default, created when first needed
+     * and flushed by ctx_finish()
+     */
+    struct output *output;
+
+    /** The compiled format string to use for printing the results of the
+     * command, if specified
+     */
+    struct printf_format *format;
+
+    /** The state of -ls and -fls, created when first needed and freed by
+     * ctx_finish()
+     */
+    struct ls_format *ls;
+
+    /** The results of an aggregating action, if the action is one */
+    struct aggregate *aggregate;
+
+    /** The command to run, if the action is -exec or -execdir */
+    struct command *command;
+
+    /** The fsentries to delete, if the action is -delete */
+    struct deletion *deletion;
+
+    /** The directory the root of the backends is mounted on, which -delete,
+     * -exec and -execdir act relative to, and which they require
+     */
+    const char *mount_root;
+
+    /** How many commands -exec and -execdir may run, and how many fsentries
+     * -delete may delete, at once, 0 for one
+     */
+    size_t jobs;
+
+    /** If an action failed on some fsentries, in which case find should exit
+     * with an error
+     */
+    bool action_failed;
+
+    /** The field aggregating actions group fsentries by, if `grouped' */
+    bool grouped;
+    struct rbh_filter_field group_by;
+
+    /** An ORred combination of enum debug_option */
+    unsigned int debug;
+
+    /** If the next actions should only print the queries they would send to
+     * the backends, see -explain, rather than send them
+     */
+    bool explain;
+
+    /** The maximum number of entries the next actions are executed on, 0 if
+     * there is no limit (-quit always stops at the first entry)
+     */
+    size_t limit;
+
+    /** How many fsentries are fetched from a backend at once, 0 for the
+     * default
+     */
+    size_t batch_size;
+
+    /** How many batches of fsentries may be fetched ahead of the actions, 0
+     * to only fetch a batch once the previous one was acted upon
+     */
+    size_t prefetch;
+
+    /** How many disjoint queries to split each query into, on ranges of
+     * `partition_field', 0 or 1 not to split them, see partition_by_range()
+     */
+    size_t partition_count;
+    struct rbh_filter_field partition_field;
+
+    /** If actions should be recorded and run in a single scan of each
+     * backend, see find_plan_run()
+     */
+    bool single_scan;
+
+    /** The actions recorded for the single scan */
+    size_t plan_count;
+    struct plan_action *plan;
 
-    /** The format string to use for printing the results of the command, if
-     * specified
+    /** Statistics about the next actions, if they are to be recorded, see
+     * ctx_enable_stats()
      */
-    char *format_string;
+    struct find_stats *stats;
+
+    /** The cache queries go through, NULL if they are sent to the backends
+     * every time
+     */
+    struct result_cache *cache;
+
+    /** The checkpoint the next actions only look at the changes since, and
+     * update, NULL if they look at every fsentry
+     */
+    struct checkpoint *checkpoint;
+
+    /** The fraction of fsentries the next actions are executed on, see
+     * -sample, 0 to execute them on every fsentry
+     */
+    double sample;
+
+    /** If entries may be processed in any order when there are several
+     * backends, rather than backend after backend, or in the order of the
+     * sort criteria
+     */
+    bool unordered;
+
+    /** If `exec_action_callback' may be called concurrently from several
+     * threads, see backends_foreach(). -single-scan ignores it: it matches
+     * fsentries against every action from one thread at a time.
+     */
+    bool exec_action_thread_safe;
 
     /**
      * Callback to prepare an action's execution
@@ -64,10 +232,136 @@ struct find_context {
      * @param fsentry  the fsentry to act on
      *
      * @return         1 if the action is ACT_COUNT, 0 otherwise.
+     *
+     * When there are several backends they are queried in parallel, but this
+     * callback is still called from the thread that called find(), one fsentry
+     * at a time, unless both `unordered' and `exec_action_thread_safe' are set.
      */
     int (*exec_action_callback)(struct find_context *ctx, enum action action,
                                 struct rbh_fsentry *fsentry);
 
+    /**
+     * Callback for executing an action on several fsentries at once
+     *
+     * @param ctx        find's context for this execution
+     * @param action     the type of action to execute
+     * @param fsentries  the fsentries to act on, in order
+     * @param count      the number of fsentries in \p fsentries
+     *
+     * @return           the sum of what `exec_action_callback' would have
+     *                   returned for each fsentry
+     *
+     * If this callback is set, find() and _find() use it instead of
+     * `exec_action_callback', which single-scan mode still uses since it
+     * interleaves actions fsentry by fsentry. It is called under the same
+     * conditions as `exec_action_callback'.
+     */
+    size_t (*exec_batch_callback)(struct find_context *ctx, enum action action,
+                                  struct rbh_fsentry **fsentries,
+                                  size_t count);
+
+    /**
+     * Callback to list the fields of an fsentry an action uses
+     *
+     * @param ctx          find's context for this execution
+     * @param action       the type of action to execute
+     * @param projection   the projection to add the action's fields to
+     *
+     * If this callback is not set, every field of every fsentry is fetched.
+     */
+    void (*action_projection_callback)(struct find_context *ctx,
+                                       enum action action,
+                                       struct rbh_filter_projection *projection);
+
+    /**
+     * Callback to have a backend compute an aggregate itself
+     *
+     * @param ctx            find's context for this execution
+     * @param backend_index  index of the backend to aggregate fsentries with
+     * @param filter         the fsentries to aggregate
+     * @param aggregate      the aggregate to add the backend's results to
+     *
+     * @return               0 on success, -1 if the backend cannot compute
+     *                       \p aggregate, in which case fsentries are streamed
+     *                       from it and aggregated by `exec_action_callback'
+     *
+     * If this callback is not set, aggregates are always computed by streaming
+     * fsentries.
+     */
+    int (*aggregate_callback)(struct find_context *ctx, int backend_index,
+                              const struct rbh_filter *filter,
+                              struct aggregate *aggregate);
+
+    /**
+     * Callback to get a marker that changes whenever a backend's content does
+     *
+     * @param ctx            find's context for this execution
+     * @param backend_index  index of the backend to get the marker of
+     * @param backend        the handle to get the marker from
+     * @param generation     where to store the marker
+     *
+     * @return               0 on success, -1 if the backend has no such marker
+     *
+     * Cached results are only reused if the marker of the backend did not
+     * change since they were cached. If this callback is not set, or the
+     * backend has no marker, they are reused until they expire.
+     *
+     * \p backend is `ctx->backends[backend_index]', or another handle on the
+     * same URI when the callback may run from several threads at once (see
+     * backends_foreach_partitioned_batch()): only \p backend may be used.
+     */
+    int (*generation_callback)(struct find_context *ctx, int backend_index,
+                               struct rbh_backend *backend,
+                               uint64_t *generation);
+
+    /**
+     * Callback to have a backend explain how it would run a query
+     *
+     * @param ctx            find's context for this execution
+     * @param backend_index  index of the backend to explain the query to
+     * @param filter         the filter of the query
+     * @param options        the options of the query
+     * @param file           the stream to print the explanation on
+     *
+     * @return               0 on success, -1 if the backend cannot explain
+     *                       queries
+     *
+     * The query must not be run, only planned (which indexes it would use,
+     * how many entries it would examine, ...). If this callback is not set,
+     * -explain only shows what rbh-find would send to the backends.
+     */
+    int (*explain_callback)(struct find_context *ctx, int backend_index,
+                            const struct rbh_filter *filter,
+                            const struct rbh_filter_options *options,
+                            FILE *file);
+
+    /**
+     * Callback to have a backend sample the fsentries of a query itself
+     *
+     * @param ctx            find's context for this execution
+     * @param backend_index  index of the backend to query
+     * @param backend        the handle to query
+     * @param filter         the filter of the query
+     * @param options        the options of the query
+     * @param rate           the fraction of fsentries to return, see `sample'
+     *
+     * @return               an iterator over the sampled fsentries, or NULL if
+     *                       the backend cannot sample
+     *
+     * Each fsentry that matches the query must be returned with a probability
+     * of \p rate, independently of the others, for the estimates of -count,
+     * -sum and -histogram to hold. If this callback is not set, returns NULL,
+     * or queries go through `cache', every fsentry is fetched and they are
+     * sampled with fsentry_sampled().
+     *
+     * Like for `generation_callback', only \p backend may be used.
+     */
+    struct rbh_mut_iterator *(*sample_callback)(
+            struct find_context *ctx, int backend_index,
+            struct rbh_backend *backend, const struct rbh_filter *filter,
+            const struct rbh_filter_options *options, double rate
+            );
+
     /**
      * Callback to finish an action's execution
      *
@@ -85,7 +379,9 @@ struct find_context {
      * @param ctx            find's context for this execution
      * @param arg_idx        index of the predicate to parse in the command line
      *
-     * @return               a filter corresponding to the predicate
+     * @return               a filter corresponding to the predicate, a single
+     *                       block of memory parse_expression() moves into
+     *                       `filters' with filter_adopt()
      */
     struct rbh_filter *(*parse_predicate_callback)(struct find_context *ctx,
                                                    int *arg_idx);
@@ -102,13 +398,30 @@ struct find_context {
 };
 
 /**
- * Destroy and free the backends of a `struct find_context`
+ * Destroy and free the backends of a `struct find_context`, close its output,
+ * free its filters, and report its statistics, if any
  *
  * @param ctx      find's context for this execution
  */
 void
 ctx_finish(struct find_context *ctx);
 
+/**
+ * Record statistics about the next actions, and report them in ctx_finish()
+ *
+ * @param ctx      find's context for this execution
+ * @param format   how to report statistics, either "text" or "json"
+ *
+ * @return         0 on success, -1 if \p format is invalid
+ *
+ * Statistics are reported on stderr. If they are already recorded, only their
+ * format changes.
+ *
+ * Exit on error
+ */
+int
+ctx_enable_stats(struct find_context *ctx, const char *format);
+
 /**
  * str2command_line_token - command line token classifier
  *
@@ -122,6 +435,25 @@ ctx_finish(struct find_context *ctx);
 enum command_line_token
 str2command_line_token(struct find_context *ctx, const char *string);
 
+/**
+ * Compute the fields to fetch from the backends to execute an action
+ *
+ * @param ctx            find's context for this execution
+ * @param action         the type of action to execute
+ * @param filter         the filter to apply to each fsentry
+ * @param sorts          how the list of retrieved fsentries is sorted
+ * @param sorts_count    the size of \p sorts
+ * @param projection     the projection to fill
+ *
+ * The projection is the union of the fields \p filter and \p sorts refer to
+ * and of the fields `action_projection_callback' asks for.
+ */
+void
+find_projection(struct find_context *ctx, enum action action,
+                const struct rbh_filter *filter,
+                const struct rbh_filter_sort *sorts, size_t sorts_count,
+                struct rbh_filter_projection *projection);
+
 /**
  * Filter through every fsentries in a specific backend, executing the
  * requested action on each of them
@@ -155,6 +487,25 @@ find(struct find_context *ctx, enum action action, int *arg_idx,
      const struct rbh_filter *filter, const struct rbh_filter_sort *sorts,
      size_t sorts_count);
 
+/**
+ * Execute the actions recorded by find() in single scan mode
+ *
+ * @param ctx            find's context for this execution
+ * @param sorts          list of criteria used to sort the list of fsentries
+ * @param sorts_count    size of the sorts list
+ *
+ * Each backend is sent a single query that matches the entries of every
+ * recorded action, each entry is then matched against every action's filter
+ * which decides what actions to execute on it.
+ *
+ * Actions are executed in the order they were recorded. \p sorts should be the
+ * sort criteria of the last recorded action, those of the other actions are a
+ * prefix of it.
+ */
+void
+find_plan_run(struct find_context *ctx, const struct rbh_filter_sort *sorts,
+              size_t sorts_count);
+
 /**
  * parse_expression - parse a find expression (predicates / operators / actions)
  *
@@ -164,7 +515,8 @@ find(struct find_context *ctx, enum action action, int *arg_idx,
  * @param sorts         an array of filtering options
  * @param sorts_count   the size of \p sorts
  *
- * @return              a filter that represents the parsed expression
+ * @return              a filter that represents the parsed expression, allocated
+ *                      in `ctx->filters'
  *
  * Note this function is recursive and will call find() itself if it parses an
  * action
@@ -0,0 +1,72 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifndef RBH_FIND_DELETE_H
+#define RBH_FIND_DELETE_H
+
+#include <stddef.h>
+
+#include <robinhood/fsentry.h>
+#include <robinhood/statx.h>
+
+/** The fields of an fsentry a deletion needs */
+#define DELETION_STATX_MASK RBH_STATX_TYPE
+
+/**
+ * The removal of fsentries from the filesystem a backend mirrors
+ *
+ * Files are unlinked as they are added, by a pool of threads if there are more
+ * than one job, relative to the file descriptors of their parent directories,
+ * which each thread caches. Directories are removed once every file was, the
+ * deepest ones first, so that they are empty by the time they are.
+ */
+struct deletion;
+
+/**
+ * Start deleting fsentries
+ *
+ * @param root      the directory the root of the backend is mounted on
+ * @param jobs      how many fsentries may be deleted at once
+ *
+ * @return          a pointer to a newly allocated struct deletion
+ *
+ * Directories are never followed through symbolic links under \p root.
+ *
+ * Exit on error
+ */
+struct deletion *
+deletion_new(const char *root, size_t jobs);
+
+/**
+ * Delete an fsentry
+ *
+ * @param deletion  the deletion to add \p fsentry to
+ * @param fsentry   the fsentry to delete, with a path and, ideally, its type
+ *
+ * \p fsentry is not used once this function returns. Files may not be deleted
+ * yet, directories are not until deletion_finish() is called. The root of the
+ * backend is never deleted, and neither are fsentries that are already gone.
+ * Other failures are reported on stderr.
+ *
+ * Exit on error
+ */
+void
+deletion_add(struct deletion *deletion, const struct rbh_fsentry *fsentry);
+
+/**
+ * Finish deleting fsentries, and free a deletion
+ *
+ * @param deletion  the deletion to finish
+ *
+ * @return          the number of fsentries that could not be deleted
+ *
+ * Exit on error
+ */
+size_t
+deletion_finish(struct deletion *deletion);
+
+#endif
@@ -0,0 +1,97 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifndef RBH_FIND_EVALUATOR_H
+#define RBH_FIND_EVALUATOR_H
+
+#include <stdbool.h>
+
+#include <robinhood/filter.h>
+#include <robinhood/fsentry.h>
+
+/**
+ * A filter compiled to be matched against fsentries in memory
+ */
+struct filter_evaluator;
+
+/**
+ * Prepare a filter to be evaluated against fsentries
+ *
+ * @param filter    the filter to evaluate (NULL matches every fsentry)
+ *
+ * @return          a pointer to a newly allocated struct filter_evaluator
+ *
+ * \p filter must stay valid for as long as the returned evaluator is used.
+ *
+ * Exit on error
+ */
+struct filter_evaluator *
+filter_evaluator_new(const struct rbh_filter *filter);
+
+/**
+ * Check whether an fsentry matches a filter
+ *
+ * @param evaluator the evaluator of the filter to match \p fsentry against
+ * @param fsentry   the fsentry to match
+ *
+ * @return          true if \p fsentry matches, false otherwise
+ *
+ * Fields of \p fsentry that are needed but were not fetched from the backend
+ * are treated as missing, which is what backends do too.
+ *
+ * An evaluator must not be used by several threads at once.
+ */
+bool
+filter_evaluator_match(struct filter_evaluator *evaluator,
+                       const struct rbh_fsentry *fsentry);
+
+/**
+ * Get the value of an fsentry's field
+ *
+ * @param fsentry   the fsentry to read \p field from
+ * @param field     the field to read
+ * @param buffer    storage for values that are not part of \p fsentry as is
+ *
+ * @return          a pointer to the value of \p field, or NULL if \p fsentry
+ *                  does not have it
+ *
+ * The returned value may point into \p fsentry or \p buffer, it is only valid
+ * as long as both are.
+ */
+const struct rbh_value *
+fsentry_field_value(const struct rbh_fsentry *fsentry,
+                    const struct rbh_filter_field *field,
+                    struct rbh_value *buffer);
+
+/**
+ * Order two fsentries according to a list of sort criteria
+ *
+ * @param first         an fsentry
+ * @param second        another fsentry
+ * @param sorts         a list of sort criteria
+ * @param sorts_count   the size of \p sorts
+ *
+ * @return              a negative integer if \p first comes before \p second,
+ *                      0 if they are equivalent, and a positive integer
+ *                      otherwise
+ *
+ * Entries that miss a field come first, like they do in backends.
+ */
+int
+fsentry_sort_compare(const struct rbh_fsentry *first,
+                     const struct rbh_fsentry *second,
+                     const struct rbh_filter_sort *sorts, size_t sorts_count);
+
+/**
+ * Free an evaluator
+ *
+ * @param evaluator the evaluator to free
+ */
+void
+filter_evaluator_destroy(struct filter_evaluator *evaluator);
+
+#endif
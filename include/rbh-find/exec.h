@@ -0,0 +1,79 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifndef RBH_FIND_EXEC_H
+#define RBH_FIND_EXEC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <robinhood/fsentry.h>
+
+/**
+ * A command -exec or -execdir runs on fsentries
+ *
+ * Commands run in child processes, at most as many at once as there are jobs.
+ * A command that ends with "{} +" is run on as many fsentries at once as its
+ * arguments may hold (ARG_MAX); otherwise, every "{}" in its arguments is
+ * replaced with the path of an fsentry, and it is run once per fsentry.
+ */
+struct command;
+
+/**
+ * Compile a command
+ *
+ * @param argv          the command and its arguments, "{}" included
+ * @param argc          the number of strings in \p argv, the trailing ';' or
+ *                      '+' excluded
+ * @param batched       whether the command ended with "{} +"
+ * @param in_directory  whether the command runs from the directory of the
+ *                      fsentries, on "./" followed by their names (-execdir)
+ * @param root          the directory the root of the backend is mounted on
+ * @param jobs          how many commands may run at once
+ *
+ * @return              a pointer to a newly allocated struct command
+ *
+ * \p argv must outlive the returned command.
+ *
+ * Exit on error
+ */
+struct command *
+command_new(char * const *argv, size_t argc, bool batched, bool in_directory,
+            const char *root, size_t jobs);
+
+/**
+ * Run a command on an fsentry
+ *
+ * @param command   the command to run
+ * @param fsentry   the fsentry to run \p command on, which must have a path
+ *
+ * \p fsentry is not used once this function returns. The command may not run
+ * before command_finish() is called, or may still run once this function
+ * returns. If as many commands as there are jobs are running, this waits for
+ * one of them to exit.
+ *
+ * Exit on error
+ */
+void
+command_add(struct command *command, const struct rbh_fsentry *fsentry);
+
+/**
+ * Run a command on the fsentries it was not run on yet, wait for it to exit,
+ * and free it
+ *
+ * @param command   the command to finish
+ *
+ * @return          the number of times a batched command failed (commands run
+ *                  on a single fsentry at a time are not expected to succeed,
+ *                  like with find)
+ *
+ * Exit on error
+ */
+size_t
+command_finish(struct command *command);
+
+#endif
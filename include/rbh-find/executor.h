@@ -0,0 +1,211 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifndef RBH_FIND_EXECUTOR_H
+#define RBH_FIND_EXECUTOR_H
+
+#include "rbh-find/core.h"
+
+/* Backends are not thread-safe: the functions below never use a same struct
+ * rbh_backend from two threads at once. When they query a backend several times
+ * at once (see backends_foreach_partitioned_batch()), they open other handles
+ * on its URI for the extra queries.
+ */
+
+/**
+ * Query a backend and call a function on every fsentry it returns
+ *
+ * @param ctx            find's context for this execution
+ * @param backend_index  index of the backend to query
+ * @param filter         the filter to send to the backend
+ * @param options        the options to send to the backend
+ * @param callback       the function to call on each fsentry
+ * @param data           an opaque pointer to pass to \p callback
+ *
+ * @return               the sum of what \p callback returned
+ *
+ * Fsentries are fetched, and then released, a batch at a time. \p callback
+ * only borrows the fsentries it is given: they must not be used once it
+ * returns.
+ *
+ * Exit on error
+ */
+size_t
+backend_foreach(struct find_context *ctx, int backend_index,
+                const struct rbh_filter *filter,
+                const struct rbh_filter_options *options,
+                size_t (*callback)(struct find_context *ctx,
+                                   struct rbh_fsentry *fsentry, void *data),
+                void *data);
+
+/**
+ * Query a backend and call a function on batches of the fsentries it returns
+ *
+ * @param ctx            find's context for this execution
+ * @param backend_index  index of the backend to query
+ * @param filter         the filter to send to the backend
+ * @param options        the options to send to the backend
+ * @param callback       the function to call on each batch of fsentries
+ * @param data           an opaque pointer to pass to \p callback
+ *
+ * @return               the sum of what \p callback returned
+ *
+ * Same as backend_foreach(), except that \p callback is given every fsentry of
+ * a batch at once.
+ *
+ * Exit on error
+ */
+size_t
+backend_foreach_batch(struct find_context *ctx, int backend_index,
+                      const struct rbh_filter *filter,
+                      const struct rbh_filter_options *options,
+                      size_t (*callback)(struct find_context *ctx,
+                                         struct rbh_fsentry **fsentries,
+                                         size_t count, void *data),
+                      void *data);
+
+/**
+ * Query every backend and call a function on every fsentry they return
+ *
+ * @param ctx            find's context for this execution
+ * @param filter         the filter to send to the backends
+ * @param options        the options to send to the backends
+ * @param callback       the function to call on each fsentry
+ * @param data           an opaque pointer to pass to \p callback
+ *
+ * @return               the sum of what \p callback returned
+ *
+ * When there are several backends, they are all queried at once, each from its
+ * own thread. The fsentries they return are queued and \p callback is called
+ * from the calling thread in one of the following orders:
+ *   - if `ctx->unordered' is set, in whatever order the fsentries arrive;
+ *   - otherwise, if \p options sorts fsentries, in the order of the sort;
+ *   - otherwise, backend after backend, like for sequential queries.
+ *
+ * If both `ctx->unordered' and `ctx->exec_action_thread_safe' are set, the
+ * fsentries are not queued and \p callback is called directly, and
+ * concurrently, from each backend's thread.
+ *
+ * Exit on error
+ */
+size_t
+backends_foreach(struct find_context *ctx, const struct rbh_filter *filter,
+                 const struct rbh_filter_options *options,
+                 size_t (*callback)(struct find_context *ctx,
+                                    struct rbh_fsentry *fsentry, void *data),
+                 void *data);
+
+/**
+ * Split the values of a field into ranges, to partition queries with
+ *
+ * @param ctx            find's context for this execution
+ * @param field          the field to split the values of, which must be an
+ *                       integer
+ * @param count          the number of partitions to make, at most
+ * @param partitions     where to store an array of filters, one per partition
+ *
+ * @return               the number of filters stored in \p partitions, which
+ *                       may be lower than \p count, or 0 if the values of
+ *                       \p field cannot be split
+ *
+ * The smallest and largest values of \p field are queried from every backend
+ * (querying an indexed field is cheap), and split into ranges of the same
+ * width. Every fsentry matches exactly one of the filters in \p partitions,
+ * fsentries that do not have \p field match the first one.
+ *
+ * \p partitions is to be freed with partitions_destroy().
+ *
+ * Exit on error
+ */
+size_t
+partition_by_range(struct find_context *ctx,
+                   const struct rbh_filter_field *field, size_t count,
+                   struct rbh_filter ***partitions);
+
+/**
+ * Free the partitions partition_by_range() made
+ *
+ * @param partitions     the partitions to free
+ * @param count          the number of partitions in \p partitions
+ */
+void
+partitions_destroy(struct rbh_filter **partitions, size_t count);
+
+/**
+ * Query every backend once per partition and call a function on batches of
+ * the fsentries they return
+ *
+ * @param ctx             find's context for this execution
+ * @param filter          the filter to send to the backends
+ * @param options         the options to send to the backends
+ * @param partitions      filters that split \p filter into disjoint queries
+ * @param partition_count the number of filters in \p partitions
+ * @param callback        the function to call on each batch of fsentries
+ * @param data            an opaque pointer to pass to \p callback
+ *
+ * @return                the sum of what \p callback returned
+ *
+ * Each backend is sent \p filter ANDed with each partition, all at once, from
+ * a thread per query, so that a backend serves them with as many cursors.
+ * Backends are not thread-safe (the mongo backend has a single client), so
+ * each query but the first of a backend goes through a backend of its own,
+ * opened with rbh_backend_from_uri() on the URI of `ctx->backends[i]', which
+ * must therefore be `ctx->argv[i]'. `ctx->backends[i]' is only ever used by
+ * one thread at a time, `ctx->sample_callback' and `ctx->generation_callback'
+ * are given the handle of the query they are called for.
+ * Fsentries are dispatched like backends_foreach_batch() does, except that
+ * the partitions of a same backend come in no particular order unless
+ * \p options sorts fsentries, in which case they are merged.
+ *
+ * \p options should not skip fsentries: each query would skip them.
+ *
+ * Exit on error
+ */
+size_t
+backends_foreach_partitioned_batch(struct find_context *ctx,
+                                   const struct rbh_filter *filter,
+                                   const struct rbh_filter_options *options,
+                                   struct rbh_filter * const *partitions,
+                                   size_t partition_count,
+                                   size_t (*callback)(
+                                       struct find_context *ctx,
+                                       struct rbh_fsentry **fsentries,
+                                       size_t count, void *data
+                                       ),
+                                   void *data);
+
+/**
+ * Query every backend and call a function on batches of the fsentries they
+ * return
+ *
+ * @param ctx            find's context for this execution
+ * @param filter         the filter to send to the backends
+ * @param options        the options to send to the backends
+ * @param callback       the function to call on each batch of fsentries
+ * @param data           an opaque pointer to pass to \p callback
+ *
+ * @return               the sum of what \p callback returned
+ *
+ * Same as backends_foreach(), except that \p callback is given several
+ * fsentries at once. Batches keep the order backends_foreach() would call
+ * \p callback in.
+ *
+ * If `ctx->partition_count' is more than 1, queries are split with
+ * partition_by_range() and sent with backends_foreach_partitioned_batch().
+ *
+ * Exit on error
+ */
+size_t
+backends_foreach_batch(struct find_context *ctx,
+                       const struct rbh_filter *filter,
+                       const struct rbh_filter_options *options,
+                       size_t (*callback)(struct find_context *ctx,
+                                          struct rbh_fsentry **fsentries,
+                                          size_t count, void *data),
+                       void *data);
+
+#endif
@@ -11,6 +11,9 @@
 #include "parser.h"
 #include "utils.h"
 
+#include <stdbool.h>
+#include <stdio.h>
+
 #include <robinhood/filter.h>
 
 /**
@@ -135,50 +138,205 @@ struct rbh_filter *
 xattr2filter(const char *xattr_field);
 
 /**
- * AND two dynamically allocated filters
+ * Build a filter for the -uid, -gid, -inum and -links predicates
+ *
+ * @param predicate one of PRED_UID, PRED_GID, PRED_INUM or PRED_LINKS
+ * @param integer   a string representing a uint64_t, optionnally prefixed
+ *                  with either a '+' or '-' sign
+ *
+ * @return          a pointer to a newly allocated struct rbh_filter
+ *
+ * Exit on error
+ */
+struct rbh_filter *
+integer2filter(enum predicate predicate, const char *integer);
+
+/**
+ * Build a filter for the -user predicate
  *
- * @param left  a pointer to a dynamically allocated struct rbh_filter
- * @param right a pointer to a dynamically allocated struct rbh_filter
+ * @param user      the name of a user, or a user ID
  *
- * @return      a pointer to a newly allocated struct rbh_filter
+ * @return          a pointer to a newly allocated struct rbh_filter
  *
- * \p left and \p right should not be accessed anymore after this function is
- * called.
+ * \p user is resolved once, through the cache of uid2name().
  *
  * Exit on error
  */
 struct rbh_filter *
-filter_and(struct rbh_filter *left, struct rbh_filter *right);
+user2filter(const char *user);
 
 /**
- * OR two dynamically allocated filters
+ * Build a filter for the -group predicate
  *
- * @param left  a pointer to a dynamically allocated struct rbh_filter
- * @param right a pointer to a dynamically allocated struct rbh_filter
+ * @param group     the name of a group, or a group ID
  *
- * @return      a pointer to a newly allocated struct rbh_filter
+ * @return          a pointer to a newly allocated struct rbh_filter
  *
- * \p left and \p right should not be accessed anymore after this function is
- * called.
+ * Same as user2filter(), for groups.
+ */
+struct rbh_filter *
+group2filter(const char *group);
+
+/**
+ * Build a filter for the -empty predicate
+ *
+ * @return          a pointer to a newly allocated struct rbh_filter
+ *
+ * Only empty regular files match: backends do not know whether a directory
+ * has entries.
  *
  * Exit on error
  */
 struct rbh_filter *
-filter_or(struct rbh_filter *left, struct rbh_filter *right);
+empty2filter(void);
 
 /**
- * Negate a dynamically allocated filter
+ * Build a filter for the -newer, -anewer, -bnewer and -cnewer predicates
  *
- * @param filter    a pointer to a dynamically allocated struct rbh_filter
+ * @param predicate one of PRED_NEWER, PRED_ANEWER, PRED_BNEWER or PRED_CNEWER
+ * @param path      the path of the reference file
  *
  * @return          a pointer to a newly allocated struct rbh_filter
  *
- * \p filter should not be accessed anymore after this function is called.
+ * The filter compares the modification, access, birth or change time of
+ * fsentries with the modification time of \p path, which is read once, to the
+ * nanosecond.
+ *
+ * Exit on error
+ */
+struct rbh_filter *
+newer2filter(enum predicate predicate, const char *path);
+
+/**
+ * An arena the filters of a command line are allocated in
+ *
+ * Filters allocated in an arena are never freed on their own, but all at once
+ * with the whole arena, in a few calls to free(), however many filters it
+ * holds. An arena is not thread-safe, but several ones may be used at once.
+ */
+struct filter_arena;
+
+/**
+ * Create an arena of filters
+ *
+ * @return          a pointer to a newly allocated struct filter_arena
+ *
+ * Exit on error
+ */
+struct filter_arena *
+filter_arena_new(void);
+
+/**
+ * Free an arena, and every filter allocated in it
+ *
+ * @param arena     the arena to free
+ */
+void
+filter_arena_destroy(struct filter_arena *arena);
+
+/**
+ * Move a filter into an arena
+ *
+ * @param arena     the arena to move \p filter into
+ * @param filter    a filter that is a single block of memory, like the ones
+ *                  the functions of this file and rbh_filter_clone() return
+ *                  (may be NULL)
+ *
+ * @return          a copy of \p filter allocated in \p arena
+ *
+ * \p filter is freed.
  *
  * Exit on error
  */
 struct rbh_filter *
-filter_not(struct rbh_filter *filter);
+filter_adopt(struct filter_arena *arena, struct rbh_filter *filter);
+
+/**
+ * AND two filters of an arena
+ *
+ * @param arena the arena to allocate the filter in
+ * @param left  a pointer to a struct rbh_filter of \p arena (may be NULL)
+ * @param right a pointer to a struct rbh_filter of \p arena (may be NULL)
+ *
+ * @return      a pointer to a struct rbh_filter allocated in \p arena
+ *
+ * Exit on error
+ */
+struct rbh_filter *
+filter_and(struct filter_arena *arena, struct rbh_filter *left,
+           struct rbh_filter *right);
+
+/**
+ * OR two filters of an arena
+ *
+ * @param arena the arena to allocate the filter in
+ * @param left  a pointer to a struct rbh_filter of \p arena (may be NULL)
+ * @param right a pointer to a struct rbh_filter of \p arena (may be NULL)
+ *
+ * @return      a pointer to a struct rbh_filter allocated in \p arena
+ *
+ * Exit on error
+ */
+struct rbh_filter *
+filter_or(struct filter_arena *arena, struct rbh_filter *left,
+          struct rbh_filter *right);
+
+/**
+ * Negate a filter of an arena
+ *
+ * @param arena     the arena to allocate the filter in
+ * @param filter    a pointer to a struct rbh_filter of \p arena
+ *
+ * @return          a pointer to a struct rbh_filter allocated in \p arena
+ *
+ * Exit on error
+ */
+struct rbh_filter *
+filter_not(struct filter_arena *arena, struct rbh_filter *filter);
+
+/**
+ * Check whether two filter fields are the same
+ *
+ * @param left      a filter field
+ * @param right     another filter field
+ *
+ * @return          true if \p left and \p right designate the same field, false
+ *                  otherwise
+ */
+bool
+filter_field_equals(const struct rbh_filter_field *left,
+                    const struct rbh_filter_field *right);
+
+/**
+ * Check whether two filters are the same
+ *
+ * @param left      a pointer to a struct rbh_filter (may be NULL)
+ * @param right     a pointer to a struct rbh_filter (may be NULL)
+ *
+ * @return          true if \p left and \p right have the same structure, the
+ *                  same fields and the same values, false otherwise
+ */
+bool
+filter_equals(const struct rbh_filter *left, const struct rbh_filter *right);
+
+/**
+ * Print a human readable representation of a filter field
+ *
+ * @param file      the stream to print to
+ * @param field     the field to print
+ */
+void
+filter_field_dump(FILE *file, const struct rbh_filter_field *field);
+
+/**
+ * Print a human readable representation of a filter, one node per line
+ *
+ * @param file      the stream to print to
+ * @param filter    the filter to print (NULL matches every fsentry)
+ * @param indent    how deep \p filter is in the tree it belongs to
+ */
+void
+filter_dump(FILE *file, const struct rbh_filter *filter, int indent);
 
 /**
  * Build a filter field from the -sort/-rsort attribute
@@ -30,6 +30,26 @@ int
 find_exec_action(struct find_context *ctx, enum action action,
                  struct rbh_fsentry *fsentry);
 
+/**
+ * Find exec_batch function, see `exec_batch_callback` in `struct
+ * find_context` for more information.
+ *
+ * Called by rbh-find and implement GNU-find like behaviour.
+ */
+size_t
+find_exec_batch(struct find_context *ctx, enum action action,
+                struct rbh_fsentry **fsentries, size_t count);
+
+/**
+ * Find action_projection function, see `action_projection_callback` in `struct
+ * find_context` for more information.
+ *
+ * Called by rbh-find and implement GNU-find like behaviour.
+ */
+void
+find_action_projection(struct find_context *ctx, enum action action,
+                       struct rbh_filter_projection *projection);
+
 /**
  * Find post_action function, see `post_action_callback` in `struct
  * find_context` for more information.
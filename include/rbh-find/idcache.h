@@ -0,0 +1,87 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifndef RBH_FIND_IDCACHE_H
+#define RBH_FIND_IDCACHE_H
+
+#include <stdbool.h>
+
+#include <sys/types.h>
+
+/**
+ * Get the name of a user
+ *
+ * @param uid   the user ID to look up
+ *
+ * @return      the name of the user whose ID is \p uid, or NULL if there is
+ *              none
+ *
+ * Lookups, successful or not, are cached for the lifetime of the process, so
+ * that the user database is queried at most once per user ID. The returned
+ * string must not be freed.
+ *
+ * This function is thread-safe.
+ *
+ * Exit on error
+ */
+const char *
+uid2name(uid_t uid);
+
+/**
+ * Get the name of a group
+ *
+ * @param gid   the group ID to look up
+ *
+ * @return      the name of the group whose ID is \p gid, or NULL if there is
+ *              none
+ *
+ * Same as uid2name(), for groups.
+ */
+const char *
+gid2name(gid_t gid);
+
+/**
+ * Get the ID of a user from its name
+ *
+ * @param name  the name of the user to look up
+ * @param uid   where to store the ID of the user
+ *
+ * @return      true if there is a user named \p name, false otherwise
+ *
+ * The user found is added to the cache uid2name() uses.
+ *
+ * Exit on error
+ */
+bool
+name2uid(const char *name, uid_t *uid);
+
+/**
+ * Get the ID of a group from its name
+ *
+ * @param name  the name of the group to look up
+ * @param gid   where to store the ID of the group
+ *
+ * @return      true if there is a group named \p name, false otherwise
+ *
+ * Same as name2uid(), for groups.
+ */
+bool
+name2gid(const char *name, gid_t *gid);
+
+/**
+ * Fill the caches of uid2name() and gid2name() with the whole user and group
+ * databases
+ *
+ * This enumerates the databases with getpwent() and getgrent(), which is much
+ * cheaper than one lookup per ID when many users own entries, but may be very
+ * expensive (or return nothing) with some remote databases. This is why
+ * rbh-find only calls it with -prefetch-ids.
+ */
+void
+idcache_prefetch(void);
+
+#endif
@@ -0,0 +1,37 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifndef RBH_FIND_JSON_H
+#define RBH_FIND_JSON_H
+
+#include <robinhood/fsentry.h>
+
+#include "rbh-find/output.h"
+
+/**
+ * Write an fsentry as a line of JSON
+ *
+ * @param output    the output to write the fsentry to
+ * @param fsentry   the fsentry to write
+ *
+ * The fsentry is written as a single JSON object, followed by a newline, with
+ * the fields of \p fsentry it has, and only those: "id" and "parent_id"
+ * (base64-encoded), "name", "symlink", "statx" (an object of the statx fields
+ * it has), "ns_xattrs" and "xattrs". Binary values are base64-encoded, and
+ * bytes of strings that are not valid UTF-8 are escaped as the lone surrogates
+ * U+DC80 to U+DCFF (like Python's "surrogateescape"), so that they can be told
+ * apart from valid characters.
+ *
+ * The object is written directly in the buffer of \p output, nothing is
+ * allocated.
+ *
+ * Exit on error
+ */
+void
+fsentry_print_json(struct output *output, const struct rbh_fsentry *fsentry);
+
+#endif
@@ -0,0 +1,43 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifndef RBH_FIND_OPTIMIZER_H
+#define RBH_FIND_OPTIMIZER_H
+
+#include <robinhood/filter.h>
+
+/**
+ * Simplify a filter before it is sent to a backend
+ *
+ * @param filter    the filter to simplify (NULL matches every fsentry)
+ *
+ * @return          a pointer to a newly allocated filter that matches the same
+ *                  fsentries as \p filter, or NULL if it matches every fsentry
+ *
+ * The returned filter does not share anything with \p filter. It:
+ *   - has no NULL children, nor nested ANDs (resp. ORs) directly under an AND
+ *     (resp. OR), nor double negations;
+ *   - only keeps the tightest lower and upper bounds of the integer
+ *     comparisons an AND makes on a same field;
+ *   - does not repeat what an earlier operand of an AND (resp. OR) already
+ *     knows to be true (resp. false), which removes the guards of the
+ *     "A -o (! A -a B)" rewrite whenever A is a sibling.
+ *
+ * Exit on error
+ */
+struct rbh_filter *
+filter_optimize(const struct rbh_filter *filter);
+
+/**
+ * Free a filter returned by filter_optimize()
+ *
+ * @param filter    a pointer returned by filter_optimize()
+ */
+void
+filter_optimized_free(struct rbh_filter *filter);
+
+#endif
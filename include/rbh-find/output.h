@@ -0,0 +1,155 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifndef RBH_FIND_OUTPUT_H
+#define RBH_FIND_OUTPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** The size of the buffer of an output */
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+
+/**
+ * A buffered sink for the results of actions
+ *
+ * Outputs bypass stdio: data is copied in a large buffer which is written to
+ * the underlying file descriptor only once full, or when the output is flushed.
+ *
+ * Outputs are not thread-safe.
+ */
+struct output {
+    /** The file descriptor to write to */
+    int fd;
+    /** The name of what \p fd refers to, for error messages */
+    char *name;
+    /** If \p fd should be closed with the output */
+    bool owned;
+    /** If the output is line buffered (for terminals) */
+    bool interactive;
+
+    char *buffer;
+    size_t length;
+
+    /** The number of bytes written to the output so far, buffered or not */
+    uint64_t total;
+};
+
+/**
+ * Create an output that writes to a file descriptor
+ *
+ * @param fd        the file descriptor to write to
+ * @param name      the name of what \p fd refers to, for error messages
+ *
+ * @return          a pointer to a newly allocated output
+ *
+ * \p fd is not closed with the output.
+ *
+ * Exit on error
+ */
+struct output *
+output_new(int fd, const char *name);
+
+/**
+ * Create (or truncate) a file and return an output that writes to it
+ *
+ * @param path      the path of the file to create
+ *
+ * @return          a pointer to a newly allocated output
+ *
+ * Exit on error
+ */
+struct output *
+output_open(const char *path);
+
+/**
+ * Write data to an output
+ *
+ * @param output    the output to write to
+ * @param data      the data to write
+ * @param size      the size of \p data
+ *
+ * Exit on error
+ */
+void
+output_write(struct output *output, const void *data, size_t size);
+
+/**
+ * Write a single character to an output
+ *
+ * @param output    the output to write to
+ * @param c         the character to write
+ *
+ * Exit on error
+ */
+void
+output_putc(struct output *output, char c);
+
+/**
+ * Write a formatted string to an output
+ *
+ * @param output    the output to write to
+ * @param format    a printf-like format string
+ *
+ * @return          the number of bytes written
+ *
+ * Exit on error
+ */
+int
+output_printf(struct output *output, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/**
+ * Get room to write directly in the buffer of an output
+ *
+ * @param output    the output to write to
+ * @param size      how many bytes to make room for, at most
+ *                  OUTPUT_BUFFER_SIZE
+ *
+ * @return          a pointer to at least \p size bytes of the buffer of
+ *                  \p output, what is written there is only part of the output
+ *                  once output_commit() is called
+ *
+ * Exit on error
+ */
+char *
+output_reserve(struct output *output, size_t size);
+
+/**
+ * Add what was written in the buffer of an output to it
+ *
+ * @param output    the output output_reserve() was called on
+ * @param size      the number of bytes written from where output_reserve()
+ *                  returned, at most what it was asked for
+ *
+ * Exit on error
+ */
+void
+output_commit(struct output *output, size_t size);
+
+/**
+ * Write everything an output buffered to its file descriptor
+ *
+ * @param output    the output to flush
+ *
+ * Exit on error
+ */
+void
+output_flush(struct output *output);
+
+/**
+ * Flush an output and free it
+ *
+ * @param output    the output to close
+ *
+ * Exit on error
+ */
+void
+output_close(struct output *output);
+
+#endif
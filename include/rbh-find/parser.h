@@ -19,6 +19,7 @@ enum command_line_token {
     CLT_ACTION,
     CLT_SORT,
     CLT_RSORT,
+    CLT_OPTION,
 };
 
 enum predicate {
@@ -99,10 +100,14 @@ enum action {
     ACT_DELETE,
     ACT_EXEC,
     ACT_EXECDIR,
+    ACT_FJSON,
     ACT_FLS,
     ACT_FPRINT,
     ACT_FPRINT0,
+    ACT_FPRINTBIN,
     ACT_FPRINTF,
+    ACT_HISTOGRAM,
+    ACT_JSON,
     ACT_LS,
     ACT_OK,
     ACT_OKDIR,
@@ -111,6 +116,7 @@ enum action {
     ACT_PRINTF,
     ACT_PRUNE,
     ACT_QUIT,
+    ACT_SUM,
 };
 
 /**
@@ -135,4 +141,45 @@ str2action(const char *string);
 const char *
 action2str(enum action action);
 
+enum option {
+    OPT_BATCH_SIZE,
+    OPT_CACHE,
+    OPT_DEBUG,
+    OPT_EXPLAIN,
+    OPT_GROUP_BY,
+    OPT_JOBS,
+    OPT_LIMIT,
+    OPT_MOUNT_ROOT,
+    OPT_PARTITION,
+    OPT_PREFETCH,
+    OPT_PREFETCH_IDS,
+    OPT_SAMPLE,
+    OPT_SINCE_CHECKPOINT,
+    OPT_SINGLE_SCAN,
+    OPT_STATS,
+    OPT_UNORDERED,
+};
+
+/**
+ * str2option - convert a string to an option
+ *
+ * @param string    a string representing a valid option
+ *
+ * @return          the option \p string represents
+ *
+ * This function will exit if \p string is not a valid option
+ */
+enum option
+str2option(const char *string);
+
+/**
+ * option2str - convert an option to a string
+ *
+ * @param option    an option
+ *
+ * @return          the string that represents \p option
+ */
+const char *
+option2str(enum option option);
+
 #endif
@@ -0,0 +1,75 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifndef RBH_FIND_PROJECTION_H
+#define RBH_FIND_PROJECTION_H
+
+#include <stdio.h>
+
+#include <robinhood/filter.h>
+
+/**
+ * Add a filter field to a projection
+ *
+ * @param projection    the projection to update
+ * @param field         the field to add to \p projection
+ */
+void
+projection_add_field(struct rbh_filter_projection *projection,
+                     const struct rbh_filter_field *field);
+
+/**
+ * Add every field a filter tree refers to to a projection
+ *
+ * @param projection    the projection to update
+ * @param filter        the filter to walk (may be NULL)
+ */
+void
+projection_add_filter(struct rbh_filter_projection *projection,
+                      const struct rbh_filter *filter);
+
+/**
+ * Add every field a list of sort criteria refers to to a projection
+ *
+ * @param projection    the projection to update
+ * @param sorts         a list of sort criteria
+ * @param sorts_count   the size of \p sorts
+ */
+void
+projection_add_sorts(struct rbh_filter_projection *projection,
+                     const struct rbh_filter_sort *sorts, size_t sorts_count);
+
+/**
+ * Get the name of an fsentry property
+ *
+ * @param property      a single enum rbh_fsentry_property
+ *
+ * @return              the name of \p property, or NULL if it is unknown
+ */
+const char *
+fsentry_property2str(unsigned int property);
+
+/**
+ * Get the name of a statx field
+ *
+ * @param field         a single RBH_STATX_* bit
+ *
+ * @return              the name of \p field, or NULL if it is unknown
+ */
+const char *
+statx_field2str(unsigned int field);
+
+/**
+ * Print a human readable representation of a projection
+ *
+ * @param file          the stream to print to
+ * @param projection    the projection to print
+ */
+void
+projection_dump(FILE *file, const struct rbh_filter_projection *projection);
+
+#endif
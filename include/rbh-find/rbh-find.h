@@ -6,8 +6,24 @@
  */
 
 #include "rbh-find/actions.h"
+#include "rbh-find/aggregate.h"
+#include "rbh-find/binary.h"
+#include "rbh-find/cache.h"
+#include "rbh-find/checkpoint.h"
 #include "rbh-find/core.h"
+#include "rbh-find/delete.h"
+#include "rbh-find/evaluator.h"
+#include "rbh-find/exec.h"
+#include "rbh-find/executor.h"
 #include "rbh-find/filters.h"
 #include "rbh-find/find_cb.h"
+#include "rbh-find/idcache.h"
+#include "rbh-find/json.h"
+#include "rbh-find/optimizer.h"
+#include "rbh-find/output.h"
 #include "rbh-find/parser.h"
+#include "rbh-find/projection.h"
+#include "rbh-find/sample.h"
+#include "rbh-find/server.h"
+#include "rbh-find/stats.h"
 #include "rbh-find/utils.h"
@@ -0,0 +1,85 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifndef RBH_FIND_SAMPLE_H
+#define RBH_FIND_SAMPLE_H
+
+#include <stdbool.h>
+
+#include <robinhood.h>
+
+/**
+ * Parse the argument of -sample
+ *
+ * @param string    a fraction in (0, 1], either as a decimal number ("0.001")
+ *                  or as a percentage ("0.1%")
+ * @param rate      where to store the fraction \p string represents
+ *
+ * @return          0 on success, -1 if \p string is not a valid rate
+ */
+int
+str2sample_rate(const char *string, double *rate);
+
+/**
+ * Whether an fsentry is part of a sample
+ *
+ * @param fsentry   the fsentry to check, which must have an ID
+ * @param rate      the fraction of fsentries in the sample
+ *
+ * @return          true if \p fsentry is, false otherwise
+ *
+ * Fsentries are picked by a hash of their ID, so that each one is picked with
+ * a probability of \p rate, independently of the others, and a same fsentry is
+ * always picked (or not) from one query to the next.
+ */
+bool
+fsentry_sampled(const struct rbh_fsentry *fsentry, double rate);
+
+/**
+ * Sample the fsentries of an iterator
+ *
+ * @param fsentries the iterator to sample, which the returned iterator owns
+ * @param rate      the fraction of fsentries to keep
+ *
+ * @return          an iterator over the fsentries of \p fsentries that
+ *                  fsentry_sampled() picks
+ *
+ * The fsentries that are not picked are freed as they are skipped.
+ *
+ * Exit on error
+ */
+struct rbh_mut_iterator *
+sample_iter_new(struct rbh_mut_iterator *fsentries, double rate);
+
+/**
+ * An estimate of a total over every fsentry, from a sample
+ */
+struct estimate {
+    double value;
+    /** The bounds of the 95% confidence interval of `value' */
+    double low;
+    double high;
+};
+
+/**
+ * Estimate a total from a sample
+ *
+ * @param rate      the fraction of fsentries that were sampled
+ * @param total     the total over the sampled fsentries
+ * @param squares   the sum of the squares of the values that make \p total
+ *                  (equal to \p total for a count)
+ * @param estimate  where to store the estimate
+ *
+ * The estimate is \p total / \p rate, its interval assumes it is normally
+ * distributed, which only holds for samples of more than a few dozen
+ * fsentries. The lower bound is never below \p total.
+ */
+void
+sample_estimate(double rate, double total, double squares,
+                struct estimate *estimate);
+
+#endif
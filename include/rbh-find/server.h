@@ -0,0 +1,63 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifndef RBH_FIND_SERVER_H
+#define RBH_FIND_SERVER_H
+
+/**
+ * A server runs rbh-find command lines sent over a Unix socket
+ *
+ * A client sends its arguments (what follows the program's name), a
+ * descriptor of its working directory, and its standard input, output and
+ * error, and waits for the exit status of the request.
+ *
+ * The server forks a process for each request, which runs the request from
+ * the working directory and with the standard streams of the client, so that
+ * results go straight to the client. That process inherits everything the
+ * server set up beforehand, like the backends it opened, and a request that
+ * fails only ends its own process.
+ *
+ * Only clients with the same user ID as the server are served, since requests
+ * run with the credentials of the server.
+ */
+
+/**
+ * Serve requests on a Unix socket
+ *
+ * @param path      the path of the socket to listen on
+ * @param argc      where to store the number of arguments of a request
+ * @param argv      where to store the arguments of a request, NULL-terminated,
+ *                  the name of the program first
+ *
+ * This function only returns in the processes forked to run requests, once
+ * \p argc and \p argv are set, and the working directory and standard streams
+ * are those of the client. The exit status of such a process is sent back to
+ * the client.
+ *
+ * If \p path is a socket no server listens on, it is replaced.
+ *
+ * Exit on error
+ */
+void
+find_serve(const char *path, int *argc, char ***argv);
+
+/**
+ * Have a server run a command line
+ *
+ * @param path      the path of the socket the server listens on
+ * @param argc      the number of arguments in \p argv
+ * @param argv      the arguments to run, the name of the program excluded
+ *
+ * @return          the exit status of the request (128 plus the number of the
+ *                  signal that killed it, if any)
+ *
+ * Exit on error
+ */
+int
+find_connect(const char *path, int argc, char * const *argv);
+
+#endif
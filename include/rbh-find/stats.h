@@ -0,0 +1,176 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifndef RBH_FIND_STATS_H
+#define RBH_FIND_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * How statistics are reported
+ */
+enum stats_format {
+    STATS_TEXT,
+    STATS_JSON,
+};
+
+/**
+ * What an action spent querying and iterating over one backend
+ *
+ * Durations are in nanoseconds. Each backend_stats is only updated by the
+ * thread that iterates over the backend, threads that iterate over parts of a
+ * backend record their own and merge them with backend_stats_merge().
+ */
+struct backend_stats {
+    /** If the backend was queried at all */
+    bool queried;
+    /** When the backend was queried */
+    uint64_t start;
+    /** How long it took, from the query, to get the first fsentry */
+    uint64_t first_entry_time;
+    /** How long it took, from the query, to be done with the backend */
+    uint64_t elapsed;
+
+    /** The time spent in rbh_backend_filter() */
+    uint64_t filter_time;
+    /** The time spent in rbh_mut_iter_next() */
+    uint64_t next_time;
+    /** The number of times rbh_mut_iter_next() failed with EAGAIN */
+    uint64_t retries;
+    /** The number of fsentries fetched */
+    uint64_t entries;
+};
+
+/**
+ * What an action (or a single scan) spent
+ */
+struct action_stats {
+    /** The name of the action, as on the command line */
+    const char *name;
+
+    /** When the action started, and how long it took */
+    uint64_t start;
+    uint64_t elapsed;
+
+    /** The time spent executing the action, updated atomically */
+    uint64_t exec_time;
+    /** The number of fsentries the action was executed on, updated
+     * atomically
+     */
+    uint64_t entries;
+    /** The number of bytes the action wrote */
+    uint64_t bytes;
+
+    size_t backend_count;
+    struct backend_stats backends[];
+};
+
+/**
+ * Statistics about the actions of an execution of rbh-find
+ */
+struct find_stats {
+    enum stats_format format;
+
+    size_t action_count;
+    struct action_stats **actions;
+
+    /** The action in progress, if any */
+    struct action_stats *current;
+};
+
+/**
+ * Get the current time of a monotonic clock
+ *
+ * @return          the current time, in nanoseconds
+ */
+uint64_t
+stats_clock(void);
+
+/**
+ * Convert a string to a stats_format
+ *
+ * @param string    either "text" or "json"
+ * @param format    where to store the format
+ *
+ * @return          0 on success, -1 if \p string is not a format
+ */
+int
+str2stats_format(const char *string, enum stats_format *format);
+
+/**
+ * Create an empty set of statistics
+ *
+ * @param format    how the statistics are to be reported
+ *
+ * @return          a pointer to a newly allocated struct find_stats
+ *
+ * Exit on error
+ */
+struct find_stats *
+find_stats_new(enum stats_format format);
+
+/**
+ * Start recording the statistics of an action
+ *
+ * @param stats         the statistics to add the action to
+ * @param name          the name of the action (not copied)
+ * @param backend_count the number of backends the action goes through
+ *
+ * @return              the statistics of the action, which are also
+ *                      `stats->current' until find_stats_end() is called
+ *
+ * Exit on error
+ */
+struct action_stats *
+find_stats_begin(struct find_stats *stats, const char *name,
+                 size_t backend_count);
+
+/**
+ * Stop recording the statistics of the current action
+ *
+ * @param stats     the statistics of the action to stop recording
+ * @param bytes     the number of bytes the action wrote
+ */
+void
+find_stats_end(struct find_stats *stats, uint64_t bytes);
+
+/**
+ * Add the statistics of a part of a backend to those of the whole backend
+ *
+ * @param stats     the statistics of the backend
+ * @param part      the statistics of the part (see partition_by_range())
+ *
+ * The backend is considered queried from the first part's query to the last
+ * part's end.
+ */
+void
+backend_stats_merge(struct backend_stats *stats,
+                    const struct backend_stats *part);
+
+/**
+ * Report statistics
+ *
+ * @param file      the file to report statistics to
+ * @param stats     the statistics to report
+ * @param names     the names of the backends, for each action
+ */
+void
+find_stats_print(FILE *file, const struct find_stats *stats,
+                 char * const *names);
+
+/**
+ * Free statistics
+ *
+ * @param stats     the statistics to free
+ */
+void
+find_stats_destroy(struct find_stats *stats);
+
+#endif
@@ -8,6 +8,9 @@
 #ifndef RBH_FIND_UTILS_H
 #define RBH_FIND_UTILS_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 /**
  * shell2pcre - translate a shell pattern into a Perl Compatible regex
  *
@@ -25,6 +28,34 @@
 char *
 shell2pcre(const char *shell);
 
+/**
+ * The shapes of shell patterns that do not need a regex to be matched
+ */
+enum glob_type {
+    /** No wildcard, e.g. "file.txt" */
+    GLOB_LITERAL,
+    /** A single trailing star, e.g. "file.*" */
+    GLOB_PREFIX,
+    /** A single leading star, e.g. "*.txt" */
+    GLOB_SUFFIX,
+    /** Anything else */
+    GLOB_PATTERN,
+};
+
+/**
+ * glob_classify - recognize simple shell patterns
+ *
+ * @param glob      the shell pattern to classify
+ * @param literal   a buffer of at least strlen(\p glob) + 1 bytes
+ *
+ * @return          the shape of \p glob
+ *
+ * Unless \p glob is a GLOB_PATTERN, its unescaped text, stars excluded, is
+ * stored in \p literal.
+ */
+enum glob_type
+glob_classify(const char *glob, char *literal);
+
 enum time_unit {
     TU_SECOND,
     TU_MINUTE,
@@ -57,4 +88,21 @@ str2seconds(enum time_unit unit, const char *string);
 int
 str2uint64_t(const char *input, uint64_t *result);
 
+/**
+ * path_under_root - locate an fsentry's path under a mount point
+ *
+ * @param root      the directory the backend's root is mounted on
+ * @param path      the path of an fsentry in the backend, e.g. "/dir/file"
+ * @param length    the number of bytes of \p path to use
+ *
+ * @return          a pointer to the newly allocated path of \p path in the
+ *                  local filesystem, \p root itself if \p path is "/"
+ *
+ * The returned pointer must be freed by the caller.
+ *
+ * Exit on error
+ */
+char *
+path_under_root(const char *root, const char *path, size_t length);
+
 #endif
@@ -16,6 +16,7 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <sysexits.h>
 
 #include <robinhood.h>
@@ -26,6 +27,7 @@
 #include "rbh-find/filters.h"
 #include "rbh-find/find_cb.h"
 #include "rbh-find/parser.h"
+#include "rbh-find/server.h"
 
 static struct find_context ctx;
 
@@ -35,23 +37,91 @@ on_find_exit(void)
     ctx_finish(&ctx);
 }
 
+/* The backends a server opened, handed over to the requests that name them */
+static struct served_backend {
+    const char *uri;
+    struct rbh_backend *backend;
+} *served;
+static size_t served_count;
+
+static struct rbh_backend *
+backend_from_uri(const char *uri)
+{
+    struct rbh_backend *backend;
+
+    for (size_t i = 0; i < served_count; i++) {
+        if (served[i].backend == NULL || strcmp(served[i].uri, uri))
+            continue;
+
+        /* A request may name a backend twice, it is destroyed once per name */
+        backend = served[i].backend;
+        served[i].backend = NULL;
+        return backend;
+    }
+
+    return rbh_backend_from_uri(uri);
+}
+
+/* rbh-find --serve SOCKET URI...
+ *
+ * Only returns in the processes that run requests, with their command line
+ */
+static void
+serve(int *argc, char ***argv)
+{
+    if (*argc < 3)
+        error(EX_USAGE, 0, "missing the socket to serve requests on");
+    if (*argc == 3)
+        error(EX_USAGE, 0, "missing at least one robinhood URI");
+
+    served_count = *argc - 3;
+    served = malloc(served_count * sizeof(*served));
+    if (served == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+
+    for (size_t i = 0; i < served_count; i++) {
+        served[i].uri = (*argv)[3 + i];
+        served[i].backend = rbh_backend_from_uri(served[i].uri);
+    }
+
+    find_serve((*argv)[2], argc, argv);
+}
+
 int
 main(int _argc, char *_argv[])
 {
     struct rbh_filter_sort *sorts = NULL;
     struct rbh_filter *filter;
     size_t sorts_count = 0;
+    const char *stats;
     int index;
 
+    if (_argc > 1 && strcmp(_argv[1], "--connect") == 0) {
+        if (_argc < 3)
+            error(EX_USAGE, 0, "missing the socket to send the request to");
+        return find_connect(_argv[2], _argc - 3, &_argv[3]);
+    }
+
+    if (_argc > 1 && strcmp(_argv[1], "--serve") == 0)
+        serve(&_argc, &_argv);
+
     /* Discard the program's name */
     ctx.argc = _argc - 1;
     ctx.argv = &_argv[1];
 
     ctx.pre_action_callback = &find_pre_action;
     ctx.exec_action_callback = &find_exec_action;
+    ctx.exec_batch_callback = &find_exec_batch;
+    ctx.action_projection_callback = &find_action_projection;
     ctx.post_action_callback = &find_post_action;
     ctx.parse_predicate_callback = &find_parse_predicate;
     ctx.pred_or_action_callback = &find_predicate_or_action;
+    /* Fetch the next batch of fsentries while acting on the current one */
+    ctx.prefetch = 1;
+
+    stats = getenv("RBH_FIND_STATS");
+    if (stats != NULL && ctx_enable_stats(&ctx, stats))
+        error(EX_USAGE, 0, "invalid value `%s' for RBH_FIND_STATS", stats);
 
     /* Parse the command line */
     for (index = 0; index < ctx.argc; index++) {
@@ -66,7 +136,7 @@ main(int _argc, char *_argv[])
         error(EXIT_FAILURE, errno, "malloc");
 
     for (int i = 0; i < index; i++) {
-        ctx.backends[i] = rbh_backend_from_uri(ctx.argv[i]);
+        ctx.backends[i] = backend_from_uri(ctx.argv[i]);
         ctx.backend_count++;
     }
     filter = parse_expression(&ctx, &index, NULL, &sorts, &sorts_count);
@@ -75,7 +145,9 @@ main(int _argc, char *_argv[])
 
     if (!ctx.action_done)
         find(&ctx, ACT_PRINT, &index, filter, sorts, sorts_count);
-    free(filter);
 
-    return EXIT_SUCCESS;
+    if (ctx.single_scan)
+        find_plan_run(&ctx, sorts, sorts_count);
+
+    return ctx.action_failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -7,14 +7,12 @@
 #include <assert.h>
 #include <errno.h>
 #include <error.h>
-#include <grp.h>
 #include <inttypes.h>
-#include <linux/limits.h>
-#include <pwd.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <sysexits.h>
 #include <time.h>
 
 #include <sys/param.h>
@@ -23,37 +21,161 @@
 #include <robinhood/statx.h>
 
 #include "rbh-find/actions.h"
+#include "rbh-find/idcache.h"
 
-static struct tm now;
+static const char MONTHS[][4] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec",
+};
 
-static void __attribute__((constructor))
-now_init(void)
+#define SECONDS_PER_DAY (24 * 60 * 60)
+
+/* The timestamps of a single day (or a single minute, around DST changes), for
+ * which fsentry_print_ls_dils() prints the same date and at most the time
+ * changes
+ */
+struct day {
+    /* The day spans [start, end) */
+    int64_t start;
+    int64_t end;
+    /* The number of minutes between midnight and `start' */
+    int minutes;
+    /* If the day is in a year before the current one, `text' is the whole
+     * timestamp string, otherwise it is the date only
+     */
+    bool past_year;
+    char text[32];
+};
+
+struct ls_format {
+    /* The year fsentry_print_ls_dils() prints timestamps relative to, since
+     * 1900
+     */
+    int year;
+
+    /* The last day printed, as entries are often sorted or at least clustered
+     * by date
+     */
+    struct day day;
+
+    /* The width of the columns, which grow to fit the widest value printed */
+    struct ls_columns {
+        int ino;
+        int blocks;
+        int nlink;
+        int uid;
+        int gid;
+        int size;
+    } length;
+};
+
+struct ls_format *
+ls_format_new(void)
 {
+    struct ls_format *ls;
+    struct tm now;
     time_t tmp;
 
     tmp = time(NULL);
     if (localtime_r(&tmp, &now) == NULL)
         error(EXIT_FAILURE, errno, "localtime_r");
+
+    ls = calloc(1, sizeof(*ls));
+    if (ls == NULL)
+        error(EXIT_FAILURE, errno, "calloc");
+
+    ls->year = now.tm_year;
+    ls->length.ino = 9;
+    ls->length.blocks = 6;
+    ls->length.nlink = 3;
+    ls->length.uid = 8;
+    ls->length.gid = 8;
+    ls->length.size = 8;
+
+    return ls;
+}
+
+void
+ls_format_destroy(struct ls_format *ls)
+{
+    free(ls);
+}
+
+/* Whether \p timestamp is on the day of \p datetime, with the same UTC offset,
+ * and if so, store its broken-down time in \p other
+ */
+static bool
+is_same_day(int64_t timestamp, const struct tm *datetime, struct tm *other)
+{
+    time_t duration = timestamp;
+
+    return localtime_r(&duration, other) != NULL &&
+           other->tm_gmtoff == datetime->tm_gmtoff &&
+           other->tm_mday == datetime->tm_mday;
 }
 
-/* Timestamp string is: "Jan 31 12:00" or "Jan 31  2000" */
 static void
-timestamp_print_ls_dils(FILE *file, int64_t timestamp)
+day_init(struct day *day, int64_t timestamp, int year)
 {
-    static_assert(sizeof(time_t) >= sizeof(int64_t), "");
-    char buffer[sizeof("Jan 31 12:00")];
     time_t duration = timestamp;
-    struct tm *datetime;
+    struct tm datetime, boundary;
+    int seconds;
 
-    datetime = localtime(&duration);
-    if (datetime == NULL)
-        error(EXIT_FAILURE, errno, "localtime");
+    if (localtime_r(&duration, &datetime) == NULL)
+        error(EXIT_FAILURE, errno, "localtime_r");
 
-    strftime(buffer, sizeof(buffer),
-             datetime->tm_year < now.tm_year ? "%b %e  %G" : "%b %e %H:%M",
-             datetime);
+    seconds = (datetime.tm_hour * 60 + datetime.tm_min) * 60 + datetime.tm_sec;
+    day->start = timestamp - seconds;
+    day->end = day->start + SECONDS_PER_DAY;
+    day->minutes = 0;
+
+    /* Only cache the current minute if the UTC offset changes during the day
+     * (or if the day does not have 24 hours, which is the same). The start of
+     * the day is computed with the offset of \p timestamp, so it must be
+     * checked as well as the end: after a change, it is not midnight.
+     */
+    if (!is_same_day(day->start, &datetime, &boundary) ||
+        boundary.tm_hour != 0 || boundary.tm_min != 0 || boundary.tm_sec != 0 ||
+        !is_same_day(day->end - 1, &datetime, &boundary)) {
+        day->start = timestamp - datetime.tm_sec;
+        day->end = day->start + 60;
+        day->minutes = datetime.tm_hour * 60 + datetime.tm_min;
+    }
 
-    fprintf(file, "%s", buffer);
+    day->past_year = datetime.tm_year < year;
+    if (day->past_year)
+        snprintf(day->text, sizeof(day->text), "%s %2d  %d",
+                 MONTHS[datetime.tm_mon], datetime.tm_mday,
+                 datetime.tm_year + 1900);
+    else
+        snprintf(day->text, sizeof(day->text), "%s %2d ",
+                 MONTHS[datetime.tm_mon], datetime.tm_mday);
+}
+
+/* Timestamp string is: "Jan 31 12:00" or "Jan 31  2000" */
+static void
+timestamp_print_ls_dils(struct output *output, struct ls_format *ls,
+                        int64_t timestamp)
+{
+    struct day *day = &ls->day;
+    char time[sizeof("12:00")];
+    int minutes;
+
+    /* The day is zeroed at first, which no timestamp is in */
+    if (timestamp < day->start || timestamp >= day->end)
+        day_init(day, timestamp, ls->year);
+
+    output_write(output, day->text, strlen(day->text));
+    if (day->past_year)
+        return;
+
+    minutes = day->minutes + (timestamp - day->start) / 60;
+    time[0] = '0' + minutes / 600;
+    time[1] = '0' + minutes / 60 % 10;
+    time[2] = ':';
+    time[3] = '0' + minutes % 60 / 10;
+    time[4] = '0' + minutes % 10;
+    output_write(output, time, 5);
 }
 
 /**
@@ -102,8 +224,9 @@ static const mode_t MODE_BITS[] = {
 # define ARRAY_SIZE(array) sizeof(array) / sizeof(array[0])
 #endif
 
+/* Write the 9 permission characters of \p mode, as `ls -l' does */
 static void
-mode_print_ls_dils(FILE *file, mode_t mode)
+mode2str(mode_t mode, char *string)
 {
     static_assert(ARRAY_SIZE(MODE_BITS) == ARRAY_SIZE(SPECIAL_BITS), "");
     for (size_t i = 0; i < ARRAY_SIZE(MODE_BITS); i++) {
@@ -112,10 +235,19 @@ mode_print_ls_dils(FILE *file, mode_t mode)
                                                          : "..S..S..T"
                                    : mode & MODE_BITS[i] ? "rwxrwxrwx"
                                                          : "---------";
-        fprintf(file, "%c", mapping[i]);
+        string[i] = mapping[i];
     }
 }
 
+static void
+mode_print_ls_dils(struct output *output, mode_t mode)
+{
+    char string[ARRAY_SIZE(MODE_BITS)];
+
+    mode2str(mode, string);
+    output_write(output, string, sizeof(string));
+}
+
 static bool posixly_correct;
 
 static void __attribute__((constructor))
@@ -125,38 +257,26 @@ posixly_correct_init(void)
 }
 
 static void
-statx_print_ls_dils(FILE *file, const struct rbh_statx *statxbuf)
+statx_print_ls_dils(struct output *output, struct ls_format *ls,
+                    const struct rbh_statx *statxbuf)
 {
-    static struct {
-        int ino;
-        int blocks;
-        int nlink;
-        int uid;
-        int gid;
-        int size;
-    } length = {
-        .ino = 9,
-        .blocks = 6,
-        .nlink = 3,
-        .uid = 8,
-        .gid = 8,
-        .size = 8,
-    };
+    struct ls_columns *length = &ls->length;
     int rc;
 
     if (statxbuf == NULL) {
         /*              -rwxrwxrwx                 Jan 31 20:00 */
-        fprintf(file, "%*c %*c ?????????? %*c %*c %*c %*c ????????????",
-                length.ino, '?', length.blocks, '?', length.nlink, '?',
-                length.uid, '?', length.gid, '?', length.size, '?');
+        output_printf(output,
+                      "%*c %*c ?????????? %*c %*c %*c %*c ????????????",
+                      length->ino, '?', length->blocks, '?', length->nlink, '?',
+                      length->uid, '?', length->gid, '?', length->size, '?');
         return;
     }
 
     if (statxbuf->stx_mask & RBH_STATX_INO) {
-        rc = fprintf(file, "%*" PRIu64, length.ino, statxbuf->stx_ino);
-        length.ino = MAX(length.ino, rc);
+        rc = output_printf(output, "%*" PRIu64, length->ino, statxbuf->stx_ino);
+        length->ino = MAX(length->ino, rc);
     } else {
-        fprintf(file, "%*c", length.ino, '?');
+        output_printf(output, "%*c", length->ino, '?');
     }
 
     if (statxbuf->stx_mask & RBH_STATX_BLOCKS) {
@@ -164,213 +284,612 @@ statx_print_ls_dils(FILE *file, const struct rbh_statx *statxbuf)
                                           : statxbuf->stx_blocks / 2;
 
         /* The `-1` makes up for the space before the string */
-        rc = fprintf(file, " %*ld", length.blocks, blocks) - 1;
-        length.blocks = MAX(length.blocks, rc);
+        rc = output_printf(output, " %*ld", length->blocks, blocks) - 1;
+        length->blocks = MAX(length->blocks, rc);
     } else {
-        fprintf(file, " %*c", length.blocks, '?');
+        output_printf(output, " %*c", length->blocks, '?');
     }
 
-    fprintf(file, " %c",
-           statxbuf->stx_mask & RBH_STATX_TYPE ? mode2type(statxbuf->stx_mode)
-                                           : '?');
+    output_putc(output, ' ');
+    output_putc(output, statxbuf->stx_mask & RBH_STATX_TYPE ?
+                            mode2type(statxbuf->stx_mode) : '?');
 
     if (statxbuf->stx_mask & RBH_STATX_MODE)
-        mode_print_ls_dils(file, statxbuf->stx_mode);
+        mode_print_ls_dils(output, statxbuf->stx_mode);
     else
         /*      rwxrwxrwx */
-        fprintf(file, "?????????");
+        output_write(output, "?????????", 9);
 
     if (statxbuf->stx_mask & RBH_STATX_NLINK) {
-        rc = fprintf(file, " %*d", length.nlink, statxbuf->stx_nlink) - 1;
-        length.nlink = MAX(length.nlink, rc);
+        rc = output_printf(output, " %*d", length->nlink,
+                           statxbuf->stx_nlink) - 1;
+        length->nlink = MAX(length->nlink, rc);
     } else {
-        fprintf(file, " %*c", length.nlink, '?');
+        output_printf(output, " %*c", length->nlink, '?');
     }
 
     if (statxbuf->stx_mask & RBH_STATX_UID) {
-        const struct passwd *uid = getpwuid(statxbuf->stx_uid);
+        const char *uid = uid2name(statxbuf->stx_uid);
 
         if (uid)
-            rc = fprintf(file, " %-*s", length.uid, uid->pw_name) - 1;
+            rc = output_printf(output, " %-*s", length->uid, uid) - 1;
         else
-            rc = fprintf(file, " %*d", length.uid, statxbuf->stx_uid) - 1;
+            rc = output_printf(output, " %*d", length->uid,
+                               statxbuf->stx_uid) - 1;
 
-        length.uid = MAX(length.uid, rc);
+        length->uid = MAX(length->uid, rc);
     } else {
-        fprintf(file, " %*c", length.uid, '?');
+        output_printf(output, " %*c", length->uid, '?');
     }
 
     if (statxbuf->stx_mask & RBH_STATX_GID) {
-        const struct group *gid = getgrgid(statxbuf->stx_gid);
+        const char *gid = gid2name(statxbuf->stx_gid);
 
         if (gid)
-            rc = fprintf(file, " %-*s", length.gid, gid->gr_name) - 1;
+            rc = output_printf(output, " %-*s", length->gid, gid) - 1;
         else
-            rc = fprintf(file, " %*d", length.gid, statxbuf->stx_gid) - 1;
+            rc = output_printf(output, " %*d", length->gid,
+                               statxbuf->stx_gid) - 1;
 
-        length.gid = MAX(length.gid, rc);
+        length->gid = MAX(length->gid, rc);
     } else {
-        fprintf(file, " %*c", length.gid, '?');
+        output_printf(output, " %*c", length->gid, '?');
     }
 
     if (statxbuf->stx_mask & RBH_STATX_SIZE) {
-        rc = fprintf(file, " %*" PRIu64, length.size, statxbuf->stx_size) - 1;
-        length.size = MAX(length.size, rc);
+        rc = output_printf(output, " %*" PRIu64, length->size,
+                           statxbuf->stx_size) - 1;
+        length->size = MAX(length->size, rc);
     } else {
-        fprintf(file, " %*c", length.size, '?');
+        output_printf(output, " %*c", length->size, '?');
     }
 
-    fprintf(file, " ");
+    output_putc(output, ' ');
     if (statxbuf->stx_mask & RBH_STATX_MTIME_SEC)
-        timestamp_print_ls_dils(file, statxbuf->stx_mtime.tv_sec);
+        timestamp_print_ls_dils(output, ls, statxbuf->stx_mtime.tv_sec);
     else
         /*      Jan 31 20:00 */
-        fprintf(file, "????????????");
+        output_write(output, "????????????", 12);
 }
 
 void
-fsentry_print_ls_dils(FILE *file, const struct rbh_fsentry *fsentry)
+fsentry_print_ls_dils(struct output *output, struct ls_format *ls,
+                      const struct rbh_fsentry *fsentry)
 {
-    statx_print_ls_dils(file,
+    statx_print_ls_dils(output, ls,
                         fsentry->mask & RBH_FP_STATX ? fsentry->statx : NULL);
 
-    fprintf(file, " %s", fsentry_path(fsentry));
+    output_printf(output, " %s", fsentry_path(fsentry));
 
     if (fsentry->mask & RBH_FP_SYMLINK)
-        fprintf(file, " -> %s", fsentry->symlink);
+        output_printf(output, " -> %s", fsentry->symlink);
+
+    output_putc(output, '\n');
+}
 
-    fprintf(file, "\n");
+static bool
+pair_is_path(const struct rbh_value_pair *pair)
+{
+    /* XXX: a "path" that is not a string should probably say something... */
+    return strcmp(pair->key, "path") == 0 && pair->value != NULL &&
+           pair->value->type == RBH_VT_STRING;
 }
 
 const char *
 fsentry_path(const struct rbh_fsentry *fsentry)
 {
+    const struct rbh_value_map *ns = &fsentry->xattrs.ns;
+
     if (!(fsentry->mask & RBH_FP_NAMESPACE_XATTRS))
         return NULL;
 
-    for (size_t i = 0; i < fsentry->xattrs.ns.count; i++) {
-        const struct rbh_value_pair *pair = &fsentry->xattrs.ns.pairs[i];
+    /* Where fsentry_index_path() puts it */
+    if (ns->count > 0 && pair_is_path(&ns->pairs[0]))
+        return ns->pairs[0].value->string;
 
-        if (strcmp(pair->key, "path"))
-            continue;
+    for (size_t i = 1; i < ns->count; i++) {
+        if (pair_is_path(&ns->pairs[i]))
+            return ns->pairs[i].value->string;
+    }
 
-        if (pair->value->type != RBH_VT_STRING)
-            /* XXX: should probably say something... */
-            continue;
+    return NULL;
+}
 
-        return pair->value->string;
+void
+fsentry_index_path(struct rbh_fsentry *fsentry)
+{
+    struct rbh_value_pair *pairs;
+    struct rbh_value_pair path;
+    size_t i;
+
+    if (!(fsentry->mask & RBH_FP_NAMESPACE_XATTRS))
+        return;
+
+    for (i = 0; i < fsentry->xattrs.ns.count; i++) {
+        if (pair_is_path(&fsentry->xattrs.ns.pairs[i]))
+            break;
     }
 
-    return NULL;
+    if (i == 0 || i == fsentry->xattrs.ns.count)
+        return;
+
+    /* The fsentry belongs to the caller, and so do its xattrs */
+    pairs = (struct rbh_value_pair *)fsentry->xattrs.ns.pairs;
+    path = pairs[i];
+    memmove(&pairs[1], &pairs[0], i * sizeof(*pairs));
+    pairs[0] = path;
 }
 
-#define MAX_OUTPUT_SIZE (PATH_MAX + 256)
+enum printf_op_type {
+    POT_LITERAL,
+    POT_DIRECTIVE,
+    POT_STOP,
+};
 
-static int
-fsentry_print_directive(char *output, int max_length,
-                        const struct rbh_fsentry *fsentry,
-                        const char *directive)
-{
-    assert(directive != NULL);
-    assert(*directive != '\0');
+struct printf_op {
+    enum printf_op_type type;
+
+    /* POT_LITERAL, a span of the format's `literals' */
+    size_t offset;
+    size_t length;
+
+    /* POT_DIRECTIVE */
+    char directive;
+    /* The conversion after %A, %B, %C and %T */
+    char conversion;
+    /* If the directive has no flag, width or precision */
+    bool plain;
+    /* The printf() formats of the value as a string and as a number */
+    char string[24];
+    char number[24];
+    /* The fields the directive needs */
+    uint32_t fsentry_mask;
+    uint32_t statx_mask;
+};
 
-    /* For now, consider the directive to be a single character */
-    switch (*directive) {
-    case 'p':
-        return snprintf(output, max_length, "%s", fsentry_path(fsentry));
-    default:
-        error(EXIT_FAILURE, ENOTSUP, "format directive not supported");
+struct printf_format {
+    struct printf_op *ops;
+    size_t count;
+
+    char *literals;
+    size_t literals_length;
+
+    /* The fields the directives need */
+    uint32_t fsentry_mask;
+    uint32_t statx_mask;
+};
+
+static void
+literal_append(struct printf_format *format, char c)
+{
+    struct printf_op *last = format->count ? &format->ops[format->count - 1]
+                                           : NULL;
+
+    if (last == NULL || last->type != POT_LITERAL) {
+        last = &format->ops[format->count++];
+        memset(last, 0, sizeof(*last));
+        last->type = POT_LITERAL;
+        last->offset = format->literals_length;
     }
 
-    __builtin_unreachable();
+    format->literals[format->literals_length++] = c;
+    last->length++;
 }
 
-static int
-fsentry_print_escape(char *output, int max_length, const char *escape)
+static const char *
+escape_compile(struct printf_format *format, const char *escape)
 {
-    assert(escape != NULL);
-    assert(*escape != '\0');
+    static const char ESCAPES[] = "a\ab\bf\fn\nr\rt\tv\v\\\\";
+    const char *mapping;
+    char c = 0;
 
-    (void) max_length;
+    if (*escape == '\0')
+        error(EX_USAGE, 0, "missing escape after `\\'");
 
-    /* For now, consider the escape to be a single character */
-    switch (*escape) {
-    case 'n':
-        *output = '\n';
-        return 1;
-    default:
-        error(EXIT_FAILURE, ENOTSUP, "format escape not supported");
+    if (*escape == 'c') {
+        format->ops[format->count].type = POT_STOP;
+        format->count++;
+        return escape + 1;
+    }
+
+    if ('0' <= *escape && *escape <= '7') {
+        for (int i = 0; i < 3 && '0' <= *escape && *escape <= '7'; i++)
+            c = c * 8 + *escape++ - '0';
+        literal_append(format, c);
+        return escape;
+    }
+
+    for (mapping = ESCAPES; *mapping != '\0'; mapping += 2) {
+        if (*mapping == *escape)
+            break;
     }
+    if (*mapping == '\0')
+        error(EX_USAGE, 0, "unrecognized escape `\\%c'", *escape);
 
-    __builtin_unreachable();
+    literal_append(format, mapping[1]);
+    return escape + 1;
 }
 
-static int
-fsentry_print_regular_char(char *output, int max_length,
-                           const char *format_string)
+#define PRINTF_STATX_TIME(directive) \
+    ((directive) == 'a' || (directive) == 'A' ? RBH_STATX_ATIME : \
+     (directive) == 'B' ? RBH_STATX_BTIME : \
+     (directive) == 'c' || (directive) == 'C' ? RBH_STATX_CTIME : \
+     RBH_STATX_MTIME)
+
+static const char *
+directive_compile(struct printf_format *format, const char *directive)
 {
-    int sublength = 0;
+    const char *spec = directive;
+    struct printf_op *op;
+    int spec_length;
 
-    assert(format_string != NULL);
-    assert(*format_string != '\0');
+    if (*directive == '%') {
+        literal_append(format, '%');
+        return directive + 1;
+    }
 
-    while (format_string[sublength] != '%' &&
-           format_string[sublength] != '\\' &&
-           format_string[sublength] != 0 &&
-           sublength < max_length) {
-        output[sublength] = format_string[sublength];
-        sublength++;
+    /* Flags, width and precision, as for printf() */
+    directive += strspn(directive, "-+ #0");
+    directive += strspn(directive, "0123456789");
+    if (*directive == '.') {
+        directive++;
+        directive += strspn(directive, "0123456789");
+    }
+    spec_length = directive - spec;
+    if (spec_length > 8)
+        error(EX_USAGE, 0, "invalid directive `%%%.*s'", spec_length + 1, spec);
+
+    op = &format->ops[format->count];
+    memset(op, 0, sizeof(*op));
+    op->type = POT_DIRECTIVE;
+    op->directive = *directive;
+    op->plain = spec_length == 0;
+    snprintf(op->string, sizeof(op->string), "%%%.*ss", spec_length, spec);
+    snprintf(op->number, sizeof(op->number), "%%%.*s%s", spec_length, spec,
+             *directive == 'm' ? PRIo64 : PRIu64);
+
+    switch (*directive) {
+    case 'd':
+    case 'f':
+    case 'h':
+    case 'p':
+        op->fsentry_mask = RBH_FP_NAMESPACE_XATTRS;
+        break;
+    case 'l':
+        op->fsentry_mask = RBH_FP_SYMLINK;
+        break;
+    case 'b':
+    case 'k':
+        op->statx_mask = RBH_STATX_BLOCKS;
+        break;
+    case 'g':
+    case 'G':
+        op->statx_mask = RBH_STATX_GID;
+        break;
+    case 'i':
+        op->statx_mask = RBH_STATX_INO;
+        break;
+    case 'm':
+        op->statx_mask = RBH_STATX_MODE;
+        break;
+    case 'M':
+        op->statx_mask = RBH_STATX_MODE | RBH_STATX_TYPE;
+        break;
+    case 'n':
+        op->statx_mask = RBH_STATX_NLINK;
+        break;
+    case 's':
+        op->statx_mask = RBH_STATX_SIZE;
+        break;
+    case 'u':
+    case 'U':
+        op->statx_mask = RBH_STATX_UID;
+        break;
+    case 'y':
+        op->statx_mask = RBH_STATX_TYPE;
+        break;
+    case 'a':
+    case 'c':
+    case 't':
+        op->statx_mask = PRINTF_STATX_TIME(*directive);
+        break;
+    case 'A':
+    case 'B':
+    case 'C':
+    case 'T':
+        op->conversion = directive[1];
+        if (op->conversion == '\0')
+            error(EX_USAGE, 0, "missing conversion after `%%%c'", *directive);
+        op->statx_mask = PRINTF_STATX_TIME(*directive);
+        directive++;
+        break;
+    case '\0':
+        error(EX_USAGE, 0, "missing directive after `%%'");
+        __builtin_unreachable();
+    default:
+        error(EX_USAGE, 0, "unrecognized directive `%%%c'", *directive);
+        __builtin_unreachable();
     }
 
-    return sublength;
+    format->fsentry_mask |= op->fsentry_mask;
+    format->statx_mask |= op->statx_mask;
+    format->count++;
+    return directive + 1;
 }
 
-void
-fsentry_printf_format(FILE *file, const struct rbh_fsentry *fsentry,
-                      const char *format_string)
+struct printf_format *
+printf_format_compile(const char *string)
 {
-    size_t length = strlen(format_string);
-    int max_length = MAX_OUTPUT_SIZE;
-    char output[MAX_OUTPUT_SIZE];
-    size_t output_length = 0;
+    size_t length = strlen(string);
+    struct printf_format *format;
+
+    format = calloc(1, sizeof(*format));
+    if (format == NULL)
+        error(EXIT_FAILURE, errno, "calloc");
 
-    for (size_t i = 0; i < length; i++) {
-        int tmp_length;
+    /* There are never more ops, or literal characters, than characters */
+    format->ops = malloc(length * sizeof(*format->ops));
+    format->literals = malloc(length + 1);
+    if ((length && format->ops == NULL) || format->literals == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
 
-        switch (format_string[i]) {
+    while (*string != '\0') {
+        switch (*string) {
         case '%':
-            tmp_length = fsentry_print_directive(&output[output_length],
-                                                 max_length, fsentry,
-                                                 format_string + i + 1);
-            /* Go over the directive that was just printed */
-            i++;
+            string = directive_compile(format, string + 1);
             break;
         case '\\':
-            tmp_length = fsentry_print_escape(&output[output_length],
-                                              max_length,
-                                              format_string + i + 1);
-            /* Go over the escape that was just printed */
-            i++;
+            string = escape_compile(format, string + 1);
             break;
         default:
-            tmp_length = fsentry_print_regular_char(&output[output_length],
-                                                    max_length,
-                                                    format_string + i);
-            i += tmp_length - 1;
+            literal_append(format, *string++);
+            break;
         }
+    }
+
+    if (format->statx_mask)
+        format->fsentry_mask |= RBH_FP_STATX;
+
+    return format;
+}
+
+void
+printf_format_projection(const struct printf_format *format,
+                         struct rbh_filter_projection *projection)
+{
+    projection->fsentry_mask |= format->fsentry_mask;
+    projection->statx_mask |= format->statx_mask;
+}
+
+void
+printf_format_destroy(struct printf_format *format)
+{
+    free(format->literals);
+    free(format->ops);
+    free(format);
+}
+
+static void
+print_string(struct output *output, const struct printf_op *op,
+             const char *string, size_t length)
+{
+    char *copy;
 
-        output_length += tmp_length;
-        max_length -= tmp_length;
+    if (op->plain) {
+        output_write(output, string, length);
+        return;
+    }
 
-        if (tmp_length < 0) {
-            error(EXIT_FAILURE, EINVAL, "failed to write to buffer for printf");
-        } else if (max_length <= 0) {
-            /* No more data can fit in the output array */
-            output_length = MAX_OUTPUT_SIZE - 1;
+    if (string[length] == '\0') {
+        output_printf(output, op->string, string);
+        return;
+    }
+
+    copy = strndup(string, length);
+    if (copy == NULL)
+        error(EXIT_FAILURE, errno, "strndup");
+    output_printf(output, op->string, copy);
+    free(copy);
+}
+
+static void
+print_number(struct output *output, const struct printf_op *op,
+             uint64_t number)
+{
+    output_printf(output, op->number, number);
+}
+
+static void
+print_time(struct output *output, const struct printf_op *op,
+           const struct rbh_statx_timestamp *timestamp, bool has_nsec)
+{
+    uint32_t nsec = has_nsec ? timestamp->tv_nsec : 0;
+    time_t seconds = timestamp->tv_sec;
+    char buffer[256];
+    char conversion[3] = { '%', op->conversion, '\0' };
+    struct tm datetime;
+    int length;
+
+    /* Like find's, with the nanoseconds and a trailing 0 */
+    if (op->conversion == '@') {
+        length = snprintf(buffer, sizeof(buffer), "%" PRId64 ".%09" PRIu32 "0",
+                          timestamp->tv_sec, nsec);
+        print_string(output, op, buffer, length);
+        return;
+    }
+
+    if (localtime_r(&seconds, &datetime) == NULL)
+        error(EXIT_FAILURE, errno, "localtime_r");
+
+    switch (op->conversion) {
+    case '\0':
+        /* The format of ctime() */
+        length = strftime(buffer, sizeof(buffer), "%a %b %e %H:%M:%S %Y",
+                          &datetime);
+        break;
+    case '+':
+        length = strftime(buffer, sizeof(buffer), "%Y-%m-%d+%H:%M:%S",
+                          &datetime);
+        length += snprintf(buffer + length, sizeof(buffer) - length,
+                           ".%09" PRIu32 "0", nsec);
+        break;
+    default:
+        length = strftime(buffer, sizeof(buffer), conversion, &datetime);
+        break;
+    }
+
+    print_string(output, op, buffer, length);
+}
+
+/* The nanoseconds of timestamps are optional */
+#define STATX_NSEC (RBH_STATX_ATIME_NSEC | RBH_STATX_BTIME_NSEC \
+                  | RBH_STATX_CTIME_NSEC | RBH_STATX_MTIME_NSEC)
+
+static void
+print_directive(struct output *output, const struct printf_op *op,
+                const struct rbh_fsentry *fsentry)
+{
+    const struct rbh_statx *statxbuf = fsentry->statx;
+    const char *path = NULL;
+    const char *name;
+    uint32_t mask = 0;
+    char mode[11];
+    size_t depth;
+
+    if (fsentry->mask & RBH_FP_STATX)
+        mask = statxbuf->stx_mask;
+    if (op->fsentry_mask & RBH_FP_NAMESPACE_XATTRS)
+        path = fsentry_path(fsentry);
+
+    /* Fields that are missing are printed as '?', like for `-ls' */
+    if ((op->fsentry_mask & RBH_FP_NAMESPACE_XATTRS && path == NULL) ||
+        (op->statx_mask & ~STATX_NSEC & ~mask)) {
+        print_string(output, op, "?", 1);
+        return;
+    }
+
+    switch (op->directive) {
+    case 'd':
+        /* "/" is at depth 0, "/a" at depth 1... */
+        depth = 0;
+        for (const char *c = path; *c != '\0'; c++)
+            depth += *c == '/' && c[1] != '\0';
+        print_number(output, op, depth);
+        break;
+    case 'f':
+        name = strrchr(path, '/');
+        if (name == NULL || path[1] == '\0')
+            name = path;
+        else
+            name++;
+        print_string(output, op, name, strlen(name));
+        break;
+    case 'h':
+        name = strrchr(path, '/');
+        if (name == NULL)
+            print_string(output, op, ".", 1);
+        else
+            print_string(output, op, path, name - path);
+        break;
+    case 'l':
+        /* Empty for anything but symlinks */
+        name = fsentry->mask & RBH_FP_SYMLINK ? fsentry->symlink : "";
+        print_string(output, op, name, strlen(name));
+        break;
+    case 'p':
+        print_string(output, op, path, strlen(path));
+        break;
+    case 'b':
+        print_number(output, op, statxbuf->stx_blocks);
+        break;
+    case 'k':
+        print_number(output, op, (statxbuf->stx_blocks + 1) / 2);
+        break;
+    case 'g':
+        name = gid2name(statxbuf->stx_gid);
+        if (name != NULL)
+            print_string(output, op, name, strlen(name));
+        else
+            print_number(output, op, statxbuf->stx_gid);
+        break;
+    case 'G':
+        print_number(output, op, statxbuf->stx_gid);
+        break;
+    case 'i':
+        print_number(output, op, statxbuf->stx_ino);
+        break;
+    case 'm':
+        print_number(output, op, statxbuf->stx_mode & 07777);
+        break;
+    case 'M':
+        mode[0] = mode2type(statxbuf->stx_mode);
+        mode2str(statxbuf->stx_mode, &mode[1]);
+        /* print_string() checks for a terminator after the string */
+        mode[10] = '\0';
+        print_string(output, op, mode, 10);
+        break;
+    case 'n':
+        print_number(output, op, statxbuf->stx_nlink);
+        break;
+    case 's':
+        print_number(output, op, statxbuf->stx_size);
+        break;
+    case 'u':
+        name = uid2name(statxbuf->stx_uid);
+        if (name != NULL)
+            print_string(output, op, name, strlen(name));
+        else
+            print_number(output, op, statxbuf->stx_uid);
+        break;
+    case 'U':
+        print_number(output, op, statxbuf->stx_uid);
+        break;
+    case 'y':
+        /* find says 'f' where ls says '-' */
+        mode[0] = S_ISREG(statxbuf->stx_mode) ? 'f'
+                                               : mode2type(statxbuf->stx_mode);
+        mode[1] = '\0';
+        print_string(output, op, mode, 1);
+        break;
+    case 'a':
+    case 'A':
+        print_time(output, op, &statxbuf->stx_atime,
+                   mask & RBH_STATX_ATIME_NSEC);
+        break;
+    case 'B':
+        print_time(output, op, &statxbuf->stx_btime,
+                   mask & RBH_STATX_BTIME_NSEC);
+        break;
+    case 'c':
+    case 'C':
+        print_time(output, op, &statxbuf->stx_ctime,
+                   mask & RBH_STATX_CTIME_NSEC);
+        break;
+    case 't':
+    case 'T':
+        print_time(output, op, &statxbuf->stx_mtime,
+                   mask & RBH_STATX_MTIME_NSEC);
+        break;
+    }
+}
+
+void
+fsentry_printf_format(struct output *output, const struct rbh_fsentry *fsentry,
+                      const struct printf_format *format)
+{
+    for (size_t i = 0; i < format->count; i++) {
+        const struct printf_op *op = &format->ops[i];
+
+        switch (op->type) {
+        case POT_LITERAL:
+            output_write(output, format->literals + op->offset, op->length);
             break;
+        case POT_DIRECTIVE:
+            print_directive(output, op, fsentry);
+            break;
+        case POT_STOP:
+            output_flush(output);
+            return;
         }
     }
-
-    output[output_length] = 0;
-    fprintf(file, "%s", output);
 }
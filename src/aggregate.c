@@ -0,0 +1,292 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <error.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rbh-find/aggregate.h"
+#include "rbh-find/evaluator.h"
+#include "rbh-find/projection.h"
+#include "rbh-find/sample.h"
+
+struct aggregate *
+aggregate_new(enum aggregate_function function,
+              const struct rbh_filter_field *field,
+              const struct rbh_filter_field *group)
+{
+    struct aggregate *aggregate;
+
+    aggregate = calloc(1, sizeof(*aggregate));
+    if (aggregate == NULL)
+        error(EXIT_FAILURE, errno, "calloc");
+
+    aggregate->function = function;
+    if (function != AGG_COUNT)
+        aggregate->field = *field;
+    if (group != NULL) {
+        aggregate->grouped = true;
+        aggregate->group = *group;
+    }
+
+    return aggregate;
+}
+
+void
+aggregate_destroy(struct aggregate *aggregate)
+{
+    free(aggregate->rows);
+    free(aggregate);
+}
+
+unsigned int
+histogram_bucket(uint64_t value)
+{
+    return value == 0 ? 0 : 64 - __builtin_clzll(value);
+}
+
+static int
+row_compare(const struct aggregate_row *row, uint64_t group,
+            unsigned int bucket)
+{
+    if (row->group != group)
+        return row->group < group ? -1 : 1;
+
+    if (row->bucket != bucket)
+        return row->bucket < bucket ? -1 : 1;
+
+    return 0;
+}
+
+/* Find the row of (\p group, \p bucket), or create it */
+static struct aggregate_row *
+aggregate_row(struct aggregate *aggregate, uint64_t group, unsigned int bucket)
+{
+    struct aggregate_row *rows;
+    size_t low = 0, high = aggregate->row_count;
+
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        int order;
+
+        order = row_compare(&aggregate->rows[middle], group, bucket);
+        if (order == 0)
+            return &aggregate->rows[middle];
+
+        if (order < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    rows = reallocarray(aggregate->rows, aggregate->row_count + 1,
+                        sizeof(*rows));
+    if (rows == NULL)
+        error(EXIT_FAILURE, errno, "reallocarray");
+    aggregate->rows = rows;
+
+    memmove(&rows[low + 1], &rows[low],
+            (aggregate->row_count - low) * sizeof(*rows));
+    aggregate->row_count++;
+
+    rows[low] = (struct aggregate_row) {
+        .group = group,
+        .bucket = bucket,
+    };
+
+    return &rows[low];
+}
+
+static struct aggregate_row *
+aggregate_update(struct aggregate *aggregate, uint64_t group,
+                 unsigned int bucket, uint64_t count, uint64_t sum)
+{
+    struct aggregate_row *row = aggregate_row(aggregate, group, bucket);
+
+    row->count += count;
+    row->sum += sum;
+    aggregate->count += count;
+    return row;
+}
+
+void
+aggregate_add(struct aggregate *aggregate, uint64_t group, unsigned int bucket,
+              uint64_t count, uint64_t sum)
+{
+    aggregate_update(aggregate, group, bucket, count, sum);
+}
+
+static bool
+field_uint64(const struct rbh_fsentry *fsentry,
+             const struct rbh_filter_field *field, uint64_t *integer)
+{
+    const struct rbh_value *value;
+    struct rbh_value buffer;
+
+    value = fsentry_field_value(fsentry, field, &buffer);
+    if (value == NULL)
+        return false;
+
+    switch (value->type) {
+    case RBH_VT_UINT32:
+        *integer = value->uint32;
+        return true;
+    case RBH_VT_UINT64:
+        *integer = value->uint64;
+        return true;
+    case RBH_VT_INT32:
+        *integer = value->int32;
+        return value->int32 >= 0;
+    case RBH_VT_INT64:
+        *integer = value->int64;
+        return value->int64 >= 0;
+    default:
+        return false;
+    }
+}
+
+void
+aggregate_fsentry(struct aggregate *aggregate,
+                  const struct rbh_fsentry *fsentry)
+{
+    uint64_t group = 0;
+    uint64_t value = 0;
+
+    if (aggregate->grouped &&
+        !field_uint64(fsentry, &aggregate->group, &group))
+        return;
+
+    if (aggregate->function != AGG_COUNT &&
+        !field_uint64(fsentry, &aggregate->field, &value))
+        return;
+
+    switch (aggregate->function) {
+    case AGG_COUNT:
+        aggregate_add(aggregate, group, 0, 1, 0);
+        break;
+    case AGG_SUM:
+        aggregate_update(aggregate, group, 0, 1, value)->squares +=
+            (double)value * value;
+        break;
+    case AGG_HISTOGRAM:
+        aggregate_add(aggregate, group, histogram_bucket(value), 1, 0);
+        break;
+    }
+}
+
+void
+aggregate_projection(const struct aggregate *aggregate,
+                     struct rbh_filter_projection *projection)
+{
+    if (aggregate->function != AGG_COUNT)
+        projection_add_field(projection, &aggregate->field);
+
+    if (aggregate->grouped)
+        projection_add_field(projection, &aggregate->group);
+}
+
+static const char *
+field_name(const struct rbh_filter_field *field)
+{
+    const char *name = NULL;
+
+    if (field->fsentry == RBH_FP_STATX)
+        name = statx_field2str(field->statx);
+    else if (field->fsentry == RBH_FP_NAMESPACE_XATTRS ||
+             field->fsentry == RBH_FP_INODE_XATTRS)
+        name = field->xattr;
+
+    if (name == NULL)
+        name = fsentry_property2str(field->fsentry);
+
+    return name ? name : "?";
+}
+
+/* "~value (95% CI: low to high)", the estimate of a total from a sample */
+static void
+estimate_print(struct output *output, double rate, double total,
+               double squares)
+{
+    struct estimate estimate;
+
+    sample_estimate(rate, total, squares, &estimate);
+    output_printf(output, "~%.0f (95%% CI: %.0f to %.0f)", estimate.value,
+                  estimate.low, estimate.high);
+}
+
+/* Print a count, or its estimate */
+static void
+count_print(struct output *output, const struct aggregate *aggregate,
+            uint64_t count)
+{
+    if (aggregate->rate == 0)
+        output_printf(output, "%" PRIu64, count);
+    else
+        /* Each fsentry counts for 1, and so does its square */
+        estimate_print(output, aggregate->rate, count, count);
+}
+
+static void
+row_print(struct output *output, const struct aggregate *aggregate,
+          const struct aggregate_row *row)
+{
+    const char *name = field_name(&aggregate->field);
+
+    if (aggregate->grouped)
+        output_printf(output, "%s=%" PRIu64 ": ",
+                      field_name(&aggregate->group), row->group);
+
+    switch (aggregate->function) {
+    case AGG_COUNT:
+        count_print(output, aggregate, row->count);
+        output_printf(output, " matching entries\n");
+        break;
+    case AGG_SUM:
+        output_printf(output, "sum(%s)=", name);
+        if (aggregate->rate == 0)
+            output_printf(output, "%" PRIu64, row->sum);
+        else
+            estimate_print(output, aggregate->rate, row->sum, row->squares);
+        output_printf(output, "\n");
+        break;
+    case AGG_HISTOGRAM:
+        if (row->bucket == 0)
+            output_printf(output, "%s in [0, 1): ", name);
+        else if (row->bucket == HISTOGRAM_BUCKETS - 1)
+            output_printf(output, "%s in [%" PRIu64 ", inf): ", name,
+                          UINT64_C(1) << (row->bucket - 1));
+        else
+            output_printf(output, "%s in [%" PRIu64 ", %" PRIu64 "): ", name,
+                          UINT64_C(1) << (row->bucket - 1),
+                          UINT64_C(1) << row->bucket);
+        count_print(output, aggregate, row->count);
+        output_printf(output, "\n");
+        break;
+    }
+}
+
+void
+aggregate_print(struct output *output, const struct aggregate *aggregate)
+{
+    const struct aggregate_row empty = {};
+
+    /* Say that nothing matched rather than print nothing at all */
+    if (aggregate->row_count == 0 && !aggregate->grouped &&
+        aggregate->function != AGG_HISTOGRAM) {
+        row_print(output, aggregate, &empty);
+        return;
+    }
+
+    for (size_t i = 0; i < aggregate->row_count; i++)
+        row_print(output, aggregate, &aggregate->rows[i]);
+}
@@ -0,0 +1,104 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <error.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rbh-find/actions.h"
+#include "rbh-find/binary.h"
+
+static_assert(sizeof(struct binary_header) == 16, "unexpected padding");
+static_assert(sizeof(struct binary_record) == 160, "unexpected padding");
+
+void
+binary_print_header(struct output *output)
+{
+    const struct binary_header header = {
+        .magic = BINARY_MAGIC,
+        .version = BINARY_VERSION,
+        .byte_order = BINARY_BYTE_ORDER,
+    };
+
+    output_write(output, &header, sizeof(header));
+}
+
+static void
+binary_timestamp(struct binary_timestamp *timestamp,
+                 const struct rbh_statx_timestamp *statx_timestamp)
+{
+    timestamp->sec = statx_timestamp->tv_sec;
+    timestamp->nsec = statx_timestamp->tv_nsec;
+}
+
+/* The fields of an fsentry may be NULL when they are unknown */
+static void
+output_field(struct output *output, const void *data, size_t size)
+{
+    if (size > 0)
+        output_write(output, data, size);
+}
+
+void
+fsentry_print_binary(struct output *output, const struct rbh_fsentry *fsentry)
+{
+    static const char PADDING[8];
+    struct binary_record record = {};
+    const char *path = fsentry_path(fsentry);
+    size_t size;
+
+    if (fsentry->mask & RBH_FP_ID)
+        record.id_size = fsentry->id.size;
+    if (fsentry->mask & RBH_FP_PARENT_ID)
+        record.parent_id_size = fsentry->parent_id.size;
+    if (fsentry->mask & RBH_FP_NAME)
+        record.name_size = strlen(fsentry->name) + 1;
+    if (path != NULL)
+        record.path_size = strlen(path) + 1;
+
+    size = sizeof(record) + (size_t)record.id_size + record.parent_id_size
+         + record.name_size + record.path_size;
+    if (size > UINT32_MAX - 8)
+        error(EXIT_FAILURE, EOVERFLOW, "fsentry_print_binary");
+    record.length = (size + 7) & ~(size_t)7;
+
+    if (fsentry->mask & RBH_FP_STATX) {
+        const struct rbh_statx *statx = fsentry->statx;
+
+        record.statx_mask = statx->stx_mask & BINARY_STATX_MASK;
+        record.blksize = statx->stx_blksize;
+        record.nlink = statx->stx_nlink;
+        record.uid = statx->stx_uid;
+        record.gid = statx->stx_gid;
+        record.mode = statx->stx_mode;
+        record.rdev_major = statx->stx_rdev_major;
+        record.rdev_minor = statx->stx_rdev_minor;
+        record.dev_major = statx->stx_dev_major;
+        record.dev_minor = statx->stx_dev_minor;
+        record.attributes = statx->stx_attributes;
+        record.ino = statx->stx_ino;
+        record.size = statx->stx_size;
+        record.blocks = statx->stx_blocks;
+        binary_timestamp(&record.atime, &statx->stx_atime);
+        binary_timestamp(&record.btime, &statx->stx_btime);
+        binary_timestamp(&record.ctime, &statx->stx_ctime);
+        binary_timestamp(&record.mtime, &statx->stx_mtime);
+    }
+
+    output_write(output, &record, sizeof(record));
+    output_field(output, fsentry->id.data, record.id_size);
+    output_field(output, fsentry->parent_id.data, record.parent_id_size);
+    output_field(output, fsentry->name, record.name_size);
+    output_field(output, path, record.path_size);
+    output_field(output, PADDING, record.length - size);
+}
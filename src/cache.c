@@ -0,0 +1,1064 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <error.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "rbh-find/cache.h"
+
+/* Cached results are stored in files that look like this:
+ *
+ *     header:  "RBHFCACH" version statx-size creation-time has-generation
+ *              generation key-size key
+ *     records: size fsentry
+ *     trailer: 0 "RBHFDONE"
+ *
+ * Integers are stored in the byte order of the host, the cache is not meant to
+ * be shared across hosts.
+ */
+#define CACHE_MAGIC "RBHFCACH"
+#define CACHE_TRAILER "RBHFDONE"
+#define CACHE_VERSION 1
+
+/*----------------------------------------------------------------------------*
+ |                                serialization                               |
+ *----------------------------------------------------------------------------*/
+
+struct buffer {
+    char *data;
+    size_t length;
+    size_t size;
+};
+
+static void
+buffer_append(struct buffer *buffer, const void *data, size_t size)
+{
+    if (buffer->length + size > buffer->size) {
+        size_t new_size = buffer->size ? buffer->size : 4096;
+        char *new_data;
+
+        while (new_size < buffer->length + size)
+            new_size *= 2;
+
+        new_data = realloc(buffer->data, new_size);
+        if (new_data == NULL)
+            error(EXIT_FAILURE, errno, "realloc");
+
+        buffer->data = new_data;
+        buffer->size = new_size;
+    }
+
+    memcpy(buffer->data + buffer->length, data, size);
+    buffer->length += size;
+}
+
+static void
+buffer_u8(struct buffer *buffer, uint8_t value)
+{
+    buffer_append(buffer, &value, sizeof(value));
+}
+
+static void
+buffer_u32(struct buffer *buffer, uint32_t value)
+{
+    buffer_append(buffer, &value, sizeof(value));
+}
+
+static void
+buffer_u64(struct buffer *buffer, uint64_t value)
+{
+    buffer_append(buffer, &value, sizeof(value));
+}
+
+static void
+buffer_bytes(struct buffer *buffer, const char *data, size_t size)
+{
+    buffer_u64(buffer, size);
+    buffer_append(buffer, data, size);
+}
+
+/* Strings are stored with their terminating null byte, so that they can be
+ * used right from the memory-mapped file
+ */
+static void
+buffer_string(struct buffer *buffer, const char *string)
+{
+    size_t length = strlen(string);
+
+    buffer_u64(buffer, length);
+    buffer_append(buffer, string, length + 1);
+}
+
+static void
+buffer_map(struct buffer *buffer, const struct rbh_value_map *map);
+
+static void
+buffer_value(struct buffer *buffer, const struct rbh_value *value)
+{
+    buffer_u8(buffer, value->type);
+
+    switch (value->type) {
+    case RBH_VT_BOOLEAN:
+        buffer_u8(buffer, value->boolean);
+        break;
+    case RBH_VT_INT32:
+        buffer_u32(buffer, value->int32);
+        break;
+    case RBH_VT_UINT32:
+        buffer_u32(buffer, value->uint32);
+        break;
+    case RBH_VT_INT64:
+        buffer_u64(buffer, value->int64);
+        break;
+    case RBH_VT_UINT64:
+        buffer_u64(buffer, value->uint64);
+        break;
+    case RBH_VT_STRING:
+        buffer_string(buffer, value->string);
+        break;
+    case RBH_VT_BINARY:
+        buffer_bytes(buffer, value->binary.data, value->binary.size);
+        break;
+    case RBH_VT_REGEX:
+        buffer_string(buffer, value->regex.string);
+        buffer_u32(buffer, value->regex.options);
+        break;
+    case RBH_VT_SEQUENCE:
+        buffer_u64(buffer, value->sequence.count);
+        for (size_t i = 0; i < value->sequence.count; i++)
+            buffer_value(buffer, &value->sequence.values[i]);
+        break;
+    case RBH_VT_MAP:
+        buffer_map(buffer, &value->map);
+        break;
+    default:
+        break;
+    }
+}
+
+static void
+buffer_map(struct buffer *buffer, const struct rbh_value_map *map)
+{
+    buffer_u64(buffer, map->count);
+    for (size_t i = 0; i < map->count; i++) {
+        buffer_string(buffer, map->pairs[i].key);
+        buffer_u8(buffer, map->pairs[i].value != NULL);
+        if (map->pairs[i].value != NULL)
+            buffer_value(buffer, map->pairs[i].value);
+    }
+}
+
+static void
+buffer_field(struct buffer *buffer, const struct rbh_filter_field *field)
+{
+    buffer_u32(buffer, field->fsentry);
+
+    switch (field->fsentry) {
+    case RBH_FP_STATX:
+        buffer_u32(buffer, field->statx);
+        break;
+    case RBH_FP_NAMESPACE_XATTRS:
+    case RBH_FP_INODE_XATTRS:
+        buffer_u8(buffer, field->xattr != NULL);
+        if (field->xattr != NULL)
+            buffer_string(buffer, field->xattr);
+        break;
+    default:
+        break;
+    }
+}
+
+static void
+buffer_filter(struct buffer *buffer, const struct rbh_filter *filter);
+
+static int
+buffer_cmp(const void *_x, const void *_y)
+{
+    const struct buffer *x = _x;
+    const struct buffer *y = _y;
+    int order;
+
+    order = memcmp(x->data, y->data,
+                   x->length < y->length ? x->length : y->length);
+    if (order != 0)
+        return order;
+    return (x->length > y->length) - (x->length < y->length);
+}
+
+/* The operands of AND and OR are serialized in a canonical order, so that
+ * `-name a -size +1k' and `-size +1k -name a' are the same query
+ */
+static void
+buffer_operands(struct buffer *buffer, const struct rbh_filter *filter)
+{
+    struct buffer *operands;
+
+    operands = calloc(filter->logical.count, sizeof(*operands));
+    if (operands == NULL && filter->logical.count > 0)
+        error(EXIT_FAILURE, errno, "calloc");
+
+    for (size_t i = 0; i < filter->logical.count; i++)
+        buffer_filter(&operands[i], filter->logical.filters[i]);
+
+    qsort(operands, filter->logical.count, sizeof(*operands), buffer_cmp);
+
+    for (size_t i = 0; i < filter->logical.count; i++) {
+        buffer_append(buffer, operands[i].data, operands[i].length);
+        free(operands[i].data);
+    }
+    free(operands);
+}
+
+/* Filters are expected to be simplified by filter_optimize() already */
+static void
+buffer_filter(struct buffer *buffer, const struct rbh_filter *filter)
+{
+    if (filter == NULL) {
+        buffer_u8(buffer, UINT8_MAX);
+        return;
+    }
+
+    buffer_u8(buffer, filter->op);
+
+    if (rbh_is_logical_operator(filter->op)) {
+        buffer_u32(buffer, filter->logical.count);
+        if (filter->op == RBH_FOP_NOT) {
+            buffer_filter(buffer, filter->logical.filters[0]);
+            return;
+        }
+        buffer_operands(buffer, filter);
+        return;
+    }
+
+    buffer_field(buffer, &filter->compare.field);
+    if (filter->op != RBH_FOP_EXISTS)
+        buffer_value(buffer, &filter->compare.value);
+}
+
+/* Everything that identifies a query */
+static void
+buffer_query(struct buffer *buffer, const char *uri,
+             const struct rbh_filter *filter,
+             const struct rbh_filter_options *options)
+{
+    buffer_string(buffer, uri);
+    buffer_filter(buffer, filter);
+    buffer_u64(buffer, options->skip);
+    buffer_u64(buffer, options->limit);
+    buffer_u32(buffer, options->projection.fsentry_mask);
+    buffer_u32(buffer, options->projection.statx_mask);
+    buffer_u64(buffer, options->sort.count);
+    for (size_t i = 0; i < options->sort.count; i++) {
+        buffer_field(buffer, &options->sort.items[i].field);
+        buffer_u8(buffer, options->sort.items[i].ascending);
+    }
+}
+
+static void
+buffer_fsentry(struct buffer *buffer, const struct rbh_fsentry *fsentry)
+{
+    buffer_u32(buffer, fsentry->mask);
+
+    if (fsentry->mask & RBH_FP_ID)
+        buffer_bytes(buffer, fsentry->id.data, fsentry->id.size);
+    if (fsentry->mask & RBH_FP_PARENT_ID)
+        buffer_bytes(buffer, fsentry->parent_id.data,
+                     fsentry->parent_id.size);
+    if (fsentry->mask & RBH_FP_NAME)
+        buffer_string(buffer, fsentry->name);
+    if (fsentry->mask & RBH_FP_STATX)
+        buffer_append(buffer, fsentry->statx, sizeof(*fsentry->statx));
+    if (fsentry->mask & RBH_FP_NAMESPACE_XATTRS)
+        buffer_map(buffer, &fsentry->xattrs.ns);
+    if (fsentry->mask & RBH_FP_INODE_XATTRS)
+        buffer_map(buffer, &fsentry->xattrs.inode);
+    if (fsentry->mask & RBH_FP_SYMLINK)
+        buffer_string(buffer, fsentry->symlink);
+}
+
+/*----------------------------------------------------------------------------*
+ |                               deserialization                              |
+ *----------------------------------------------------------------------------*/
+
+struct reader {
+    const char *data;
+    size_t size;
+    size_t offset;
+};
+
+/* Return NULL if there are less than \p size bytes left */
+static const char *
+reader_take(struct reader *reader, size_t size)
+{
+    const char *data = reader->data + reader->offset;
+
+    if (size > reader->size - reader->offset)
+        return NULL;
+
+    reader->offset += size;
+    return data;
+}
+
+static bool
+reader_u8(struct reader *reader, uint8_t *value)
+{
+    const char *data = reader_take(reader, sizeof(*value));
+
+    if (data != NULL)
+        memcpy(value, data, sizeof(*value));
+    return data != NULL;
+}
+
+static bool
+reader_u32(struct reader *reader, uint32_t *value)
+{
+    const char *data = reader_take(reader, sizeof(*value));
+
+    if (data != NULL)
+        memcpy(value, data, sizeof(*value));
+    return data != NULL;
+}
+
+static bool
+reader_u64(struct reader *reader, uint64_t *value)
+{
+    const char *data = reader_take(reader, sizeof(*value));
+
+    if (data != NULL)
+        memcpy(value, data, sizeof(*value));
+    return data != NULL;
+}
+
+static const char *
+reader_bytes(struct reader *reader, size_t *size)
+{
+    uint64_t length;
+
+    if (!reader_u64(reader, &length))
+        return NULL;
+
+    *size = length;
+    return reader_take(reader, length);
+}
+
+static const char *
+reader_string(struct reader *reader)
+{
+    const char *string;
+    uint64_t length;
+
+    if (!reader_u64(reader, &length) || length == UINT64_MAX)
+        return NULL;
+
+    string = reader_take(reader, length + 1);
+    if (string == NULL || string[length] != '\0')
+        return NULL;
+    return string;
+}
+
+/* Values and pairs of the maps of an fsentry, decoded in two passes: the first
+ * one only counts them (`values' and `pairs' are NULL), the second one fills
+ * arrays of the right size.
+ */
+struct value_decoder {
+    struct reader *reader;
+    struct rbh_value *values;
+    size_t value_count;
+    struct rbh_value_pair *pairs;
+    size_t pair_count;
+};
+
+static struct rbh_value *
+decoder_values(struct value_decoder *decoder, size_t count)
+{
+    struct rbh_value *values = NULL;
+
+    if (decoder->values != NULL)
+        values = &decoder->values[decoder->value_count];
+    decoder->value_count += count;
+    return values;
+}
+
+static bool
+decode_map(struct value_decoder *decoder, struct rbh_value_map *map);
+
+static bool
+decode_value(struct value_decoder *decoder, struct rbh_value *value)
+{
+    struct reader *reader = decoder->reader;
+    struct rbh_value *values;
+    uint8_t byte, type;
+    uint64_t count;
+    uint32_t u32;
+    uint64_t u64;
+
+    if (!reader_u8(reader, &type))
+        return false;
+    value->type = type;
+
+    switch (type) {
+    case RBH_VT_BOOLEAN:
+        if (!reader_u8(reader, &byte))
+            return false;
+        value->boolean = byte;
+        return true;
+    case RBH_VT_INT32:
+        if (!reader_u32(reader, &u32))
+            return false;
+        value->int32 = u32;
+        return true;
+    case RBH_VT_UINT32:
+        return reader_u32(reader, &value->uint32);
+    case RBH_VT_INT64:
+        if (!reader_u64(reader, &u64))
+            return false;
+        value->int64 = u64;
+        return true;
+    case RBH_VT_UINT64:
+        return reader_u64(reader, &value->uint64);
+    case RBH_VT_STRING:
+        value->string = reader_string(reader);
+        return value->string != NULL;
+    case RBH_VT_BINARY:
+        value->binary.data = reader_bytes(reader, &value->binary.size);
+        return value->binary.data != NULL;
+    case RBH_VT_REGEX:
+        value->regex.string = reader_string(reader);
+        return value->regex.string != NULL &&
+               reader_u32(reader, &value->regex.options);
+    case RBH_VT_SEQUENCE:
+        if (!reader_u64(reader, &count) || count > reader->size)
+            return false;
+
+        values = decoder_values(decoder, count);
+        for (size_t i = 0; i < count; i++) {
+            struct rbh_value dummy;
+
+            if (!decode_value(decoder, values ? &values[i] : &dummy))
+                return false;
+        }
+        value->sequence.values = values;
+        value->sequence.count = count;
+        return true;
+    case RBH_VT_MAP:
+        return decode_map(decoder, &value->map);
+    }
+
+    return false;
+}
+
+static bool
+decode_map(struct value_decoder *decoder, struct rbh_value_map *map)
+{
+    struct rbh_value_pair *pairs = NULL;
+    uint64_t count;
+
+    if (!reader_u64(decoder->reader, &count) || count > decoder->reader->size)
+        return false;
+
+    if (decoder->pairs != NULL)
+        pairs = &decoder->pairs[decoder->pair_count];
+    decoder->pair_count += count;
+
+    for (size_t i = 0; i < count; i++) {
+        struct rbh_value *value;
+        struct rbh_value dummy;
+        const char *key;
+        uint8_t present;
+
+        key = reader_string(decoder->reader);
+        if (key == NULL || !reader_u8(decoder->reader, &present))
+            return false;
+
+        value = present ? decoder_values(decoder, 1) : NULL;
+        if (present && !decode_value(decoder, value ? value : &dummy))
+            return false;
+
+        if (pairs != NULL) {
+            pairs[i].key = key;
+            pairs[i].value = value;
+        }
+    }
+
+    map->pairs = pairs;
+    map->count = count;
+    return true;
+}
+
+/* The arrays a replay iterator decodes the maps of fsentries in */
+struct value_storage {
+    struct rbh_value *values;
+    size_t value_size;
+    struct rbh_value_pair *pairs;
+    size_t pair_size;
+};
+
+static bool
+decode_fsentry_fields(struct value_decoder *decoder, uint32_t *mask,
+                      struct rbh_id *id, struct rbh_id *parent_id,
+                      const char **name, const struct rbh_statx **statxbuf,
+                      struct rbh_value_map *ns, struct rbh_value_map *inode,
+                      const char **symlink)
+{
+    struct reader *reader = decoder->reader;
+
+    if (!reader_u32(reader, mask))
+        return false;
+
+    if (*mask & RBH_FP_ID) {
+        id->data = reader_bytes(reader, &id->size);
+        if (id->data == NULL)
+            return false;
+    }
+    if (*mask & RBH_FP_PARENT_ID) {
+        parent_id->data = reader_bytes(reader, &parent_id->size);
+        if (parent_id->data == NULL)
+            return false;
+    }
+    if (*mask & RBH_FP_NAME) {
+        *name = reader_string(reader);
+        if (*name == NULL)
+            return false;
+    }
+    if (*mask & RBH_FP_STATX) {
+        /* The mapping is only guaranteed to be aligned on pages */
+        *statxbuf = (const void *)reader_take(reader, sizeof(**statxbuf));
+        if (*statxbuf == NULL)
+            return false;
+    }
+    if (*mask & RBH_FP_NAMESPACE_XATTRS && !decode_map(decoder, ns))
+        return false;
+    if (*mask & RBH_FP_INODE_XATTRS && !decode_map(decoder, inode))
+        return false;
+    if (*mask & RBH_FP_SYMLINK) {
+        *symlink = reader_string(reader);
+        if (*symlink == NULL)
+            return false;
+    }
+
+    return true;
+}
+
+static void *
+storage_reserve(void *array, size_t *size, size_t count, size_t item_size)
+{
+    if (count <= *size)
+        return array;
+
+    array = reallocarray(array, count, item_size);
+    if (array == NULL)
+        error(EXIT_FAILURE, errno, "reallocarray");
+    *size = count;
+    return array;
+}
+
+/* Return NULL with errno set to EBADMSG if the record is malformed */
+static struct rbh_fsentry *
+decode_fsentry(struct reader *record, struct value_storage *storage)
+{
+    struct value_decoder decoder = {
+        .reader = record,
+    };
+    struct rbh_value_map ns, inode;
+    const struct rbh_statx *statxbuf;
+    struct rbh_id id, parent_id;
+    const char *name, *symlink;
+    struct rbh_statx statx;
+    struct rbh_fsentry *fsentry;
+    uint32_t mask;
+
+    if (!decode_fsentry_fields(&decoder, &mask, &id, &parent_id, &name,
+                               &statxbuf, &ns, &inode, &symlink))
+        goto malformed;
+
+    storage->values = storage_reserve(storage->values, &storage->value_size,
+                                      decoder.value_count,
+                                      sizeof(*storage->values));
+    storage->pairs = storage_reserve(storage->pairs, &storage->pair_size,
+                                     decoder.pair_count,
+                                     sizeof(*storage->pairs));
+
+    record->offset = 0;
+    decoder = (struct value_decoder) {
+        .reader = record,
+        .values = storage->values ? storage->values : (void *)storage,
+        .pairs = storage->pairs ? storage->pairs : (void *)storage,
+    };
+    if (!decode_fsentry_fields(&decoder, &mask, &id, &parent_id, &name,
+                               &statxbuf, &ns, &inode, &symlink))
+        goto malformed;
+
+    if (mask & RBH_FP_STATX)
+        memcpy(&statx, statxbuf, sizeof(statx));
+
+    fsentry = rbh_fsentry_new(mask & RBH_FP_ID ? &id : NULL,
+                              mask & RBH_FP_PARENT_ID ? &parent_id : NULL,
+                              mask & RBH_FP_NAME ? name : NULL,
+                              mask & RBH_FP_STATX ? &statx : NULL,
+                              mask & RBH_FP_NAMESPACE_XATTRS ? &ns : NULL,
+                              mask & RBH_FP_INODE_XATTRS ? &inode : NULL,
+                              mask & RBH_FP_SYMLINK ? symlink : NULL);
+    if (fsentry == NULL)
+        error(EXIT_FAILURE, errno, "rbh_fsentry_new");
+    return fsentry;
+
+malformed:
+    errno = EBADMSG;
+    return NULL;
+}
+
+/*----------------------------------------------------------------------------*
+ |                               replay_iterator                              |
+ *----------------------------------------------------------------------------*/
+
+struct replay_iterator {
+    struct rbh_mut_iterator iterator;
+
+    void *map;
+    size_t size;
+    /* Positioned on the next record */
+    struct reader reader;
+    struct value_storage storage;
+};
+
+static void *
+replay_iter_next(void *_iterator)
+{
+    struct replay_iterator *iterator = _iterator;
+    struct reader record;
+    uint64_t size;
+
+    if (!reader_u64(&iterator->reader, &size)) {
+        errno = EBADMSG;
+        return NULL;
+    }
+
+    if (size == 0) {
+        /* Stay on the trailer */
+        iterator->reader.offset -= sizeof(size);
+        errno = ENODATA;
+        return NULL;
+    }
+
+    record.data = reader_take(&iterator->reader, size);
+    if (record.data == NULL) {
+        errno = EBADMSG;
+        return NULL;
+    }
+    record.size = size;
+    record.offset = 0;
+
+    return decode_fsentry(&record, &iterator->storage);
+}
+
+static void
+replay_iter_destroy(void *_iterator)
+{
+    struct replay_iterator *iterator = _iterator;
+
+    munmap(iterator->map, iterator->size);
+    free(iterator->storage.values);
+    free(iterator->storage.pairs);
+    free(iterator);
+}
+
+static const struct rbh_mut_iterator_operations REPLAY_ITER_OPS = {
+    .next = replay_iter_next,
+    .destroy = replay_iter_destroy,
+};
+
+/* Check the header of a cache file, and position \p reader on its first
+ * record
+ */
+static bool
+cache_file_valid(struct reader *reader, const struct buffer *key, time_t ttl,
+                 const uint64_t *generation)
+{
+    const char *magic, *stored_key;
+    uint32_t version, statx_size;
+    uint64_t created, stored_generation;
+    uint8_t has_generation;
+    size_t key_size;
+    time_t now = time(NULL);
+
+    if (reader->size < sizeof(uint64_t) + strlen(CACHE_TRAILER) ||
+        memcmp(reader->data + reader->size - strlen(CACHE_TRAILER),
+               CACHE_TRAILER, strlen(CACHE_TRAILER)) != 0)
+        return false;
+
+    magic = reader_take(reader, strlen(CACHE_MAGIC));
+    if (magic == NULL || memcmp(magic, CACHE_MAGIC, strlen(CACHE_MAGIC)) != 0)
+        return false;
+
+    if (!reader_u32(reader, &version) || version != CACHE_VERSION ||
+        !reader_u32(reader, &statx_size) ||
+        statx_size != sizeof(struct rbh_statx))
+        return false;
+
+    if (!reader_u64(reader, &created) || (time_t)created > now ||
+        now - (time_t)created >= ttl)
+        return false;
+
+    if (!reader_u8(reader, &has_generation) ||
+        !reader_u64(reader, &stored_generation))
+        return false;
+    if ((generation != NULL) != has_generation ||
+        (generation != NULL && *generation != stored_generation))
+        return false;
+
+    stored_key = reader_bytes(reader, &key_size);
+    return stored_key != NULL && key_size == key->length &&
+           memcmp(stored_key, key->data, key_size) == 0;
+}
+
+static struct rbh_mut_iterator *
+cache_replay(const char *path, const struct buffer *key, time_t ttl,
+             const uint64_t *generation)
+{
+    struct replay_iterator *iterator;
+    struct stat statxbuf;
+    void *map;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    if (fstat(fd, &statxbuf) || statxbuf.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    map = mmap(NULL, statxbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    iterator = malloc(sizeof(*iterator));
+    if (iterator == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+
+    iterator->iterator.ops = &REPLAY_ITER_OPS;
+    iterator->map = map;
+    iterator->size = statxbuf.st_size;
+    iterator->reader = (struct reader) {
+        .data = map,
+        .size = statxbuf.st_size,
+    };
+    iterator->storage = (struct value_storage) {};
+
+    if (!cache_file_valid(&iterator->reader, key, ttl, generation)) {
+        replay_iter_destroy(iterator);
+        return NULL;
+    }
+
+    madvise(map, statxbuf.st_size, MADV_SEQUENTIAL);
+    return &iterator->iterator;
+}
+
+/*----------------------------------------------------------------------------*
+ |                               record_iterator                              |
+ *----------------------------------------------------------------------------*/
+
+/* Cache the fsentries of a backend's iterator as they are iterated over */
+struct record_iterator {
+    struct rbh_mut_iterator iterator;
+    struct rbh_mut_iterator *fsentries;
+
+    /* NULL once recording failed */
+    FILE *file;
+    char *tmp_path;
+    char *path;
+    struct buffer buffer;
+
+    size_t count;
+    size_t limit;
+    bool complete;
+};
+
+static void
+record_abort(struct record_iterator *iterator, int errnum)
+{
+    error(0, errnum, "cannot cache results in `%s'", iterator->path);
+    fclose(iterator->file);
+    unlink(iterator->tmp_path);
+    iterator->file = NULL;
+}
+
+static void
+record_write(struct record_iterator *iterator, const void *data, size_t size)
+{
+    if (fwrite(data, size, 1, iterator->file) != 1)
+        record_abort(iterator, errno);
+}
+
+static void *
+record_iter_next(void *_iterator)
+{
+    struct record_iterator *iterator = _iterator;
+    struct rbh_fsentry *fsentry;
+    int save_errno;
+
+    fsentry = rbh_mut_iter_next(iterator->fsentries);
+    if (fsentry == NULL) {
+        if (errno == ENODATA)
+            iterator->complete = true;
+        return NULL;
+    }
+
+    if (iterator->file == NULL || iterator->complete)
+        return fsentry;
+
+    save_errno = errno;
+    iterator->buffer.length = 0;
+    buffer_u64(&iterator->buffer, 0);
+    buffer_fsentry(&iterator->buffer, fsentry);
+    *(uint64_t *)iterator->buffer.data =
+        iterator->buffer.length - sizeof(uint64_t);
+    record_write(iterator, iterator->buffer.data, iterator->buffer.length);
+    errno = save_errno;
+
+    /* Whatever comes after the limit is not part of the results */
+    if (++iterator->count == iterator->limit)
+        iterator->complete = true;
+
+    return fsentry;
+}
+
+static void
+record_commit(struct record_iterator *iterator)
+{
+    uint64_t end = 0;
+
+    record_write(iterator, &end, sizeof(end));
+    if (iterator->file == NULL)
+        return;
+    record_write(iterator, CACHE_TRAILER, strlen(CACHE_TRAILER));
+    if (iterator->file == NULL)
+        return;
+
+    if (fclose(iterator->file)) {
+        error(0, errno, "cannot cache results in `%s'", iterator->path);
+        unlink(iterator->tmp_path);
+        return;
+    }
+
+    /* Readers either see the previous results or the new ones */
+    if (rename(iterator->tmp_path, iterator->path)) {
+        error(0, errno, "cannot cache results in `%s'", iterator->path);
+        unlink(iterator->tmp_path);
+    }
+}
+
+static void
+record_iter_destroy(void *_iterator)
+{
+    struct record_iterator *iterator = _iterator;
+
+    rbh_mut_iter_destroy(iterator->fsentries);
+
+    if (iterator->file != NULL) {
+        if (iterator->complete) {
+            record_commit(iterator);
+        } else {
+            /* The results were not all iterated over */
+            fclose(iterator->file);
+            unlink(iterator->tmp_path);
+        }
+    }
+
+    free(iterator->buffer.data);
+    free(iterator->tmp_path);
+    free(iterator->path);
+    free(iterator);
+}
+
+static const struct rbh_mut_iterator_operations RECORD_ITER_OPS = {
+    .next = record_iter_next,
+    .destroy = record_iter_destroy,
+};
+
+static FILE *
+cache_create(const struct result_cache *cache, const struct buffer *key,
+             const uint64_t *generation, char **tmp_path)
+{
+    struct buffer header = {};
+    FILE *file;
+    int fd;
+
+    if (asprintf(tmp_path, "%s/.tmp-XXXXXX", cache->directory) < 0)
+        error(EXIT_FAILURE, errno, "asprintf");
+
+    fd = mkstemp(*tmp_path);
+    if (fd < 0) {
+        error(0, errno, "cannot cache results in `%s'", cache->directory);
+        return NULL;
+    }
+
+    file = fdopen(fd, "w");
+    if (file == NULL)
+        error(EXIT_FAILURE, errno, "fdopen");
+
+    buffer_append(&header, CACHE_MAGIC, strlen(CACHE_MAGIC));
+    buffer_u32(&header, CACHE_VERSION);
+    buffer_u32(&header, sizeof(struct rbh_statx));
+    buffer_u64(&header, time(NULL));
+    buffer_u8(&header, generation != NULL);
+    buffer_u64(&header, generation ? *generation : 0);
+    buffer_bytes(&header, key->data, key->length);
+
+    if (fwrite(header.data, header.length, 1, file) != 1) {
+        error(0, errno, "cannot cache results in `%s'", cache->directory);
+        fclose(file);
+        unlink(*tmp_path);
+        file = NULL;
+    }
+
+    free(header.data);
+    return file;
+}
+
+/*----------------------------------------------------------------------------*
+ |                                result_cache                                |
+ *----------------------------------------------------------------------------*/
+
+/* Create a directory and its parents, like `mkdir -p' */
+static void
+mkdirs(char *path)
+{
+    for (char *slash = strchr(path + 1, '/'); ; slash = strchr(slash + 1, '/')) {
+        if (slash != NULL)
+            *slash = '\0';
+
+        if (mkdir(path, 0700) && errno != EEXIST)
+            error(EXIT_FAILURE, errno, "mkdir: %s", path);
+
+        if (slash == NULL)
+            break;
+        *slash = '/';
+    }
+}
+
+struct result_cache *
+result_cache_new(const char *directory, time_t ttl)
+{
+    struct result_cache *cache;
+    const char *base;
+
+    cache = malloc(sizeof(*cache));
+    if (cache == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+
+    if (directory == NULL)
+        directory = getenv("RBH_FIND_CACHE_DIR");
+
+    if (directory != NULL) {
+        cache->directory = strdup(directory);
+        if (cache->directory == NULL)
+            error(EXIT_FAILURE, errno, "strdup");
+    } else if ((base = getenv("XDG_CACHE_HOME")) != NULL && *base == '/') {
+        if (asprintf(&cache->directory, "%s/rbh-find", base) < 0)
+            error(EXIT_FAILURE, errno, "asprintf");
+    } else if ((base = getenv("HOME")) != NULL) {
+        if (asprintf(&cache->directory, "%s/.cache/rbh-find", base) < 0)
+            error(EXIT_FAILURE, errno, "asprintf");
+    } else {
+        error(EXIT_FAILURE, 0,
+              "cannot locate a cache directory, set RBH_FIND_CACHE_DIR");
+    }
+
+    mkdirs(cache->directory);
+    cache->ttl = ttl;
+
+    return cache;
+}
+
+void
+result_cache_destroy(struct result_cache *cache)
+{
+    free(cache->directory);
+    free(cache);
+}
+
+/* 64-bit FNV-1a, it only names files: keys are compared as a whole */
+static uint64_t
+key_hash(const struct buffer *key)
+{
+    uint64_t hash = UINT64_C(14695981039346656037);
+
+    for (size_t i = 0; i < key->length; i++) {
+        hash ^= (unsigned char)key->data[i];
+        hash *= UINT64_C(1099511628211);
+    }
+
+    return hash;
+}
+
+struct rbh_mut_iterator *
+result_cache_filter(struct result_cache *cache, const char *uri,
+                    struct rbh_backend *backend,
+                    const struct rbh_filter *filter,
+                    const struct rbh_filter_options *options,
+                    const uint64_t *generation)
+{
+    struct record_iterator *iterator;
+    struct rbh_mut_iterator *fsentries;
+    struct buffer key = {};
+    char *path;
+
+    buffer_query(&key, uri, filter, options);
+    if (asprintf(&path, "%s/%016" PRIx64 ".cache", cache->directory,
+                 key_hash(&key)) < 0)
+        error(EXIT_FAILURE, errno, "asprintf");
+
+    fsentries = cache_replay(path, &key, cache->ttl, generation);
+    if (fsentries != NULL) {
+        free(key.data);
+        free(path);
+        return fsentries;
+    }
+
+    fsentries = rbh_backend_filter(backend, filter, options);
+    if (fsentries == NULL) {
+        int save_errno = errno;
+
+        free(key.data);
+        free(path);
+        errno = save_errno;
+        return NULL;
+    }
+
+    iterator = malloc(sizeof(*iterator));
+    if (iterator == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+
+    iterator->iterator.ops = &RECORD_ITER_OPS;
+    iterator->fsentries = fsentries;
+    iterator->path = path;
+    iterator->file = cache_create(cache, &key, generation, &iterator->tmp_path);
+    iterator->buffer = (struct buffer) {};
+    iterator->count = 0;
+    iterator->limit = options->limit;
+    iterator->complete = false;
+
+    free(key.data);
+    return &iterator->iterator;
+}
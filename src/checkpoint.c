@@ -0,0 +1,158 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <error.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rbh-find/checkpoint.h"
+#include "rbh-find/utils.h"
+
+static const struct rbh_filter_field CTIME_FIELD = {
+    .fsentry = RBH_FP_STATX,
+    .statx = RBH_STATX_CTIME_SEC,
+};
+
+/* Read the mark stored in \p path, return false if there is none */
+static bool
+checkpoint_load(const char *path, uint64_t *mark)
+{
+    char line[32];
+    size_t length;
+    FILE *file;
+
+    file = fopen(path, "r");
+    if (file == NULL) {
+        if (errno == ENOENT)
+            return false;
+        error(EXIT_FAILURE, errno, "cannot read checkpoint `%s'", path);
+    }
+
+    if (fgets(line, sizeof(line), file) == NULL) {
+        if (ferror(file))
+            error(EXIT_FAILURE, errno, "cannot read checkpoint `%s'", path);
+        line[0] = '\0';
+    }
+    fclose(file);
+
+    length = strlen(line);
+    if (length > 0 && line[length - 1] == '\n')
+        line[--length] = '\0';
+    if (length == 0 || str2uint64_t(line, mark))
+        error(EXIT_FAILURE, 0, "malformed checkpoint `%s'", path);
+
+    return true;
+}
+
+struct checkpoint *
+checkpoint_new(const char *path)
+{
+    struct checkpoint *checkpoint;
+
+    checkpoint = malloc(sizeof(*checkpoint));
+    if (checkpoint == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+
+    checkpoint->path = strdup(path);
+    if (checkpoint->path == NULL)
+        error(EXIT_FAILURE, errno, "strdup");
+
+    checkpoint->mark = 0;
+    checkpoint->filter = NULL;
+    if (checkpoint_load(path, &checkpoint->mark)) {
+        /* Not strictly greater: entries can change within the same second
+         * as the mark after it was taken
+         */
+        checkpoint->filter = rbh_filter_compare_uint64_new(
+            RBH_FOP_GREATER_OR_EQUAL, &CTIME_FIELD, checkpoint->mark
+            );
+        if (checkpoint->filter == NULL)
+            error_at_line(EXIT_FAILURE, errno, __FILE__, __LINE__ - 3,
+                          "rbh_filter_compare_uint64_new");
+    }
+    checkpoint->seen = checkpoint->mark;
+
+    return checkpoint;
+}
+
+void
+checkpoint_see(struct checkpoint *checkpoint,
+               const struct rbh_fsentry *fsentry)
+{
+    uint64_t seen = __atomic_load_n(&checkpoint->seen, __ATOMIC_RELAXED);
+    uint64_t ctime;
+
+    if (!(fsentry->mask & RBH_FP_STATX) ||
+        !(fsentry->statx->stx_mask & RBH_STATX_CTIME_SEC))
+        return;
+
+    ctime = fsentry->statx->stx_ctime.tv_sec;
+    while (ctime > seen &&
+           !__atomic_compare_exchange_n(&checkpoint->seen, &seen, ctime, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+void
+checkpoint_save(struct checkpoint *checkpoint)
+{
+    uint64_t seen = __atomic_load_n(&checkpoint->seen, __ATOMIC_RELAXED);
+    char *tmp_path;
+    FILE *file;
+    int fd;
+
+    if (seen == checkpoint->mark)
+        return;
+
+    if (asprintf(&tmp_path, "%s.tmp-XXXXXX", checkpoint->path) < 0)
+        error(EXIT_FAILURE, errno, "asprintf");
+
+    fd = mkstemp(tmp_path);
+    if (fd < 0) {
+        error(0, errno, "cannot save checkpoint `%s'", checkpoint->path);
+        free(tmp_path);
+        return;
+    }
+
+    file = fdopen(fd, "w");
+    if (file == NULL)
+        error(EXIT_FAILURE, errno, "fdopen");
+
+    /* The new mark must be on disk before it replaces the previous one */
+    if (fprintf(file, "%" PRIu64 "\n", seen) < 0 || fflush(file) ||
+        fsync(fd)) {
+        error(0, errno, "cannot save checkpoint `%s'", checkpoint->path);
+        fclose(file);
+        unlink(tmp_path);
+        free(tmp_path);
+        return;
+    }
+
+    if (fclose(file) || rename(tmp_path, checkpoint->path)) {
+        error(0, errno, "cannot save checkpoint `%s'", checkpoint->path);
+        unlink(tmp_path);
+    } else {
+        checkpoint->mark = seen;
+    }
+    free(tmp_path);
+}
+
+void
+checkpoint_destroy(struct checkpoint *checkpoint)
+{
+    free(checkpoint->filter);
+    free(checkpoint->path);
+    free(checkpoint);
+}
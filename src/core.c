@@ -13,13 +13,120 @@
 #include <sysexits.h>
 
 #include "rbh-find/core.h"
+#include "rbh-find/executor.h"
+#include "rbh-find/idcache.h"
+
+static void
+plan_clear(struct find_context *ctx)
+{
+    for (size_t i = 0; i < ctx->plan_count; i++) {
+        if (ctx->plan[i].evaluator)
+            filter_evaluator_destroy(ctx->plan[i].evaluator);
+        filter_optimized_free(ctx->plan[i].filter);
+    }
+    free(ctx->plan);
+    ctx->plan = NULL;
+    ctx->plan_count = 0;
+}
 
 void
 ctx_finish(struct find_context *ctx)
 {
+    plan_clear(ctx);
+
     for (size_t i = 0; i < ctx->backend_count; i++)
         rbh_backend_destroy(ctx->backends[i]);
     free(ctx->backends);
+
+    if (ctx->output != NULL) {
+        output_close(ctx->output);
+        ctx->output = NULL;
+    }
+
+    if (ctx->stats != NULL) {
+        /* The arguments of find start with the URIs of the backends */
+        find_stats_print(stderr, ctx->stats, ctx->argv);
+        find_stats_destroy(ctx->stats);
+        ctx->stats = NULL;
+    }
+
+    if (ctx->cache != NULL) {
+        result_cache_destroy(ctx->cache);
+        ctx->cache = NULL;
+    }
+
+    if (ctx->checkpoint != NULL) {
+        checkpoint_destroy(ctx->checkpoint);
+        ctx->checkpoint = NULL;
+    }
+
+    if (ctx->filters != NULL) {
+        filter_arena_destroy(ctx->filters);
+        ctx->filters = NULL;
+    }
+
+    if (ctx->ls != NULL) {
+        ls_format_destroy(ctx->ls);
+        ctx->ls = NULL;
+    }
+}
+
+int
+ctx_enable_stats(struct find_context *ctx, const char *string)
+{
+    enum stats_format format;
+
+    if (str2stats_format(string, &format))
+        return -1;
+
+    if (ctx->stats == NULL)
+        ctx->stats = find_stats_new(format);
+    else
+        ctx->stats->format = format;
+    return 0;
+}
+
+/* The number of bytes written to an output so far, 0 if there is none */
+static uint64_t
+output_total(const struct output *output)
+{
+    return output == NULL ? 0 : output->total;
+}
+
+/* Start recording the statistics of an action, return what stats_end() needs
+ * to count the bytes the action writes
+ */
+static uint64_t
+stats_begin(struct find_context *ctx, const char *name)
+{
+    if (ctx->stats == NULL)
+        return 0;
+
+    find_stats_begin(ctx->stats, name, ctx->backend_count);
+    return output_total(ctx->output) + output_total(ctx->action_file);
+}
+
+static void
+stats_end(struct find_context *ctx, uint64_t written)
+{
+    if (ctx->stats == NULL)
+        return;
+
+    find_stats_end(ctx->stats, output_total(ctx->output)
+                               + output_total(ctx->action_file) - written);
+}
+
+/* Account for the execution of an action on \p count fsentries, which may
+ * happen concurrently in several threads
+ */
+static void
+stats_exec(struct find_context *ctx, uint64_t start, size_t count)
+{
+    struct action_stats *action = ctx->stats->current;
+
+    __atomic_fetch_add(&action->exec_time, stats_clock() - start,
+                       __ATOMIC_RELAXED);
+    __atomic_fetch_add(&action->entries, count, __ATOMIC_RELAXED);
 }
 
 enum command_line_token
@@ -56,9 +163,57 @@ str2command_line_token(struct find_context *ctx, const char *string)
             if (strcmp(&string[2], "sort") == 0)
                 return CLT_RSORT;
             break;
+        case 'b':
+            if (strcmp(&string[2], "atch-size") == 0)
+                return CLT_OPTION;
+            break;
+        case 'c':
+            if (strcmp(&string[2], "ache") == 0)
+                return CLT_OPTION;
+            break;
+        case 'D':
+            if (string[2] == '\0')
+                return CLT_OPTION;
+            break;
+        case 'e':
+            if (strcmp(&string[2], "xplain") == 0)
+                return CLT_OPTION;
+            break;
+        case 'g':
+            if (strcmp(&string[2], "roup-by") == 0)
+                return CLT_OPTION;
+            break;
+        case 'j':
+            if (strcmp(&string[2], "obs") == 0)
+                return CLT_OPTION;
+            break;
+        case 'l':
+            if (strcmp(&string[2], "imit") == 0)
+                return CLT_OPTION;
+            break;
+        case 'm':
+            if (strcmp(&string[2], "ount-root") == 0)
+                return CLT_OPTION;
+            break;
+        case 'p':
+            if (strcmp(&string[2], "artition") == 0 ||
+                strcmp(&string[2], "refetch") == 0 ||
+                strcmp(&string[2], "refetch-ids") == 0)
+                return CLT_OPTION;
+            break;
         case 's':
             if (strcmp(&string[2], "ort") == 0)
                 return CLT_SORT;
+            if (strcmp(&string[2], "ample") == 0 ||
+                strcmp(&string[2], "ince-checkpoint") == 0 ||
+                strcmp(&string[2], "ingle-scan") == 0)
+                return CLT_OPTION;
+            if (strcmp(&string[2], "tats") == 0)
+                return CLT_OPTION;
+            break;
+        case 'u':
+            if (strcmp(&string[2], "nordered") == 0)
+                return CLT_OPTION;
             break;
         }
         return ctx->pred_or_action_callback(string);
@@ -66,52 +221,451 @@ str2command_line_token(struct find_context *ctx, const char *string)
     return CLT_URI;
 }
 
+void
+find_projection(struct find_context *ctx, enum action action,
+                const struct rbh_filter *filter,
+                const struct rbh_filter_sort *sorts, size_t sorts_count,
+                struct rbh_filter_projection *projection)
+{
+    projection->fsentry_mask = 0;
+    projection->statx_mask = 0;
+
+    if (ctx->action_projection_callback == NULL) {
+        projection->fsentry_mask = RBH_FP_ALL;
+        projection->statx_mask = RBH_STATX_ALL;
+        return;
+    }
+
+    projection_add_filter(projection, filter);
+    projection_add_sorts(projection, sorts, sorts_count);
+    ctx->action_projection_callback(ctx, action, projection);
+    /* The next mark is the largest ctime seen */
+    if (ctx->checkpoint != NULL) {
+        projection->fsentry_mask |= RBH_FP_STATX;
+        projection->statx_mask |= RBH_STATX_CTIME_SEC;
+    }
+    /* Fsentries are sampled by their ID */
+    if (ctx->sample != 0)
+        projection->fsentry_mask |= RBH_FP_ID;
+
+    if (!(projection->fsentry_mask & RBH_FP_STATX))
+        projection->statx_mask = 0;
+}
+
+static size_t
+exec_batch(struct find_context *ctx, struct rbh_fsentry **fsentries,
+           size_t count, void *data)
+{
+    const enum action *action = data;
+    uint64_t start = 0;
+    size_t total = 0;
+
+    if (ctx->stats != NULL && ctx->stats->current != NULL)
+        start = stats_clock();
+
+    if (ctx->checkpoint != NULL) {
+        for (size_t i = 0; i < count; i++)
+            checkpoint_see(ctx->checkpoint, fsentries[i]);
+    }
+
+    if (ctx->exec_batch_callback != NULL) {
+        total = ctx->exec_batch_callback(ctx, *action, fsentries, count);
+    } else {
+        for (size_t i = 0; i < count; i++)
+            total += ctx->exec_action_callback(ctx, *action, fsentries[i]);
+    }
+
+    if (start != 0)
+        stats_exec(ctx, start, count);
+
+    return total;
+}
+
+static void
+find_options(struct find_context *ctx, enum action action,
+             const struct rbh_filter *filter,
+             const struct rbh_filter_sort *sorts, size_t sorts_count,
+             struct rbh_filter_options *options)
+{
+    *options = (struct rbh_filter_options) {
+        /* Backends enforce the limit so that queries stop early */
+        .limit = action == ACT_QUIT ? 1 : ctx->limit,
+        .sort = {
+            .items = sorts,
+            .count = sorts_count
+        },
+    };
+
+    find_projection(ctx, action, filter, sorts, sorts_count,
+                    &options->projection);
+    if (ctx->debug & DEBUG_PROJECTION) {
+        fprintf(stderr, "%s: ", action2str(action));
+        projection_dump(stderr, &options->projection);
+    }
+}
+
 size_t
 _find(struct find_context *ctx, int backend_index, enum action action,
       const struct rbh_filter *filter, const struct rbh_filter_sort *sorts,
       size_t sorts_count)
 {
-    const struct rbh_filter_options OPTIONS = {
-        .projection = {
-            .fsentry_mask = RBH_FP_ALL,
-            .statx_mask = RBH_STATX_ALL,
+    struct rbh_filter_options options;
+    uint64_t written = 0;
+    bool recording;
+    size_t count;
+
+    find_options(ctx, action, filter, sorts, sorts_count, &options);
+
+    /* Callers may already record this in the statistics of an action */
+    recording = ctx->stats != NULL && ctx->stats->current == NULL;
+    if (recording)
+        written = stats_begin(ctx, action2str(action));
+
+    count = backend_foreach_batch(ctx, backend_index, filter, &options,
+                                  exec_batch, &action);
+
+    if (recording)
+        stats_end(ctx, written);
+
+    return count;
+}
+
+/* Let each backend compute `ctx->aggregate', if it can, or stream fsentries
+ * from it. Return the number of fsentries aggregated.
+ */
+static size_t
+backends_aggregate(struct find_context *ctx, enum action action,
+                   const struct rbh_filter *filter,
+                   const struct rbh_filter_options *options)
+{
+    /* Backends cannot know which fsentries a limit would keep, do not tell
+     * the largest ctime of those they aggregate, nor what estimates of a
+     * sample need
+     */
+    if (ctx->aggregate_callback == NULL || options->limit != 0 ||
+        ctx->checkpoint != NULL || ctx->sample != 0) {
+        backends_foreach_batch(ctx, filter, options, exec_batch, &action);
+        return ctx->aggregate->count;
+    }
+
+    for (size_t i = 0; i < ctx->backend_count; i++) {
+        if (ctx->aggregate_callback(ctx, i, filter, ctx->aggregate) == 0)
+            continue;
+
+        backend_foreach_batch(ctx, i, filter, options, exec_batch, &action);
+    }
+
+    return ctx->aggregate->count;
+}
+
+/* Simplify the filter of an action, once restricted to the changes since the
+ * checkpoint, if any
+ */
+static struct rbh_filter *
+find_optimize(struct find_context *ctx, const struct rbh_filter *filter)
+{
+    const struct rbh_filter *filters[2] = {filter, NULL};
+    const struct rbh_filter conjunction = {
+        .op = RBH_FOP_AND,
+        .logical = {
+            .filters = filters,
+            .count = 2,
         },
+    };
+
+    if (ctx->checkpoint == NULL || ctx->checkpoint->filter == NULL)
+        return filter_optimize(filter);
+
+    filters[1] = ctx->checkpoint->filter;
+    return filter_optimize(&conjunction);
+}
+
+static void
+explain_sorts(FILE *file, const struct rbh_filter_options *options)
+{
+    fprintf(file, "  sort:");
+    if (options->sort.count == 0)
+        fprintf(file, " none");
+
+    for (size_t i = 0; i < options->sort.count; i++) {
+        fprintf(file, i > 0 ? ", " : " ");
+        filter_field_dump(file, &options->sort.items[i].field);
+        fprintf(file, " %s", options->sort.items[i].ascending ? "ascending"
+                                                              : "descending");
+    }
+    fprintf(file, "\n");
+}
+
+/* How many queries backends_aggregate() or backends_foreach_batch() send */
+static void
+explain_queries(struct find_context *ctx, FILE *file,
+                const struct rbh_filter_options *options, bool aggregated)
+{
+    size_t backends = ctx->backend_count;
+
+    /* See backends_aggregate() */
+    if (aggregated && ctx->aggregate_callback != NULL && options->limit == 0 &&
+        ctx->checkpoint == NULL && ctx->sample == 0) {
+        fprintf(file, "  queries: %zu, 1 aggregation per backend\n",
+                backends);
+        return;
+    }
+
+    if (ctx->partition_count > 1 && options->skip == 0) {
+        fprintf(file, "  queries: %zu at most, %zu partitions of ",
+                backends * ctx->partition_count, ctx->partition_count);
+        filter_field_dump(file, &ctx->partition_field);
+        fprintf(file, " per backend, and %zu to find their bounds\n",
+                2 * backends);
+        return;
+    }
+
+    fprintf(file, "  queries: %zu, 1 per backend\n", backends);
+}
+
+/* Print what running an action would send to the backends, on stdout */
+static void
+find_explain(struct find_context *ctx, const char *name,
+             const struct rbh_filter *filter,
+             const struct rbh_filter_options *options, bool aggregated)
+{
+    FILE *file = stdout;
+
+    /* What the actions before this one printed comes first */
+    if (ctx->output != NULL)
+        output_flush(ctx->output);
+
+    fprintf(file, "%s:\n", name);
+    fprintf(file, "  filter:\n");
+    filter_dump(file, filter, 2);
+    fprintf(file, "  projection: ");
+    projection_dump(file, &options->projection);
+    explain_sorts(file, options);
+    if (options->limit > 0)
+        fprintf(file, "  limit: %zu\n", options->limit);
+    if (ctx->cache != NULL)
+        fprintf(file, "  cache: %jd seconds\n", (intmax_t)ctx->cache->ttl);
+    if (ctx->sample != 0)
+        fprintf(file, "  sample: %g\n", ctx->sample);
+    explain_queries(ctx, file, options, aggregated);
+
+    for (size_t i = 0; i < ctx->backend_count && ctx->explain_callback; i++) {
+        /* The arguments of find start with the URIs of the backends */
+        fprintf(file, "  %s:\n", ctx->argv[i]);
+        if (ctx->explain_callback(ctx, i, filter, options, file))
+            fprintf(file, "    no explanation\n");
+    }
+
+    if (fflush(file))
+        error(EXIT_FAILURE, errno, "fflush");
+}
+
+static void
+plan_append(struct find_context *ctx, enum action action, int index,
+            const struct rbh_filter *filter)
+{
+    struct plan_action *plan;
+
+    plan = reallocarray(ctx->plan, ctx->plan_count + 1, sizeof(*plan));
+    if (plan == NULL)
+        error(EXIT_FAILURE, errno, "reallocarray");
+    ctx->plan = plan;
+
+    plan = &ctx->plan[ctx->plan_count++];
+    plan->action = action;
+    plan->index = index;
+    /* `filter' usually lives on parse_expression()'s stack */
+    plan->filter = filter_optimize(filter);
+    plan->evaluator = NULL;
+    plan->limit = action == ACT_QUIT ? 1 : ctx->limit;
+    plan->matched = 0;
+    plan->action_file = ctx->action_file;
+    plan->format = ctx->format;
+    plan->aggregate = ctx->aggregate;
+    plan->command = ctx->command;
+    plan->deletion = ctx->deletion;
+    plan->count = 0;
+
+    /* The next actions are not aggregating, unless they say otherwise */
+    ctx->aggregate = NULL;
+}
+
+/* `data' points at a bool set once a -quit action matched, after which no
+ * fsentry is dispatched anymore
+ */
+static size_t
+plan_dispatch(struct find_context *ctx, struct rbh_fsentry *fsentry,
+              void *data)
+{
+    bool *quit = data;
+    uint64_t start = 0;
+
+    if (*quit)
+        return 0;
+
+    if (ctx->stats != NULL)
+        start = stats_clock();
+
+    if (ctx->checkpoint != NULL)
+        checkpoint_see(ctx->checkpoint, fsentry);
+
+    for (size_t i = 0; i < ctx->plan_count; i++) {
+        struct plan_action *plan = &ctx->plan[i];
+
+        if (plan->limit && plan->matched == plan->limit)
+            continue;
+
+        if (!filter_evaluator_match(plan->evaluator, fsentry))
+            continue;
+
+        plan->matched++;
+
+        ctx->action_file = plan->action_file;
+        ctx->format = plan->format;
+        ctx->aggregate = plan->aggregate;
+        ctx->command = plan->command;
+        ctx->deletion = plan->deletion;
+        plan->count += ctx->exec_action_callback(ctx, plan->action, fsentry);
+
+        /* The actions after -quit are not executed on this fsentry either */
+        if (plan->action == ACT_QUIT) {
+            *quit = true;
+            break;
+        }
+    }
+
+    if (ctx->stats != NULL)
+        stats_exec(ctx, start, 1);
+
+    return 1;
+}
+
+/* The number of bytes the recorded actions wrote so far */
+static uint64_t
+plan_written(struct find_context *ctx)
+{
+    uint64_t total = output_total(ctx->output);
+
+    for (size_t i = 0; i < ctx->plan_count; i++)
+        total += output_total(ctx->plan[i].action_file);
+
+    return total;
+}
+
+static void
+plan_post_action(struct find_context *ctx, struct plan_action *plan)
+{
+    ctx->action_file = plan->action_file;
+    ctx->format = plan->format;
+    ctx->aggregate = plan->aggregate;
+    ctx->command = plan->command;
+    ctx->deletion = plan->deletion;
+    ctx->post_action_callback(ctx, plan->index, plan->action, plan->count);
+}
+
+void
+find_plan_run(struct find_context *ctx, const struct rbh_filter_sort *sorts,
+              size_t sorts_count)
+{
+    struct rbh_filter_options options = {
         .sort = {
             .items = sorts,
             .count = sorts_count
         },
     };
-    struct rbh_mut_iterator *fsentries;
-    size_t count = 0;
+    struct rbh_filter disjunction = {
+        .op = RBH_FOP_OR,
+    };
+    const struct rbh_filter **filters;
+    struct rbh_filter *filter;
+    bool thread_safe, quit = false;
+    uint64_t written = 0;
 
-    fsentries = rbh_backend_filter(ctx->backends[backend_index], filter,
-                                   &OPTIONS);
-    if (fsentries == NULL)
-        error_at_line(EXIT_FAILURE, errno, __FILE__, __LINE__,
-                      "filter_fsentries");
+    if (ctx->plan_count == 0)
+        return;
 
-    do {
-        struct rbh_fsentry *fsentry;
+    filters = malloc(sizeof(*filters) * ctx->plan_count);
+    if (filters == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
 
-        do {
-            errno = 0;
-            fsentry = rbh_mut_iter_next(fsentries);
-        } while (fsentry == NULL && errno == EAGAIN);
+    for (size_t i = 0; i < ctx->plan_count; i++) {
+        struct plan_action *plan = &ctx->plan[i];
+        struct rbh_filter_projection projection;
 
-        if (fsentry == NULL)
-            break;
+        /* The projection of an action may depend on how it was prepared */
+        ctx->action_file = plan->action_file;
+        ctx->format = plan->format;
+        ctx->aggregate = plan->aggregate;
+        ctx->command = plan->command;
+        ctx->deletion = plan->deletion;
+        find_projection(ctx, plan->action, plan->filter, sorts, sorts_count,
+                        &projection);
+        options.projection.fsentry_mask |= projection.fsentry_mask;
+        options.projection.statx_mask |= projection.statx_mask;
 
-        count += ctx->exec_action_callback(ctx, action, fsentry);
-        free(fsentry);
-    } while (true);
+        plan->evaluator = filter_evaluator_new(plan->filter);
+        filters[i] = plan->filter;
+    }
+    disjunction.logical.filters = filters;
+    disjunction.logical.count = ctx->plan_count;
+    /* With several actions, the limit of one does not bound the others */
+    if (ctx->plan_count == 1)
+        options.limit = ctx->plan[0].limit;
 
-    if (errno != ENODATA)
-        error_at_line(EXIT_FAILURE, errno, __FILE__, __LINE__,
-                      "rbh_mut_iter_next");
+    /* This also drops the guards an action's filter shares with the filters
+     * of the actions before it.
+     */
+    filter = find_optimize(ctx, &disjunction);
+    free(filters);
 
-    rbh_mut_iter_destroy(fsentries);
+    if (ctx->debug & DEBUG_TREE) {
+        fprintf(stderr, "%s:\n", option2str(OPT_SINGLE_SCAN));
+        filter_dump(stderr, filter, 1);
+    }
+    if (ctx->debug & DEBUG_PROJECTION) {
+        fprintf(stderr, "%s: ", option2str(OPT_SINGLE_SCAN));
+        projection_dump(stderr, &options.projection);
+    }
 
-    return count;
+    if (ctx->explain) {
+        find_explain(ctx, option2str(OPT_SINGLE_SCAN), filter, &options,
+                     false);
+    } else {
+        if (ctx->stats != NULL) {
+            find_stats_begin(ctx->stats, option2str(OPT_SINGLE_SCAN),
+                             ctx->backend_count);
+            written = plan_written(ctx);
+        }
+
+        /* plan_dispatch() switches the context from one action to the next,
+         * and the evaluators of each action are shared: it may only run from
+         * one thread at a time, whatever `exec_action_callback' allows
+         */
+        thread_safe = ctx->exec_action_thread_safe;
+        ctx->exec_action_thread_safe = false;
+        backends_foreach(ctx, filter, &options, plan_dispatch, &quit);
+        ctx->exec_action_thread_safe = thread_safe;
+
+        if (ctx->stats != NULL)
+            find_stats_end(ctx->stats, plan_written(ctx) - written);
+        if (ctx->checkpoint != NULL)
+            checkpoint_save(ctx->checkpoint);
+    }
+    filter_optimized_free(filter);
+
+    /* -quit exits from its post action, which must therefore come after the
+     * post actions of every other action
+     */
+    for (size_t i = 0; i < ctx->plan_count; i++) {
+        if (ctx->plan[i].action != ACT_QUIT)
+            plan_post_action(ctx, &ctx->plan[i]);
+    }
+    for (size_t i = 0; i < ctx->plan_count; i++) {
+        if (ctx->plan[i].action == ACT_QUIT)
+            plan_post_action(ctx, &ctx->plan[i]);
+    }
+
+    plan_clear(ctx);
 }
 
 void
@@ -119,31 +673,238 @@ find(struct find_context *ctx, enum action action, int *arg_idx,
      const struct rbh_filter *filter, const struct rbh_filter_sort *sorts,
      size_t sorts_count)
 {
+    struct rbh_filter_options options;
+    struct rbh_filter *optimized;
     int i = *arg_idx;
-    size_t count = 0;
+    uint64_t written;
+    size_t count;
 
     ctx->action_done = true;
 
     i += ctx->pre_action_callback(ctx, i, action);
 
-    for (size_t i = 0; i < ctx->backend_count; i++)
-        count += _find(ctx, i, action, filter, sorts, sorts_count);
+    if (ctx->single_scan) {
+        plan_append(ctx, action, i, filter);
+        *arg_idx = i;
+        return;
+    }
+
+    optimized = find_optimize(ctx, filter);
+    if (ctx->debug & DEBUG_TREE) {
+        fprintf(stderr, "%s:\n", action2str(action));
+        filter_dump(stderr, optimized, 1);
+    }
 
+    find_options(ctx, action, optimized, sorts, sorts_count, &options);
+
+    if (ctx->explain) {
+        find_explain(ctx, action2str(action), optimized, &options,
+                     ctx->aggregate != NULL);
+        filter_optimized_free(optimized);
+        ctx->post_action_callback(ctx, i, action, 0);
+        *arg_idx = i;
+        return;
+    }
+
+    written = stats_begin(ctx, action2str(action));
+    if (ctx->aggregate != NULL)
+        count = backends_aggregate(ctx, action, optimized, &options);
+    else
+        count = backends_foreach_batch(ctx, optimized, &options, exec_batch,
+                                       &action);
+    filter_optimized_free(optimized);
+
+    /* Before the post action, which may close the action's file or exit */
+    stats_end(ctx, written);
+    if (ctx->checkpoint != NULL)
+        checkpoint_save(ctx->checkpoint);
     ctx->post_action_callback(ctx, i, action, count);
 
     *arg_idx = i;
 }
 
+static const struct {
+    const char *name;
+    enum debug_option option;
+} DEBUG_OPTIONS[] = {
+    { "projection",     DEBUG_PROJECTION },
+    { "tree",           DEBUG_TREE },
+};
+
+static void
+parse_debug_options(struct find_context *ctx, const char *_options)
+{
+    const char *options = _options;
+
+    do {
+        size_t length = strchrnul(options, ',') - options;
+        size_t i;
+
+        for (i = 0; i < sizeof(DEBUG_OPTIONS) / sizeof(*DEBUG_OPTIONS); i++) {
+            if (strlen(DEBUG_OPTIONS[i].name) == length &&
+                strncmp(options, DEBUG_OPTIONS[i].name, length) == 0)
+                break;
+        }
+        if (i == sizeof(DEBUG_OPTIONS) / sizeof(*DEBUG_OPTIONS))
+            error(EX_USAGE, 0, "invalid argument `%s' to `-D'", _options);
+
+        ctx->debug |= DEBUG_OPTIONS[i].option;
+        options += length;
+    } while (*options++ == ',');
+}
+
+/**
+ * Parse an option and its arguments
+ *
+ * @param ctx       find's context for this execution
+ * @param index     the command line index of the option token
+ *
+ * @return          the number of arguments the option consumed
+ */
+static int
+parse_option(struct find_context *ctx, int index)
+{
+    enum option option = str2option(ctx->argv[index]);
+    uint64_t limit;
+
+    switch (option) {
+    case OPT_BATCH_SIZE:
+        if (index + 1 >= ctx->argc)
+            error(EX_USAGE, 0, "missing argument to `%s'", option2str(option));
+        if (str2uint64_t(ctx->argv[index + 1], &limit) || limit == 0 ||
+            limit > SIZE_MAX / sizeof(struct rbh_fsentry *))
+            error(EX_USAGE, 0, "invalid argument `%s' to `%s'",
+                  ctx->argv[index + 1], option2str(option));
+        ctx->batch_size = limit;
+        return 1;
+    case OPT_CACHE:
+        if (index + 1 >= ctx->argc)
+            error(EX_USAGE, 0, "missing argument to `%s'", option2str(option));
+        if (str2uint64_t(ctx->argv[index + 1], &limit) || limit == 0 ||
+            limit > INT64_MAX)
+            error(EX_USAGE, 0, "invalid argument `%s' to `%s'",
+                  ctx->argv[index + 1], option2str(option));
+        if (ctx->cache == NULL)
+            ctx->cache = result_cache_new(NULL, limit);
+        else
+            ctx->cache->ttl = limit;
+        return 1;
+    case OPT_DEBUG:
+        if (index + 1 >= ctx->argc)
+            error(EX_USAGE, 0, "missing argument to `%s'", option2str(option));
+        parse_debug_options(ctx, ctx->argv[index + 1]);
+        return 1;
+    case OPT_EXPLAIN:
+        ctx->explain = true;
+        return 0;
+    case OPT_GROUP_BY:
+        if (index + 1 >= ctx->argc)
+            error(EX_USAGE, 0, "missing argument to `%s'", option2str(option));
+        ctx->group_by = str2field(ctx->argv[index + 1]);
+        if (ctx->group_by.fsentry != RBH_FP_STATX)
+            error(EX_USAGE, 0, "invalid argument `%s' to `%s'",
+                  ctx->argv[index + 1], option2str(option));
+        ctx->grouped = true;
+        return 1;
+    case OPT_JOBS:
+        if (index + 1 >= ctx->argc)
+            error(EX_USAGE, 0, "missing argument to `%s'", option2str(option));
+        if (str2uint64_t(ctx->argv[index + 1], &limit) || limit == 0 ||
+            limit > 1024)
+            error(EX_USAGE, 0, "invalid argument `%s' to `%s'",
+                  ctx->argv[index + 1], option2str(option));
+        ctx->jobs = limit;
+        return 1;
+    case OPT_LIMIT:
+        if (index + 1 >= ctx->argc)
+            error(EX_USAGE, 0, "missing argument to `%s'", option2str(option));
+        if (str2uint64_t(ctx->argv[index + 1], &limit) || limit == 0)
+            error(EX_USAGE, 0, "invalid argument `%s' to `%s'",
+                  ctx->argv[index + 1], option2str(option));
+        ctx->limit = limit;
+        return 1;
+    case OPT_MOUNT_ROOT:
+        if (index + 1 >= ctx->argc)
+            error(EX_USAGE, 0, "missing argument to `%s'", option2str(option));
+        if (ctx->argv[index + 1][0] == '\0')
+            error(EX_USAGE, 0, "invalid argument `%s' to `%s'",
+                  ctx->argv[index + 1], option2str(option));
+        ctx->mount_root = ctx->argv[index + 1];
+        return 1;
+    case OPT_PARTITION:
+        if (index + 2 >= ctx->argc)
+            error(EX_USAGE, 0, "missing argument to `%s'", option2str(option));
+        ctx->partition_field = str2field(ctx->argv[index + 1]);
+        if (ctx->partition_field.fsentry != RBH_FP_STATX)
+            error(EX_USAGE, 0, "invalid argument `%s' to `%s'",
+                  ctx->argv[index + 1], option2str(option));
+        if (str2uint64_t(ctx->argv[index + 2], &limit) || limit > 1024)
+            error(EX_USAGE, 0, "invalid argument `%s' to `%s'",
+                  ctx->argv[index + 2], option2str(option));
+        ctx->partition_count = limit;
+        return 2;
+    case OPT_PREFETCH:
+        if (index + 1 >= ctx->argc)
+            error(EX_USAGE, 0, "missing argument to `%s'", option2str(option));
+        if (str2uint64_t(ctx->argv[index + 1], &limit) || limit > 1024)
+            error(EX_USAGE, 0, "invalid argument `%s' to `%s'",
+                  ctx->argv[index + 1], option2str(option));
+        ctx->prefetch = limit;
+        return 1;
+    case OPT_PREFETCH_IDS:
+        idcache_prefetch();
+        return 0;
+    case OPT_SAMPLE:
+        if (index + 1 >= ctx->argc)
+            error(EX_USAGE, 0, "missing argument to `%s'", option2str(option));
+        if (str2sample_rate(ctx->argv[index + 1], &ctx->sample))
+            error(EX_USAGE, 0, "invalid argument `%s' to `%s'",
+                  ctx->argv[index + 1], option2str(option));
+        /* Sampling everything is not sampling */
+        if (ctx->sample == 1)
+            ctx->sample = 0;
+        return 1;
+    case OPT_SINCE_CHECKPOINT:
+        if (index + 1 >= ctx->argc)
+            error(EX_USAGE, 0, "missing argument to `%s'", option2str(option));
+        if (ctx->argv[index + 1][0] == '\0')
+            error(EX_USAGE, 0, "invalid argument `%s' to `%s'",
+                  ctx->argv[index + 1], option2str(option));
+        /* The previous checkpoint was saved by the actions that used it */
+        if (ctx->checkpoint != NULL)
+            checkpoint_destroy(ctx->checkpoint);
+        ctx->checkpoint = checkpoint_new(ctx->argv[index + 1]);
+        return 1;
+    case OPT_SINGLE_SCAN:
+        ctx->single_scan = true;
+        return 0;
+    case OPT_STATS:
+        if (index + 1 >= ctx->argc)
+            error(EX_USAGE, 0, "missing argument to `%s'", option2str(option));
+        if (ctx_enable_stats(ctx, ctx->argv[index + 1]))
+            error(EX_USAGE, 0, "invalid argument `%s' to `%s'",
+                  ctx->argv[index + 1], option2str(option));
+        return 1;
+    case OPT_UNORDERED:
+        ctx->unordered = true;
+        return 0;
+    }
+
+    __builtin_unreachable();
+}
+
 struct rbh_filter *
 parse_expression(struct find_context *ctx, int *arg_idx,
                  const struct rbh_filter *_filter,
                  struct rbh_filter_sort **sorts, size_t *sorts_count)
 {
-    static enum command_line_token token = CLT_URI;
     struct rbh_filter *filter = NULL;
     bool negate = false;
     int i;
 
+    if (ctx->filters == NULL)
+        ctx->filters = filter_arena_new();
+
     for (i = *arg_idx; i < ctx->argc; i++) {
         const struct rbh_filter *left_filters[2] = {filter, _filter};
         const struct rbh_filter left_filter = {
@@ -161,12 +922,12 @@ parse_expression(struct find_context *ctx, int *arg_idx,
                 .count = 1,
             },
         };
-        enum command_line_token previous_token = token;
+        enum command_line_token previous_token = ctx->token;
         struct rbh_filter *tmp;
         bool ascending = true;
 
-        token = str2command_line_token(ctx, ctx->argv[i]);
-        switch (token) {
+        ctx->token = str2command_line_token(ctx, ctx->argv[i]);
+        switch (ctx->token) {
         case CLT_URI:
             error(EX_USAGE, 0, "paths must preceed expression: %s",
                   ctx->argv[i]);
@@ -185,7 +946,7 @@ parse_expression(struct find_context *ctx, int *arg_idx,
             }
 
             /* No further processing needed for CLT_AND */
-            if (token == CLT_AND)
+            if (ctx->token == CLT_AND)
                 break;
 
             /* The -o/-or operator is tricky to implement!
@@ -221,7 +982,7 @@ parse_expression(struct find_context *ctx, int *arg_idx,
             /* "OR" the part of the left filter we parsed ourselves (ie. not
              * `_filter') and the right filter.
             */
-            filter = filter_or(filter, tmp);
+            filter = filter_or(ctx->filters, filter, tmp);
 
             /* Update arg_idx and return */
             *arg_idx = i;
@@ -235,18 +996,18 @@ parse_expression(struct find_context *ctx, int *arg_idx,
 
             /* Parse the sub-expression */
             tmp = parse_expression(ctx, &i, &left_filter, sorts, sorts_count);
-            if (i >= ctx->argc || token != CLT_PARENTHESIS_CLOSE)
+            if (i >= ctx->argc || ctx->token != CLT_PARENTHESIS_CLOSE)
                 error(EX_USAGE, 0,
                       "invalid expression; I was expecting to find a ')' somewhere but did not see one.");
 
             /* Negate the sub-expression's filter, if need be */
             if (negate) {
-                tmp = filter_not(tmp);
+                tmp = filter_not(ctx->filters, tmp);
                 negate = false;
             }
 
             /* Build the resulting filter and continue */
-            filter = filter_and(filter, tmp);
+            filter = filter_and(ctx->filters, filter, tmp);
             break;
         case CLT_PARENTHESIS_CLOSE:
             if (previous_token == CLT_PARENTHESIS_OPEN)
@@ -268,13 +1029,19 @@ parse_expression(struct find_context *ctx, int *arg_idx,
             break;
         case CLT_PREDICATE:
             /* Build a filter from the predicate and its arguments */
-            tmp = ctx->parse_predicate_callback(ctx, &i);
+            tmp = filter_adopt(ctx->filters,
+                               ctx->parse_predicate_callback(ctx, &i));
             if (negate) {
-                tmp = filter_not(tmp);
+                tmp = filter_not(ctx->filters, tmp);
                 negate = false;
             }
 
-            filter = filter_and(filter, tmp);
+            filter = filter_and(ctx->filters, filter, tmp);
+            break;
+        case CLT_OPTION:
+            i += parse_option(ctx, i);
+            /* Options are not part of the expression */
+            ctx->token = previous_token;
             break;
         case CLT_ACTION:
             ctx->action_done = true;
@@ -0,0 +1,448 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <error.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include "rbh-find/actions.h"
+#include "rbh-find/delete.h"
+#include "rbh-find/utils.h"
+
+/*----------------------------------------------------------------------------*
+ |                               directory cache                              |
+ *----------------------------------------------------------------------------*/
+
+/* Fsentries mostly come directory after directory, a small direct-mapped cache
+ * is enough to open each directory about once
+ */
+#define DIR_CACHE_SIZE 256
+
+struct dir_cache {
+    struct {
+        char *path;
+        size_t length;
+        int fd;
+    } slots[DIR_CACHE_SIZE];
+};
+
+static void
+dir_cache_init(struct dir_cache *cache)
+{
+    for (size_t i = 0; i < DIR_CACHE_SIZE; i++) {
+        cache->slots[i].path = NULL;
+        cache->slots[i].fd = -1;
+    }
+}
+
+static void
+dir_cache_clear(struct dir_cache *cache)
+{
+    for (size_t i = 0; i < DIR_CACHE_SIZE; i++) {
+        free(cache->slots[i].path);
+        if (cache->slots[i].fd >= 0)
+            close(cache->slots[i].fd);
+    }
+    dir_cache_init(cache);
+}
+
+static size_t
+dir_cache_slot(const char *path, size_t length)
+{
+    uint64_t hash = UINT64_C(0xcbf29ce484222325);
+
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)path[i];
+        hash *= UINT64_C(0x100000001b3);
+    }
+
+    return hash % DIR_CACHE_SIZE;
+}
+
+/* Return a file descriptor of the directory at the first \p length bytes of
+ * \p path, relative to \p root, or -1 and set errno. Each component is opened
+ * relative to its parent, without following symbolic links.
+ */
+static int
+dir_cache_open(struct dir_cache *cache, int root, const char *path,
+               size_t length)
+{
+    size_t slot = dir_cache_slot(path, length);
+    size_t parent_length = length;
+    char *name;
+    int parent;
+    int fd;
+
+    if (length == 0)
+        return root;
+
+    if (cache->slots[slot].path != NULL && cache->slots[slot].length == length
+            && memcmp(cache->slots[slot].path, path, length) == 0)
+        return cache->slots[slot].fd;
+
+    while (parent_length > 0 && path[parent_length - 1] != '/')
+        parent_length--;
+
+    /* Caching `fd' may evict and close `parent', which is only used before */
+    parent = dir_cache_open(cache, root, path,
+                            parent_length > 0 ? parent_length - 1 : 0);
+    if (parent < 0)
+        return -1;
+
+    name = strndup(&path[parent_length], length - parent_length);
+    if (name == NULL)
+        error(EXIT_FAILURE, errno, "strndup");
+
+    fd = openat(parent, name,
+                O_PATH | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    free(name);
+    if (fd < 0)
+        return -1;
+
+    free(cache->slots[slot].path);
+    if (cache->slots[slot].fd >= 0)
+        close(cache->slots[slot].fd);
+
+    cache->slots[slot].path = strndup(path, length);
+    if (cache->slots[slot].path == NULL)
+        error(EXIT_FAILURE, errno, "strndup");
+    cache->slots[slot].length = length;
+    cache->slots[slot].fd = fd;
+
+    return fd;
+}
+
+/*----------------------------------------------------------------------------*
+ |                                  deletion                                  |
+ *----------------------------------------------------------------------------*/
+
+/* How many paths workers may be behind on, and take from the queue at once */
+#define QUEUE_CAPACITY 4096
+#define CHUNK_SIZE 64
+
+struct removal {
+    char *path;
+    bool directory;
+};
+
+struct deletion_worker {
+    struct deletion *deletion;
+    pthread_t thread;
+    struct dir_cache cache;
+};
+
+struct deletion {
+    char *root_path;
+    int root;
+
+    /* What fsentries are removed with when there is a single job */
+    struct dir_cache cache;
+
+    /* A ring buffer of removals, protected by `lock' */
+    struct removal *queue;
+    size_t head;
+    size_t count;
+    /* How many removals workers took from the queue but did not finish */
+    size_t busy;
+    bool done;
+
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    pthread_cond_t drained;
+
+    size_t worker_count;
+    struct deletion_worker *workers;
+
+    /* Removed by deletion_finish() */
+    struct removal *directories;
+    size_t directory_count;
+
+    size_t failures;
+};
+
+static void
+removal_run(struct deletion *deletion, struct dir_cache *cache,
+            const struct removal *removal)
+{
+    const char *path = removal->path;
+    const char *name = strrchr(path, '/');
+    char *local;
+    int parent;
+
+    if (name == NULL) {
+        parent = deletion->root;
+        name = path;
+    } else {
+        parent = dir_cache_open(cache, deletion->root, path, name - path);
+        name++;
+    }
+
+    if (parent >= 0 &&
+        unlinkat(parent, name, removal->directory ? AT_REMOVEDIR : 0) == 0)
+        return;
+
+    /* What is gone need not be deleted */
+    if (errno == ENOENT)
+        return;
+
+    local = path_under_root(deletion->root_path, path, strlen(path));
+    error(0, errno, "cannot delete `%s'", local);
+    free(local);
+
+    __atomic_fetch_add(&deletion->failures, 1, __ATOMIC_RELAXED);
+}
+
+static void *
+deletion_worker_run(void *_worker)
+{
+    struct deletion_worker *worker = _worker;
+    struct deletion *deletion = worker->deletion;
+    struct removal chunk[CHUNK_SIZE];
+    size_t count;
+
+    while (true) {
+        pthread_mutex_lock(&deletion->lock);
+        while (deletion->count == 0 && !deletion->done)
+            pthread_cond_wait(&deletion->not_empty, &deletion->lock);
+
+        if (deletion->count == 0) {
+            pthread_mutex_unlock(&deletion->lock);
+            break;
+        }
+
+        for (count = 0; count < CHUNK_SIZE && deletion->count > 0; count++) {
+            chunk[count] = deletion->queue[deletion->head];
+            deletion->head = (deletion->head + 1) % QUEUE_CAPACITY;
+            deletion->count--;
+        }
+        deletion->busy += count;
+        pthread_cond_broadcast(&deletion->not_full);
+        pthread_mutex_unlock(&deletion->lock);
+
+        for (size_t i = 0; i < count; i++) {
+            removal_run(deletion, &worker->cache, &chunk[i]);
+            free(chunk[i].path);
+        }
+
+        pthread_mutex_lock(&deletion->lock);
+        deletion->busy -= count;
+        if (deletion->busy == 0 && deletion->count == 0)
+            pthread_cond_broadcast(&deletion->drained);
+        pthread_mutex_unlock(&deletion->lock);
+    }
+
+    dir_cache_clear(&worker->cache);
+    return NULL;
+}
+
+struct deletion *
+deletion_new(const char *root, size_t jobs)
+{
+    struct deletion *deletion;
+    int rc;
+
+    deletion = calloc(1, sizeof(*deletion));
+    if (deletion == NULL)
+        error(EXIT_FAILURE, errno, "calloc");
+
+    deletion->root_path = strdup(root);
+    if (deletion->root_path == NULL)
+        error(EXIT_FAILURE, errno, "strdup");
+
+    deletion->root = open(root, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (deletion->root < 0)
+        error(EXIT_FAILURE, errno, "open: %s", root);
+
+    dir_cache_init(&deletion->cache);
+
+    /* A single job deletes fsentries from the calling thread */
+    if (jobs <= 1)
+        return deletion;
+
+    deletion->queue = malloc(QUEUE_CAPACITY * sizeof(*deletion->queue));
+    if (deletion->queue == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+
+    pthread_mutex_init(&deletion->lock, NULL);
+    pthread_cond_init(&deletion->not_empty, NULL);
+    pthread_cond_init(&deletion->not_full, NULL);
+    pthread_cond_init(&deletion->drained, NULL);
+
+    deletion->workers = calloc(jobs, sizeof(*deletion->workers));
+    if (deletion->workers == NULL)
+        error(EXIT_FAILURE, errno, "calloc");
+
+    for (size_t i = 0; i < jobs; i++) {
+        struct deletion_worker *worker = &deletion->workers[i];
+
+        worker->deletion = deletion;
+        dir_cache_init(&worker->cache);
+        rc = pthread_create(&worker->thread, NULL, deletion_worker_run, worker);
+        if (rc)
+            error(EXIT_FAILURE, rc, "pthread_create");
+        deletion->worker_count++;
+    }
+
+    return deletion;
+}
+
+/* Take ownership of `removal->path' */
+static void
+deletion_push(struct deletion *deletion, const struct removal *removal)
+{
+    if (deletion->worker_count == 0) {
+        removal_run(deletion, &deletion->cache, removal);
+        free(removal->path);
+        return;
+    }
+
+    pthread_mutex_lock(&deletion->lock);
+    while (deletion->count == QUEUE_CAPACITY)
+        pthread_cond_wait(&deletion->not_full, &deletion->lock);
+
+    deletion->queue[(deletion->head + deletion->count) % QUEUE_CAPACITY] =
+        *removal;
+    deletion->count++;
+    pthread_cond_signal(&deletion->not_empty);
+    pthread_mutex_unlock(&deletion->lock);
+}
+
+/* Wait for the workers to be done with every removal pushed so far */
+static void
+deletion_drain(struct deletion *deletion)
+{
+    if (deletion->worker_count == 0)
+        return;
+
+    pthread_mutex_lock(&deletion->lock);
+    while (deletion->count > 0 || deletion->busy > 0)
+        pthread_cond_wait(&deletion->drained, &deletion->lock);
+    pthread_mutex_unlock(&deletion->lock);
+}
+
+void
+deletion_add(struct deletion *deletion, const struct rbh_fsentry *fsentry)
+{
+    const char *path = fsentry_path(fsentry);
+    struct removal removal;
+    void *tmp;
+
+    if (path == NULL) {
+        error(0, 0, "cannot delete an entry without a path");
+        __atomic_fetch_add(&deletion->failures, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    /* Like find, which does not delete its starting points */
+    if (strspn(path, "/") == strlen(path))
+        return;
+
+    removal.path = strdup(path);
+    if (removal.path == NULL)
+        error(EXIT_FAILURE, errno, "strdup");
+    removal.directory = fsentry->mask & RBH_FP_STATX &&
+                        fsentry->statx->stx_mask & RBH_STATX_TYPE &&
+                        S_ISDIR(fsentry->statx->stx_mode);
+
+    if (!removal.directory) {
+        deletion_push(deletion, &removal);
+        return;
+    }
+
+    tmp = reallocarray(deletion->directories, deletion->directory_count + 1,
+                       sizeof(*deletion->directories));
+    if (tmp == NULL)
+        error(EXIT_FAILURE, errno, "reallocarray");
+    deletion->directories = tmp;
+    deletion->directories[deletion->directory_count++] = removal;
+}
+
+static size_t
+path_depth(const char *path)
+{
+    size_t depth = 0;
+
+    for (; *path != '\0'; path++)
+        depth += *path == '/';
+
+    return depth;
+}
+
+static int
+removal_deeper(const void *_first, const void *_second)
+{
+    const struct removal *first = _first;
+    const struct removal *second = _second;
+    size_t first_depth = path_depth(first->path);
+    size_t second_depth = path_depth(second->path);
+
+    return first_depth > second_depth ? -1 : first_depth < second_depth;
+}
+
+size_t
+deletion_finish(struct deletion *deletion)
+{
+    size_t depth = SIZE_MAX;
+    size_t failures;
+    int rc;
+
+    /* Directories are removed depth after depth, so that they are empty */
+    deletion_drain(deletion);
+    qsort(deletion->directories, deletion->directory_count,
+          sizeof(*deletion->directories), removal_deeper);
+    for (size_t i = 0; i < deletion->directory_count; i++) {
+        struct removal *directory = &deletion->directories[i];
+
+        if (path_depth(directory->path) != depth) {
+            deletion_drain(deletion);
+            depth = path_depth(directory->path);
+        }
+        deletion_push(deletion, directory);
+    }
+    free(deletion->directories);
+
+    if (deletion->worker_count > 0) {
+        pthread_mutex_lock(&deletion->lock);
+        deletion->done = true;
+        pthread_cond_broadcast(&deletion->not_empty);
+        pthread_mutex_unlock(&deletion->lock);
+
+        for (size_t i = 0; i < deletion->worker_count; i++) {
+            rc = pthread_join(deletion->workers[i].thread, NULL);
+            if (rc)
+                error(EXIT_FAILURE, rc, "pthread_join");
+        }
+        free(deletion->workers);
+        free(deletion->queue);
+
+        pthread_cond_destroy(&deletion->drained);
+        pthread_cond_destroy(&deletion->not_full);
+        pthread_cond_destroy(&deletion->not_empty);
+        pthread_mutex_destroy(&deletion->lock);
+    }
+
+    dir_cache_clear(&deletion->cache);
+    close(deletion->root);
+    free(deletion->root_path);
+
+    failures = deletion->failures;
+    free(deletion);
+    return failures;
+}
@@ -0,0 +1,904 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <error.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+
+#include <robinhood/statx.h>
+
+#include "rbh-find/evaluator.h"
+#include "rbh-find/filters.h"
+
+struct integer {
+    bool negative;
+    uint64_t magnitude;
+};
+
+/* A comparison filter, prepared to be evaluated */
+struct comparison {
+    const struct rbh_filter *filter;
+    /* Only set for RBH_FOP_REGEX, shared with other evaluators */
+    pcre2_code *regex;
+    /* Whether the filter's value is an integer, and which */
+    bool is_integer;
+    struct integer integer;
+
+    /* The result of the comparison for the fsentry being matched, only valid
+     * if `generation' is the evaluator's
+     */
+    unsigned int generation;
+    bool result;
+};
+
+/* Filters are compiled into a program that computes a single boolean, with
+ * conditional jumps to short-circuit logical operators.
+ */
+enum opcode {
+    OP_TRUE,            /* result = true */
+    OP_FALSE,           /* result = false */
+    OP_COMPARE,         /* result = comparisons[operand] matches */
+    OP_NOT,             /* result = !result */
+    OP_JUMP_IF_FALSE,   /* if (!result) goto operand */
+    OP_JUMP_IF_TRUE,    /* if (result) goto operand */
+};
+
+struct instruction {
+    enum opcode opcode;
+    size_t operand;
+};
+
+struct filter_evaluator {
+    struct instruction *program;
+    size_t length;
+
+    /* Comparisons that appear several times in a filter (the rewrite of
+     * "A -o B" into "A -o (! A -a B)" does that) are only stored once.
+     */
+    struct comparison *comparisons;
+    size_t comparison_count;
+    unsigned int generation;
+
+    pcre2_match_data *match_data;
+};
+
+/*----------------------------------------------------------------------------*
+ |                             fsentry field values                           |
+ *----------------------------------------------------------------------------*/
+
+static bool
+statx_field_value(const struct rbh_statx *statx, uint32_t field,
+                  struct rbh_value *value)
+{
+    if (!(statx->stx_mask & field))
+        return false;
+
+    value->type = RBH_VT_UINT64;
+    switch (field) {
+    case RBH_STATX_TYPE:
+        value->uint64 = statx->stx_mode & S_IFMT;
+        break;
+    case RBH_STATX_MODE:
+        value->uint64 = statx->stx_mode & ~S_IFMT;
+        break;
+    case RBH_STATX_NLINK:
+        value->uint64 = statx->stx_nlink;
+        break;
+    case RBH_STATX_UID:
+        value->uint64 = statx->stx_uid;
+        break;
+    case RBH_STATX_GID:
+        value->uint64 = statx->stx_gid;
+        break;
+    case RBH_STATX_INO:
+        value->uint64 = statx->stx_ino;
+        break;
+    case RBH_STATX_SIZE:
+        value->uint64 = statx->stx_size;
+        break;
+    case RBH_STATX_BLOCKS:
+        value->uint64 = statx->stx_blocks;
+        break;
+    case RBH_STATX_BLKSIZE:
+        value->uint64 = statx->stx_blksize;
+        break;
+    case RBH_STATX_ATTRIBUTES:
+        value->uint64 = statx->stx_attributes;
+        break;
+    case RBH_STATX_ATIME_SEC:
+        value->type = RBH_VT_INT64;
+        value->int64 = statx->stx_atime.tv_sec;
+        break;
+    case RBH_STATX_BTIME_SEC:
+        value->type = RBH_VT_INT64;
+        value->int64 = statx->stx_btime.tv_sec;
+        break;
+    case RBH_STATX_CTIME_SEC:
+        value->type = RBH_VT_INT64;
+        value->int64 = statx->stx_ctime.tv_sec;
+        break;
+    case RBH_STATX_MTIME_SEC:
+        value->type = RBH_VT_INT64;
+        value->int64 = statx->stx_mtime.tv_sec;
+        break;
+    case RBH_STATX_ATIME_NSEC:
+        value->uint64 = statx->stx_atime.tv_nsec;
+        break;
+    case RBH_STATX_BTIME_NSEC:
+        value->uint64 = statx->stx_btime.tv_nsec;
+        break;
+    case RBH_STATX_CTIME_NSEC:
+        value->uint64 = statx->stx_ctime.tv_nsec;
+        break;
+    case RBH_STATX_MTIME_NSEC:
+        value->uint64 = statx->stx_mtime.tv_nsec;
+        break;
+    case RBH_STATX_RDEV_MAJOR:
+        value->uint64 = statx->stx_rdev_major;
+        break;
+    case RBH_STATX_RDEV_MINOR:
+        value->uint64 = statx->stx_rdev_minor;
+        break;
+    case RBH_STATX_DEV_MAJOR:
+        value->uint64 = statx->stx_dev_major;
+        break;
+    case RBH_STATX_DEV_MINOR:
+        value->uint64 = statx->stx_dev_minor;
+        break;
+    default:
+        return false;
+    }
+
+    return true;
+}
+
+/* Xattrs keys are dot separated paths into nested maps, "user.key" either
+ * names a pair whose key is "user.key" or the pair "key" of the map "user".
+ */
+static const struct rbh_value *
+value_map_find(const struct rbh_value_map *map, const char *key)
+{
+    for (size_t i = 0; i < map->count; i++) {
+        const struct rbh_value_pair *pair = &map->pairs[i];
+        size_t length = strlen(pair->key);
+        const struct rbh_value *value;
+
+        if (strncmp(key, pair->key, length))
+            continue;
+
+        if (key[length] == '\0')
+            return pair->value;
+
+        if (key[length] != '.' || pair->value == NULL ||
+            pair->value->type != RBH_VT_MAP)
+            continue;
+
+        value = value_map_find(&pair->value->map, key + length + 1);
+        if (value)
+            return value;
+    }
+
+    return NULL;
+}
+
+/* Whether \p key or any key under it exists */
+static bool
+value_map_has(const struct rbh_value_map *map, const char *key)
+{
+    size_t length = strlen(key);
+
+    if (value_map_find(map, key))
+        return true;
+
+    for (size_t i = 0; i < map->count; i++) {
+        const char *pair_key = map->pairs[i].key;
+
+        if (strncmp(pair_key, key, length) == 0 && pair_key[length] == '.')
+            return true;
+    }
+
+    return false;
+}
+
+static const struct rbh_value_map *
+fsentry_xattrs(const struct rbh_fsentry *fsentry,
+               enum rbh_fsentry_property property)
+{
+    if (!(fsentry->mask & property))
+        return NULL;
+
+    return property == RBH_FP_NAMESPACE_XATTRS ? &fsentry->xattrs.ns
+                                               : &fsentry->xattrs.inode;
+}
+
+const struct rbh_value *
+fsentry_field_value(const struct rbh_fsentry *fsentry,
+                    const struct rbh_filter_field *field,
+                    struct rbh_value *buffer)
+{
+    const struct rbh_value_map *xattrs;
+
+    if (!(fsentry->mask & field->fsentry))
+        return NULL;
+
+    switch (field->fsentry) {
+    case RBH_FP_ID:
+        buffer->type = RBH_VT_BINARY;
+        buffer->binary.data = fsentry->id.data;
+        buffer->binary.size = fsentry->id.size;
+        return buffer;
+    case RBH_FP_PARENT_ID:
+        buffer->type = RBH_VT_BINARY;
+        buffer->binary.data = fsentry->parent_id.data;
+        buffer->binary.size = fsentry->parent_id.size;
+        return buffer;
+    case RBH_FP_NAME:
+        buffer->type = RBH_VT_STRING;
+        buffer->string = fsentry->name;
+        return buffer;
+    case RBH_FP_SYMLINK:
+        buffer->type = RBH_VT_STRING;
+        buffer->string = fsentry->symlink;
+        return buffer;
+    case RBH_FP_STATX:
+        return statx_field_value(fsentry->statx, field->statx, buffer) ?
+            buffer : NULL;
+    case RBH_FP_NAMESPACE_XATTRS:
+    case RBH_FP_INODE_XATTRS:
+        xattrs = fsentry_xattrs(fsentry, field->fsentry);
+        if (field->xattr == NULL) {
+            buffer->type = RBH_VT_MAP;
+            buffer->map = *xattrs;
+            return buffer;
+        }
+        return value_map_find(xattrs, field->xattr);
+    }
+
+    return NULL;
+}
+
+/*----------------------------------------------------------------------------*
+ |                                 comparisons                                |
+ *----------------------------------------------------------------------------*/
+
+static bool
+value2integer(const struct rbh_value *value, struct integer *integer)
+{
+    int64_t signed_value;
+
+    switch (value->type) {
+    case RBH_VT_INT32:
+        signed_value = value->int32;
+        break;
+    case RBH_VT_INT64:
+        signed_value = value->int64;
+        break;
+    case RBH_VT_UINT32:
+        integer->negative = false;
+        integer->magnitude = value->uint32;
+        return true;
+    case RBH_VT_UINT64:
+        integer->negative = false;
+        integer->magnitude = value->uint64;
+        return true;
+    default:
+        return false;
+    }
+
+    integer->negative = signed_value < 0;
+    integer->magnitude = integer->negative ? -(uint64_t)signed_value
+                                           : (uint64_t)signed_value;
+    return true;
+}
+
+static int
+integer_compare(const struct integer *left, const struct integer *right)
+{
+    if (left->negative != right->negative)
+        return left->negative ? -1 : 1;
+
+    if (left->magnitude == right->magnitude)
+        return 0;
+
+    return (left->magnitude < right->magnitude) != left->negative ? -1 : 1;
+}
+
+/**
+ * Order two values
+ *
+ * @param left      a value
+ * @param right     another value
+ * @param order     where to store the result of the comparison: a negative
+ *                  integer if \p left < \p right, 0 if they are equal, and a
+ *                  positive integer otherwise
+ *
+ * @return          true if \p left and \p right can be compared, false
+ *                  otherwise
+ */
+static bool
+value_compare(const struct rbh_value *left, const struct rbh_value *right,
+              int *order)
+{
+    struct integer left_integer, right_integer;
+
+    if (value2integer(left, &left_integer)) {
+        if (!value2integer(right, &right_integer))
+            return false;
+
+        *order = integer_compare(&left_integer, &right_integer);
+        return true;
+    }
+
+    if (left->type != right->type)
+        return false;
+
+    switch (left->type) {
+    case RBH_VT_STRING:
+        if (left->string == NULL || right->string == NULL)
+            return false;
+        *order = strcmp(left->string, right->string);
+        return true;
+    case RBH_VT_BINARY:
+        if (left->binary.size != right->binary.size) {
+            *order = left->binary.size < right->binary.size ? -1 : 1;
+            return true;
+        }
+        *order = left->binary.size == 0 ? 0 :
+            memcmp(left->binary.data, right->binary.data, left->binary.size);
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool
+value_equals(const struct rbh_value *left, const struct rbh_value *right)
+{
+    int order;
+
+    return value_compare(left, right, &order) && order == 0;
+}
+
+static bool
+bits_match(enum rbh_filter_operator op, const struct rbh_value *value,
+           const struct rbh_value *_mask)
+{
+    struct integer integer, mask;
+    uint64_t bits;
+
+    if (!value2integer(value, &integer) || !value2integer(_mask, &mask))
+        return false;
+
+    bits = integer.negative ? -integer.magnitude : integer.magnitude;
+    bits &= mask.magnitude;
+
+    switch (op) {
+    case RBH_FOP_BITS_ANY_SET:
+        return bits != 0;
+    case RBH_FOP_BITS_ALL_SET:
+        return bits == mask.magnitude;
+    case RBH_FOP_BITS_ANY_CLEAR:
+        return bits != mask.magnitude;
+    case RBH_FOP_BITS_ALL_CLEAR:
+        return bits == 0;
+    default:
+        return false;
+    }
+}
+
+static bool
+regex_match(struct filter_evaluator *evaluator, const pcre2_code *regex,
+            const struct rbh_value *value)
+{
+    int rc;
+
+    if (value->type != RBH_VT_STRING || value->string == NULL)
+        return false;
+
+    rc = pcre2_match(regex, (PCRE2_SPTR)value->string, strlen(value->string),
+                     0, 0, evaluator->match_data, NULL);
+    if (rc < 0 && rc != PCRE2_ERROR_NOMATCH)
+        error(EXIT_FAILURE, 0, "pcre2_match: error %d", rc);
+
+    return rc >= 0;
+}
+
+static bool
+comparison_order(const struct comparison *comparison,
+                 const struct rbh_value *value, int *order)
+{
+    struct integer integer;
+
+    if (!comparison->is_integer)
+        return value_compare(value, &comparison->filter->compare.value,
+                             order);
+
+    if (!value2integer(value, &integer))
+        return false;
+
+    *order = integer_compare(&integer, &comparison->integer);
+    return true;
+}
+
+static bool
+comparison_match(struct filter_evaluator *evaluator,
+                 const struct comparison *comparison,
+                 const struct rbh_fsentry *fsentry)
+{
+    const struct rbh_filter *filter = comparison->filter;
+    const struct rbh_value *value;
+    struct rbh_value buffer;
+    int order;
+
+    if (filter->op == RBH_FOP_EXISTS) {
+        const struct rbh_value_map *xattrs;
+
+        switch (filter->compare.field.fsentry) {
+        case RBH_FP_NAMESPACE_XATTRS:
+        case RBH_FP_INODE_XATTRS:
+            xattrs = fsentry_xattrs(fsentry, filter->compare.field.fsentry);
+            if (xattrs == NULL)
+                return false;
+            if (filter->compare.field.xattr == NULL)
+                return true;
+            return value_map_has(xattrs, filter->compare.field.xattr);
+        default:
+            return fsentry_field_value(fsentry, &filter->compare.field,
+                                       &buffer) != NULL;
+        }
+    }
+
+    value = fsentry_field_value(fsentry, &filter->compare.field, &buffer);
+    if (value == NULL)
+        return false;
+
+    switch (filter->op) {
+    case RBH_FOP_EQUAL:
+        return comparison_order(comparison, value, &order) && order == 0;
+    case RBH_FOP_STRICTLY_LOWER:
+        return comparison_order(comparison, value, &order) && order < 0;
+    case RBH_FOP_LOWER_OR_EQUAL:
+        return comparison_order(comparison, value, &order) && order <= 0;
+    case RBH_FOP_STRICTLY_GREATER:
+        return comparison_order(comparison, value, &order) && order > 0;
+    case RBH_FOP_GREATER_OR_EQUAL:
+        return comparison_order(comparison, value, &order) && order >= 0;
+    case RBH_FOP_REGEX:
+        return regex_match(evaluator, comparison->regex, value);
+    case RBH_FOP_IN:
+        if (filter->compare.value.type != RBH_VT_SEQUENCE)
+            return false;
+        for (size_t i = 0; i < filter->compare.value.sequence.count; i++) {
+            if (value_equals(value, &filter->compare.value.sequence.values[i]))
+                return true;
+        }
+        return false;
+    case RBH_FOP_BITS_ANY_SET:
+    case RBH_FOP_BITS_ALL_SET:
+    case RBH_FOP_BITS_ANY_CLEAR:
+    case RBH_FOP_BITS_ALL_CLEAR:
+        return bits_match(filter->op, value, &filter->compare.value);
+    default:
+        error(EXIT_FAILURE, ENOSYS, "unsupported filter operator %d",
+              filter->op);
+        __builtin_unreachable();
+    }
+}
+
+/*----------------------------------------------------------------------------*
+ |                                 compilation                                |
+ *----------------------------------------------------------------------------*/
+
+/* Regexes are compiled once per process and shared by every evaluator: the
+ * same patterns tend to appear in several actions, and compiled patterns are
+ * read-only once JIT-compiled.
+ */
+struct cached_regex {
+    struct cached_regex *next;
+    char *pattern;
+    unsigned int options;
+    pcre2_code *code;
+};
+
+static struct cached_regex *regex_cache;
+static pthread_mutex_t regex_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pcre2_code *
+regex_compile(const char *pattern, unsigned int regex_options)
+{
+    PCRE2_UCHAR message[256];
+    PCRE2_SIZE offset;
+    pcre2_code *code;
+    int rc;
+
+    code = pcre2_compile((PCRE2_SPTR)pattern, PCRE2_ZERO_TERMINATED,
+                         regex_options & RBH_RO_CASE_INSENSITIVE ?
+                            PCRE2_CASELESS : 0,
+                         &rc, &offset, NULL);
+    if (code == NULL) {
+        pcre2_get_error_message(rc, message, sizeof(message));
+        error(EXIT_FAILURE, 0, "invalid regex `%s' at offset %zu: %s",
+              pattern, offset, message);
+    }
+
+    /* pcre2_match() falls back on the interpreter if JIT is not available */
+    pcre2_jit_compile(code, PCRE2_JIT_COMPLETE);
+
+    return code;
+}
+
+static pcre2_code *
+regex_get(const char *pattern, unsigned int regex_options)
+{
+    struct cached_regex *regex;
+
+    pthread_mutex_lock(&regex_cache_lock);
+    for (regex = regex_cache; regex != NULL; regex = regex->next) {
+        if (regex->options == regex_options &&
+            strcmp(regex->pattern, pattern) == 0)
+            break;
+    }
+
+    if (regex == NULL) {
+        regex = malloc(sizeof(*regex));
+        if (regex == NULL)
+            error(EXIT_FAILURE, errno, "malloc");
+
+        regex->pattern = strdup(pattern);
+        if (regex->pattern == NULL)
+            error(EXIT_FAILURE, errno, "strdup");
+        regex->options = regex_options;
+        regex->code = regex_compile(pattern, regex_options);
+        regex->next = regex_cache;
+        regex_cache = regex;
+    }
+
+    pthread_mutex_unlock(&regex_cache_lock);
+
+    return regex->code;
+}
+
+static void __attribute__((destructor))
+regex_cache_clear(void)
+{
+    while (regex_cache != NULL) {
+        struct cached_regex *regex = regex_cache;
+
+        regex_cache = regex->next;
+        pcre2_code_free(regex->code);
+        free(regex->pattern);
+        free(regex);
+    }
+}
+
+/* Count how many instructions and comparisons compiling \p filter needs, at
+ * most.
+ */
+static void
+program_size(const struct rbh_filter *filter, size_t *length,
+             size_t *comparison_count)
+{
+    if (filter == NULL) {
+        (*length)++;
+        return;
+    }
+
+    switch (filter->op) {
+    case RBH_FOP_AND:
+    case RBH_FOP_OR:
+        /* One jump between every two children, or a constant if none */
+        *length += filter->logical.count == 0 ? 1 : filter->logical.count - 1;
+        for (unsigned int i = 0; i < filter->logical.count; i++)
+            program_size(filter->logical.filters[i], length,
+                         comparison_count);
+        break;
+    case RBH_FOP_NOT:
+        (*length)++;
+        program_size(filter->logical.filters[0], length, comparison_count);
+        break;
+    default:
+        (*length)++;
+        (*comparison_count)++;
+        break;
+    }
+}
+
+static size_t
+comparison_add(struct filter_evaluator *evaluator,
+               const struct rbh_filter *filter)
+{
+    struct comparison *comparison;
+
+    for (size_t i = 0; i < evaluator->comparison_count; i++) {
+        if (filter_equals(evaluator->comparisons[i].filter, filter))
+            return i;
+    }
+
+    comparison = &evaluator->comparisons[evaluator->comparison_count];
+    comparison->filter = filter;
+    comparison->regex = NULL;
+    comparison->generation = 0;
+    comparison->is_integer = filter->op != RBH_FOP_REGEX &&
+        value2integer(&filter->compare.value, &comparison->integer);
+
+    if (filter->op == RBH_FOP_REGEX) {
+        if (filter->compare.value.type != RBH_VT_REGEX)
+            error(EXIT_FAILURE, EINVAL, "regex filter without a regex");
+
+        comparison->regex = regex_get(filter->compare.value.regex.string,
+                                      filter->compare.value.regex.options);
+    }
+
+    return evaluator->comparison_count++;
+}
+
+static void
+emit(struct filter_evaluator *evaluator, enum opcode opcode, size_t operand)
+{
+    evaluator->program[evaluator->length].opcode = opcode;
+    evaluator->program[evaluator->length].operand = operand;
+    evaluator->length++;
+}
+
+static void
+compile(struct filter_evaluator *evaluator, const struct rbh_filter *filter)
+{
+    enum opcode jump;
+    size_t *jumps;
+    size_t count;
+
+    if (filter == NULL) {
+        emit(evaluator, OP_TRUE, 0);
+        return;
+    }
+
+    switch (filter->op) {
+    case RBH_FOP_AND:
+    case RBH_FOP_OR:
+        count = filter->logical.count;
+        if (count == 0) {
+            emit(evaluator, filter->op == RBH_FOP_AND ? OP_TRUE : OP_FALSE, 0);
+            return;
+        }
+
+        /* The first child that is false (resp. true) decides for the whole
+         * conjunction (resp. disjunction), jump over the others.
+         */
+        jump = filter->op == RBH_FOP_AND ? OP_JUMP_IF_FALSE : OP_JUMP_IF_TRUE;
+        jumps = malloc(count * sizeof(*jumps));
+        if (jumps == NULL)
+            error(EXIT_FAILURE, errno, "malloc");
+
+        for (size_t i = 0; i < count; i++) {
+            compile(evaluator, filter->logical.filters[i]);
+            if (i + 1 == count)
+                break;
+
+            jumps[i] = evaluator->length;
+            emit(evaluator, jump, 0);
+        }
+
+        for (size_t i = 0; i + 1 < count; i++)
+            evaluator->program[jumps[i]].operand = evaluator->length;
+        free(jumps);
+        break;
+    case RBH_FOP_NOT:
+        compile(evaluator, filter->logical.filters[0]);
+        emit(evaluator, OP_NOT, 0);
+        break;
+    default:
+        emit(evaluator, OP_COMPARE, comparison_add(evaluator, filter));
+        break;
+    }
+}
+
+/* Nested logical operators make jumps land on other jumps, send them directly
+ * where they would end up.
+ */
+static void
+thread_jumps(struct filter_evaluator *evaluator)
+{
+    struct instruction *program = evaluator->program;
+
+    for (size_t i = 0; i < evaluator->length; i++) {
+        struct instruction *jump = &program[i];
+
+        if (jump->opcode != OP_JUMP_IF_FALSE && jump->opcode != OP_JUMP_IF_TRUE)
+            continue;
+
+        while (jump->operand < evaluator->length) {
+            const struct instruction *target = &program[jump->operand];
+
+            if (target->opcode == jump->opcode)
+                /* The result did not change, the jump is taken */
+                jump->operand = target->operand;
+            else if (target->opcode == OP_JUMP_IF_FALSE ||
+                     target->opcode == OP_JUMP_IF_TRUE)
+                /* The result did not change, the jump is not taken */
+                jump->operand++;
+            else
+                break;
+        }
+    }
+}
+
+struct filter_evaluator *
+filter_evaluator_new(const struct rbh_filter *filter)
+{
+    struct filter_evaluator *evaluator;
+    size_t comparison_count = 0;
+    size_t length = 0;
+
+    evaluator = malloc(sizeof(*evaluator));
+    if (evaluator == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+
+    program_size(filter, &length, &comparison_count);
+
+    evaluator->program = malloc(length * sizeof(*evaluator->program));
+    if (evaluator->program == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+    evaluator->length = 0;
+
+    evaluator->comparisons = malloc(comparison_count *
+                                    sizeof(*evaluator->comparisons));
+    if (evaluator->comparisons == NULL && comparison_count != 0)
+        error(EXIT_FAILURE, errno, "malloc");
+    evaluator->comparison_count = 0;
+    evaluator->generation = 0;
+
+    compile(evaluator, filter);
+    thread_jumps(evaluator);
+
+    evaluator->match_data = pcre2_match_data_create(1, NULL);
+    if (evaluator->match_data == NULL)
+        error(EXIT_FAILURE, ENOMEM, "pcre2_match_data_create");
+
+    return evaluator;
+}
+
+void
+filter_evaluator_destroy(struct filter_evaluator *evaluator)
+{
+    free(evaluator->comparisons);
+    free(evaluator->program);
+    pcre2_match_data_free(evaluator->match_data);
+    free(evaluator);
+}
+
+/*----------------------------------------------------------------------------*
+ |                                 evaluation                                 |
+ *----------------------------------------------------------------------------*/
+
+static bool
+comparison_eval(struct filter_evaluator *evaluator,
+                struct comparison *comparison,
+                const struct rbh_fsentry *fsentry)
+{
+    if (comparison->generation != evaluator->generation) {
+        comparison->result = comparison_match(evaluator, comparison, fsentry);
+        comparison->generation = evaluator->generation;
+    }
+
+    return comparison->result;
+}
+
+bool
+filter_evaluator_match(struct filter_evaluator *evaluator,
+                       const struct rbh_fsentry *fsentry)
+{
+    const struct instruction *program = evaluator->program;
+    bool result = true;
+    size_t pc = 0;
+
+    /* Forget the results of comparisons on the previous fsentry */
+    if (++evaluator->generation == 0) {
+        for (size_t i = 0; i < evaluator->comparison_count; i++)
+            evaluator->comparisons[i].generation = 0;
+        evaluator->generation = 1;
+    }
+
+    while (pc < evaluator->length) {
+        const struct instruction *instruction = &program[pc++];
+        struct comparison *comparison;
+
+        switch (instruction->opcode) {
+        case OP_TRUE:
+            result = true;
+            break;
+        case OP_FALSE:
+            result = false;
+            break;
+        case OP_COMPARE:
+            comparison = &evaluator->comparisons[instruction->operand];
+            result = comparison_eval(evaluator, comparison, fsentry);
+            break;
+        case OP_NOT:
+            result = !result;
+            break;
+        case OP_JUMP_IF_FALSE:
+            if (!result)
+                pc = instruction->operand;
+            break;
+        case OP_JUMP_IF_TRUE:
+            if (result)
+                pc = instruction->operand;
+            break;
+        }
+    }
+
+    return result;
+}
+
+/*----------------------------------------------------------------------------*
+ |                                   sorting                                  |
+ *----------------------------------------------------------------------------*/
+
+/* Values of different types sort in this order: missing, numbers, strings,
+ * maps, sequences, binaries, regexes.
+ */
+static int
+value_type_rank(const struct rbh_value *value)
+{
+    struct integer integer;
+
+    if (value == NULL)
+        return 0;
+
+    if (value2integer(value, &integer))
+        return 1;
+
+    switch (value->type) {
+    case RBH_VT_STRING:
+        return 2;
+    case RBH_VT_MAP:
+        return 3;
+    case RBH_VT_SEQUENCE:
+        return 4;
+    case RBH_VT_BINARY:
+        return 5;
+    default:
+        return 6;
+    }
+}
+
+int
+fsentry_sort_compare(const struct rbh_fsentry *first,
+                     const struct rbh_fsentry *second,
+                     const struct rbh_filter_sort *sorts, size_t sorts_count)
+{
+    for (size_t i = 0; i < sorts_count; i++) {
+        const struct rbh_value *left, *right;
+        struct rbh_value buffers[2];
+        int order;
+
+        left = fsentry_field_value(first, &sorts[i].field, &buffers[0]);
+        right = fsentry_field_value(second, &sorts[i].field, &buffers[1]);
+
+        order = value_type_rank(left) - value_type_rank(right);
+        if (order == 0 && left != NULL &&
+            !value_compare(left, right, &order))
+            order = 0;
+
+        if (order != 0)
+            return sorts[i].ascending ? order : -order;
+    }
+
+    return 0;
+}
@@ -0,0 +1,314 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <error.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/wait.h>
+
+#include "rbh-find/actions.h"
+#include "rbh-find/exec.h"
+#include "rbh-find/utils.h"
+
+extern char **environ;
+
+/* Leave room for what the kernel and the dynamic loader put on the stack, like
+ * xargs does
+ */
+#define ARG_HEADROOM 2048
+
+struct command {
+    /* The command line, the "{}" of batched commands excluded */
+    char * const *argv;
+    size_t argc;
+    bool batched;
+    bool in_directory;
+    char *root;
+
+    /* The children running, at most `job_count' */
+    pid_t *jobs;
+    size_t job_count;
+    size_t running;
+
+    /* With `batched', the arguments to run the command on next, their size,
+     * the maximum size they may reach, and the directory they are relative to
+     * if `in_directory'
+     */
+    char **paths;
+    size_t path_count;
+    size_t path_capacity;
+    size_t size;
+    size_t max_size;
+    char *directory;
+
+    size_t failures;
+};
+
+/* How many bytes arguments may use, once the environment and \p argv are */
+static size_t
+arguments_max_size(char * const *argv, size_t argc)
+{
+    long arg_max = sysconf(_SC_ARG_MAX);
+    size_t used = ARG_HEADROOM;
+
+    if (arg_max <= 0)
+        arg_max = _POSIX_ARG_MAX;
+
+    for (char **env = environ; *env != NULL; env++)
+        used += strlen(*env) + 1 + sizeof(*env);
+    for (size_t i = 0; i < argc; i++)
+        used += strlen(argv[i]) + 1 + sizeof(*argv);
+
+    /* There should at least be room for a path */
+    if ((size_t)arg_max < used + PATH_MAX + sizeof(*argv))
+        return PATH_MAX + sizeof(*argv);
+
+    return arg_max - used;
+}
+
+struct command *
+command_new(char * const *argv, size_t argc, bool batched, bool in_directory,
+            const char *root, size_t jobs)
+{
+    struct command *command;
+
+    command = calloc(1, sizeof(*command));
+    if (command == NULL)
+        error(EXIT_FAILURE, errno, "calloc");
+
+    command->argv = argv;
+    command->argc = batched ? argc - 1 : argc;
+    command->batched = batched;
+    command->in_directory = in_directory;
+    command->root = strdup(root);
+    if (command->root == NULL)
+        error(EXIT_FAILURE, errno, "strdup");
+
+    command->job_count = jobs > 0 ? jobs : 1;
+    command->jobs = malloc(command->job_count * sizeof(*command->jobs));
+    if (command->jobs == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+
+    if (batched)
+        command->max_size = arguments_max_size(argv, command->argc);
+
+    return command;
+}
+
+/* Wait for one of the children of \p command to exit
+ *
+ * Only the children of \p command are waited for, the other commands may have
+ * children of their own running.
+ */
+static void
+command_wait(struct command *command)
+{
+    size_t i = 0;
+    int status;
+    pid_t pid;
+
+    /* Reap a child that already exited, or else wait for the last one */
+    do {
+        pid = waitpid(command->jobs[i], &status,
+                      i + 1 < command->running ? WNOHANG : 0);
+        if (pid == 0)
+            i++;
+    } while (pid == 0 || (pid < 0 && errno == EINTR));
+    if (pid < 0)
+        error(EXIT_FAILURE, errno, "waitpid");
+
+    command->jobs[i] = command->jobs[--command->running];
+    if (command->batched && !(WIFEXITED(status) && WEXITSTATUS(status) == 0))
+        command->failures++;
+}
+
+static void
+command_spawn(struct command *command, char * const *argv,
+              const char *directory)
+{
+    pid_t pid;
+
+    while (command->running == command->job_count)
+        command_wait(command);
+
+    pid = fork();
+    if (pid < 0)
+        error(EXIT_FAILURE, errno, "fork");
+
+    if (pid == 0) {
+        if (directory != NULL && chdir(directory)) {
+            error(0, errno, "cannot change directory to `%s'", directory);
+            _exit(127);
+        }
+
+        execvp(argv[0], argv);
+        error(0, errno, "%s", argv[0]);
+        _exit(127);
+    }
+
+    command->jobs[command->running++] = pid;
+}
+
+/* Replace every "{}" of \p arg with \p path */
+static char *
+argument_expand(const char *arg, const char *path)
+{
+    size_t path_length = strlen(path);
+    size_t size = strlen(arg) + 1;
+    const char *brace;
+    char *expanded;
+    char *next;
+
+    for (brace = strstr(arg, "{}"); brace != NULL;
+         brace = strstr(brace + 2, "{}"))
+        size = size - 2 + path_length;
+
+    expanded = malloc(size);
+    if (expanded == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+
+    next = expanded;
+    while ((brace = strstr(arg, "{}")) != NULL) {
+        next = mempcpy(next, arg, brace - arg);
+        next = mempcpy(next, path, path_length);
+        arg = brace + 2;
+    }
+    strcpy(next, arg);
+
+    return expanded;
+}
+
+static void
+command_flush(struct command *command)
+{
+    char **argv;
+
+    if (command->path_count == 0)
+        return;
+
+    argv = malloc((command->argc + command->path_count + 1) * sizeof(*argv));
+    if (argv == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+
+    memcpy(argv, command->argv, command->argc * sizeof(*argv));
+    memcpy(&argv[command->argc], command->paths,
+           command->path_count * sizeof(*argv));
+    argv[command->argc + command->path_count] = NULL;
+
+    command_spawn(command, argv, command->directory);
+    free(argv);
+
+    for (size_t i = 0; i < command->path_count; i++)
+        free(command->paths[i]);
+    command->path_count = 0;
+    command->size = 0;
+    free(command->directory);
+    command->directory = NULL;
+}
+
+static void
+command_append(struct command *command, char *path, char *directory)
+{
+    size_t size = strlen(path) + 1 + sizeof(path);
+    void *tmp;
+
+    /* -execdir runs commands from a single directory at a time */
+    if (command->directory != NULL && strcmp(command->directory, directory))
+        command_flush(command);
+    if (command->size + size > command->max_size)
+        command_flush(command);
+
+    if (command->path_count == command->path_capacity) {
+        command->path_capacity = command->path_capacity * 2 + 64;
+        tmp = reallocarray(command->paths, command->path_capacity,
+                           sizeof(*command->paths));
+        if (tmp == NULL)
+            error(EXIT_FAILURE, errno, "reallocarray");
+        command->paths = tmp;
+    }
+
+    command->paths[command->path_count++] = path;
+    command->size += size;
+    if (command->directory == NULL)
+        command->directory = directory;
+    else
+        free(directory);
+}
+
+void
+command_add(struct command *command, const struct rbh_fsentry *fsentry)
+{
+    const char *path = fsentry_path(fsentry);
+    char *directory = NULL;
+    char *argument;
+    const char *name;
+    char **argv;
+
+    if (path == NULL) {
+        error(0, 0, "cannot run `%s' on an entry without a path",
+              command->argv[0]);
+        return;
+    }
+
+    if (command->in_directory) {
+        name = strrchr(path, '/');
+        name = name == NULL ? path : name + 1;
+        directory = path_under_root(command->root, path, name - path);
+        if (asprintf(&argument, "./%s", *name == '\0' ? "." : name) < 0)
+            error(EXIT_FAILURE, errno, "asprintf");
+    } else {
+        argument = path_under_root(command->root, path, strlen(path));
+    }
+
+    if (command->batched) {
+        command_append(command, argument, directory);
+        return;
+    }
+
+    argv = malloc((command->argc + 1) * sizeof(*argv));
+    if (argv == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+
+    for (size_t i = 0; i < command->argc; i++)
+        argv[i] = argument_expand(command->argv[i], argument);
+    argv[command->argc] = NULL;
+
+    command_spawn(command, argv, directory);
+
+    for (size_t i = 0; i < command->argc; i++)
+        free(argv[i]);
+    free(argv);
+    free(argument);
+    free(directory);
+}
+
+size_t
+command_finish(struct command *command)
+{
+    size_t failures;
+
+    command_flush(command);
+    while (command->running > 0)
+        command_wait(command);
+
+    failures = command->failures;
+    free(command->paths);
+    free(command->jobs);
+    free(command->root);
+    free(command);
+
+    return failures;
+}
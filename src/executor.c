@@ -0,0 +1,1206 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <error.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "rbh-find/executor.h"
+
+/* The fsentries a backend returned for a query, and the statistics of the
+ * current action about that backend, if they are recorded
+ */
+struct backend_cursor {
+    struct rbh_mut_iterator *fsentries;
+    struct backend_stats *stats;
+};
+
+/* The statistics of the current action about a backend, NULL if they are not
+ * recorded
+ */
+static struct backend_stats *
+current_backend_stats(struct find_context *ctx, int backend_index)
+{
+    if (ctx->stats == NULL || ctx->stats->current == NULL)
+        return NULL;
+
+    return &ctx->stats->current->backends[backend_index];
+}
+
+/* Query \p backend, which is `ctx->backends[backend_index]' or a handle of its
+ * own on the same URI
+ */
+static void
+backend_query(struct find_context *ctx, int backend_index,
+              struct rbh_backend *backend, const struct rbh_filter *filter,
+              const struct rbh_filter_options *options,
+              struct backend_stats *stats, struct backend_cursor *cursor)
+{
+    struct rbh_mut_iterator *sampled = NULL;
+    struct rbh_filter_options unlimited;
+
+    if (stats != NULL) {
+        stats->queried = true;
+        stats->start = stats_clock();
+    }
+
+    /* Cached results are not sampled, so that any rate can use them */
+    if (ctx->sample != 0 && ctx->sample_callback != NULL && ctx->cache == NULL)
+        sampled = ctx->sample_callback(ctx, backend_index, backend, filter,
+                                       options, ctx->sample);
+
+    /* Entries are sampled after the backend returns them: the limit must
+     * apply to what is left then, which callers enforce on their own
+     */
+    if (ctx->sample != 0 && sampled == NULL) {
+        unlimited = *options;
+        unlimited.limit = 0;
+        options = &unlimited;
+    }
+
+    if (sampled != NULL) {
+        cursor->fsentries = sampled;
+    } else if (ctx->cache != NULL) {
+        uint64_t generation;
+        bool has_generation;
+
+        has_generation = ctx->generation_callback != NULL &&
+            ctx->generation_callback(ctx, backend_index, backend,
+                                     &generation) == 0;
+        cursor->fsentries = result_cache_filter(ctx->cache,
+                                                ctx->argv[backend_index],
+                                                backend, filter, options,
+                                                has_generation ? &generation
+                                                               : NULL);
+    } else {
+        cursor->fsentries = rbh_backend_filter(backend, filter, options);
+    }
+    if (cursor->fsentries == NULL)
+        error_at_line(EXIT_FAILURE, errno, __FILE__, __LINE__,
+                      "filter_fsentries");
+
+    /* Backends that cannot sample, and the cache, return every fsentry */
+    if (ctx->sample != 0 && sampled == NULL)
+        cursor->fsentries = sample_iter_new(cursor->fsentries, ctx->sample);
+
+    if (stats != NULL)
+        stats->filter_time += stats_clock() - stats->start;
+    cursor->stats = stats;
+}
+
+static void
+backend_cursor_close(struct backend_cursor *cursor)
+{
+    rbh_mut_iter_destroy(cursor->fsentries);
+
+    if (cursor->stats != NULL)
+        cursor->stats->elapsed = stats_clock() - cursor->stats->start;
+}
+
+/* Return NULL once \p cursor is exhausted */
+static struct rbh_fsentry *
+fsentries_next(struct backend_cursor *cursor)
+{
+    struct backend_stats *stats = cursor->stats;
+    struct rbh_fsentry *fsentry;
+    uint64_t start = 0;
+
+    if (stats != NULL)
+        start = stats_clock();
+
+    do {
+        errno = 0;
+        fsentry = rbh_mut_iter_next(cursor->fsentries);
+        if (fsentry == NULL && errno == EAGAIN && stats != NULL)
+            stats->retries++;
+    } while (fsentry == NULL && errno == EAGAIN);
+
+    if (fsentry == NULL && errno != ENODATA)
+        error_at_line(EXIT_FAILURE, errno, __FILE__, __LINE__,
+                      "rbh_mut_iter_next");
+
+    if (stats != NULL) {
+        uint64_t now = stats_clock();
+
+        stats->next_time += now - start;
+        if (fsentry != NULL && stats->entries++ == 0)
+            stats->first_entry_time = now - stats->start;
+    }
+
+    /* Most actions print the path, some several times */
+    if (fsentry != NULL)
+        fsentry_index_path(fsentry);
+
+    return fsentry;
+}
+
+/* How many fsentries are fetched from a backend at once, by default */
+#define BATCH_SIZE 256
+
+/* A batch of fsentries fetched from a backend, which are all released at once
+ * when the batch is cleared
+ */
+struct fsentry_batch {
+    struct rbh_fsentry **fsentries;
+    size_t count;
+    size_t size;
+};
+
+static void
+fsentry_batch_init(struct fsentry_batch *batch, struct find_context *ctx)
+{
+    batch->size = ctx->batch_size ? ctx->batch_size : BATCH_SIZE;
+    batch->count = 0;
+    batch->fsentries = malloc(batch->size * sizeof(*batch->fsentries));
+    if (batch->fsentries == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+}
+
+/* Fetch up to \p max fsentries (0 for as many as fit) in an empty batch,
+ * return how many were fetched, 0 once \p cursor is exhausted
+ */
+static size_t
+fsentry_batch_fetch(struct fsentry_batch *batch,
+                    struct backend_cursor *cursor, size_t max)
+{
+    struct rbh_fsentry *fsentry;
+
+    if (max == 0 || max > batch->size)
+        max = batch->size;
+
+    while (batch->count < max && (fsentry = fsentries_next(cursor)) != NULL)
+        batch->fsentries[batch->count++] = fsentry;
+
+    return batch->count;
+}
+
+/* Release the fsentries of a batch */
+static void
+fsentry_batch_clear(struct fsentry_batch *batch)
+{
+    for (size_t i = 0; i < batch->count; i++)
+        free(batch->fsentries[i]);
+    batch->count = 0;
+}
+
+static void
+fsentry_batch_destroy(struct fsentry_batch *batch)
+{
+    fsentry_batch_clear(batch);
+    free(batch->fsentries);
+}
+
+/*----------------------------------------------------------------------------*
+ |                                prefetching                                 |
+ *----------------------------------------------------------------------------*/
+
+/* A thread that fetches batches of fsentries from a cursor ahead of the thread
+ * that consumes them, so that waiting on the backend and executing actions
+ * overlap
+ */
+struct prefetcher {
+    struct backend_cursor *cursor;
+    size_t limit;
+    pthread_t thread;
+
+    /* A ring buffer of `depth' batches, the slot after the last full batch
+     * belongs to the fetching thread, the first full batch to the consumer
+     */
+    struct fsentry_batch *batches;
+    size_t depth;
+    size_t head;
+    size_t count;
+    bool done;
+
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+};
+
+static void *
+prefetcher_run(void *_prefetcher)
+{
+    struct prefetcher *prefetcher = _prefetcher;
+    size_t fetched = 0;
+
+    while (true) {
+        struct fsentry_batch *batch;
+        size_t count;
+
+        if (prefetcher->limit && fetched == prefetcher->limit)
+            break;
+
+        pthread_mutex_lock(&prefetcher->lock);
+        while (prefetcher->count == prefetcher->depth)
+            pthread_cond_wait(&prefetcher->not_full, &prefetcher->lock);
+        batch = &prefetcher->batches[(prefetcher->head + prefetcher->count)
+                                     % prefetcher->depth];
+        pthread_mutex_unlock(&prefetcher->lock);
+
+        /* Backends are not required to honor the limit */
+        count = fsentry_batch_fetch(batch, prefetcher->cursor,
+                                    prefetcher->limit ? prefetcher->limit
+                                                        - fetched
+                                                      : 0);
+        if (count == 0)
+            break;
+        fetched += count;
+
+        pthread_mutex_lock(&prefetcher->lock);
+        prefetcher->count++;
+        pthread_cond_signal(&prefetcher->not_empty);
+        pthread_mutex_unlock(&prefetcher->lock);
+    }
+
+    pthread_mutex_lock(&prefetcher->lock);
+    prefetcher->done = true;
+    pthread_cond_signal(&prefetcher->not_empty);
+    pthread_mutex_unlock(&prefetcher->lock);
+
+    return NULL;
+}
+
+/* Return the next batch, or NULL once the cursor is exhausted. The batch must
+ * be handed back with prefetcher_release().
+ */
+static struct fsentry_batch *
+prefetcher_next(struct prefetcher *prefetcher)
+{
+    struct fsentry_batch *batch = NULL;
+
+    pthread_mutex_lock(&prefetcher->lock);
+    while (prefetcher->count == 0 && !prefetcher->done)
+        pthread_cond_wait(&prefetcher->not_empty, &prefetcher->lock);
+    if (prefetcher->count > 0)
+        batch = &prefetcher->batches[prefetcher->head];
+    pthread_mutex_unlock(&prefetcher->lock);
+
+    return batch;
+}
+
+static void
+prefetcher_release(struct prefetcher *prefetcher, struct fsentry_batch *batch)
+{
+    fsentry_batch_clear(batch);
+
+    pthread_mutex_lock(&prefetcher->lock);
+    prefetcher->head = (prefetcher->head + 1) % prefetcher->depth;
+    prefetcher->count--;
+    pthread_cond_signal(&prefetcher->not_full);
+    pthread_mutex_unlock(&prefetcher->lock);
+}
+
+static size_t
+prefetch_foreach(struct find_context *ctx, struct backend_cursor *cursor,
+                 size_t limit,
+                 size_t (*callback)(struct find_context *ctx,
+                                    struct rbh_fsentry **fsentries,
+                                    size_t count, void *data),
+                 void *data)
+{
+    struct prefetcher prefetcher = {
+        .cursor = cursor,
+        .limit = limit,
+        /* One batch being consumed, the others being fetched */
+        .depth = ctx->prefetch + 1,
+    };
+    struct fsentry_batch *batch;
+    size_t count = 0;
+    int rc;
+
+    prefetcher.batches = malloc(prefetcher.depth * sizeof(*prefetcher.batches));
+    if (prefetcher.batches == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+    for (size_t i = 0; i < prefetcher.depth; i++)
+        fsentry_batch_init(&prefetcher.batches[i], ctx);
+
+    pthread_mutex_init(&prefetcher.lock, NULL);
+    pthread_cond_init(&prefetcher.not_empty, NULL);
+    pthread_cond_init(&prefetcher.not_full, NULL);
+
+    rc = pthread_create(&prefetcher.thread, NULL, prefetcher_run, &prefetcher);
+    if (rc)
+        error(EXIT_FAILURE, rc, "pthread_create");
+
+    while ((batch = prefetcher_next(&prefetcher)) != NULL) {
+        count += callback(ctx, batch->fsentries, batch->count, data);
+        prefetcher_release(&prefetcher, batch);
+    }
+
+    rc = pthread_join(prefetcher.thread, NULL);
+    if (rc)
+        error(EXIT_FAILURE, rc, "pthread_join");
+
+    for (size_t i = 0; i < prefetcher.depth; i++)
+        fsentry_batch_destroy(&prefetcher.batches[i]);
+    free(prefetcher.batches);
+
+    pthread_cond_destroy(&prefetcher.not_full);
+    pthread_cond_destroy(&prefetcher.not_empty);
+    pthread_mutex_destroy(&prefetcher.lock);
+
+    return count;
+}
+
+size_t
+backend_foreach_batch(struct find_context *ctx, int backend_index,
+                      const struct rbh_filter *filter,
+                      const struct rbh_filter_options *options,
+                      size_t (*callback)(struct find_context *ctx,
+                                         struct rbh_fsentry **fsentries,
+                                         size_t count, void *data),
+                      void *data)
+{
+    struct backend_cursor cursor;
+    struct fsentry_batch batch;
+    size_t count = 0;
+    size_t i = 0;
+
+    backend_query(ctx, backend_index, ctx->backends[backend_index], filter,
+                  options, current_backend_stats(ctx, backend_index), &cursor);
+
+    if (ctx->prefetch > 0) {
+        count = prefetch_foreach(ctx, &cursor, options->limit, callback, data);
+        backend_cursor_close(&cursor);
+        return count;
+    }
+
+    fsentry_batch_init(&batch, ctx);
+    /* Backends are not required to honor the limit */
+    while ((options->limit == 0 || i < options->limit) &&
+           fsentry_batch_fetch(&batch, &cursor,
+                               options->limit ? options->limit - i : 0) > 0) {
+        count += callback(ctx, batch.fsentries, batch.count, data);
+        i += batch.count;
+        fsentry_batch_clear(&batch);
+    }
+    fsentry_batch_destroy(&batch);
+
+    backend_cursor_close(&cursor);
+
+    return count;
+}
+
+/* Call a callback on fsentries one by one, for the *_foreach() functions */
+struct foreach_adapter {
+    size_t (*callback)(struct find_context *ctx, struct rbh_fsentry *fsentry,
+                       void *data);
+    void *data;
+};
+
+static size_t
+foreach_batch(struct find_context *ctx, struct rbh_fsentry **fsentries,
+              size_t count, void *data)
+{
+    struct foreach_adapter *adapter = data;
+    size_t total = 0;
+
+    for (size_t i = 0; i < count; i++)
+        total += adapter->callback(ctx, fsentries[i], adapter->data);
+
+    return total;
+}
+
+size_t
+backend_foreach(struct find_context *ctx, int backend_index,
+                const struct rbh_filter *filter,
+                const struct rbh_filter_options *options,
+                size_t (*callback)(struct find_context *ctx,
+                                   struct rbh_fsentry *fsentry, void *data),
+                void *data)
+{
+    struct foreach_adapter adapter = {
+        .callback = callback,
+        .data = data,
+    };
+
+    return backend_foreach_batch(ctx, backend_index, filter, options,
+                                 foreach_batch, &adapter);
+}
+
+/*----------------------------------------------------------------------------*
+ |                            parallel execution                              |
+ *----------------------------------------------------------------------------*/
+
+/* How many fsentries each backend's thread may fetch ahead of the callback */
+#define QUEUE_CAPACITY 1024
+
+struct executor;
+
+struct worker {
+    struct executor *executor;
+    int backend_index;
+    /* `ctx->backends[backend_index]' for the first partition of a backend, a
+     * handle of the worker's own for the others: backends are not required to
+     * be thread-safe
+     */
+    struct rbh_backend *backend;
+    bool owns_backend;
+    pthread_t thread;
+
+    /* The executor's filter, ANDed with the worker's partition, if any */
+    const struct rbh_filter *filter;
+    struct rbh_filter partitioned;
+    const struct rbh_filter *operands[2];
+    /* What the worker recorded about its partition of the backend */
+    struct backend_stats stats;
+
+    /* A ring buffer of QUEUE_CAPACITY fsentries, protected by
+     * `executor->lock'
+     */
+    struct rbh_fsentry **fsentries;
+    size_t head;
+    size_t count;
+    bool done;
+    pthread_cond_t not_full;
+};
+
+struct executor {
+    struct find_context *ctx;
+    const struct rbh_filter *filter;
+    const struct rbh_filter_options *options;
+    size_t (*callback)(struct find_context *ctx, struct rbh_fsentry **fsentries,
+                       size_t count, void *data);
+    void *data;
+
+    /* Whether workers call `callback' themselves rather than queue fsentries */
+    bool direct;
+    size_t direct_count;
+
+    /* How many more fsentries `callback' may be called on, if there is a
+     * limit, and whether workers should stop fetching fsentries
+     */
+    size_t remaining;
+    bool stopped;
+
+    pthread_mutex_t lock;
+    /* Signaled whenever a worker queues an fsentry or is done */
+    pthread_cond_t not_empty;
+
+    /* Workers query the backends partition after partition: the workers of
+     * backend `i' are those from `i * partition_count' on
+     */
+    size_t partition_count;
+    size_t worker_count;
+    struct worker *workers;
+
+    /* When fsentries are sorted, a min-heap of the workers that have a next
+     * fsentry, ordered by that fsentry, and the worker the last fsentry was
+     * taken from, which goes back in the heap once its next one is known
+     */
+    struct worker **heap;
+    size_t heap_count;
+    struct worker *popped;
+};
+
+/* Must be called with `executor->lock' held */
+static void
+executor_stop(struct executor *executor)
+{
+    executor->stopped = true;
+    for (size_t i = 0; i < executor->worker_count; i++)
+        pthread_cond_signal(&executor->workers[i].not_full);
+}
+
+/* Return false if the executor was stopped, in which case \p fsentry is not
+ * queued.
+ */
+static bool
+worker_push(struct worker *worker, struct rbh_fsentry *fsentry)
+{
+    struct executor *executor = worker->executor;
+    bool stopped;
+
+    pthread_mutex_lock(&executor->lock);
+    while (worker->count == QUEUE_CAPACITY && !executor->stopped)
+        pthread_cond_wait(&worker->not_full, &executor->lock);
+
+    stopped = executor->stopped;
+    if (!stopped) {
+        worker->fsentries[(worker->head + worker->count) % QUEUE_CAPACITY] =
+            fsentry;
+        worker->count++;
+        pthread_cond_signal(&executor->not_empty);
+    }
+    pthread_mutex_unlock(&executor->lock);
+
+    return !stopped;
+}
+
+/* Count up to \p count more fsentries against the limit, return how many there
+ * is room for, and set \p full once the limit is reached
+ */
+static size_t
+executor_take(struct executor *executor, size_t count, bool *full)
+{
+    if (executor->options->limit == 0)
+        return count;
+
+    pthread_mutex_lock(&executor->lock);
+    if (count > executor->remaining)
+        count = executor->remaining;
+    executor->remaining -= count;
+    if (executor->remaining == 0) {
+        executor_stop(executor);
+        *full = true;
+    }
+    pthread_mutex_unlock(&executor->lock);
+
+    return count;
+}
+
+/* Call `callback' on what the limit leaves of a batch, and clear it */
+static size_t
+executor_dispatch(struct executor *executor, struct fsentry_batch *batch,
+                  bool *full)
+{
+    size_t taken = executor_take(executor, batch->count, full);
+    size_t count = 0;
+
+    if (taken > 0)
+        count = executor->callback(executor->ctx, batch->fsentries, taken,
+                                   executor->data);
+
+    fsentry_batch_clear(batch);
+    return count;
+}
+
+static void *
+worker_run(void *_worker)
+{
+    struct worker *worker = _worker;
+    struct executor *executor = worker->executor;
+    struct backend_stats *stats;
+    struct backend_cursor cursor;
+    struct rbh_fsentry *fsentry;
+    size_t count = 0;
+
+    /* The workers of a same backend cannot share its statistics */
+    stats = current_backend_stats(executor->ctx, worker->backend_index);
+    if (stats != NULL && executor->partition_count > 1)
+        stats = &worker->stats;
+
+    backend_query(executor->ctx, worker->backend_index, worker->backend,
+                  worker->filter, executor->options, stats, &cursor);
+
+    if (executor->direct) {
+        struct fsentry_batch batch;
+        bool full = false;
+
+        fsentry_batch_init(&batch, executor->ctx);
+        while (!full && fsentry_batch_fetch(&batch, &cursor, 0) > 0)
+            count += executor_dispatch(executor, &batch, &full);
+        fsentry_batch_destroy(&batch);
+    } else {
+        while ((fsentry = fsentries_next(&cursor)) != NULL) {
+            if (worker_push(worker, fsentry))
+                continue;
+
+            /* The limit was reached */
+            free(fsentry);
+            break;
+        }
+    }
+
+    backend_cursor_close(&cursor);
+
+    pthread_mutex_lock(&executor->lock);
+    if (stats == &worker->stats)
+        backend_stats_merge(current_backend_stats(executor->ctx,
+                                                  worker->backend_index),
+                            stats);
+    executor->direct_count += count;
+    worker->done = true;
+    pthread_cond_signal(&executor->not_empty);
+    pthread_mutex_unlock(&executor->lock);
+
+    return NULL;
+}
+
+/* Must be called with `executor->lock' held and `worker->count' > 0 */
+static struct rbh_fsentry *
+worker_pop(struct worker *worker)
+{
+    struct rbh_fsentry *fsentry = worker->fsentries[worker->head];
+
+    worker->head = (worker->head + 1) % QUEUE_CAPACITY;
+    worker->count--;
+    pthread_cond_signal(&worker->not_full);
+
+    return fsentry;
+}
+
+/* Return the next fsentry of any of \p count workers from \p first, or NULL
+ * once they are all done
+ */
+static struct rbh_fsentry *
+next_unordered(struct executor *executor, size_t first, size_t count,
+               size_t *start)
+{
+    struct rbh_fsentry *fsentry = NULL;
+
+    pthread_mutex_lock(&executor->lock);
+    while (true) {
+        bool done = true;
+
+        /* Go round-robin so that no backend starves the others */
+        for (size_t i = 0; i < count; i++) {
+            struct worker *worker;
+
+            worker = &executor->workers[first + (*start + i) % count];
+            if (worker->count > 0) {
+                fsentry = worker_pop(worker);
+                *start = (*start + i + 1) % count;
+                break;
+            }
+            done &= worker->done;
+        }
+
+        if (fsentry != NULL || done)
+            break;
+
+        pthread_cond_wait(&executor->not_empty, &executor->lock);
+    }
+    pthread_mutex_unlock(&executor->lock);
+
+    return fsentry;
+}
+
+/* Whether the next fsentry of \p first comes before that of \p second, ties
+ * are broken in the order of the workers, so that merges are stable
+ */
+static bool
+worker_precedes(const struct executor *executor, const struct worker *first,
+                const struct worker *second)
+{
+    const struct rbh_filter_options *options = executor->options;
+    int rc;
+
+    rc = fsentry_sort_compare(first->fsentries[first->head],
+                              second->fsentries[second->head],
+                              options->sort.items, options->sort.count);
+    return rc < 0 || (rc == 0 && first < second);
+}
+
+static void
+heap_sift_down(struct executor *executor, size_t index)
+{
+    struct worker **heap = executor->heap;
+
+    while (true) {
+        size_t smallest = index;
+        size_t child = 2 * index + 1;
+        struct worker *tmp;
+
+        for (size_t i = child; i < child + 2 && i < executor->heap_count; i++)
+            if (worker_precedes(executor, heap[i], heap[smallest]))
+                smallest = i;
+
+        if (smallest == index)
+            return;
+
+        tmp = heap[index];
+        heap[index] = heap[smallest];
+        heap[smallest] = tmp;
+        index = smallest;
+    }
+}
+
+/* Must be called with `executor->lock' held. Wait for the next fsentry of
+ * \p worker and, if there is one, put \p worker in the heap.
+ */
+static void
+heap_insert(struct executor *executor, struct worker *worker)
+{
+    struct worker **heap = executor->heap;
+    size_t index;
+
+    while (worker->count == 0 && !worker->done)
+        pthread_cond_wait(&executor->not_empty, &executor->lock);
+
+    if (worker->count == 0)
+        return;
+
+    index = executor->heap_count++;
+    while (index > 0 && worker_precedes(executor, worker,
+                                        heap[(index - 1) / 2])) {
+        heap[index] = heap[(index - 1) / 2];
+        index = (index - 1) / 2;
+    }
+    heap[index] = worker;
+}
+
+/* Return the smallest of the next fsentries of every worker, or NULL once every
+ * worker is done. This only waits for the worker the previous fsentry came
+ * from: top-N queries merge the N first fsentries of each backend (and
+ * partition) in O(N log(workers)).
+ */
+static struct rbh_fsentry *
+next_merged(struct executor *executor)
+{
+    struct rbh_fsentry *fsentry = NULL;
+    struct worker *smallest;
+
+    pthread_mutex_lock(&executor->lock);
+    if (executor->popped != NULL) {
+        heap_insert(executor, executor->popped);
+        executor->popped = NULL;
+    }
+
+    if (executor->heap_count > 0) {
+        smallest = executor->heap[0];
+        executor->heap[0] = executor->heap[--executor->heap_count];
+        heap_sift_down(executor, 0);
+
+        fsentry = worker_pop(smallest);
+        executor->popped = smallest;
+    }
+    pthread_mutex_unlock(&executor->lock);
+
+    return fsentry;
+}
+
+/* Every worker's first fsentry is needed to know which is smallest */
+static void
+merge_start(struct executor *executor)
+{
+    executor->heap = malloc(executor->worker_count * sizeof(*executor->heap));
+    if (executor->heap == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+
+    pthread_mutex_lock(&executor->lock);
+    for (size_t i = 0; i < executor->worker_count; i++)
+        heap_insert(executor, &executor->workers[i]);
+    pthread_mutex_unlock(&executor->lock);
+}
+
+static size_t
+executor_consume(struct executor *executor)
+{
+    struct find_context *ctx = executor->ctx;
+    struct fsentry_batch batch;
+    struct rbh_fsentry *fsentry;
+    size_t partitions = executor->partition_count;
+    size_t backend = 0;
+    size_t current = 0;
+    size_t count = 0;
+    bool full = false;
+
+    fsentry_batch_init(&batch, ctx);
+    if (!ctx->unordered && executor->options->sort.count > 0)
+        merge_start(executor);
+
+    while (!full) {
+        /* The partitions of a backend come in no particular order */
+        if (ctx->unordered)
+            fsentry = next_unordered(executor, 0, executor->worker_count,
+                                     &current);
+        else if (executor->options->sort.count > 0)
+            fsentry = next_merged(executor);
+        else
+            fsentry = next_unordered(executor, backend * partitions,
+                                     partitions, &current);
+
+        if (fsentry == NULL) {
+            if (ctx->unordered || executor->options->sort.count > 0 ||
+                ++backend == ctx->backend_count)
+                break;
+            current = 0;
+            continue;
+        }
+
+        batch.fsentries[batch.count++] = fsentry;
+        /* Only this thread takes from the limit, `remaining' is stable */
+        if (batch.count == batch.size ||
+            (executor->options->limit && batch.count == executor->remaining))
+            count += executor_dispatch(executor, &batch, &full);
+    }
+
+    if (batch.count > 0)
+        count += executor_dispatch(executor, &batch, &full);
+    fsentry_batch_destroy(&batch);
+    free(executor->heap);
+
+    return count;
+}
+
+static size_t
+executor_run(struct find_context *ctx, const struct rbh_filter *filter,
+             const struct rbh_filter_options *options,
+             struct rbh_filter * const *partitions, size_t partition_count,
+             size_t (*callback)(struct find_context *ctx,
+                                struct rbh_fsentry **fsentries, size_t count,
+                                void *data),
+             void *data)
+{
+    struct executor executor = {
+        .ctx = ctx,
+        .filter = filter,
+        .options = options,
+        .callback = callback,
+        .data = data,
+        .direct = ctx->unordered && ctx->exec_action_thread_safe,
+        .remaining = options->limit,
+        .partition_count = partition_count ? partition_count : 1,
+    };
+    size_t count = 0;
+    int rc;
+
+    pthread_mutex_init(&executor.lock, NULL);
+    pthread_cond_init(&executor.not_empty, NULL);
+
+    executor.worker_count = ctx->backend_count * executor.partition_count;
+
+    executor.workers = calloc(executor.worker_count,
+                              sizeof(*executor.workers));
+    if (executor.workers == NULL)
+        error(EXIT_FAILURE, errno, "calloc");
+
+    for (size_t i = 0; i < executor.worker_count; i++) {
+        struct worker *worker = &executor.workers[i];
+
+        worker->executor = &executor;
+        worker->backend_index = i / executor.partition_count;
+        worker->backend = ctx->backends[worker->backend_index];
+        /* Opened here rather than in the worker's thread, in case opening a
+         * backend is not thread-safe either
+         */
+        if (i % executor.partition_count != 0) {
+            worker->backend =
+                rbh_backend_from_uri(ctx->argv[worker->backend_index]);
+            if (worker->backend == NULL)
+                error(EXIT_FAILURE, errno, "cannot open `%s'",
+                      ctx->argv[worker->backend_index]);
+            worker->owns_backend = true;
+        }
+        worker->filter = filter;
+        if (partition_count > 0) {
+            worker->operands[0] = partitions[i % partition_count];
+            worker->operands[1] = filter;
+            worker->partitioned.op = RBH_FOP_AND;
+            worker->partitioned.logical.filters = worker->operands;
+            worker->partitioned.logical.count = filter ? 2 : 1;
+            worker->filter = &worker->partitioned;
+        }
+        pthread_cond_init(&worker->not_full, NULL);
+        if (!executor.direct) {
+            worker->fsentries = malloc(QUEUE_CAPACITY *
+                                       sizeof(*worker->fsentries));
+            if (worker->fsentries == NULL)
+                error(EXIT_FAILURE, errno, "malloc");
+        }
+
+        rc = pthread_create(&worker->thread, NULL, worker_run, worker);
+        if (rc)
+            error(EXIT_FAILURE, rc, "pthread_create");
+    }
+
+    if (!executor.direct)
+        count = executor_consume(&executor);
+
+    for (size_t i = 0; i < executor.worker_count; i++) {
+        struct worker *worker = &executor.workers[i];
+
+        rc = pthread_join(worker->thread, NULL);
+        if (rc)
+            error(EXIT_FAILURE, rc, "pthread_join");
+
+        /* What was queued after the limit was reached */
+        for (size_t j = 0; j < worker->count; j++)
+            free(worker->fsentries[(worker->head + j) % QUEUE_CAPACITY]);
+
+        pthread_cond_destroy(&worker->not_full);
+        free(worker->fsentries);
+        if (worker->owns_backend)
+            rbh_backend_destroy(worker->backend);
+    }
+    free(executor.workers);
+
+    pthread_cond_destroy(&executor.not_empty);
+    pthread_mutex_destroy(&executor.lock);
+
+    return count + executor.direct_count;
+}
+
+/*----------------------------------------------------------------------------*
+ |                                 partitions                                 |
+ *----------------------------------------------------------------------------*/
+
+/* Values of signed fields are shifted so that they compare like unsigned ones */
+#define SIGN_BIT (UINT64_C(1) << 63)
+
+/* Get the smallest or largest value of a field in a backend, return false if
+ * no fsentry has the field
+ */
+static bool
+field_bound(struct find_context *ctx, int backend_index,
+            const struct rbh_filter_field *field, bool ascending,
+            uint64_t *bound, bool *is_signed)
+{
+    const struct rbh_filter_sort sort = {
+        .field = *field,
+        .ascending = ascending,
+    };
+    const struct rbh_filter_options options = {
+        .limit = 1,
+        .projection = {
+            .fsentry_mask = field->fsentry,
+            .statx_mask = field->fsentry == RBH_FP_STATX ? field->statx : 0,
+        },
+        .sort = {
+            .items = &sort,
+            .count = 1,
+        },
+    };
+    struct rbh_mut_iterator *fsentries;
+    struct rbh_fsentry *fsentry;
+    struct rbh_filter *exists;
+    const struct rbh_value *value;
+    struct rbh_value buffer;
+    bool found = false;
+
+    /* Fsentries without the field would come first */
+    exists = rbh_filter_exists_new(field);
+    if (exists == NULL)
+        error_at_line(EXIT_FAILURE, errno, __FILE__, __LINE__ - 2,
+                      "rbh_filter_exists_new");
+
+    fsentries = rbh_backend_filter(ctx->backends[backend_index], exists,
+                                   &options);
+    if (fsentries == NULL)
+        error_at_line(EXIT_FAILURE, errno, __FILE__, __LINE__ - 2,
+                      "filter_fsentries");
+
+    do {
+        errno = 0;
+        fsentry = rbh_mut_iter_next(fsentries);
+    } while (fsentry == NULL && errno == EAGAIN);
+
+    if (fsentry == NULL && errno != ENODATA)
+        error_at_line(EXIT_FAILURE, errno, __FILE__, __LINE__ - 4,
+                      "rbh_mut_iter_next");
+
+    if (fsentry != NULL) {
+        value = fsentry_field_value(fsentry, field, &buffer);
+        if (value != NULL && value->type == RBH_VT_UINT64) {
+            *bound = value->uint64;
+            *is_signed = false;
+            found = true;
+        } else if (value != NULL && value->type == RBH_VT_INT64) {
+            *bound = (uint64_t)value->int64 ^ SIGN_BIT;
+            *is_signed = true;
+            found = true;
+        }
+        free(fsentry);
+    }
+
+    rbh_mut_iter_destroy(fsentries);
+    free(exists);
+    return found;
+}
+
+/* `field' >= `bound' */
+static struct rbh_filter *
+bound_filter(const struct rbh_filter_field *field, uint64_t bound,
+             bool is_signed)
+{
+    struct rbh_filter *filter;
+
+    if (is_signed)
+        filter = rbh_filter_compare_int64_new(RBH_FOP_GREATER_OR_EQUAL, field,
+                                              (int64_t)(bound ^ SIGN_BIT));
+    else
+        filter = rbh_filter_compare_uint64_new(RBH_FOP_GREATER_OR_EQUAL,
+                                               field, bound);
+    if (filter == NULL)
+        error_at_line(EXIT_FAILURE, errno, __FILE__, __LINE__ - 2,
+                      "rbh_filter_compare_new");
+
+    return filter;
+}
+
+/* A logical filter allocated along with its array of operands, which it owns */
+static struct rbh_filter *
+logical_filter(enum rbh_filter_operator op, struct rbh_filter *first,
+               struct rbh_filter *second)
+{
+    const struct rbh_filter **operands;
+    struct rbh_filter *filter;
+
+    filter = malloc(sizeof(*filter) + 2 * sizeof(*operands));
+    if (filter == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+
+    operands = (const struct rbh_filter **)(filter + 1);
+    operands[0] = first;
+    operands[1] = second;
+
+    filter->op = op;
+    filter->logical.filters = operands;
+    filter->logical.count = second == NULL ? 1 : 2;
+    return filter;
+}
+
+size_t
+partition_by_range(struct find_context *ctx,
+                   const struct rbh_filter_field *field, size_t count,
+                   struct rbh_filter ***partitions)
+{
+    uint64_t min = UINT64_MAX, max = 0, span, bound;
+    bool is_signed = false;
+    bool found = false;
+
+    *partitions = NULL;
+
+    for (size_t i = 0; i < ctx->backend_count; i++) {
+        if (field_bound(ctx, i, field, true, &bound, &is_signed)) {
+            min = bound < min ? bound : min;
+            found = true;
+        }
+        if (field_bound(ctx, i, field, false, &bound, &is_signed))
+            max = bound > max ? bound : max;
+    }
+
+    if (!found || min >= max || count < 2)
+        return 0;
+
+    span = max - min;
+    if (span < count)
+        count = span + 1;
+
+    *partitions = calloc(count, sizeof(**partitions));
+    if (*partitions == NULL)
+        error(EXIT_FAILURE, errno, "calloc");
+
+    /* Partition `i' goes from the `i'th bound to the next one, the first one
+     * also holds the fsentries that do not have the field
+     */
+    for (size_t i = 0; i < count; i++) {
+        uint64_t start = min + i * (span / count);
+        uint64_t end = min + (i + 1) * (span / count);
+        struct rbh_filter *upper = NULL;
+
+        if (span < count) {
+            start = min + i;
+            end = min + i + 1;
+        }
+
+        if (i + 1 < count)
+            upper = logical_filter(RBH_FOP_NOT,
+                                   bound_filter(field, end, is_signed), NULL);
+        if (i == 0)
+            (*partitions)[i] = upper;
+        else if (upper == NULL)
+            (*partitions)[i] = bound_filter(field, start, is_signed);
+        else
+            (*partitions)[i] = logical_filter(
+                RBH_FOP_AND, bound_filter(field, start, is_signed), upper
+                );
+    }
+
+    return count;
+}
+
+static void
+partition_destroy(struct rbh_filter *filter)
+{
+    if (filter == NULL)
+        return;
+
+    if (rbh_is_logical_operator(filter->op)) {
+        for (size_t i = 0; i < filter->logical.count; i++)
+            partition_destroy((struct rbh_filter *)filter->logical.filters[i]);
+    }
+    free(filter);
+}
+
+void
+partitions_destroy(struct rbh_filter **partitions, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        partition_destroy(partitions[i]);
+    free(partitions);
+}
+
+size_t
+backends_foreach_partitioned_batch(struct find_context *ctx,
+                                   const struct rbh_filter *filter,
+                                   const struct rbh_filter_options *options,
+                                   struct rbh_filter * const *partitions,
+                                   size_t partition_count,
+                                   size_t (*callback)(
+                                       struct find_context *ctx,
+                                       struct rbh_fsentry **fsentries,
+                                       size_t count, void *data
+                                       ),
+                                   void *data)
+{
+    if (ctx->backend_count == 0)
+        return 0;
+
+    return executor_run(ctx, filter, options, partitions, partition_count,
+                        callback, data);
+}
+
+size_t
+backends_foreach_batch(struct find_context *ctx,
+                       const struct rbh_filter *filter,
+                       const struct rbh_filter_options *options,
+                       size_t (*callback)(struct find_context *ctx,
+                                          struct rbh_fsentry **fsentries,
+                                          size_t count, void *data),
+                       void *data)
+{
+    struct rbh_filter **partitions;
+    size_t partition_count;
+    size_t count;
+
+    /* Skipping is only meaningful for a whole query */
+    if (ctx->partition_count > 1 && options->skip == 0) {
+        partition_count = partition_by_range(ctx, &ctx->partition_field,
+                                             ctx->partition_count,
+                                             &partitions);
+        if (partition_count > 1) {
+            count = backends_foreach_partitioned_batch(ctx, filter, options,
+                                                       partitions,
+                                                       partition_count,
+                                                       callback, data);
+            partitions_destroy(partitions, partition_count);
+            return count;
+        }
+        partitions_destroy(partitions, partition_count);
+    }
+
+    if (ctx->backend_count > 1)
+        return executor_run(ctx, filter, options, NULL, 0, callback, data);
+
+    if (ctx->backend_count == 0)
+        return 0;
+
+    return backend_foreach_batch(ctx, 0, filter, options, callback, data);
+}
+
+size_t
+backends_foreach(struct find_context *ctx, const struct rbh_filter *filter,
+                 const struct rbh_filter_options *options,
+                 size_t (*callback)(struct find_context *ctx,
+                                    struct rbh_fsentry *fsentry, void *data),
+                 void *data)
+{
+    struct foreach_adapter adapter = {
+        .callback = callback,
+        .data = data,
+    };
+
+    return backends_foreach_batch(ctx, filter, options, foreach_batch,
+                                  &adapter);
+}
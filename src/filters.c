@@ -18,9 +18,12 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdalign.h>
+#include <stddef.h>
 #include <sysexits.h>
 #include <ctype.h>
 
+#include <sys/param.h>
 #include <sys/stat.h>
 
 #include <robinhood/statx.h>
@@ -29,9 +32,10 @@
 #endif
 
 #include <robinhood/backend.h>
-#include <robinhood/sstack.h>
 
 #include "rbh-find/filters.h"
+#include "rbh-find/idcache.h"
+#include "rbh-find/projection.h"
 #include "rbh-find/utils.h"
 
 static const struct rbh_filter_field predicate2filter_field[] = {
@@ -49,20 +53,97 @@ static const struct rbh_filter_field predicate2filter_field[] = {
     [PRED_TYPE]     = {.fsentry = RBH_FP_STATX, .statx = RBH_STATX_TYPE},
     [PRED_SIZE]     = {.fsentry = RBH_FP_STATX, .statx = RBH_STATX_SIZE},
     [PRED_PERM]     = {.fsentry = RBH_FP_STATX, .statx = RBH_STATX_MODE},
+    [PRED_UID]      = {.fsentry = RBH_FP_STATX, .statx = RBH_STATX_UID},
+    [PRED_USER]     = {.fsentry = RBH_FP_STATX, .statx = RBH_STATX_UID},
+    [PRED_GID]      = {.fsentry = RBH_FP_STATX, .statx = RBH_STATX_GID},
+    [PRED_GROUP]    = {.fsentry = RBH_FP_STATX, .statx = RBH_STATX_GID},
+    [PRED_INUM]     = {.fsentry = RBH_FP_STATX, .statx = RBH_STATX_INO},
+    [PRED_LINKS]    = {.fsentry = RBH_FP_STATX, .statx = RBH_STATX_NLINK},
+    [PRED_ANEWER]   = {.fsentry = RBH_FP_STATX, .statx = RBH_STATX_ATIME_SEC},
+    [PRED_BNEWER]   = {.fsentry = RBH_FP_STATX, .statx = RBH_STATX_BTIME_SEC},
+    [PRED_CNEWER]   = {.fsentry = RBH_FP_STATX, .statx = RBH_STATX_CTIME_SEC},
+    [PRED_NEWER]    = {.fsentry = RBH_FP_STATX, .statx = RBH_STATX_MTIME_SEC},
 };
 
+/* The nanoseconds of the timestamps -[abc]newer and -newer compare */
+static const struct rbh_filter_field predicate2nsec_field[] = {
+    [PRED_ANEWER]   = {.fsentry = RBH_FP_STATX, .statx = RBH_STATX_ATIME_NSEC},
+    [PRED_BNEWER]   = {.fsentry = RBH_FP_STATX, .statx = RBH_STATX_BTIME_NSEC},
+    [PRED_CNEWER]   = {.fsentry = RBH_FP_STATX, .statx = RBH_STATX_CTIME_NSEC},
+    [PRED_NEWER]    = {.fsentry = RBH_FP_STATX, .statx = RBH_STATX_MTIME_NSEC},
+};
+
+/* Build a regex that matches \p literal at the start or at the end of a
+ * string, escaping its every non-alphanumeric character
+ */
+static char *
+literal2pcre(const char *literal, enum glob_type type)
+{
+    size_t length = strlen(literal);
+    char *pcre, *c;
+
+    /* "^" <literal> or <literal> "(?!\n)$" */
+    pcre = malloc(2 * length + 8);
+    if (pcre == NULL)
+        error_at_line(EXIT_FAILURE, errno, __FILE__, __LINE__ - 2, "malloc");
+
+    c = pcre;
+    if (type == GLOB_PREFIX)
+        *c++ = '^';
+    for (; *literal != '\0'; literal++) {
+        if (!isalnum((unsigned char)*literal) && !(*literal & 0x80))
+            *c++ = '\\';
+        *c++ = *literal;
+    }
+    if (type == GLOB_SUFFIX)
+        c = stpcpy(c, "(?!\n)$");
+    *c = '\0';
+
+    return pcre;
+}
+
 struct rbh_filter *
 shell_regex2filter(enum predicate predicate, const char *shell_regex,
                    unsigned int regex_options)
 {
     struct rbh_filter *filter;
+    enum glob_type type;
+    char *literal;
     char *pcre;
 
-    pcre = shell2pcre(shell_regex);
-    if (pcre == NULL)
-        error_at_line(EXIT_FAILURE, ENOMEM, __FILE__, __LINE__ - 2,
-                      "converting %s into a Perl Compatible Regular Expression",
-                      shell_regex);
+    literal = malloc(strlen(shell_regex) + 1);
+    if (literal == NULL)
+        error_at_line(EXIT_FAILURE, errno, __FILE__, __LINE__ - 2, "malloc");
+
+    /* Literals and anchored literals can be looked up in an index, and are
+     * cheaper to match than what shell2pcre() would make of them
+     */
+    type = glob_classify(shell_regex, literal);
+    if (type == GLOB_LITERAL && !(regex_options & RBH_RO_CASE_INSENSITIVE)) {
+        filter = rbh_filter_compare_string_new(
+            RBH_FOP_EQUAL, &predicate2filter_field[predicate], literal
+            );
+        if (filter == NULL)
+            error_at_line(EXIT_FAILURE, errno, __FILE__, __LINE__ - 3,
+                          "building a filter for %s", literal);
+        free(literal);
+        return filter;
+    }
+
+    switch (type) {
+    case GLOB_PREFIX:
+    case GLOB_SUFFIX:
+        pcre = literal2pcre(literal, type);
+        break;
+    default:
+        pcre = shell2pcre(shell_regex);
+        if (pcre == NULL)
+            error_at_line(EXIT_FAILURE, ENOMEM, __FILE__, __LINE__ - 2,
+                          "converting %s into a Perl Compatible Regular Expression",
+                          shell_regex);
+        break;
+    }
+    free(literal);
 
     filter = rbh_filter_compare_regex_new(RBH_FOP_REGEX,
                                           &predicate2filter_field[predicate],
@@ -133,7 +214,15 @@ static struct rbh_filter *
 filter_uint64_range_new(const struct rbh_filter_field *field, uint64_t start,
                         uint64_t end)
 {
-    struct rbh_filter *low, *high;
+    struct rbh_filter *low, *high, *range;
+    const struct rbh_filter *bounds[2];
+    const struct rbh_filter conjunction = {
+        .op = RBH_FOP_AND,
+        .logical = {
+            .filters = bounds,
+            .count = 2,
+        },
+    };
 
     low = rbh_filter_compare_uint64_new(RBH_FOP_STRICTLY_GREATER, field, start);
     if (low == NULL)
@@ -145,7 +234,17 @@ filter_uint64_range_new(const struct rbh_filter_field *field, uint64_t start,
         error_at_line(EXIT_FAILURE, errno, __FILE__, __LINE__,
                       "rbh_filter_compare_time");
 
-    return filter_and(low, high);
+    /* Predicates return filters that are a single allocation */
+    bounds[0] = low;
+    bounds[1] = high;
+    range = rbh_filter_clone(&conjunction);
+    if (range == NULL)
+        error_at_line(EXIT_FAILURE, errno, __FILE__, __LINE__,
+                      "rbh_filter_clone");
+
+    free(low);
+    free(high);
+    return range;
 }
 
 static struct rbh_filter *
@@ -688,58 +787,347 @@ xattr2filter(const char *xattr_field)
     return filter;
 }
 
-static struct rbh_sstack *filters;
+struct rbh_filter *
+integer2filter(enum predicate predicate, const char *integer)
+{
+    struct rbh_filter *filter;
+
+    filter = numeric2filter(&predicate2filter_field[predicate], integer);
+    if (filter == NULL)
+        error(EX_USAGE, 0, "invalid argument `%s' to `-%s'", integer,
+              predicate2str(predicate));
 
-static void __attribute__((constructor))
-init_filters(void)
+    return filter;
+}
+
+struct rbh_filter *
+user2filter(const char *user)
+{
+    struct rbh_filter *filter;
+    uint64_t id;
+    uid_t uid;
+
+    /* Like find, names that are not those of a user may be user IDs */
+    if (name2uid(user, &uid))
+        id = uid;
+    else if (str2uint64_t(user, &id) || id > UINT32_MAX)
+        error(EX_USAGE, 0, "`%s' is not the name of a known user", user);
+
+    filter = rbh_filter_compare_uint64_new(RBH_FOP_EQUAL,
+                                           &predicate2filter_field[PRED_USER],
+                                           id);
+    if (filter == NULL)
+        error_at_line(EXIT_FAILURE, errno, __FILE__, __LINE__ - 3,
+                      "rbh_filter_compare_uint64_new");
+
+    return filter;
+}
+
+struct rbh_filter *
+group2filter(const char *group)
 {
-    const int MIN_FILTER_ALLOC = 32;
+    struct rbh_filter *filter;
+    uint64_t id;
+    gid_t gid;
+
+    if (name2gid(group, &gid))
+        id = gid;
+    else if (str2uint64_t(group, &id) || id > UINT32_MAX)
+        error(EX_USAGE, 0, "`%s' is not the name of a known group", group);
 
-    filters = rbh_sstack_new(MIN_FILTER_ALLOC * sizeof(struct rbh_filter *));
-    if (filters == NULL)
-        error(EXIT_FAILURE, errno, "rbh_sstack_new");
+    filter = rbh_filter_compare_uint64_new(RBH_FOP_EQUAL,
+                                           &predicate2filter_field[PRED_GROUP],
+                                           id);
+    if (filter == NULL)
+        error_at_line(EXIT_FAILURE, errno, __FILE__, __LINE__ - 3,
+                      "rbh_filter_compare_uint64_new");
+
+    return filter;
 }
 
-static void __attribute__((destructor))
-exit_filters(void)
+struct rbh_filter *
+empty2filter(void)
 {
-    struct rbh_filter **filter;
+    struct rbh_filter *regular, *empty, *filter;
+    const struct rbh_filter *conditions[2];
+    const struct rbh_filter conjunction = {
+        .op = RBH_FOP_AND,
+        .logical = {
+            .filters = conditions,
+            .count = 2,
+        },
+    };
+
+    regular = filetype2filter("f");
+    empty = rbh_filter_compare_uint64_new(RBH_FOP_EQUAL,
+                                          &predicate2filter_field[PRED_SIZE],
+                                          0);
+    if (empty == NULL)
+        error_at_line(EXIT_FAILURE, errno, __FILE__, __LINE__ - 3,
+                      "rbh_filter_compare_uint64_new");
+
+    /* Predicates return filters that are a single allocation */
+    conditions[0] = regular;
+    conditions[1] = empty;
+    filter = rbh_filter_clone(&conjunction);
+    if (filter == NULL)
+        error_at_line(EXIT_FAILURE, errno, __FILE__, __LINE__,
+                      "rbh_filter_clone");
+
+    free(regular);
+    free(empty);
+    return filter;
+}
+
+struct rbh_filter *
+newer2filter(enum predicate predicate, const char *path)
+{
+    const struct rbh_filter_field *nsec = &predicate2nsec_field[predicate];
+    const struct rbh_filter_field *sec = &predicate2filter_field[predicate];
+    struct rbh_filter *later, *same, *after, *filter;
+    const struct rbh_filter *conditions[2];
+    const struct rbh_filter *nanoseconds[2];
+    const struct rbh_filter same_second = {
+        .op = RBH_FOP_AND,
+        .logical = {
+            .filters = nanoseconds,
+            .count = 2,
+        },
+    };
+    const struct rbh_filter disjunction = {
+        .op = RBH_FOP_OR,
+        .logical = {
+            .filters = conditions,
+            .count = 2,
+        },
+    };
+    struct stat reference;
+
+    /* The reference is resolved once, like find, and is not a symlink's
+     * target
+     */
+    if (lstat(path, &reference))
+        error(EXIT_FAILURE, errno, "cannot stat `%s'", path);
+
+    later = rbh_filter_compare_uint64_new(RBH_FOP_STRICTLY_GREATER, sec,
+                                          reference.st_mtim.tv_sec);
+    same = rbh_filter_compare_uint64_new(RBH_FOP_EQUAL, sec,
+                                         reference.st_mtim.tv_sec);
+    after = rbh_filter_compare_uint64_new(RBH_FOP_STRICTLY_GREATER, nsec,
+                                          reference.st_mtim.tv_nsec);
+    if (later == NULL || same == NULL || after == NULL)
+        error_at_line(EXIT_FAILURE, errno, __FILE__, __LINE__,
+                      "rbh_filter_compare_uint64_new");
+
+    /* sec > s || (sec == s && nsec > ns), each term of which an index on the
+     * seconds can serve
+     */
+    nanoseconds[0] = same;
+    nanoseconds[1] = after;
+    conditions[0] = later;
+    conditions[1] = &same_second;
+    filter = rbh_filter_clone(&disjunction);
+    if (filter == NULL)
+        error_at_line(EXIT_FAILURE, errno, __FILE__, __LINE__,
+                      "rbh_filter_clone");
+
+    free(later);
+    free(same);
+    free(after);
+    return filter;
+}
+
+/* Arenas hand out memory from blocks of at least this size, and only ever free
+ * them all at once
+ */
+#define ARENA_BLOCK_SIZE (1 << 14)
+
+struct arena_block {
+    struct arena_block *next;
     size_t size;
+    size_t used;
+    max_align_t data[];
+};
 
-    while (true) {
-        int rc;
+struct filter_arena {
+    struct arena_block *blocks;
+};
 
-        filter = rbh_sstack_peek(filters, &size);
-        if (size == 0)
-            break;
+struct filter_arena *
+filter_arena_new(void)
+{
+    struct filter_arena *arena;
+
+    arena = calloc(1, sizeof(*arena));
+    if (arena == NULL)
+        error(EXIT_FAILURE, errno, "calloc");
+
+    return arena;
+}
+
+void
+filter_arena_destroy(struct filter_arena *arena)
+{
+    struct arena_block *block = arena->blocks;
+
+    while (block != NULL) {
+        struct arena_block *next = block->next;
+
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
+
+static void *
+arena_alloc(struct filter_arena *arena, size_t size)
+{
+    struct arena_block *block = arena->blocks;
+    void *data;
+
+    size = (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+    if (block == NULL || block->size - block->used < size) {
+        size_t block_size = MAX(size, ARENA_BLOCK_SIZE);
+
+        block = malloc(sizeof(*block) + block_size);
+        if (block == NULL)
+            error(EXIT_FAILURE, errno, "malloc");
+
+        block->size = block_size;
+        block->used = 0;
+        block->next = arena->blocks;
+        arena->blocks = block;
+    }
+
+    data = (char *)block->data + block->used;
+    block->used += size;
+    return data;
+}
+
+static const char *
+arena_memdup(struct filter_arena *arena, const void *data, size_t size)
+{
+    return memcpy(arena_alloc(arena, size), data, size);
+}
+
+static const char *
+arena_strdup(struct filter_arena *arena, const char *string)
+{
+    return arena_memdup(arena, string, strlen(string) + 1);
+}
+
+static void
+value_copy(struct filter_arena *arena, struct rbh_value *dest,
+           const struct rbh_value *src)
+{
+    *dest = *src;
+
+    switch (src->type) {
+    case RBH_VT_STRING:
+        dest->string = arena_strdup(arena, src->string);
+        break;
+    case RBH_VT_BINARY:
+        dest->binary.data = arena_memdup(arena, src->binary.data,
+                                         src->binary.size);
+        break;
+    case RBH_VT_REGEX:
+        dest->regex.string = arena_strdup(arena, src->regex.string);
+        break;
+    case RBH_VT_SEQUENCE: {
+        struct rbh_value *values;
 
-        assert(size % sizeof(*filter) == 0);
+        values = arena_alloc(arena, sizeof(*values) * src->sequence.count);
+        for (size_t i = 0; i < src->sequence.count; i++)
+            value_copy(arena, &values[i], &src->sequence.values[i]);
+        dest->sequence.values = values;
+        break;
+    }
+    case RBH_VT_MAP: {
+        struct rbh_value_pair *pairs;
 
-        for (size_t i = 0; i < size / sizeof(*filter); i++, filter++)
-            free(*filter);
+        pairs = arena_alloc(arena, sizeof(*pairs) * src->map.count);
+        for (size_t i = 0; i < src->map.count; i++) {
+            struct rbh_value *value = NULL;
 
-        rc = rbh_sstack_pop(filters, size);
-        assert(rc == 0);
+            pairs[i].key = arena_strdup(arena, src->map.pairs[i].key);
+            if (src->map.pairs[i].value != NULL) {
+                value = arena_alloc(arena, sizeof(*value));
+                value_copy(arena, value, src->map.pairs[i].value);
+            }
+            pairs[i].value = value;
+        }
+        dest->map.pairs = pairs;
+        break;
+    }
+    default:
+        break;
     }
-    rbh_sstack_destroy(filters);
 }
 
 static struct rbh_filter *
-filter_compose(enum rbh_filter_operator op, struct rbh_filter *left,
-               struct rbh_filter *right)
+filter_copy(struct filter_arena *arena, const struct rbh_filter *filter)
+{
+    const struct rbh_filter **children;
+    struct rbh_filter *copy;
+
+    if (filter == NULL)
+        return NULL;
+
+    copy = arena_alloc(arena, sizeof(*copy));
+    *copy = *filter;
+
+    switch (filter->op) {
+    case RBH_FOP_AND:
+    case RBH_FOP_OR:
+    case RBH_FOP_NOT:
+        children = arena_alloc(arena,
+                               sizeof(*children) * filter->logical.count);
+        for (unsigned int i = 0; i < filter->logical.count; i++)
+            children[i] = filter_copy(arena, filter->logical.filters[i]);
+        copy->logical.filters = children;
+        return copy;
+    default:
+        break;
+    }
+
+    switch (filter->compare.field.fsentry) {
+    case RBH_FP_NAMESPACE_XATTRS:
+    case RBH_FP_INODE_XATTRS:
+        if (filter->compare.field.xattr != NULL)
+            copy->compare.field.xattr = arena_strdup(arena,
+                                                     filter->compare.field.xattr);
+        break;
+    default:
+        break;
+    }
+
+    /* The value of an RBH_FOP_EXISTS filter is meaningless */
+    if (filter->op != RBH_FOP_EXISTS)
+        value_copy(arena, &copy->compare.value, &filter->compare.value);
+
+    return copy;
+}
+
+struct rbh_filter *
+filter_adopt(struct filter_arena *arena, struct rbh_filter *filter)
+{
+    struct rbh_filter *copy = filter_copy(arena, filter);
+
+    free(filter);
+    return copy;
+}
+
+static struct rbh_filter *
+filter_compose(struct filter_arena *arena, enum rbh_filter_operator op,
+               struct rbh_filter *left, struct rbh_filter *right)
 {
     const struct rbh_filter **array;
     struct rbh_filter *filter;
 
     assert(op == RBH_FOP_AND || op == RBH_FOP_OR);
 
-    filter = malloc(sizeof(*filter));
-    if (filter == NULL)
-        error(EXIT_FAILURE, errno, "malloc");
-
-    array = rbh_sstack_push(filters, NULL, sizeof(*array) * 2);
-    if (array == NULL)
-        error(EXIT_FAILURE, errno, "rbh_sstack_push");
+    filter = arena_alloc(arena, sizeof(*filter));
+    array = arena_alloc(arena, sizeof(*array) * 2);
 
     array[0] = left;
     array[1] = right;
@@ -752,36 +1140,284 @@ filter_compose(enum rbh_filter_operator op, struct rbh_filter *left,
 }
 
 struct rbh_filter *
-filter_and(struct rbh_filter *left, struct rbh_filter *right)
+filter_and(struct filter_arena *arena, struct rbh_filter *left,
+           struct rbh_filter *right)
 {
-    return filter_compose(RBH_FOP_AND, left, right);
+    return filter_compose(arena, RBH_FOP_AND, left, right);
 }
 
 struct rbh_filter *
-filter_or(struct rbh_filter *left, struct rbh_filter *right)
+filter_or(struct filter_arena *arena, struct rbh_filter *left,
+          struct rbh_filter *right)
 {
-    return filter_compose(RBH_FOP_OR, left, right);
+    return filter_compose(arena, RBH_FOP_OR, left, right);
 }
 
 struct rbh_filter *
-filter_not(struct rbh_filter *filter)
+filter_not(struct filter_arena *arena, struct rbh_filter *filter)
 {
+    const struct rbh_filter **array;
     struct rbh_filter *not;
 
-    not = malloc(sizeof(*not));
-    if (not == NULL)
-        error(EXIT_FAILURE, errno, "malloc");
+    not = arena_alloc(arena, sizeof(*not));
+    array = arena_alloc(arena, sizeof(*array));
 
-    not->logical.filters = rbh_sstack_push(filters, &filter, sizeof(filter));
-    if (not->logical.filters == NULL)
-        error(EXIT_FAILURE, errno, "rbh_sstack_push");
+    array[0] = filter;
 
     not->op = RBH_FOP_NOT;
+    not->logical.filters = array;
     not->logical.count = 1;
 
     return not;
 }
 
+static bool
+value_equals(const struct rbh_value *left, const struct rbh_value *right);
+
+static bool
+value_map_equals(const struct rbh_value_map *left,
+                 const struct rbh_value_map *right)
+{
+    if (left->count != right->count)
+        return false;
+
+    for (size_t i = 0; i < left->count; i++) {
+        if (strcmp(left->pairs[i].key, right->pairs[i].key))
+            return false;
+        if (!value_equals(left->pairs[i].value, right->pairs[i].value))
+            return false;
+    }
+
+    return true;
+}
+
+static bool
+value_equals(const struct rbh_value *left, const struct rbh_value *right)
+{
+    if (left == NULL || right == NULL)
+        return left == right;
+
+    if (left->type != right->type)
+        return false;
+
+    switch (left->type) {
+    case RBH_VT_INT32:
+        return left->int32 == right->int32;
+    case RBH_VT_UINT32:
+        return left->uint32 == right->uint32;
+    case RBH_VT_INT64:
+        return left->int64 == right->int64;
+    case RBH_VT_UINT64:
+        return left->uint64 == right->uint64;
+    case RBH_VT_STRING:
+        return strcmp(left->string, right->string) == 0;
+    case RBH_VT_BINARY:
+        return left->binary.size == right->binary.size &&
+            memcmp(left->binary.data, right->binary.data,
+                   left->binary.size) == 0;
+    case RBH_VT_REGEX:
+        return left->regex.options == right->regex.options &&
+            strcmp(left->regex.string, right->regex.string) == 0;
+    case RBH_VT_SEQUENCE:
+        if (left->sequence.count != right->sequence.count)
+            return false;
+        for (size_t i = 0; i < left->sequence.count; i++) {
+            if (!value_equals(&left->sequence.values[i],
+                              &right->sequence.values[i]))
+                return false;
+        }
+        return true;
+    case RBH_VT_MAP:
+        return value_map_equals(&left->map, &right->map);
+    default:
+        return false;
+    }
+}
+
+bool
+filter_field_equals(const struct rbh_filter_field *left,
+                    const struct rbh_filter_field *right)
+{
+    if (left->fsentry != right->fsentry)
+        return false;
+
+    switch (left->fsentry) {
+    case RBH_FP_STATX:
+        return left->statx == right->statx;
+    case RBH_FP_NAMESPACE_XATTRS:
+    case RBH_FP_INODE_XATTRS:
+        if (left->xattr == NULL || right->xattr == NULL)
+            return left->xattr == right->xattr;
+        return strcmp(left->xattr, right->xattr) == 0;
+    default:
+        return true;
+    }
+}
+
+bool
+filter_equals(const struct rbh_filter *left, const struct rbh_filter *right)
+{
+    if (left == right)
+        return true;
+
+    if (left == NULL || right == NULL || left->op != right->op)
+        return false;
+
+    switch (left->op) {
+    case RBH_FOP_AND:
+    case RBH_FOP_OR:
+    case RBH_FOP_NOT:
+        if (left->logical.count != right->logical.count)
+            return false;
+        for (unsigned int i = 0; i < left->logical.count; i++) {
+            if (!filter_equals(left->logical.filters[i],
+                               right->logical.filters[i]))
+                return false;
+        }
+        return true;
+    case RBH_FOP_EXISTS:
+        return filter_field_equals(&left->compare.field,
+                                   &right->compare.field);
+    default:
+        return filter_field_equals(&left->compare.field,
+                                   &right->compare.field) &&
+            value_equals(&left->compare.value, &right->compare.value);
+    }
+}
+
+void
+filter_field_dump(FILE *file, const struct rbh_filter_field *field)
+{
+    const char *name = fsentry_property2str(field->fsentry);
+
+    if (name == NULL) {
+        fprintf(file, "%#x", field->fsentry);
+        return;
+    }
+    fprintf(file, "%s", name);
+
+    switch (field->fsentry) {
+    case RBH_FP_STATX:
+        name = statx_field2str(field->statx);
+        if (name == NULL)
+            fprintf(file, ".%#x", field->statx);
+        else
+            fprintf(file, ".%s", name);
+        break;
+    case RBH_FP_NAMESPACE_XATTRS:
+    case RBH_FP_INODE_XATTRS:
+        if (field->xattr)
+            fprintf(file, ".%s", field->xattr);
+        break;
+    default:
+        break;
+    }
+}
+
+static void
+value_dump(FILE *file, const struct rbh_value *value)
+{
+    if (value == NULL) {
+        fprintf(file, "null");
+        return;
+    }
+
+    switch (value->type) {
+    case RBH_VT_INT32:
+        fprintf(file, "%" PRId32, value->int32);
+        break;
+    case RBH_VT_UINT32:
+        fprintf(file, "%" PRIu32, value->uint32);
+        break;
+    case RBH_VT_INT64:
+        fprintf(file, "%" PRId64, value->int64);
+        break;
+    case RBH_VT_UINT64:
+        fprintf(file, "%" PRIu64, value->uint64);
+        break;
+    case RBH_VT_STRING:
+        fprintf(file, "\"%s\"", value->string);
+        break;
+    case RBH_VT_BINARY:
+        fprintf(file, "0x");
+        for (size_t i = 0; i < value->binary.size; i++)
+            fprintf(file, "%02x", (unsigned char)value->binary.data[i]);
+        break;
+    case RBH_VT_REGEX:
+        fprintf(file, "/%s/%s", value->regex.string,
+                value->regex.options & RBH_RO_CASE_INSENSITIVE ? "i" : "");
+        break;
+    case RBH_VT_SEQUENCE:
+        fprintf(file, "[");
+        for (size_t i = 0; i < value->sequence.count; i++) {
+            fprintf(file, "%s", i ? ", " : "");
+            value_dump(file, &value->sequence.values[i]);
+        }
+        fprintf(file, "]");
+        break;
+    case RBH_VT_MAP:
+        fprintf(file, "{");
+        for (size_t i = 0; i < value->map.count; i++) {
+            fprintf(file, "%s%s: ", i ? ", " : "", value->map.pairs[i].key);
+            value_dump(file, value->map.pairs[i].value);
+        }
+        fprintf(file, "}");
+        break;
+    default:
+        fprintf(file, "<%d>", value->type);
+        break;
+    }
+}
+
+static const char *__operator2str[] = {
+    [RBH_FOP_EQUAL]             = "==",
+    [RBH_FOP_STRICTLY_LOWER]    = "<",
+    [RBH_FOP_LOWER_OR_EQUAL]    = "<=",
+    [RBH_FOP_STRICTLY_GREATER]  = ">",
+    [RBH_FOP_GREATER_OR_EQUAL]  = ">=",
+    [RBH_FOP_REGEX]             = "=~",
+    [RBH_FOP_IN]                = "in",
+    [RBH_FOP_EXISTS]            = "exists",
+    [RBH_FOP_BITS_ANY_SET]      = "bits-any-set",
+    [RBH_FOP_BITS_ALL_SET]      = "bits-all-set",
+    [RBH_FOP_BITS_ANY_CLEAR]    = "bits-any-clear",
+    [RBH_FOP_BITS_ALL_CLEAR]    = "bits-all-clear",
+    [RBH_FOP_AND]               = "AND",
+    [RBH_FOP_OR]                = "OR",
+    [RBH_FOP_NOT]               = "NOT",
+};
+
+void
+filter_dump(FILE *file, const struct rbh_filter *filter, int indent)
+{
+    fprintf(file, "%*s", 2 * indent, "");
+
+    if (filter == NULL) {
+        fprintf(file, "TRUE\n");
+        return;
+    }
+
+    switch (filter->op) {
+    case RBH_FOP_AND:
+    case RBH_FOP_OR:
+    case RBH_FOP_NOT:
+        fprintf(file, "%s\n", __operator2str[filter->op]);
+        for (unsigned int i = 0; i < filter->logical.count; i++)
+            filter_dump(file, filter->logical.filters[i], indent + 1);
+        break;
+    case RBH_FOP_EXISTS:
+        filter_field_dump(file, &filter->compare.field);
+        fprintf(file, " %s\n", __operator2str[filter->op]);
+        break;
+    default:
+        filter_field_dump(file, &filter->compare.field);
+        fprintf(file, " %s ", __operator2str[filter->op]);
+        value_dump(file, &filter->compare.value);
+        fprintf(file, "\n");
+        break;
+    }
+}
+
 struct rbh_filter_field
 str2field(const char *attribute)
 {
@@ -885,7 +1521,7 @@ str2field(const char *attribute)
         }
         break;
     }
-    error(EX_USAGE, 0, "invalid field for sort: %s", attribute);
+    error(EX_USAGE, 0, "invalid field: %s", attribute);
     __builtin_unreachable();
 }
 
@@ -11,31 +11,97 @@
 
 #include <string.h>
 #include <sysexits.h>
+#include <unistd.h>
 
+#include "rbh-find/binary.h"
 #include "rbh-find/find_cb.h"
+#include "rbh-find/json.h"
 
 static void
 open_action_file(struct find_context *ctx, const char *filename)
 {
-    ctx->action_file = fopen(filename, "w");
-    if (ctx->action_file == NULL)
-        error(EXIT_FAILURE, errno, "fopen: %s", filename);
+    ctx->action_file = output_open(filename);
 }
 
+static struct output *
+find_output(struct find_context *ctx)
+{
+    if (ctx->output == NULL)
+        ctx->output = output_new(STDOUT_FILENO, "stdout");
+
+    return ctx->output;
+}
+
+static struct ls_format *
+find_ls(struct find_context *ctx)
+{
+    if (ctx->ls == NULL)
+        ctx->ls = ls_format_new();
+
+    return ctx->ls;
+}
+
+/* Where -delete, -exec and -execdir find the entries of the backends, which
+ * must be given: the current directory is rarely where a backend is mounted
+ */
+static const char *
+find_mount_root(struct find_context *ctx, enum action action)
+{
+    if (ctx->mount_root == NULL)
+        error(EX_USAGE, 0, "`%s' requires `%s'", action2str(action),
+              option2str(OPT_MOUNT_ROOT));
+
+    return ctx->mount_root;
+}
+
+/* Parse the command of -exec and -execdir, which ends with ';', or with "{}"
+ * and '+' to run it on as many entries at once as possible
+ */
+static int
+parse_command(struct find_context *ctx, const int index,
+              const enum action action)
+{
+    int end;
+
+    for (end = index + 1; end < ctx->argc; end++) {
+        if (strcmp(ctx->argv[end], ";") == 0)
+            break;
+        if (strcmp(ctx->argv[end], "+") == 0 && end > index + 1 &&
+            strcmp(ctx->argv[end - 1], "{}") == 0)
+            break;
+    }
+    if (end >= ctx->argc || end == index + 1)
+        error(EX_USAGE, 0, "missing argument to `%s'", action2str(action));
 
-static bool
-validate_format_string(const char *format_string)
+    ctx->command = command_new(&ctx->argv[index + 1], end - index - 1,
+                               ctx->argv[end][0] == '+',
+                               action == ACT_EXECDIR,
+                               find_mount_root(ctx, action), ctx->jobs);
+    return end - index;
+}
+
+static void
+print_path(struct output *output, const struct rbh_fsentry *fsentry,
+           char terminator)
 {
-    (void) format_string;
+    const char *path = fsentry_path(fsentry);
 
-    return true;
+    /* Mimic glibc's printf("%s", NULL) */
+    if (path == NULL)
+        path = "(null)";
+
+    output_write(output, path, strlen(path));
+    output_putc(output, terminator);
 }
 
 int
 find_pre_action(struct find_context *ctx, const int index,
                 const enum action action)
 {
+    struct rbh_filter_field field;
+
     switch (action) {
+    case ACT_FJSON:
     case ACT_FLS:
     case ACT_FPRINT:
     case ACT_FPRINT0:
@@ -44,30 +110,56 @@ find_pre_action(struct find_context *ctx, const int index,
 
         open_action_file(ctx, ctx->argv[index + 1]);
 
+        return 1;
+    case ACT_FPRINTBIN:
+        if (index + 1 >= ctx->argc)
+            error(EX_USAGE, 0, "missing argument to `%s'", action2str(action));
+
+        open_action_file(ctx, ctx->argv[index + 1]);
+        binary_print_header(ctx->action_file);
+
         return 1;
     case ACT_FPRINTF:
         if (index + 2 >= ctx->argc)
             error(EX_USAGE, 0, "missing argument to `%s'", action2str(action));
 
         open_action_file(ctx, ctx->argv[index + 1]);
+        ctx->format = printf_format_compile(ctx->argv[index + 2]);
 
-        if (!validate_format_string(ctx->argv[index + 2]))
-            error(EX_USAGE, 0, "missing format string to `%s'",
-                  action2str(action));
+        return 2;
+    case ACT_PRINTF:
+        if (index + 1 >= ctx->argc)
+            error(EX_USAGE, 0, "missing argument to `%s'", action2str(action));
 
-        ctx->format_string = ctx->argv[index + 2];
+        ctx->format = printf_format_compile(ctx->argv[index + 1]);
 
         return 1;
-    case ACT_PRINTF:
+    case ACT_COUNT:
+        ctx->aggregate = aggregate_new(AGG_COUNT, NULL,
+                                       ctx->grouped ? &ctx->group_by : NULL);
+        ctx->aggregate->rate = ctx->sample;
+        return 0;
+    case ACT_DELETE:
+        ctx->deletion = deletion_new(find_mount_root(ctx, action), ctx->jobs);
+        return 0;
+    case ACT_EXEC:
+    case ACT_EXECDIR:
+        return parse_command(ctx, index, action);
+    case ACT_HISTOGRAM:
+    case ACT_SUM:
         if (index + 1 >= ctx->argc)
             error(EX_USAGE, 0, "missing argument to `%s'", action2str(action));
 
-        if (!validate_format_string(ctx->argv[index + 1]))
-            error(EX_USAGE, 0, "missing format string to `%s'",
-                  action2str(action));
-
-        ctx->format_string = ctx->argv[index + 1];
+        field = str2field(ctx->argv[index + 1]);
+        if (field.fsentry != RBH_FP_STATX)
+            error(EX_USAGE, 0, "invalid argument `%s' to `%s'",
+                  ctx->argv[index + 1], action2str(action));
 
+        ctx->aggregate = aggregate_new(
+            action == ACT_SUM ? AGG_SUM : AGG_HISTOGRAM, &field,
+            ctx->grouped ? &ctx->group_by : NULL
+            );
+        ctx->aggregate->rate = ctx->sample;
         return 1;
     default:
         break;
@@ -82,38 +174,61 @@ find_exec_action(struct find_context *ctx, enum action action,
 {
     switch (action) {
     case ACT_PRINT:
-        /* XXX: glibc's printf() handles printf("%s", NULL) pretty well, but
-         *      I do not think this is part of any standard.
-         */
-        printf("%s\n", fsentry_path(fsentry));
+        print_path(find_output(ctx), fsentry, '\n');
         break;
     case ACT_PRINT0:
-        printf("%s%c", fsentry_path(fsentry), '\0');
+        print_path(find_output(ctx), fsentry, '\0');
+        break;
+    case ACT_FJSON:
+        fsentry_print_json(ctx->action_file, fsentry);
         break;
     case ACT_FLS:
-        fsentry_print_ls_dils(ctx->action_file, fsentry);
+        fsentry_print_ls_dils(ctx->action_file, find_ls(ctx), fsentry);
         break;
     case ACT_FPRINT:
-        fprintf(ctx->action_file, "%s\n", fsentry_path(fsentry));
+        print_path(ctx->action_file, fsentry, '\n');
         break;
     case ACT_FPRINT0:
-        fprintf(ctx->action_file, "%s%c", fsentry_path(fsentry), '\0');
+        print_path(ctx->action_file, fsentry, '\0');
+        break;
+    case ACT_FPRINTBIN:
+        fsentry_print_binary(ctx->action_file, fsentry);
+        break;
+    case ACT_JSON:
+        fsentry_print_json(find_output(ctx), fsentry);
         break;
     case ACT_LS:
-        fsentry_print_ls_dils(stdout, fsentry);
+        fsentry_print_ls_dils(find_output(ctx), find_ls(ctx), fsentry);
         break;
     case ACT_FPRINTF:
-        fsentry_printf_format(ctx->action_file, fsentry, ctx->format_string);
+        fsentry_printf_format(ctx->action_file, fsentry, ctx->format);
         break;
     case ACT_PRINTF:
-        fsentry_printf_format(stdout, fsentry, ctx->format_string);
+        fsentry_printf_format(find_output(ctx), fsentry, ctx->format);
         break;
     case ACT_COUNT:
+        if (ctx->aggregate)
+            aggregate_fsentry(ctx->aggregate, fsentry);
         return 1;
+    case ACT_HISTOGRAM:
+    case ACT_SUM:
+        aggregate_fsentry(ctx->aggregate, fsentry);
         break;
-    case ACT_QUIT:
-        exit(0);
+    case ACT_DELETE:
+        deletion_add(ctx->deletion, fsentry);
+        break;
+    case ACT_EXEC:
+    case ACT_EXECDIR:
+        /* What was printed so far comes before what commands print */
+        if (ctx->output != NULL)
+            output_flush(ctx->output);
+        command_add(ctx->command, fsentry);
         break;
+    /* The query is limited to a single entry, find_post_action() does the
+     * rest
+     */
+    case ACT_QUIT:
+        return 1;
     default:
         error(EXIT_FAILURE, ENOSYS, "%s", action2str(action));
         break;
@@ -122,22 +237,148 @@ find_exec_action(struct find_context *ctx, enum action action,
     return 0;
 }
 
+size_t
+find_exec_batch(struct find_context *ctx, enum action action,
+                struct rbh_fsentry **fsentries, size_t count)
+{
+    struct output *output;
+    size_t total = 0;
+
+    switch (action) {
+    case ACT_PRINT:
+    case ACT_PRINT0:
+    case ACT_FPRINT:
+    case ACT_FPRINT0:
+        /* Only copy paths in the output's buffer */
+        output = action == ACT_PRINT || action == ACT_PRINT0 ? find_output(ctx)
+                                                             : ctx->action_file;
+        for (size_t i = 0; i < count; i++)
+            print_path(output, fsentries[i],
+                       action == ACT_PRINT || action == ACT_FPRINT ? '\n'
+                                                                   : '\0');
+        return 0;
+    case ACT_COUNT:
+        if (ctx->aggregate == NULL)
+            return count;
+        break;
+    default:
+        break;
+    }
+
+    for (size_t i = 0; i < count; i++)
+        total += find_exec_action(ctx, action, fsentries[i]);
+
+    return total;
+}
+
+void
+find_action_projection(struct find_context *ctx, enum action action,
+                       struct rbh_filter_projection *projection)
+{
+    switch (action) {
+    case ACT_COUNT:
+    case ACT_HISTOGRAM:
+    case ACT_SUM:
+        if (ctx->aggregate)
+            aggregate_projection(ctx->aggregate, projection);
+        break;
+    case ACT_QUIT:
+        break;
+    case ACT_PRINT:
+    case ACT_PRINT0:
+    case ACT_FPRINT:
+    case ACT_FPRINT0:
+        projection->fsentry_mask |= RBH_FP_NAMESPACE_XATTRS;
+        break;
+    case ACT_FPRINTF:
+    case ACT_PRINTF:
+        printf_format_projection(ctx->format, projection);
+        break;
+    case ACT_FLS:
+    case ACT_LS:
+        projection->fsentry_mask |= RBH_FP_STATX | RBH_FP_SYMLINK
+                                  | RBH_FP_NAMESPACE_XATTRS;
+        projection->statx_mask |= LS_DILS_STATX_MASK;
+        break;
+    case ACT_DELETE:
+        projection->fsentry_mask |= RBH_FP_STATX | RBH_FP_NAMESPACE_XATTRS;
+        projection->statx_mask |= DELETION_STATX_MASK;
+        break;
+    case ACT_EXEC:
+    case ACT_EXECDIR:
+        projection->fsentry_mask |= RBH_FP_NAMESPACE_XATTRS;
+        break;
+    case ACT_FPRINTBIN:
+        projection->fsentry_mask |= RBH_FP_ID | RBH_FP_PARENT_ID | RBH_FP_NAME
+                                  | RBH_FP_STATX | RBH_FP_NAMESPACE_XATTRS;
+        projection->statx_mask |= BINARY_STATX_MASK;
+        break;
+    /* Whatever the backends have, only what they return is printed */
+    case ACT_FJSON:
+    case ACT_JSON:
+    default:
+        projection->fsentry_mask |= RBH_FP_ALL;
+        projection->statx_mask |= RBH_STATX_ALL;
+        break;
+    }
+}
+
 void
 find_post_action(struct find_context *ctx, const int index,
                  const enum action action, const size_t count)
 {
-    const char *filename;
+    (void) index;
 
     switch (action) {
     case ACT_COUNT:
-        printf("%lu matching entries\n", count);
+        if (ctx->aggregate == NULL) {
+            /* With -explain, nothing was counted */
+            if (!ctx->explain)
+                output_printf(find_output(ctx), "%lu matching entries\n",
+                              count);
+            break;
+        }
+        __attribute__((fallthrough));
+    case ACT_HISTOGRAM:
+    case ACT_SUM:
+        if (!ctx->explain)
+            aggregate_print(find_output(ctx), ctx->aggregate);
+        aggregate_destroy(ctx->aggregate);
+        ctx->aggregate = NULL;
+        break;
+    case ACT_DELETE:
+        if (deletion_finish(ctx->deletion) > 0)
+            ctx->action_failed = true;
+        ctx->deletion = NULL;
+        break;
+    case ACT_EXEC:
+    case ACT_EXECDIR:
+        if (ctx->output != NULL)
+            output_flush(ctx->output);
+        if (command_finish(ctx->command) > 0)
+            ctx->action_failed = true;
+        ctx->command = NULL;
         break;
+    case ACT_FPRINTF:
+        printf_format_destroy(ctx->format);
+        ctx->format = NULL;
+        __attribute__((fallthrough));
+    case ACT_FJSON:
     case ACT_FLS:
     case ACT_FPRINT:
     case ACT_FPRINT0:
-        filename = ctx->argv[index];
-        if (fclose(ctx->action_file))
-            error(EXIT_FAILURE, errno, "fclose: %s", filename);
+    case ACT_FPRINTBIN:
+        output_close(ctx->action_file);
+        ctx->action_file = NULL;
+        break;
+    case ACT_PRINTF:
+        printf_format_destroy(ctx->format);
+        ctx->format = NULL;
+        break;
+    case ACT_QUIT:
+        /* The query is over, ctx_finish() flushes what was printed on exit */
+        if (count > 0)
+            exit(EXIT_SUCCESS);
         break;
     default:
         break;
@@ -153,6 +394,13 @@ find_parse_predicate(struct find_context *ctx, int *arg_idx)
 
     predicate = str2predicate(ctx->argv[i]);
 
+    /* The only predicate that takes no argument */
+    if (predicate == PRED_EMPTY) {
+        filter = empty2filter();
+        *arg_idx = i;
+        return filter;
+    }
+
     if (i + 1 >= ctx->argc)
         error(EX_USAGE, 0, "missing argument to `%s'", ctx->argv[i]);
 
@@ -195,6 +443,24 @@ find_parse_predicate(struct find_context *ctx, int *arg_idx)
     case PRED_XATTR:
         filter = xattr2filter(ctx->argv[++i]);
         break;
+    case PRED_UID:
+    case PRED_GID:
+    case PRED_INUM:
+    case PRED_LINKS:
+        filter = integer2filter(predicate, ctx->argv[++i]);
+        break;
+    case PRED_USER:
+        filter = user2filter(ctx->argv[++i]);
+        break;
+    case PRED_GROUP:
+        filter = group2filter(ctx->argv[++i]);
+        break;
+    case PRED_NEWER:
+    case PRED_ANEWER:
+    case PRED_BNEWER:
+    case PRED_CNEWER:
+        filter = newer2filter(predicate, ctx->argv[++i]);
+        break;
     default:
         error(EXIT_FAILURE, ENOSYS, "%s", ctx->argv[i]);
         /* clang: -Wsometimes-unitialized: `filter` */
@@ -217,7 +483,6 @@ find_predicate_or_action(const char *string)
     case 'm':
     case 'n':
     case 'r':
-    case 's':
     case 't':
     case 'u':
     case 'w':
@@ -254,6 +519,10 @@ find_predicate_or_action(const char *string)
         if (string[2] != 'r')
             return CLT_PREDICATE;
         return CLT_ACTION;
+    case 's':
+        if (strcmp(&string[2], "um"))
+            return CLT_PREDICATE;
+        return CLT_ACTION;
     }
     return CLT_ACTION;
 }
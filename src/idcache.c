@@ -0,0 +1,316 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <error.h>
+#include <grp.h>
+#include <pthread.h>
+#include <pwd.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rbh-find/idcache.h"
+
+/* An open addressing hash table from IDs to names, lookups that failed are
+ * recorded with a NULL name
+ */
+struct id_entry {
+    uint32_t id;
+    bool used;
+    char *name;
+};
+
+struct id_cache {
+    pthread_mutex_t lock;
+    struct id_entry *entries;
+    /* Always a power of 2 */
+    size_t size;
+    size_t count;
+};
+
+static struct id_cache users = { .lock = PTHREAD_MUTEX_INITIALIZER, };
+static struct id_cache groups = { .lock = PTHREAD_MUTEX_INITIALIZER, };
+
+static size_t
+id_hash(uint32_t id)
+{
+    /* Knuth's multiplicative hash, IDs tend to be allocated sequentially */
+    return (uint32_t)(id * UINT32_C(2654435761));
+}
+
+static struct id_entry *
+id_cache_slot(struct id_cache *cache, uint32_t id)
+{
+    size_t mask = cache->size - 1;
+
+    for (size_t i = id_hash(id) & mask; ; i = (i + 1) & mask) {
+        struct id_entry *entry = &cache->entries[i];
+
+        if (!entry->used || entry->id == id)
+            return entry;
+    }
+}
+
+static void
+id_cache_grow(struct id_cache *cache)
+{
+    struct id_entry *entries = cache->entries;
+    size_t size = cache->size;
+
+    cache->size = size ? size * 2 : 256;
+    cache->entries = calloc(cache->size, sizeof(*cache->entries));
+    if (cache->entries == NULL)
+        error(EXIT_FAILURE, errno, "calloc");
+
+    for (size_t i = 0; i < size; i++) {
+        if (entries[i].used)
+            *id_cache_slot(cache, entries[i].id) = entries[i];
+    }
+    free(entries);
+}
+
+/* The caller must hold the cache's lock */
+static struct id_entry *
+id_cache_lookup(struct id_cache *cache, uint32_t id)
+{
+    struct id_entry *entry;
+
+    if (cache->size == 0)
+        return NULL;
+
+    entry = id_cache_slot(cache, id);
+    return entry->used ? entry : NULL;
+}
+
+/* The caller must hold the cache's lock, the cache takes ownership of \p name,
+ * unless \p id is already cached
+ */
+static const char *
+id_cache_insert(struct id_cache *cache, uint32_t id, char *name)
+{
+    struct id_entry *entry;
+
+    /* Keep the load factor under 1/2 */
+    if (2 * (cache->count + 1) > cache->size)
+        id_cache_grow(cache);
+
+    entry = id_cache_slot(cache, id);
+    if (entry->used) {
+        free(name);
+        return entry->name;
+    }
+
+    entry->used = true;
+    entry->id = id;
+    entry->name = name;
+    cache->count++;
+    return name;
+}
+
+static char *
+xstrdup(const char *string)
+{
+    char *copy = strdup(string);
+
+    if (copy == NULL)
+        error(EXIT_FAILURE, errno, "strdup");
+    return copy;
+}
+
+/* A buffer for the reentrant lookup functions of the user and group
+ * databases, grown as needed
+ */
+struct nss_buffer {
+    char *data;
+    size_t size;
+};
+
+static void
+nss_buffer_init(struct nss_buffer *buffer, int name)
+{
+    long size = sysconf(name);
+
+    buffer->size = size > 0 ? size : 1024;
+    buffer->data = malloc(buffer->size);
+    if (buffer->data == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+}
+
+static void
+nss_buffer_grow(struct nss_buffer *buffer)
+{
+    free(buffer->data);
+    buffer->size *= 2;
+    buffer->data = malloc(buffer->size);
+    if (buffer->data == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+}
+
+static char *
+uid_resolve(uid_t uid)
+{
+    struct nss_buffer buffer;
+    struct passwd pwd, *result;
+    char *name = NULL;
+    int rc;
+
+    nss_buffer_init(&buffer, _SC_GETPW_R_SIZE_MAX);
+    while ((rc = getpwuid_r(uid, &pwd, buffer.data, buffer.size, &result))
+            == ERANGE)
+        nss_buffer_grow(&buffer);
+
+    /* Errors of the database are handled like missing users, the same way
+     * getpwuid() was before
+     */
+    if (rc == 0 && result != NULL)
+        name = xstrdup(result->pw_name);
+
+    free(buffer.data);
+    return name;
+}
+
+static char *
+gid_resolve(gid_t gid)
+{
+    struct nss_buffer buffer;
+    struct group grp, *result;
+    char *name = NULL;
+    int rc;
+
+    nss_buffer_init(&buffer, _SC_GETGR_R_SIZE_MAX);
+    while ((rc = getgrgid_r(gid, &grp, buffer.data, buffer.size, &result))
+            == ERANGE)
+        nss_buffer_grow(&buffer);
+
+    if (rc == 0 && result != NULL)
+        name = xstrdup(result->gr_name);
+
+    free(buffer.data);
+    return name;
+}
+
+const char *
+uid2name(uid_t uid)
+{
+    struct id_entry *entry;
+    const char *name;
+
+    pthread_mutex_lock(&users.lock);
+    entry = id_cache_lookup(&users, uid);
+    if (entry != NULL)
+        name = entry->name;
+    else
+        name = id_cache_insert(&users, uid, uid_resolve(uid));
+    pthread_mutex_unlock(&users.lock);
+
+    return name;
+}
+
+const char *
+gid2name(gid_t gid)
+{
+    struct id_entry *entry;
+    const char *name;
+
+    pthread_mutex_lock(&groups.lock);
+    entry = id_cache_lookup(&groups, gid);
+    if (entry != NULL)
+        name = entry->name;
+    else
+        name = id_cache_insert(&groups, gid, gid_resolve(gid));
+    pthread_mutex_unlock(&groups.lock);
+
+    return name;
+}
+
+bool
+name2uid(const char *name, uid_t *uid)
+{
+    struct nss_buffer buffer;
+    struct passwd pwd, *result;
+    int rc;
+
+    nss_buffer_init(&buffer, _SC_GETPW_R_SIZE_MAX);
+    while ((rc = getpwnam_r(name, &pwd, buffer.data, buffer.size, &result))
+            == ERANGE)
+        nss_buffer_grow(&buffer);
+
+    if (rc == 0 && result != NULL) {
+        *uid = result->pw_uid;
+        pthread_mutex_lock(&users.lock);
+        id_cache_insert(&users, result->pw_uid, xstrdup(result->pw_name));
+        pthread_mutex_unlock(&users.lock);
+    }
+
+    free(buffer.data);
+    return rc == 0 && result != NULL;
+}
+
+bool
+name2gid(const char *name, gid_t *gid)
+{
+    struct nss_buffer buffer;
+    struct group grp, *result;
+    int rc;
+
+    nss_buffer_init(&buffer, _SC_GETGR_R_SIZE_MAX);
+    while ((rc = getgrnam_r(name, &grp, buffer.data, buffer.size, &result))
+            == ERANGE)
+        nss_buffer_grow(&buffer);
+
+    if (rc == 0 && result != NULL) {
+        *gid = result->gr_gid;
+        pthread_mutex_lock(&groups.lock);
+        id_cache_insert(&groups, result->gr_gid, xstrdup(result->gr_name));
+        pthread_mutex_unlock(&groups.lock);
+    }
+
+    free(buffer.data);
+    return rc == 0 && result != NULL;
+}
+
+void
+idcache_prefetch(void)
+{
+    struct passwd *pwd;
+    struct group *grp;
+
+    /* getpwent() and getgrent() are not reentrant, holding the locks at least
+     * ensures this module does not call them concurrently
+     */
+    pthread_mutex_lock(&users.lock);
+    setpwent();
+    while ((pwd = getpwent()) != NULL)
+        id_cache_insert(&users, pwd->pw_uid, xstrdup(pwd->pw_name));
+    endpwent();
+    pthread_mutex_unlock(&users.lock);
+
+    pthread_mutex_lock(&groups.lock);
+    setgrent();
+    while ((grp = getgrent()) != NULL)
+        id_cache_insert(&groups, grp->gr_gid, xstrdup(grp->gr_name));
+    endgrent();
+    pthread_mutex_unlock(&groups.lock);
+}
+
+static void __attribute__((destructor))
+idcache_exit(void)
+{
+    struct id_cache *caches[] = { &users, &groups };
+
+    for (size_t i = 0; i < sizeof(caches) / sizeof(*caches); i++) {
+        for (size_t j = 0; j < caches[i]->size; j++)
+            free(caches[i]->entries[j].name);
+        free(caches[i]->entries);
+    }
+}
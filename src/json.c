@@ -0,0 +1,492 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <sys/stat.h>
+
+#include "rbh-find/json.h"
+
+static const char HEX[] = "0123456789abcdef";
+
+static const char BASE64[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* How many bytes of a string or binary are encoded in the buffer at once, and
+ * the most bytes a byte of a string is escaped into ("\udcXX")
+ */
+#define CHUNK_SIZE 4096
+#define ESCAPE_MAX 6
+
+#define json_literal(output, literal) \
+    output_write(output, literal, sizeof(literal) - 1)
+
+/* Return the length of the valid UTF-8 sequence a string starts with, 0 if it
+ * does not start with one
+ */
+static size_t
+utf8_length(const unsigned char *string, size_t size)
+{
+    unsigned char lead = string[0];
+    unsigned char min = 0x80;
+    unsigned char max = 0xbf;
+    size_t length;
+
+    if (lead < 0x80)
+        return 1;
+    if (lead < 0xc2)
+        return 0;
+
+    if (lead < 0xe0) {
+        length = 2;
+    } else if (lead < 0xf0) {
+        length = 3;
+        /* Overlong encodings and surrogates */
+        if (lead == 0xe0)
+            min = 0xa0;
+        if (lead == 0xed)
+            max = 0x9f;
+    } else if (lead < 0xf5) {
+        length = 4;
+        /* Overlong encodings and code points beyond U+10FFFF */
+        if (lead == 0xf0)
+            min = 0x90;
+        if (lead == 0xf4)
+            max = 0x8f;
+    } else {
+        return 0;
+    }
+
+    if (size < length || string[1] < min || string[1] > max)
+        return 0;
+
+    for (size_t i = 2; i < length; i++)
+        if ((string[i] & 0xc0) != 0x80)
+            return 0;
+
+    return length;
+}
+
+static char *
+escape_byte(char *out, const char *prefix, unsigned char c)
+{
+    out = mempcpy(out, prefix, 4);
+    *out++ = HEX[c >> 4];
+    *out++ = HEX[c & 0xf];
+    return out;
+}
+
+static void
+json_string(struct output *output, const char *_string, size_t size)
+{
+    const unsigned char *string = (const unsigned char *)_string;
+
+    output_putc(output, '"');
+    while (size > 0) {
+        size_t chunk = size < CHUNK_SIZE ? size : CHUNK_SIZE;
+        /* A UTF-8 sequence may end up to 3 bytes after the chunk */
+        char *start = output_reserve(output, (chunk + 3) * ESCAPE_MAX);
+        char *out = start;
+        size_t i = 0;
+
+        while (i < chunk) {
+            unsigned char c = string[i];
+            size_t length;
+
+            if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\') {
+                *out++ = c;
+                i++;
+                continue;
+            }
+
+            if (c >= 0x80) {
+                length = utf8_length(&string[i], size - i);
+                if (length > 0) {
+                    out = mempcpy(out, &string[i], length);
+                    i += length;
+                } else {
+                    out = escape_byte(out, "\\udc", c);
+                    i++;
+                }
+                continue;
+            }
+
+            switch (c) {
+            case '"':
+            case '\\':
+                *out++ = '\\';
+                *out++ = c;
+                break;
+            case '\b':
+                out = mempcpy(out, "\\b", 2);
+                break;
+            case '\f':
+                out = mempcpy(out, "\\f", 2);
+                break;
+            case '\n':
+                out = mempcpy(out, "\\n", 2);
+                break;
+            case '\r':
+                out = mempcpy(out, "\\r", 2);
+                break;
+            case '\t':
+                out = mempcpy(out, "\\t", 2);
+                break;
+            default:
+                out = escape_byte(out, "\\u00", c);
+                break;
+            }
+            i++;
+        }
+
+        output_commit(output, out - start);
+        string += i;
+        size -= i;
+    }
+    output_putc(output, '"');
+}
+
+static void
+json_base64(struct output *output, const char *_data, size_t size)
+{
+    const unsigned char *data = (const unsigned char *)_data;
+
+    output_putc(output, '"');
+    while (size > 0) {
+        /* A multiple of 3, so that only the last chunk is padded */
+        size_t chunk = size < CHUNK_SIZE / 4 * 3 ? size : CHUNK_SIZE / 4 * 3;
+        char *start = output_reserve(output, CHUNK_SIZE);
+        char *out = start;
+        size_t i;
+
+        for (i = 0; i + 3 <= chunk; i += 3) {
+            uint32_t bits = data[i] << 16 | data[i + 1] << 8 | data[i + 2];
+
+            *out++ = BASE64[bits >> 18];
+            *out++ = BASE64[(bits >> 12) & 0x3f];
+            *out++ = BASE64[(bits >> 6) & 0x3f];
+            *out++ = BASE64[bits & 0x3f];
+        }
+
+        if (i < chunk) {
+            uint32_t bits = data[i] << 16;
+
+            if (i + 1 < chunk)
+                bits |= data[i + 1] << 8;
+
+            *out++ = BASE64[bits >> 18];
+            *out++ = BASE64[(bits >> 12) & 0x3f];
+            *out++ = i + 1 < chunk ? BASE64[(bits >> 6) & 0x3f] : '=';
+            *out++ = '=';
+        }
+
+        output_commit(output, out - start);
+        data += chunk;
+        size -= chunk;
+    }
+    output_putc(output, '"');
+}
+
+static void
+json_uint64(struct output *output, uint64_t value)
+{
+    char digits[20];
+    size_t i = sizeof(digits);
+
+    do {
+        digits[--i] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+
+    output_write(output, &digits[i], sizeof(digits) - i);
+}
+
+static void
+json_int64(struct output *output, int64_t value)
+{
+    if (value >= 0) {
+        json_uint64(output, value);
+        return;
+    }
+
+    output_putc(output, '-');
+    /* -INT64_MIN does not fit in an int64_t */
+    json_uint64(output, -(uint64_t)value);
+}
+
+/* Write the separator of a member of an object, and its key, which must not
+ * need escaping
+ */
+static void
+json_key(struct output *output, bool *first, const char *key)
+{
+    size_t length = strlen(key);
+    char *start = output_reserve(output, length + 4);
+    char *out = start;
+
+    if (!*first)
+        *out++ = ',';
+    *first = false;
+
+    *out++ = '"';
+    out = mempcpy(out, key, length);
+    *out++ = '"';
+    *out++ = ':';
+
+    output_commit(output, out - start);
+}
+
+static void
+json_value(struct output *output, const struct rbh_value *value);
+
+static void
+json_map(struct output *output, const struct rbh_value_map *map)
+{
+    output_putc(output, '{');
+    for (size_t i = 0; i < map->count; i++) {
+        const struct rbh_value_pair *pair = &map->pairs[i];
+
+        if (i > 0)
+            output_putc(output, ',');
+        json_string(output, pair->key, strlen(pair->key));
+        output_putc(output, ':');
+        json_value(output, pair->value);
+    }
+    output_putc(output, '}');
+}
+
+static void
+json_value(struct output *output, const struct rbh_value *value)
+{
+    if (value == NULL) {
+        json_literal(output, "null");
+        return;
+    }
+
+    switch (value->type) {
+    case RBH_VT_BOOLEAN:
+        if (value->boolean)
+            json_literal(output, "true");
+        else
+            json_literal(output, "false");
+        break;
+    case RBH_VT_INT32:
+        json_int64(output, value->int32);
+        break;
+    case RBH_VT_UINT32:
+        json_uint64(output, value->uint32);
+        break;
+    case RBH_VT_INT64:
+        json_int64(output, value->int64);
+        break;
+    case RBH_VT_UINT64:
+        json_uint64(output, value->uint64);
+        break;
+    case RBH_VT_STRING:
+        json_string(output, value->string, strlen(value->string));
+        break;
+    case RBH_VT_BINARY:
+        json_base64(output, value->binary.data, value->binary.size);
+        break;
+    case RBH_VT_REGEX:
+        json_string(output, value->regex.string, strlen(value->regex.string));
+        break;
+    case RBH_VT_SEQUENCE:
+        output_putc(output, '[');
+        for (size_t i = 0; i < value->sequence.count; i++) {
+            if (i > 0)
+                output_putc(output, ',');
+            json_value(output, &value->sequence.values[i]);
+        }
+        output_putc(output, ']');
+        break;
+    case RBH_VT_MAP:
+        json_map(output, &value->map);
+        break;
+    default:
+        json_literal(output, "null");
+        break;
+    }
+}
+
+/* The letters of find's -type */
+static const char *
+json_type(mode_t mode)
+{
+    switch (mode & S_IFMT) {
+    case S_IFREG:
+        return "\"f\"";
+    case S_IFDIR:
+        return "\"d\"";
+    case S_IFLNK:
+        return "\"l\"";
+    case S_IFCHR:
+        return "\"c\"";
+    case S_IFBLK:
+        return "\"b\"";
+    case S_IFIFO:
+        return "\"p\"";
+    case S_IFSOCK:
+        return "\"s\"";
+    }
+    return "null";
+}
+
+static void
+json_timestamp(struct output *output, bool *first, const char *key,
+               const struct rbh_statx_timestamp *timestamp, uint32_t mask,
+               uint32_t sec, uint32_t nsec)
+{
+    bool inner = true;
+
+    if ((mask & (sec | nsec)) == 0)
+        return;
+
+    json_key(output, first, key);
+    output_putc(output, '{');
+    if (mask & sec) {
+        json_key(output, &inner, "sec");
+        json_int64(output, timestamp->tv_sec);
+    }
+    if (mask & nsec) {
+        json_key(output, &inner, "nsec");
+        json_uint64(output, timestamp->tv_nsec);
+    }
+    output_putc(output, '}');
+}
+
+static void
+json_device(struct output *output, bool *first, const char *key,
+            uint32_t major, uint32_t minor, uint32_t mask,
+            uint32_t major_mask, uint32_t minor_mask)
+{
+    bool inner = true;
+
+    if ((mask & (major_mask | minor_mask)) == 0)
+        return;
+
+    json_key(output, first, key);
+    output_putc(output, '{');
+    if (mask & major_mask) {
+        json_key(output, &inner, "major");
+        json_uint64(output, major);
+    }
+    if (mask & minor_mask) {
+        json_key(output, &inner, "minor");
+        json_uint64(output, minor);
+    }
+    output_putc(output, '}');
+}
+
+static void
+json_statx(struct output *output, const struct rbh_statx *statx)
+{
+    uint32_t mask = statx->stx_mask;
+    bool first = true;
+
+    output_putc(output, '{');
+    if (mask & RBH_STATX_TYPE) {
+        const char *type = json_type(statx->stx_mode);
+
+        json_key(output, &first, "type");
+        output_write(output, type, strlen(type));
+    }
+    if (mask & RBH_STATX_MODE) {
+        json_key(output, &first, "mode");
+        json_uint64(output, statx->stx_mode & 07777);
+    }
+    if (mask & RBH_STATX_NLINK) {
+        json_key(output, &first, "nlink");
+        json_uint64(output, statx->stx_nlink);
+    }
+    if (mask & RBH_STATX_UID) {
+        json_key(output, &first, "uid");
+        json_uint64(output, statx->stx_uid);
+    }
+    if (mask & RBH_STATX_GID) {
+        json_key(output, &first, "gid");
+        json_uint64(output, statx->stx_gid);
+    }
+    if (mask & RBH_STATX_INO) {
+        json_key(output, &first, "ino");
+        json_uint64(output, statx->stx_ino);
+    }
+    if (mask & RBH_STATX_SIZE) {
+        json_key(output, &first, "size");
+        json_uint64(output, statx->stx_size);
+    }
+    if (mask & RBH_STATX_BLOCKS) {
+        json_key(output, &first, "blocks");
+        json_uint64(output, statx->stx_blocks);
+    }
+    if (mask & RBH_STATX_BLKSIZE) {
+        json_key(output, &first, "blksize");
+        json_uint64(output, statx->stx_blksize);
+    }
+    if (mask & RBH_STATX_ATTRIBUTES) {
+        json_key(output, &first, "attributes");
+        json_uint64(output, statx->stx_attributes);
+    }
+    json_timestamp(output, &first, "atime", &statx->stx_atime, mask,
+                   RBH_STATX_ATIME_SEC, RBH_STATX_ATIME_NSEC);
+    json_timestamp(output, &first, "btime", &statx->stx_btime, mask,
+                   RBH_STATX_BTIME_SEC, RBH_STATX_BTIME_NSEC);
+    json_timestamp(output, &first, "ctime", &statx->stx_ctime, mask,
+                   RBH_STATX_CTIME_SEC, RBH_STATX_CTIME_NSEC);
+    json_timestamp(output, &first, "mtime", &statx->stx_mtime, mask,
+                   RBH_STATX_MTIME_SEC, RBH_STATX_MTIME_NSEC);
+    json_device(output, &first, "rdev", statx->stx_rdev_major,
+                statx->stx_rdev_minor, mask, RBH_STATX_RDEV_MAJOR,
+                RBH_STATX_RDEV_MINOR);
+    json_device(output, &first, "dev", statx->stx_dev_major,
+                statx->stx_dev_minor, mask, RBH_STATX_DEV_MAJOR,
+                RBH_STATX_DEV_MINOR);
+    output_putc(output, '}');
+}
+
+void
+fsentry_print_json(struct output *output, const struct rbh_fsentry *fsentry)
+{
+    bool first = true;
+
+    output_putc(output, '{');
+    if (fsentry->mask & RBH_FP_ID) {
+        json_key(output, &first, "id");
+        json_base64(output, fsentry->id.data, fsentry->id.size);
+    }
+    if (fsentry->mask & RBH_FP_PARENT_ID) {
+        json_key(output, &first, "parent_id");
+        json_base64(output, fsentry->parent_id.data, fsentry->parent_id.size);
+    }
+    if (fsentry->mask & RBH_FP_NAME && fsentry->name != NULL) {
+        json_key(output, &first, "name");
+        json_string(output, fsentry->name, strlen(fsentry->name));
+    }
+    if (fsentry->mask & RBH_FP_SYMLINK && fsentry->symlink != NULL) {
+        json_key(output, &first, "symlink");
+        json_string(output, fsentry->symlink, strlen(fsentry->symlink));
+    }
+    if (fsentry->mask & RBH_FP_STATX && fsentry->statx != NULL) {
+        json_key(output, &first, "statx");
+        json_statx(output, fsentry->statx);
+    }
+    if (fsentry->mask & RBH_FP_NAMESPACE_XATTRS) {
+        json_key(output, &first, "ns_xattrs");
+        json_map(output, &fsentry->xattrs.ns);
+    }
+    if (fsentry->mask & RBH_FP_INODE_XATTRS) {
+        json_key(output, &first, "xattrs");
+        json_map(output, &fsentry->xattrs.inode);
+    }
+    json_literal(output, "}\n");
+}
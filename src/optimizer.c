@@ -0,0 +1,448 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <error.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rbh-find/filters.h"
+#include "rbh-find/optimizer.h"
+
+/* NULL matches every fsentry, FILTER_FALSE matches none. The latter only exists
+ * while a filter is being simplified, backends have no such filter.
+ */
+static struct rbh_filter never;
+#define FILTER_FALSE (&never)
+
+static bool
+is_logical(const struct rbh_filter *filter)
+{
+    switch (filter->op) {
+    case RBH_FOP_AND:
+    case RBH_FOP_OR:
+    case RBH_FOP_NOT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* Unlike filter_compose() in filters.c, every node is allocated along with its
+ * array of children, so that simplified filters can be freed on their own.
+ */
+static struct rbh_filter *
+logical_new(enum rbh_filter_operator op, struct rbh_filter **children,
+            size_t count)
+{
+    const struct rbh_filter **array;
+    struct rbh_filter *filter;
+
+    filter = malloc(sizeof(*filter) + sizeof(*array) * count);
+    if (filter == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+    array = (const struct rbh_filter **)(filter + 1);
+
+    for (size_t i = 0; i < count; i++)
+        array[i] = children[i];
+
+    filter->op = op;
+    filter->logical.filters = array;
+    filter->logical.count = count;
+
+    return filter;
+}
+
+static struct rbh_filter *
+comparison_clone(const struct rbh_filter *filter)
+{
+    struct rbh_filter *clone;
+
+    clone = rbh_filter_clone(filter);
+    if (clone == NULL)
+        error(EXIT_FAILURE, errno, "rbh_filter_clone");
+
+    return clone;
+}
+
+static struct rbh_filter *
+filter_copy(const struct rbh_filter *filter)
+{
+    struct rbh_filter **children;
+    struct rbh_filter *copy;
+
+    if (filter == NULL)
+        return NULL;
+
+    if (!is_logical(filter))
+        return comparison_clone(filter);
+
+    children = malloc(sizeof(*children) * filter->logical.count);
+    if (children == NULL && filter->logical.count != 0)
+        error(EXIT_FAILURE, errno, "malloc");
+
+    for (unsigned int i = 0; i < filter->logical.count; i++)
+        children[i] = filter_copy(filter->logical.filters[i]);
+
+    copy = logical_new(filter->op, children, filter->logical.count);
+    free(children);
+
+    return copy;
+}
+
+void
+filter_optimized_free(struct rbh_filter *filter)
+{
+    if (filter == NULL || filter == FILTER_FALSE)
+        return;
+
+    if (is_logical(filter)) {
+        for (unsigned int i = 0; i < filter->logical.count; i++)
+            filter_optimized_free(
+                (struct rbh_filter *)filter->logical.filters[i]
+                );
+    }
+    free(filter);
+}
+
+/*----------------------------------------------------------------------------*
+ |                                   bounds                                   |
+ *----------------------------------------------------------------------------*/
+
+enum bound {
+    BOUND_NONE,
+    BOUND_LOWER,
+    BOUND_UPPER,
+};
+
+static enum bound
+filter2bound(const struct rbh_filter *filter)
+{
+    switch (filter->op) {
+    case RBH_FOP_STRICTLY_GREATER:
+    case RBH_FOP_GREATER_OR_EQUAL:
+        break;
+    case RBH_FOP_STRICTLY_LOWER:
+    case RBH_FOP_LOWER_OR_EQUAL:
+        break;
+    default:
+        return BOUND_NONE;
+    }
+
+    switch (filter->compare.value.type) {
+    case RBH_VT_INT32:
+    case RBH_VT_UINT32:
+    case RBH_VT_INT64:
+    case RBH_VT_UINT64:
+        break;
+    default:
+        return BOUND_NONE;
+    }
+
+    return filter->op == RBH_FOP_STRICTLY_GREATER ||
+           filter->op == RBH_FOP_GREATER_OR_EQUAL ? BOUND_LOWER : BOUND_UPPER;
+}
+
+static bool
+is_strict(const struct rbh_filter *bound)
+{
+    return bound->op == RBH_FOP_STRICTLY_GREATER ||
+           bound->op == RBH_FOP_STRICTLY_LOWER;
+}
+
+/* Whether two bounds can be compared: each bounds the same field with an
+ * integer of the same type.
+ */
+static bool
+bounds_comparable(const struct rbh_filter *left,
+                  const struct rbh_filter *right)
+{
+    return filter2bound(left) != BOUND_NONE &&
+           filter2bound(right) != BOUND_NONE &&
+           left->compare.value.type == right->compare.value.type &&
+           filter_field_equals(&left->compare.field, &right->compare.field);
+}
+
+#define order(left, right) (((left) > (right)) - ((left) < (right)))
+
+static int
+bound_compare(const struct rbh_filter *left, const struct rbh_filter *right)
+{
+    const struct rbh_value *x = &left->compare.value;
+    const struct rbh_value *y = &right->compare.value;
+
+    switch (x->type) {
+    case RBH_VT_INT32:
+        return order(x->int32, y->int32);
+    case RBH_VT_UINT32:
+        return order(x->uint32, y->uint32);
+    case RBH_VT_INT64:
+        return order(x->int64, y->int64);
+    case RBH_VT_UINT64:
+        return order(x->uint64, y->uint64);
+    default:
+        __builtin_unreachable();
+    }
+}
+
+/* Whether \p bound restricts a field more than \p other, both bounding the
+ * same side of it.
+ */
+static bool
+bound_tighter(const struct rbh_filter *bound, const struct rbh_filter *other)
+{
+    int order = bound_compare(bound, other);
+
+    if (filter2bound(bound) == BOUND_UPPER)
+        order = -order;
+
+    if (order != 0)
+        return order > 0;
+
+    return is_strict(bound) && !is_strict(other);
+}
+
+/* Whether no value is both above \p lower and below \p upper */
+static bool
+range_empty(const struct rbh_filter *lower, const struct rbh_filter *upper)
+{
+    int order = bound_compare(lower, upper);
+
+    return order > 0 || (order == 0 && (is_strict(lower) || is_strict(upper)));
+}
+
+/* Only keep the tightest lower and upper bounds of every field in a list of
+ * ANDed filters, return the new size of the list, or 0 if the bounds contradict
+ * each other.
+ */
+static size_t
+merge_bounds(struct rbh_filter **filters, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        size_t j = i + 1;
+
+        while (j < count) {
+            struct rbh_filter *tmp;
+
+            if (!bounds_comparable(filters[i], filters[j])) {
+                j++;
+                continue;
+            }
+
+            if (filter2bound(filters[i]) != filter2bound(filters[j])) {
+                if (filter2bound(filters[i]) == BOUND_LOWER ?
+                        range_empty(filters[i], filters[j]) :
+                        range_empty(filters[j], filters[i]))
+                    return 0;
+                j++;
+                continue;
+            }
+
+            if (bound_tighter(filters[j], filters[i])) {
+                tmp = filters[i];
+                filters[i] = filters[j];
+                filters[j] = tmp;
+            }
+
+            free(filters[j]);
+            memmove(&filters[j], &filters[j + 1],
+                    sizeof(*filters) * (count - j - 1));
+            count--;
+        }
+    }
+
+    return count;
+}
+
+/*----------------------------------------------------------------------------*
+ |                               simplification                               |
+ *----------------------------------------------------------------------------*/
+
+/* What is known of a filter while simplifying another one */
+struct assumption {
+    const struct rbh_filter *filter;
+    bool value;
+    const struct assumption *next;
+};
+
+static struct rbh_filter *
+simplify(const struct rbh_filter *filter,
+         const struct assumption *assumptions);
+
+static struct rbh_filter *
+simplify_not(const struct rbh_filter *filter,
+             const struct assumption *assumptions)
+{
+    struct rbh_filter *child;
+
+    child = simplify(filter->logical.filters[0], assumptions);
+    if (child == NULL)
+        return FILTER_FALSE;
+    if (child == FILTER_FALSE)
+        return NULL;
+
+    if (child->op == RBH_FOP_NOT) {
+        /* ! ! A <=> A */
+        struct rbh_filter *grandchild;
+
+        grandchild = (struct rbh_filter *)child->logical.filters[0];
+        free(child);
+        return grandchild;
+    }
+
+    return logical_new(RBH_FOP_NOT, &child, 1);
+}
+
+static void
+children_append(struct rbh_filter ***children, size_t *count,
+                struct rbh_filter *child)
+{
+    struct rbh_filter **tmp;
+
+    tmp = reallocarray(*children, *count + 1, sizeof(*tmp));
+    if (tmp == NULL)
+        error(EXIT_FAILURE, errno, "reallocarray");
+
+    tmp[(*count)++] = child;
+    *children = tmp;
+}
+
+static void
+children_free(struct rbh_filter **children, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        filter_optimized_free(children[i]);
+    free(children);
+}
+
+static struct rbh_filter *
+simplify_logical(const struct rbh_filter *filter,
+                 const struct assumption *assumptions)
+{
+    bool and = filter->op == RBH_FOP_AND;
+    /* NULL is neutral for an AND and absorbs an OR, FILTER_FALSE does the
+     * opposite
+     */
+    struct rbh_filter *neutral = and ? NULL : FILTER_FALSE;
+    struct rbh_filter *absorbing = and ? FILTER_FALSE : NULL;
+    struct rbh_filter **children = NULL;
+    struct assumption *known;
+    struct rbh_filter *result;
+    size_t count = 0;
+
+    known = malloc(sizeof(*known) * filter->logical.count);
+    if (known == NULL && filter->logical.count != 0)
+        error(EXIT_FAILURE, errno, "malloc");
+
+    for (unsigned int i = 0; i < filter->logical.count; i++) {
+        const struct rbh_filter *operand = filter->logical.filters[i];
+        struct rbh_filter *child;
+
+        child = simplify(operand, assumptions);
+
+        /* The next operands only matter if this one is true (resp. false) */
+        known[i].filter = operand;
+        known[i].value = and;
+        known[i].next = assumptions;
+        assumptions = &known[i];
+
+        if (child == neutral)
+            continue;
+
+        if (child == absorbing) {
+            children_free(children, count);
+            free(known);
+            return absorbing;
+        }
+
+        if (child->op != filter->op) {
+            children_append(&children, &count, child);
+            continue;
+        }
+
+        /* (A && B) && C <=> A && B && C */
+        for (unsigned int j = 0; j < child->logical.count; j++)
+            children_append(&children, &count,
+                            (struct rbh_filter *)child->logical.filters[j]);
+        free(child);
+    }
+    free(known);
+
+    if (and && count > 1) {
+        count = merge_bounds(children, count);
+        if (count == 0) {
+            free(children);
+            return FILTER_FALSE;
+        }
+    }
+
+    switch (count) {
+    case 0:
+        result = neutral;
+        break;
+    case 1:
+        result = children[0];
+        break;
+    default:
+        result = logical_new(filter->op, children, count);
+        break;
+    }
+    free(children);
+
+    return result;
+}
+
+static struct rbh_filter *
+simplify(const struct rbh_filter *filter,
+         const struct assumption *assumptions)
+{
+    if (filter == NULL)
+        return NULL;
+
+    for (const struct assumption *known = assumptions; known != NULL;
+         known = known->next) {
+        if (filter_equals(filter, known->filter))
+            return known->value ? NULL : FILTER_FALSE;
+    }
+
+    switch (filter->op) {
+    case RBH_FOP_AND:
+    case RBH_FOP_OR:
+        return simplify_logical(filter, assumptions);
+    case RBH_FOP_NOT:
+        return simplify_not(filter, assumptions);
+    default:
+        return comparison_clone(filter);
+    }
+}
+
+struct rbh_filter *
+filter_optimize(const struct rbh_filter *filter)
+{
+    struct rbh_filter *normalized;
+    struct rbh_filter *optimized;
+
+    /* Operands that only differ by NULL children or nesting are only
+     * recognized as the same once they are normalized, hence a second pass.
+     */
+    normalized = simplify(filter, NULL);
+    if (normalized == FILTER_FALSE)
+        /* There is no filter that matches nothing, keep the original one */
+        return filter_copy(filter);
+
+    optimized = simplify(normalized, NULL);
+    filter_optimized_free(normalized);
+    if (optimized == FILTER_FALSE)
+        return filter_copy(filter);
+
+    return optimized;
+}
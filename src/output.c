@@ -0,0 +1,235 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <error.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/uio.h>
+
+#include "rbh-find/output.h"
+
+struct output *
+output_new(int fd, const char *name)
+{
+    struct output *output;
+
+    output = malloc(sizeof(*output));
+    if (output == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+
+    output->buffer = malloc(OUTPUT_BUFFER_SIZE);
+    if (output->buffer == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+
+    output->name = strdup(name);
+    if (output->name == NULL)
+        error(EXIT_FAILURE, errno, "strdup");
+
+    output->fd = fd;
+    output->owned = false;
+    output->interactive = isatty(fd);
+    output->length = 0;
+    output->total = 0;
+
+    return output;
+}
+
+struct output *
+output_open(const char *path)
+{
+    struct output *output;
+    int fd;
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0)
+        error(EXIT_FAILURE, errno, "open: %s", path);
+
+    output = output_new(fd, path);
+    output->owned = true;
+    return output;
+}
+
+/* Write every byte of a vector of buffers, whatever the number of calls to
+ * writev() it takes
+ */
+static void
+output_writev(struct output *output, struct iovec *iov, int iovcnt)
+{
+    while (iovcnt > 0) {
+        ssize_t count;
+
+        count = writev(output->fd, iov, iovcnt);
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+
+            /* Drop what is buffered so that flushing on exit does not fail
+             * again
+             */
+            output->length = 0;
+            error(EXIT_FAILURE, errno, "write: %s", output->name);
+        }
+
+        while (iovcnt > 0 && (size_t)count >= iov->iov_len) {
+            count -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + count;
+            iov->iov_len -= count;
+        }
+    }
+}
+
+void
+output_flush(struct output *output)
+{
+    struct iovec iov = {
+        .iov_base = output->buffer,
+        .iov_len = output->length,
+    };
+
+    if (output->length == 0)
+        return;
+
+    output_writev(output, &iov, 1);
+    output->length = 0;
+}
+
+/* Outputs to terminals are line buffered, like stdio's */
+static void
+output_written(struct output *output, const char *data, size_t size)
+{
+    if (output->interactive && memchr(data, '\n', size) != NULL)
+        output_flush(output);
+}
+
+void
+output_write(struct output *output, const void *data, size_t size)
+{
+    output->total += size;
+
+    if (size <= OUTPUT_BUFFER_SIZE - output->length) {
+        memcpy(output->buffer + output->length, data, size);
+        output->length += size;
+    } else {
+        /* Write what is buffered and \p data in one go, there is no point in
+         * copying \p data first
+         */
+        struct iovec iov[2] = {
+            { .iov_base = output->buffer, .iov_len = output->length, },
+            { .iov_base = (void *)data, .iov_len = size, },
+        };
+
+        output_writev(output, iov, 2);
+        output->length = 0;
+        return;
+    }
+
+    output_written(output, data, size);
+}
+
+void
+output_putc(struct output *output, char c)
+{
+    if (output->length == OUTPUT_BUFFER_SIZE)
+        output_flush(output);
+
+    output->buffer[output->length++] = c;
+    output->total++;
+    output_written(output, &c, 1);
+}
+
+char *
+output_reserve(struct output *output, size_t size)
+{
+    assert(size <= OUTPUT_BUFFER_SIZE);
+
+    if (size > OUTPUT_BUFFER_SIZE - output->length)
+        output_flush(output);
+
+    return output->buffer + output->length;
+}
+
+void
+output_commit(struct output *output, size_t size)
+{
+    output->length += size;
+    output->total += size;
+    output_written(output, output->buffer + output->length - size, size);
+}
+
+int
+output_printf(struct output *output, const char *format, ...)
+{
+    size_t available = OUTPUT_BUFFER_SIZE - output->length;
+    va_list args, copy;
+    char *string;
+    int length;
+
+    va_start(args, format);
+    va_copy(copy, args);
+    length = vsnprintf(output->buffer + output->length, available, format,
+                       args);
+    va_end(args);
+    if (length < 0)
+        error(EXIT_FAILURE, errno, "vsnprintf");
+
+    if ((size_t)length < available) {
+        va_end(copy);
+        output->length += length;
+        output->total += length;
+        output_written(output, output->buffer + output->length - length,
+                       length);
+        return length;
+    }
+
+    if (length < OUTPUT_BUFFER_SIZE) {
+        output_flush(output);
+        vsnprintf(output->buffer, OUTPUT_BUFFER_SIZE, format, copy);
+        va_end(copy);
+        output->length = length;
+        output->total += length;
+        output_written(output, output->buffer, length);
+        return length;
+    }
+
+    length = vasprintf(&string, format, copy);
+    va_end(copy);
+    if (length < 0)
+        error(EXIT_FAILURE, errno, "vasprintf");
+
+    output_write(output, string, length);
+    free(string);
+    return length;
+}
+
+void
+output_close(struct output *output)
+{
+    output_flush(output);
+
+    if (output->owned && close(output->fd))
+        error(EXIT_FAILURE, errno, "close: %s", output->name);
+
+    free(output->name);
+    free(output->buffer);
+    free(output);
+}
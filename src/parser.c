@@ -380,6 +380,10 @@ str2action(const char *string)
         break;
     case 'f':
         switch (string[2]) {
+        case 'j':
+            if (strcmp(&string[3], "son") == 0)
+                return ACT_FJSON;
+            break;
         case 'l':
             if (strcmp(&string[3], "s") == 0)
                 return ACT_FLS;
@@ -395,6 +399,10 @@ str2action(const char *string)
                 if (string[8] == '\0')
                     return ACT_FPRINT0;
                 break;
+            case 'b':
+                if (strcmp(&string[8], "in") == 0)
+                    return ACT_FPRINTBIN;
+                break;
             case 'f':
                 if (string[8] == '\0')
                     return ACT_FPRINTF;
@@ -403,6 +411,14 @@ str2action(const char *string)
             break;
         }
         break;
+    case 'h':
+        if (strcmp(&string[2], "istogram") == 0)
+            return ACT_HISTOGRAM;
+        break;
+    case 'j':
+        if (strcmp(&string[2], "son") == 0)
+            return ACT_JSON;
+        break;
     case 'l':
         if (strcmp(&string[2], "s") == 0)
             return ACT_LS;
@@ -452,6 +468,10 @@ str2action(const char *string)
         if (strcmp(&string[2], "uit") == 0)
             return ACT_QUIT;
         break;
+    case 's':
+        if (strcmp(&string[2], "um") == 0)
+            return ACT_SUM;
+        break;
     }
     error(EX_USAGE, 0, "unknown predicate `%s'", string);
     __builtin_unreachable();
@@ -462,10 +482,14 @@ static const char *__action2str[] = {
     [ACT_DELETE]    = "-delete",
     [ACT_EXEC]      = "-exec",
     [ACT_EXECDIR]   = "-execdir",
+    [ACT_FJSON]     = "-fjson",
     [ACT_FLS]       = "-fls",
     [ACT_FPRINT]    = "-fprint",
     [ACT_FPRINT0]   = "-fprint0",
+    [ACT_FPRINTBIN] = "-fprintbin",
     [ACT_FPRINTF]   = "-fprintf",
+    [ACT_HISTOGRAM] = "-histogram",
+    [ACT_JSON]      = "-json",
     [ACT_LS]        = "-ls",
     [ACT_OK]        = "-ok",
     [ACT_OKDIR]     = "-okdir",
@@ -474,6 +498,7 @@ static const char *__action2str[] = {
     [ACT_PRINTF]    = "-printf",
     [ACT_PRUNE]     = "-prune",
     [ACT_QUIT]      = "-quit",
+    [ACT_SUM]       = "-sum",
 };
 
 const char *
@@ -481,3 +506,93 @@ action2str(enum action action)
 {
     return __action2str[action];
 }
+
+enum option
+str2option(const char *string)
+{
+    assert(string[0] == '-');
+
+    switch (string[1]) {
+    case 'b':
+        if (strcmp(&string[2], "atch-size") == 0)
+            return OPT_BATCH_SIZE;
+        break;
+    case 'c':
+        if (strcmp(&string[2], "ache") == 0)
+            return OPT_CACHE;
+        break;
+    case 'D':
+        if (string[2] == '\0')
+            return OPT_DEBUG;
+        break;
+    case 'e':
+        if (strcmp(&string[2], "xplain") == 0)
+            return OPT_EXPLAIN;
+        break;
+    case 'g':
+        if (strcmp(&string[2], "roup-by") == 0)
+            return OPT_GROUP_BY;
+        break;
+    case 'j':
+        if (strcmp(&string[2], "obs") == 0)
+            return OPT_JOBS;
+        break;
+    case 'l':
+        if (strcmp(&string[2], "imit") == 0)
+            return OPT_LIMIT;
+        break;
+    case 'm':
+        if (strcmp(&string[2], "ount-root") == 0)
+            return OPT_MOUNT_ROOT;
+        break;
+    case 'p':
+        if (strcmp(&string[2], "artition") == 0)
+            return OPT_PARTITION;
+        if (strcmp(&string[2], "refetch") == 0)
+            return OPT_PREFETCH;
+        if (strcmp(&string[2], "refetch-ids") == 0)
+            return OPT_PREFETCH_IDS;
+        break;
+    case 's':
+        if (strcmp(&string[2], "ample") == 0)
+            return OPT_SAMPLE;
+        if (strcmp(&string[2], "ince-checkpoint") == 0)
+            return OPT_SINCE_CHECKPOINT;
+        if (strcmp(&string[2], "ingle-scan") == 0)
+            return OPT_SINGLE_SCAN;
+        if (strcmp(&string[2], "tats") == 0)
+            return OPT_STATS;
+        break;
+    case 'u':
+        if (strcmp(&string[2], "nordered") == 0)
+            return OPT_UNORDERED;
+        break;
+    }
+    error(EX_USAGE, 0, "unknown option `%s'", string);
+    __builtin_unreachable();
+}
+
+static const char *__option2str[] = {
+    [OPT_BATCH_SIZE]    = "-batch-size",
+    [OPT_CACHE]         = "-cache",
+    [OPT_DEBUG]         = "-D",
+    [OPT_EXPLAIN]       = "-explain",
+    [OPT_GROUP_BY]      = "-group-by",
+    [OPT_JOBS]          = "-jobs",
+    [OPT_LIMIT]         = "-limit",
+    [OPT_MOUNT_ROOT]    = "-mount-root",
+    [OPT_PARTITION]     = "-partition",
+    [OPT_PREFETCH]      = "-prefetch",
+    [OPT_PREFETCH_IDS]  = "-prefetch-ids",
+    [OPT_SAMPLE]        = "-sample",
+    [OPT_SINCE_CHECKPOINT] = "-since-checkpoint",
+    [OPT_SINGLE_SCAN]   = "-single-scan",
+    [OPT_STATS]         = "-stats",
+    [OPT_UNORDERED]     = "-unordered",
+};
+
+const char *
+option2str(enum option option)
+{
+    return __option2str[option];
+}
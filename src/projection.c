@@ -0,0 +1,160 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <robinhood/statx.h>
+
+#include "rbh-find/projection.h"
+
+void
+projection_add_field(struct rbh_filter_projection *projection,
+                     const struct rbh_filter_field *field)
+{
+    projection->fsentry_mask |= field->fsentry;
+    if (field->fsentry == RBH_FP_STATX)
+        projection->statx_mask |= field->statx;
+}
+
+void
+projection_add_filter(struct rbh_filter_projection *projection,
+                      const struct rbh_filter *filter)
+{
+    if (filter == NULL)
+        return;
+
+    switch (filter->op) {
+    case RBH_FOP_AND:
+    case RBH_FOP_OR:
+    case RBH_FOP_NOT:
+        for (unsigned int i = 0; i < filter->logical.count; i++)
+            projection_add_filter(projection, filter->logical.filters[i]);
+        break;
+    default:
+        projection_add_field(projection, &filter->compare.field);
+        break;
+    }
+}
+
+void
+projection_add_sorts(struct rbh_filter_projection *projection,
+                     const struct rbh_filter_sort *sorts, size_t sorts_count)
+{
+    for (size_t i = 0; i < sorts_count; i++)
+        projection_add_field(projection, &sorts[i].field);
+}
+
+struct mask_name {
+    unsigned int mask;
+    const char *name;
+};
+
+static const struct mask_name FSENTRY_PROPERTIES[] = {
+    { RBH_FP_ID,                "id" },
+    { RBH_FP_PARENT_ID,         "parent-id" },
+    { RBH_FP_NAME,              "name" },
+    { RBH_FP_STATX,             "statx" },
+    { RBH_FP_SYMLINK,           "symlink" },
+    { RBH_FP_NAMESPACE_XATTRS,  "ns-xattrs" },
+    { RBH_FP_INODE_XATTRS,      "xattrs" },
+};
+
+static const struct mask_name STATX_FIELDS[] = {
+    { RBH_STATX_TYPE,           "type" },
+    { RBH_STATX_MODE,           "mode" },
+    { RBH_STATX_NLINK,          "nlink" },
+    { RBH_STATX_UID,            "uid" },
+    { RBH_STATX_GID,            "gid" },
+    { RBH_STATX_ATIME_SEC,      "atime.sec" },
+    { RBH_STATX_MTIME_SEC,      "mtime.sec" },
+    { RBH_STATX_CTIME_SEC,      "ctime.sec" },
+    { RBH_STATX_INO,            "ino" },
+    { RBH_STATX_SIZE,           "size" },
+    { RBH_STATX_BLOCKS,         "blocks" },
+    { RBH_STATX_BTIME_SEC,      "btime.sec" },
+    { RBH_STATX_BLKSIZE,        "blksize" },
+    { RBH_STATX_ATTRIBUTES,     "attributes" },
+    { RBH_STATX_ATIME_NSEC,     "atime.nsec" },
+    { RBH_STATX_BTIME_NSEC,     "btime.nsec" },
+    { RBH_STATX_CTIME_NSEC,     "ctime.nsec" },
+    { RBH_STATX_MTIME_NSEC,     "mtime.nsec" },
+    { RBH_STATX_RDEV_MAJOR,     "rdev.major" },
+    { RBH_STATX_RDEV_MINOR,     "rdev.minor" },
+    { RBH_STATX_DEV_MAJOR,      "dev.major" },
+    { RBH_STATX_DEV_MINOR,      "dev.minor" },
+};
+
+#ifndef ARRAY_SIZE
+# define ARRAY_SIZE(array) (sizeof(array) / sizeof(array[0]))
+#endif
+
+#define mask_name(mask, names) _mask_name(mask, names, ARRAY_SIZE(names))
+
+static const char *
+_mask_name(unsigned int mask, const struct mask_name *names, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (names[i].mask == mask)
+            return names[i].name;
+    }
+
+    return NULL;
+}
+
+const char *
+fsentry_property2str(unsigned int property)
+{
+    return mask_name(property, FSENTRY_PROPERTIES);
+}
+
+const char *
+statx_field2str(unsigned int field)
+{
+    return mask_name(field, STATX_FIELDS);
+}
+
+#define mask_dump(file, mask, names) \
+    _mask_dump(file, mask, names, ARRAY_SIZE(names))
+
+static void
+_mask_dump(FILE *file, unsigned int mask, const struct mask_name *names,
+           size_t count)
+{
+    bool first = true;
+
+    for (size_t i = 0; i < count; i++) {
+        if (!(mask & names[i].mask))
+            continue;
+
+        fprintf(file, "%s%s", first ? "" : ",", names[i].name);
+        mask &= ~names[i].mask;
+        first = false;
+    }
+
+    /* Bits we do not know the name of */
+    if (mask)
+        fprintf(file, "%s%#x", first ? "" : ",", mask);
+    else if (first)
+        fprintf(file, "none");
+}
+
+void
+projection_dump(FILE *file, const struct rbh_filter_projection *projection)
+{
+    fprintf(file, "fsentry={");
+    mask_dump(file, projection->fsentry_mask, FSENTRY_PROPERTIES);
+    fprintf(file, "} statx={");
+    mask_dump(file, projection->fsentry_mask & RBH_FP_STATX ?
+                        projection->statx_mask : 0,
+              STATX_FIELDS);
+    fprintf(file, "}\n");
+}
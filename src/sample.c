@@ -0,0 +1,143 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <error.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "rbh-find/sample.h"
+
+int
+str2sample_rate(const char *string, double *rate)
+{
+    char *end;
+    double value;
+
+    errno = 0;
+    value = strtod(string, &end);
+    if (errno != 0 || end == string)
+        return -1;
+
+    if (*end == '%') {
+        value /= 100;
+        end++;
+    }
+
+    if (*end != '\0' || !(value > 0 && value <= 1))
+        return -1;
+
+    *rate = value;
+    return 0;
+}
+
+/* FNV-1a, then the finalizer of splitmix64: FNV-1a alone mixes the last bytes
+ * of IDs, which usually are the ones that differ, too little
+ */
+static uint64_t
+id_hash(const struct rbh_id *id)
+{
+    uint64_t hash = UINT64_C(0xcbf29ce484222325);
+
+    for (size_t i = 0; i < id->size; i++) {
+        hash ^= (unsigned char)id->data[i];
+        hash *= UINT64_C(0x100000001b3);
+    }
+
+    hash ^= hash >> 30;
+    hash *= UINT64_C(0xbf58476d1ce4e5b9);
+    hash ^= hash >> 27;
+    hash *= UINT64_C(0x94d049bb133111eb);
+    hash ^= hash >> 31;
+    return hash;
+}
+
+bool
+fsentry_sampled(const struct rbh_fsentry *fsentry, double rate)
+{
+    /* 2^64 * rate, without overflowing for a rate of 1 */
+    double threshold = ldexp(rate, 64);
+
+    if (threshold >= ldexp(1, 64))
+        return true;
+
+    return id_hash(&fsentry->id) < (uint64_t)threshold;
+}
+
+struct sample_iterator {
+    struct rbh_mut_iterator iterator;
+    struct rbh_mut_iterator *fsentries;
+    double rate;
+};
+
+static void *
+sample_iter_next(void *_iterator)
+{
+    struct sample_iterator *iterator = _iterator;
+    struct rbh_fsentry *fsentry;
+
+    while ((fsentry = rbh_mut_iter_next(iterator->fsentries)) != NULL) {
+        if (fsentry_sampled(fsentry, iterator->rate))
+            return fsentry;
+        free(fsentry);
+    }
+
+    return NULL;
+}
+
+static void
+sample_iter_destroy(void *_iterator)
+{
+    struct sample_iterator *iterator = _iterator;
+
+    rbh_mut_iter_destroy(iterator->fsentries);
+    free(iterator);
+}
+
+static const struct rbh_mut_iterator_operations SAMPLE_ITER_OPS = {
+    .next = sample_iter_next,
+    .destroy = sample_iter_destroy,
+};
+
+struct rbh_mut_iterator *
+sample_iter_new(struct rbh_mut_iterator *fsentries, double rate)
+{
+    struct sample_iterator *iterator;
+
+    iterator = malloc(sizeof(*iterator));
+    if (iterator == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+
+    iterator->iterator.ops = &SAMPLE_ITER_OPS;
+    iterator->fsentries = fsentries;
+    iterator->rate = rate;
+
+    return &iterator->iterator;
+}
+
+/* The 97.5th percentile of the standard normal distribution */
+#define Z_95 1.959964
+
+void
+sample_estimate(double rate, double total, double squares,
+                struct estimate *estimate)
+{
+    /* Horvitz-Thompson: each fsentry stands for 1 / rate of them, and the
+     * variance of the estimate is (1 - rate) / rate^2 times the sum of the
+     * squares of all the values, which the sample estimates as well
+     */
+    double margin = Z_95 * sqrt((1 - rate) * squares) / rate;
+
+    estimate->value = total / rate;
+    estimate->low = fmax(total, estimate->value - margin);
+    estimate->high = estimate->value + margin;
+}
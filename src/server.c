@@ -0,0 +1,422 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <error.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "rbh-find/server.h"
+
+/* A request is the size of its arguments, sent along with the standard input,
+ * output and error and the working directory of the client, followed by the
+ * arguments, each one NUL-terminated. The server answers with the exit status
+ * of the request, once it is done.
+ */
+#define REQUEST_FD_COUNT 4
+#define REQUEST_MAX_SIZE (1 << 24)
+
+static void
+socket_address(struct sockaddr_un *address, const char *path)
+{
+    if (strlen(path) >= sizeof(address->sun_path))
+        error(EX_USAGE, 0, "socket path is too long: `%s'", path);
+
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    strcpy(address->sun_path, path);
+}
+
+static int
+unix_socket(void)
+{
+    int fd;
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        error(EXIT_FAILURE, errno, "socket");
+
+    return fd;
+}
+
+/* Read exactly \p size bytes, the end of the stream is an error */
+static int
+recv_all(int fd, void *buffer, size_t size)
+{
+    char *bytes = buffer;
+    ssize_t count;
+
+    while (size > 0) {
+        count = recv(fd, bytes, size, 0);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count < 0)
+            return -1;
+        if (count == 0) {
+            errno = ECONNRESET;
+            return -1;
+        }
+
+        bytes += count;
+        size -= count;
+    }
+
+    return 0;
+}
+
+static int
+send_all(int fd, const void *buffer, size_t size)
+{
+    const char *bytes = buffer;
+    ssize_t count;
+
+    while (size > 0) {
+        count = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count < 0)
+            return -1;
+
+        bytes += count;
+        size -= count;
+    }
+
+    return 0;
+}
+
+/*----------------------------------------------------------------------------*
+ |                                   server                                   |
+ *----------------------------------------------------------------------------*/
+
+/* Whether \p address is a socket no server listens on anymore */
+static bool
+socket_is_stale(const struct sockaddr_un *address)
+{
+    struct stat statbuf;
+    bool stale;
+    int fd;
+
+    if (lstat(address->sun_path, &statbuf) || !S_ISSOCK(statbuf.st_mode))
+        return false;
+
+    fd = unix_socket();
+    stale = connect(fd, (const struct sockaddr *)address, sizeof(*address)) &&
+            errno == ECONNREFUSED;
+    close(fd);
+
+    return stale;
+}
+
+static int
+server_listen(const char *path)
+{
+    struct sockaddr_un address;
+    int fd = unix_socket();
+
+    socket_address(&address, path);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address))) {
+        int save_errno = errno;
+
+        if (save_errno != EADDRINUSE || !socket_is_stale(&address))
+            error(EXIT_FAILURE, save_errno, "cannot listen on `%s'", path);
+
+        if (unlink(path))
+            error(EXIT_FAILURE, errno, "cannot remove `%s'", path);
+        if (bind(fd, (struct sockaddr *)&address, sizeof(address)))
+            error(EXIT_FAILURE, errno, "cannot listen on `%s'", path);
+    }
+
+    if (listen(fd, SOMAXCONN))
+        error(EXIT_FAILURE, errno, "listen");
+
+    return fd;
+}
+
+/* Requests run with the credentials of the server, only serve its own user */
+static bool
+client_is_trusted(int connection)
+{
+    struct ucred credentials;
+    socklen_t length = sizeof(credentials);
+
+    if (getsockopt(connection, SOL_SOCKET, SO_PEERCRED, &credentials,
+                   &length)) {
+        error(0, errno, "getsockopt");
+        return false;
+    }
+
+    if (credentials.uid == geteuid())
+        return true;
+
+    error(0, 0, "rejected a request of user %u", (unsigned)credentials.uid);
+    return false;
+}
+
+static void
+request_receive(int connection, int *argc, char ***argv,
+                int fds[REQUEST_FD_COUNT])
+{
+    union {
+        char buffer[CMSG_SPACE(REQUEST_FD_COUNT * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    uint32_t size;
+    struct iovec iov = {
+        .iov_base = &size,
+        .iov_len = sizeof(size),
+    };
+    struct msghdr message = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buffer,
+        .msg_controllen = sizeof(control.buffer),
+    };
+    struct cmsghdr *cmsg;
+    char *arguments;
+    ssize_t count;
+    int i;
+
+    do {
+        count = recvmsg(connection, &message, MSG_CMSG_CLOEXEC);
+    } while (count < 0 && errno == EINTR);
+    if (count < 0)
+        error(EXIT_FAILURE, errno, "recvmsg");
+    if (count == 0)
+        exit(EXIT_SUCCESS);
+
+    cmsg = CMSG_FIRSTHDR(&message);
+    if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET ||
+        cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(REQUEST_FD_COUNT * sizeof(int)) ||
+        message.msg_flags & MSG_CTRUNC)
+        error(EXIT_FAILURE, 0, "malformed request");
+    memcpy(fds, CMSG_DATA(cmsg), REQUEST_FD_COUNT * sizeof(int));
+
+    if (recv_all(connection, (char *)&size + count, sizeof(size) - count))
+        error(EXIT_FAILURE, errno, "recv");
+    if (size == 0 || size > REQUEST_MAX_SIZE)
+        error(EXIT_FAILURE, 0, "malformed request");
+
+    arguments = malloc(size);
+    if (arguments == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+    if (recv_all(connection, arguments, size))
+        error(EXIT_FAILURE, errno, "recv");
+    if (arguments[size - 1] != '\0')
+        error(EXIT_FAILURE, 0, "malformed request");
+
+    *argc = 1;
+    for (uint32_t j = 0; j < size; j++) {
+        if (arguments[j] == '\0')
+            (*argc)++;
+    }
+
+    *argv = malloc((*argc + 1) * sizeof(**argv));
+    if (*argv == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+
+    (*argv)[0] = program_invocation_name;
+    for (i = 1; i < *argc; i++) {
+        (*argv)[i] = arguments;
+        arguments += strlen(arguments) + 1;
+    }
+    (*argv)[i] = NULL;
+}
+
+/* Run a request in a child process, and send its exit status to the client.
+ * Only returns in the child process.
+ */
+static void
+request_run(int connection, int *argc, char ***argv)
+{
+    int fds[REQUEST_FD_COUNT];
+    int32_t status;
+    int wstatus;
+    pid_t pid;
+
+    request_receive(connection, argc, argv, fds);
+
+    pid = fork();
+    if (pid < 0)
+        error(EXIT_FAILURE, errno, "fork");
+
+    if (pid == 0) {
+        for (int i = 0; i < REQUEST_FD_COUNT - 1; i++) {
+            if (dup2(fds[i], i) < 0)
+                error(EXIT_FAILURE, errno, "dup2");
+        }
+        if (fchdir(fds[REQUEST_FD_COUNT - 1]))
+            error(EXIT_FAILURE, errno, "fchdir");
+
+        for (int i = 0; i < REQUEST_FD_COUNT; i++)
+            close(fds[i]);
+        close(connection);
+        return;
+    }
+
+    for (int i = 0; i < REQUEST_FD_COUNT; i++)
+        close(fds[i]);
+
+    while (waitpid(pid, &wstatus, 0) < 0) {
+        if (errno != EINTR)
+            error(EXIT_FAILURE, errno, "waitpid");
+    }
+
+    if (WIFSIGNALED(wstatus))
+        status = 128 + WTERMSIG(wstatus);
+    else
+        status = WEXITSTATUS(wstatus);
+
+    /* The client may be gone already, there is no one to tell */
+    send_all(connection, &status, sizeof(status));
+    exit(EXIT_SUCCESS);
+}
+
+void
+find_serve(const char *path, int *argc, char ***argv)
+{
+    int listener = server_listen(path);
+
+    /* Do not leave the processes that handled requests as zombies */
+    if (signal(SIGCHLD, SIG_IGN) == SIG_ERR)
+        error(EXIT_FAILURE, errno, "signal");
+
+    while (true) {
+        int connection;
+        pid_t pid;
+
+        connection = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+        if (connection < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            error(EXIT_FAILURE, errno, "accept4");
+        }
+
+        if (!client_is_trusted(connection)) {
+            close(connection);
+            continue;
+        }
+
+        pid = fork();
+        if (pid < 0)
+            error(0, errno, "fork");
+
+        if (pid == 0) {
+            close(listener);
+            /* The status of requests is collected with waitpid() */
+            signal(SIGCHLD, SIG_DFL);
+            request_run(connection, argc, argv);
+            return;
+        }
+
+        close(connection);
+    }
+}
+
+/*----------------------------------------------------------------------------*
+ |                                   client                                   |
+ *----------------------------------------------------------------------------*/
+
+int
+find_connect(const char *path, int argc, char * const *argv)
+{
+    union {
+        char buffer[CMSG_SPACE(REQUEST_FD_COUNT * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct sockaddr_un address;
+    int fds[REQUEST_FD_COUNT];
+    uint32_t size = 0;
+    struct iovec iov = {
+        .iov_base = &size,
+        .iov_len = sizeof(size),
+    };
+    struct msghdr message = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buffer,
+        .msg_controllen = sizeof(control.buffer),
+    };
+    struct cmsghdr *cmsg;
+    char *arguments;
+    int32_t status;
+    ssize_t count;
+    char *next;
+    int fd;
+
+    for (int i = 0; i < argc; i++) {
+        size_t length = strlen(argv[i]) + 1;
+
+        if (length > REQUEST_MAX_SIZE - size)
+            error(EX_USAGE, 0, "too many arguments to send to `%s'", path);
+        size += length;
+    }
+    /* A request cannot be empty */
+    if (size == 0)
+        error(EX_USAGE, 0, "missing at least one robinhood URI");
+
+    arguments = malloc(size);
+    if (arguments == NULL)
+        error(EXIT_FAILURE, errno, "malloc");
+
+    next = arguments;
+    for (int i = 0; i < argc; i++)
+        next = stpcpy(next, argv[i]) + 1;
+
+    fd = unix_socket();
+    socket_address(&address, path);
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)))
+        error(EXIT_FAILURE, errno, "cannot connect to `%s'", path);
+
+    fds[0] = STDIN_FILENO;
+    fds[1] = STDOUT_FILENO;
+    fds[2] = STDERR_FILENO;
+    fds[3] = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (fds[3] < 0)
+        error(EXIT_FAILURE, errno, "cannot open the working directory");
+
+    memset(&control, 0, sizeof(control));
+    cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    /* The descriptors go along with the first byte of the request */
+    do {
+        count = sendmsg(fd, &message, MSG_NOSIGNAL);
+    } while (count < 0 && errno == EINTR);
+    if (count < 0)
+        error(EXIT_FAILURE, errno, "sendmsg");
+
+    if (send_all(fd, (char *)&size + count, sizeof(size) - count) ||
+        send_all(fd, arguments, size))
+        error(EXIT_FAILURE, errno, "send");
+    close(fds[3]);
+    free(arguments);
+
+    if (recv_all(fd, &status, sizeof(status)))
+        error(EXIT_FAILURE, errno, "no exit status from `%s'", path);
+    close(fd);
+
+    return status;
+}
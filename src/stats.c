@@ -0,0 +1,259 @@
+/* This file is part of rbh-find
+ * Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+ *                    alternatives
+ *
+ * SPDX-License-Identifer: LGPL-3.0-or-later
+ */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <error.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rbh-find/stats.h"
+
+uint64_t
+stats_clock(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+int
+str2stats_format(const char *string, enum stats_format *format)
+{
+    if (strcmp(string, "text") == 0)
+        *format = STATS_TEXT;
+    else if (strcmp(string, "json") == 0)
+        *format = STATS_JSON;
+    else
+        return -1;
+    return 0;
+}
+
+struct find_stats *
+find_stats_new(enum stats_format format)
+{
+    struct find_stats *stats;
+
+    stats = calloc(1, sizeof(*stats));
+    if (stats == NULL)
+        error(EXIT_FAILURE, errno, "calloc");
+
+    stats->format = format;
+    return stats;
+}
+
+struct action_stats *
+find_stats_begin(struct find_stats *stats, const char *name,
+                 size_t backend_count)
+{
+    struct action_stats **actions;
+    struct action_stats *action;
+
+    actions = reallocarray(stats->actions, stats->action_count + 1,
+                           sizeof(*actions));
+    if (actions == NULL)
+        error(EXIT_FAILURE, errno, "reallocarray");
+    stats->actions = actions;
+
+    action = calloc(1, sizeof(*action)
+                     + backend_count * sizeof(*action->backends));
+    if (action == NULL)
+        error(EXIT_FAILURE, errno, "calloc");
+
+    action->name = name;
+    action->backend_count = backend_count;
+    action->start = stats_clock();
+
+    stats->actions[stats->action_count++] = action;
+    stats->current = action;
+    return action;
+}
+
+void
+find_stats_end(struct find_stats *stats, uint64_t bytes)
+{
+    struct action_stats *action = stats->current;
+
+    if (action == NULL)
+        return;
+
+    action->elapsed = stats_clock() - action->start;
+    action->bytes = bytes;
+    stats->current = NULL;
+}
+
+void
+backend_stats_merge(struct backend_stats *stats,
+                    const struct backend_stats *part)
+{
+    uint64_t end, first_entry;
+
+    if (!part->queried)
+        return;
+
+    if (!stats->queried) {
+        *stats = *part;
+        return;
+    }
+
+    /* Durations are relative to `start', first compute absolute times */
+    end = stats->start + stats->elapsed;
+    if (part->start + part->elapsed > end)
+        end = part->start + part->elapsed;
+
+    first_entry = stats->start + stats->first_entry_time;
+    if (part->entries > 0 &&
+        (stats->entries == 0 ||
+         part->start + part->first_entry_time < first_entry))
+        first_entry = part->start + part->first_entry_time;
+
+    if (part->start < stats->start)
+        stats->start = part->start;
+    stats->elapsed = end - stats->start;
+    if (stats->entries > 0 || part->entries > 0)
+        stats->first_entry_time = first_entry - stats->start;
+
+    stats->filter_time += part->filter_time;
+    stats->next_time += part->next_time;
+    stats->retries += part->retries;
+    stats->entries += part->entries;
+}
+
+static double
+seconds(uint64_t nanoseconds)
+{
+    return nanoseconds / 1e9;
+}
+
+static double
+rate(uint64_t count, uint64_t nanoseconds)
+{
+    return nanoseconds ? count / seconds(nanoseconds) : 0.;
+}
+
+static void
+stats_print_text(FILE *file, const struct find_stats *stats,
+                 char * const *names)
+{
+    for (size_t i = 0; i < stats->action_count; i++) {
+        const struct action_stats *action = stats->actions[i];
+
+        fprintf(file,
+                "%s: %" PRIu64 " entries in %.6fs (%.1f entries/s), %.6fs in actions, %" PRIu64 " bytes written\n",
+                action->name, action->entries, seconds(action->elapsed),
+                rate(action->entries, action->elapsed),
+                seconds(action->exec_time), action->bytes);
+
+        for (size_t j = 0; j < action->backend_count; j++) {
+            const struct backend_stats *backend = &action->backends[j];
+
+            if (!backend->queried)
+                continue;
+
+            fprintf(file, "  %s: %" PRIu64 " entries (%.1f entries/s)",
+                    names[j], backend->entries,
+                    rate(backend->entries, backend->elapsed));
+            if (backend->entries > 0)
+                fprintf(file, ", first after %.6fs",
+                        seconds(backend->first_entry_time));
+            fprintf(file,
+                    ", %.6fs in rbh_backend_filter(), %.6fs in rbh_mut_iter_next(), %" PRIu64 " retries\n",
+                    seconds(backend->filter_time), seconds(backend->next_time),
+                    backend->retries);
+        }
+    }
+}
+
+static void
+json_print_string(FILE *file, const char *string)
+{
+    fputc('"', file);
+    for (; *string != '\0'; string++) {
+        unsigned char c = *string;
+
+        if (c == '"' || c == '\\')
+            fprintf(file, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(file, "\\u%04x", c);
+        else
+            fputc(c, file);
+    }
+    fputc('"', file);
+}
+
+static void
+stats_print_json(FILE *file, const struct find_stats *stats,
+                 char * const *names)
+{
+    fprintf(file, "{\"actions\": [");
+    for (size_t i = 0; i < stats->action_count; i++) {
+        const struct action_stats *action = stats->actions[i];
+        bool first = true;
+
+        fprintf(file, "%s{\"action\": ", i ? ", " : "");
+        json_print_string(file, action->name);
+        fprintf(file,
+                ", \"entries\": %" PRIu64 ", \"time\": %.9f, \"entries_per_second\": %.1f, \"exec_time\": %.9f, \"bytes\": %" PRIu64 ", \"backends\": [",
+                action->entries, seconds(action->elapsed),
+                rate(action->entries, action->elapsed),
+                seconds(action->exec_time), action->bytes);
+
+        for (size_t j = 0; j < action->backend_count; j++) {
+            const struct backend_stats *backend = &action->backends[j];
+
+            if (!backend->queried)
+                continue;
+
+            fprintf(file, "%s{\"backend\": ", first ? "" : ", ");
+            json_print_string(file, names[j]);
+            fprintf(file, ", \"entries\": %" PRIu64 ", \"time\": %.9f, \"entries_per_second\": %.1f, ",
+                    backend->entries, seconds(backend->elapsed),
+                    rate(backend->entries, backend->elapsed));
+            if (backend->entries > 0)
+                fprintf(file, "\"first_entry_time\": %.9f, ",
+                        seconds(backend->first_entry_time));
+            else
+                fprintf(file, "\"first_entry_time\": null, ");
+            fprintf(file,
+                    "\"filter_time\": %.9f, \"next_time\": %.9f, \"retries\": %" PRIu64 "}",
+                    seconds(backend->filter_time), seconds(backend->next_time),
+                    backend->retries);
+            first = false;
+        }
+        fprintf(file, "]}");
+    }
+    fprintf(file, "]}\n");
+}
+
+void
+find_stats_print(FILE *file, const struct find_stats *stats,
+                 char * const *names)
+{
+    switch (stats->format) {
+    case STATS_TEXT:
+        stats_print_text(file, stats, names);
+        break;
+    case STATS_JSON:
+        stats_print_json(file, stats, names);
+        break;
+    }
+}
+
+void
+find_stats_destroy(struct find_stats *stats)
+{
+    for (size_t i = 0; i < stats->action_count; i++)
+        free(stats->actions[i]);
+    free(stats->actions);
+    free(stats);
+}
@@ -10,6 +10,7 @@
 #endif
 
 #include <errno.h>
+#include <error.h>
 #include <inttypes.h>
 #include <limits.h>
 #include <stdbool.h>
@@ -37,6 +38,7 @@ shell2pcre(const char *shell)
                 break;
             case '*':
             case '?':
+            case '.':
             case '|':
             case '+':
             case '(':
@@ -136,6 +138,49 @@ shell2pcre(const char *shell)
     return pcre;
 }
 
+enum glob_type
+glob_classify(const char *glob, char *literal)
+{
+    bool leading_star = false, trailing_star = false;
+    size_t length = 0;
+
+    if (*glob == '*') {
+        leading_star = true;
+        while (*glob == '*')
+            glob++;
+    }
+
+    for (; *glob != '\0'; glob++) {
+        switch (*glob) {
+        case '\\':
+            /* A trailing backslash is left to shell2pcre() */
+            if (*++glob == '\0')
+                return GLOB_PATTERN;
+            break;
+        case '*':
+            /* Only stars may follow the trailing one */
+            while (*glob == '*')
+                glob++;
+            if (*glob != '\0' || leading_star)
+                return GLOB_PATTERN;
+            trailing_star = true;
+            glob--;
+            continue;
+        case '?':
+        case '[':
+            return GLOB_PATTERN;
+        }
+        literal[length++] = *glob;
+    }
+    literal[length] = '\0';
+
+    if (leading_star)
+        return GLOB_SUFFIX;
+    if (trailing_star)
+        return GLOB_PREFIX;
+    return GLOB_LITERAL;
+}
+
 const unsigned long TIME_UNIT2SECONDS[] = {
     [TU_SECOND] = 1,
     [TU_MINUTE] = 60,
@@ -181,3 +226,29 @@ str2uint64_t(const char *input, uint64_t *result)
 
     return 0;
 }
+
+char *
+path_under_root(const char *root, const char *path, size_t length)
+{
+    size_t root_length = strlen(root);
+    char *local;
+
+    while (length > 0 && *path == '/') {
+        path++;
+        length--;
+    }
+
+    if (length == 0) {
+        local = strdup(root);
+        if (local == NULL)
+            error(EXIT_FAILURE, errno, "strdup");
+        return local;
+    }
+
+    if (asprintf(&local, "%s%s%.*s", root,
+                 root_length > 0 && root[root_length - 1] == '/' ? "" : "/",
+                 (int)length, path) < 0)
+        error(EXIT_FAILURE, errno, "asprintf");
+
+    return local;
+}
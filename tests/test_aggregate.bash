@@ -0,0 +1,71 @@
+#!/usr/bin/env bash
+
+# This file is part of rbh-find.
+# Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+#                    alternatives
+#
+# SPDX-License-Identifer: LGPL-3.0-or-later
+
+if ! command -v rbh-sync &> /dev/null; then
+    echo "This test requires rbh-sync to be installed" >&2
+    exit 1
+fi
+
+test_dir=$(dirname $(readlink -e $0))
+. $test_dir/test_utils.bash
+
+################################################################################
+#                                    TESTS                                     #
+################################################################################
+
+test_count_nothing()
+{
+    touch "file"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -name 'missing' -count |
+        difflines "0 matching entries"
+}
+
+test_sum()
+{
+    truncate --size 1K "1K"
+    truncate --size 1M "1M"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -type f -sum size |
+        difflines "sum(size)=$((1024 + 1024 * 1024))"
+}
+
+test_histogram()
+{
+    touch "empty"
+    truncate --size 1K "1K"
+    truncate --size 1500 "1500"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -type f -histogram size |
+        difflines "size in [0, 1): 1" "size in [1024, 2048): 2"
+}
+
+test_group_by()
+{
+    touch "file"
+    mkdir "dir"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -group-by uid -count |
+        difflines "uid=$(id -u): 3 matching entries"
+}
+
+################################################################################
+#                                     MAIN                                     #
+################################################################################
+
+declare -a tests=(test_count_nothing test_sum test_histogram test_group_by)
+
+tmpdir=$(mktemp --directory)
+trap -- "rm -rf '$tmpdir'" EXIT
+cd "$tmpdir"
+
+run_tests ${tests[@]}
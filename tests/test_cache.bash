@@ -0,0 +1,98 @@
+#!/usr/bin/env bash
+
+# This file is part of rbh-find.
+# Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+#                    alternatives
+#
+# SPDX-License-Identifer: LGPL-3.0-or-later
+
+if ! command -v rbh-sync &> /dev/null; then
+    echo "This test requires rbh-sync to be installed" >&2
+    exit 1
+fi
+
+test_dir=$(dirname $(readlink -e $0))
+. $test_dir/test_utils.bash
+
+################################################################################
+#                                    TESTS                                     #
+################################################################################
+
+test_cached()
+{
+    export RBH_FIND_CACHE_DIR="$tmpdir/$testdb.cache"
+
+    touch "file-0" "file-1"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -cache 600 -name 'file-*' | sort |
+        difflines "/file-0" "/file-1"
+
+    touch "file-2"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    # The results of the first query are still valid
+    rbh_find "rbh:mongo:$testdb" -cache 600 -name 'file-*' | sort |
+        difflines "/file-0" "/file-1"
+    rbh_find "rbh:mongo:$testdb" -name 'file-*' | sort |
+        difflines "/file-0" "/file-1" "/file-2"
+}
+
+test_key()
+{
+    export RBH_FIND_CACHE_DIR="$tmpdir/$testdb.cache"
+
+    touch "file-0" "file-1"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -cache 600 -name 'file-*' -type f |
+        sort | difflines "/file-0" "/file-1"
+
+    touch "file-2"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    # The same query, once normalized
+    rbh_find "rbh:mongo:$testdb" -cache 600 -type f -name 'file-*' |
+        sort | difflines "/file-0" "/file-1"
+    # Another query
+    rbh_find "rbh:mongo:$testdb" -cache 600 -name 'file-*' -ls | wc -l |
+        difflines 3
+}
+
+test_expired()
+{
+    export RBH_FIND_CACHE_DIR="$tmpdir/$testdb.cache"
+
+    touch "file-0"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -cache 1 -name 'file-*' |
+        difflines "/file-0"
+
+    touch "file-1"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+    sleep 2
+
+    rbh_find "rbh:mongo:$testdb" -cache 1 -name 'file-*' | sort |
+        difflines "/file-0" "/file-1"
+}
+
+test_invalid()
+{
+    ! rbh_find "rbh:mongo:$testdb" -cache 0 -print ||
+        error "a duration of 0 should be rejected"
+    ! rbh_find "rbh:mongo:$testdb" -cache ||
+        error "a missing duration should be rejected"
+}
+
+################################################################################
+#                                     MAIN                                     #
+################################################################################
+
+declare -a tests=(test_cached test_key test_expired test_invalid)
+
+tmpdir=$(mktemp --directory)
+trap -- "rm -rf '$tmpdir'" EXIT
+cd "$tmpdir"
+
+run_tests ${tests[@]}
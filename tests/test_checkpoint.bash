@@ -0,0 +1,75 @@
+#!/usr/bin/env bash
+
+# This file is part of rbh-find.
+# Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+#                    alternatives
+#
+# SPDX-License-Identifer: LGPL-3.0-or-later
+
+if ! command -v rbh-sync &> /dev/null; then
+    echo "This test requires rbh-sync to be installed" >&2
+    exit 1
+fi
+
+test_dir=$(dirname $(readlink -e $0))
+. $test_dir/test_utils.bash
+
+################################################################################
+#                                    TESTS                                     #
+################################################################################
+
+test_first_run()
+{
+    touch "file-0"
+    sleep 1
+    touch "file-1"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -since-checkpoint checkpoint \
+        -name 'file-*' -sort name | difflines "/file-0" "/file-1"
+    difflines "$(stat -c %Z "file-1")" < checkpoint
+}
+
+test_since_checkpoint()
+{
+    touch "file-0"
+    sleep 1
+    touch "file-1"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+    stat -c %Z "file-1" > checkpoint
+
+    rbh_find "rbh:mongo:$testdb" -since-checkpoint checkpoint \
+        -name 'file-*' | difflines "/file-1"
+}
+
+test_nothing_seen()
+{
+    touch "file"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+    echo 0 > checkpoint
+
+    rbh_find "rbh:mongo:$testdb" -since-checkpoint checkpoint \
+        -name missing | difflines
+    difflines "0" < checkpoint
+}
+
+test_malformed_checkpoint()
+{
+    echo "not a number" > checkpoint
+
+    ! rbh_find "rbh:mongo:$testdb" -since-checkpoint checkpoint \
+        2> /dev/null || error "a malformed checkpoint should be rejected"
+}
+
+################################################################################
+#                                     MAIN                                     #
+################################################################################
+
+declare -a tests=(test_first_run test_since_checkpoint test_nothing_seen
+                  test_malformed_checkpoint)
+
+tmpdir=$(mktemp --directory)
+trap -- "rm -rf '$tmpdir'" EXIT
+cd "$tmpdir"
+
+run_tests ${tests[@]}
@@ -0,0 +1,145 @@
+#!/usr/bin/env bash
+
+# This file is part of rbh-find.
+# Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+#                    alternatives
+#
+# SPDX-License-Identifer: LGPL-3.0-or-later
+
+if ! command -v rbh-sync &> /dev/null; then
+    echo "This test requires rbh-sync to be installed" >&2
+    exit 1
+fi
+
+test_dir=$(dirname $(readlink -e $0))
+. $test_dir/test_utils.bash
+
+################################################################################
+#                                    TESTS                                     #
+################################################################################
+
+test_delete()
+{
+    mkdir -p "dir/subdir" "kept"
+    touch "dir/file-0" "dir/subdir/file-1" "kept/file-2"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -mount-root "$PWD" -path '/dir*' -delete
+    [ ! -e "dir" ] || error "dir should have been deleted"
+    [ -e "kept/file-2" ] || error "kept/file-2 should not have been deleted"
+
+    # What is already gone is not an error
+    rbh_find "rbh:mongo:$testdb" -mount-root "$PWD" -path '/dir*' -delete
+}
+
+test_delete_jobs()
+{
+    mkdir "dir"
+    for i in $(seq 0 99); do
+        touch "dir/file-$i"
+    done
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -mount-root "$PWD" -jobs 4 -path '/dir*' \
+        -delete
+    [ ! -e "dir" ] || error "dir should have been deleted"
+}
+
+test_delete_symlink()
+{
+    mkdir "dir" "outside"
+    touch "dir/file"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    # The directory the backend knows about is now a link to another one
+    mv "dir/file" "outside/file"
+    rmdir "dir"
+    ln -s "outside" "dir"
+
+    ! rbh_find "rbh:mongo:$testdb" -mount-root "$PWD" -path '/dir/file' \
+        -delete ||
+        error "-delete should not follow symbolic links"
+    [ -e "outside/file" ] || error "outside/file should not have been deleted"
+}
+
+test_exec()
+{
+    touch "file-0" "file-1"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -mount-root "$PWD" -name 'file-*' \
+        -exec echo '<{}>' ';' | sort | difflines "<$PWD/file-0>" "<$PWD/file-1>"
+    rbh_find "rbh:mongo:$testdb" -mount-root "$PWD" -name 'file-*' \
+        -exec sh -c 'echo $#' sh {} + | difflines "2"
+    rbh_find "rbh:mongo:$testdb" -mount-root . -name 'file-0' \
+        -exec echo {} + | difflines "./file-0"
+}
+
+test_exec_concurrent()
+{
+    touch file-{0..9}
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    # Each command only waits for its own children
+    rbh_find "rbh:mongo:$testdb" -mount-root "$PWD" -single-scan -jobs 2 \
+            -name 'file-*' -exec sh -c 'sleep 0.1; echo a' ';' \
+            -exec echo b ';' | sort | uniq -c |
+        difflines "$(printf '%7d %s\n' 10 a 10 b)"
+}
+
+test_exec_failure()
+{
+    touch "file"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    # Like find, only batched commands fail rbh-find
+    rbh_find "rbh:mongo:$testdb" -mount-root "$PWD" -name 'file' \
+        -exec false ';'
+    ! rbh_find "rbh:mongo:$testdb" -mount-root "$PWD" -name 'file' \
+        -exec false {} + ||
+        error "a failing batched command should fail rbh-find"
+}
+
+test_execdir()
+{
+    mkdir "dir"
+    touch "dir/file-0" "dir/file-1" "file-2"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -mount-root "$PWD" -name 'file-*' \
+            -execdir sh -c 'echo $(basename $PWD) "$1"' sh {} ';' | sort |
+        difflines "$(printf '%s\n' "$(basename $PWD) ./file-2" "dir ./file-0" \
+                                  "dir ./file-1" | sort)"
+}
+
+test_invalid()
+{
+    ! rbh_find "rbh:mongo:$testdb" -mount-root "$PWD" -exec echo {} ||
+        error "a command without ';' should be rejected"
+    ! rbh_find "rbh:mongo:$testdb" -mount-root "$PWD" -exec ';' ||
+        error "an empty command should be rejected"
+    ! rbh_find "rbh:mongo:$testdb" -jobs 0 -print ||
+        error "0 jobs should be rejected"
+
+    # The current directory is not a default for actions on the filesystem
+    for action in -delete "-exec echo {} ;" "-execdir echo {} ;"; do
+        local status=0
+
+        rbh_find "rbh:mongo:$testdb" $action 2> /dev/null || status=$?
+        [ $status -eq 64 ] || error "$action should require -mount-root"
+    done
+}
+
+################################################################################
+#                                     MAIN                                     #
+################################################################################
+
+declare -a tests=(test_delete test_delete_jobs test_delete_symlink test_exec
+                  test_exec_concurrent test_exec_failure test_execdir
+                  test_invalid)
+
+tmpdir=$(mktemp --directory)
+trap -- "rm -rf '$tmpdir'" EXIT
+cd "$tmpdir"
+
+run_tests ${tests[@]}
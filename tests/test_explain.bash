@@ -0,0 +1,78 @@
+#!/usr/bin/env bash
+
+# This file is part of rbh-find.
+# Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+#                    alternatives
+#
+# SPDX-License-Identifer: LGPL-3.0-or-later
+
+if ! command -v rbh-sync &> /dev/null; then
+    echo "This test requires rbh-sync to be installed" >&2
+    exit 1
+fi
+
+test_dir=$(dirname $(readlink -e $0))
+. $test_dir/test_utils.bash
+
+################################################################################
+#                                    TESTS                                     #
+################################################################################
+
+test_explain()
+{
+    touch "file"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -explain -name file -sort name -print |
+        difflines "-print:" \
+                  "  filter:" \
+                  '    name == "file"' \
+                  "  projection: fsentry={name,ns-xattrs} statx={none}" \
+                  "  sort: name ascending" \
+                  "  queries: 1, 1 per backend"
+}
+
+test_explain_count()
+{
+    touch "file"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    local output="$(rbh_find "rbh:mongo:$testdb" -explain -count)"
+
+    grep --quiet -- "^-count:$" <<< "$output" ||
+        error "-explain should explain -count"
+    ! grep --quiet "matching entries" <<< "$output" ||
+        error "-explain should not count entries"
+}
+
+test_explain_delete()
+{
+    touch "file"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -mount-root "$PWD" -explain -name file \
+        -delete > /dev/null
+    [ -e "file" ] || error "-explain should not delete entries"
+}
+
+test_explain_only_following()
+{
+    touch "file"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -name file -print -explain -name file \
+        -print | head -n 2 | difflines "/file" "-print:"
+}
+
+################################################################################
+#                                     MAIN                                     #
+################################################################################
+
+declare -a tests=(test_explain test_explain_count test_explain_delete
+                  test_explain_only_following)
+
+tmpdir=$(mktemp --directory)
+trap -- "rm -rf '$tmpdir'" EXIT
+cd "$tmpdir"
+
+run_tests ${tests[@]}
@@ -0,0 +1,88 @@
+#!/usr/bin/env bash
+
+# This file is part of rbh-find.
+# Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+#                    alternatives
+#
+# SPDX-License-Identifer: LGPL-3.0-or-later
+
+if ! command -v rbh-sync &> /dev/null; then
+    echo "This test requires rbh-sync to be installed" >&2
+    exit 1
+fi
+
+test_dir=$(dirname $(readlink -e $0))
+. $test_dir/test_utils.bash
+
+# Print the path, size, mode and mtime of each record of a -fprintbin stream
+read_records()
+{
+    python3 -c '
+import struct, sys
+
+HEADER = struct.Struct("=8sII")
+RECORD = struct.Struct("=10IHH5I4Q" + 4 * "qII")
+
+data = open(sys.argv[1], "rb").read()
+magic, version, byte_order = HEADER.unpack_from(data)
+assert magic == b"RBHFBIN\0" and version == 1 and byte_order == 0x01020304
+
+offset = HEADER.size
+while offset < len(data):
+    fields = RECORD.unpack_from(data, offset)
+    length, id_size, parent_id_size, name_size, path_size = (fields[0],
+        *fields[2:6])
+    assert length % 8 == 0
+    start = offset + RECORD.size + id_size + parent_id_size + name_size
+    path = data[start:start + path_size - 1].decode()
+    size, mode, mtime = fields[19], fields[10], fields[30]
+    print(path, size, oct(mode & 0o7777), mtime)
+    offset += length
+' "$1"
+}
+
+################################################################################
+#                                    TESTS                                     #
+################################################################################
+
+test_records()
+{
+    truncate --size 1025 "file-0"
+    touch --date="@1000000000" "file-1"
+    chmod 640 "file-1"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -name 'file-*' -sort name \
+        -fprintbin "$tmpdir/out"
+    read_records "$tmpdir/out" | difflines \
+        "/file-0 1025 0o644 $(stat -c %Y file-0)" \
+        "/file-1 0 0o640 1000000000"
+}
+
+test_empty()
+{
+    touch "file"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -name missing -fprintbin "$tmpdir/out"
+    [ $(stat -c %s "$tmpdir/out") -eq 16 ] ||
+        error "an empty stream should only hold a header"
+}
+
+test_missing_argument()
+{
+    ! rbh_find "rbh:mongo:$testdb" -fprintbin 2> /dev/null ||
+        error "-fprintbin without a file should be rejected"
+}
+
+################################################################################
+#                                     MAIN                                     #
+################################################################################
+
+declare -a tests=(test_records test_empty test_missing_argument)
+
+tmpdir=$(mktemp --directory)
+trap -- "rm -rf '$tmpdir'" EXIT
+cd "$tmpdir"
+
+run_tests ${tests[@]}
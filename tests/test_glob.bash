@@ -0,0 +1,80 @@
+#!/usr/bin/env bash
+
+# This file is part of rbh-find.
+# Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+#                    alternatives
+#
+# SPDX-License-Identifer: LGPL-3.0-or-later
+
+if ! command -v rbh-sync &> /dev/null; then
+    echo "This test requires rbh-sync to be installed" >&2
+    exit 1
+fi
+
+test_dir=$(dirname $(readlink -e $0))
+. $test_dir/test_utils.bash
+
+################################################################################
+#                                    TESTS                                     #
+################################################################################
+
+test_literal()
+{
+    touch "file" "file.txt" "a.b" "axb" 'a*b'
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -name file | difflines "/file"
+    rbh_find "rbh:mongo:$testdb" -name a.b | difflines "/a.b"
+    rbh_find "rbh:mongo:$testdb" -name 'a\*b' | difflines "/a*b"
+    rbh_find "rbh:mongo:$testdb" -D tree -name file 2>&1 >/dev/null |
+        grep -q 'name == "file"' ||
+        error "a literal should be looked up as is"
+}
+
+test_prefix_and_suffix()
+{
+    touch "file-0.h5" "file-1.txt" "data.h5" "h5" "x.h5.txt"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -name 'file-*' | sort |
+        difflines "/file-0.h5" "/file-1.txt"
+    rbh_find "rbh:mongo:$testdb" -name '*.h5' | sort |
+        difflines "/data.h5" "/file-0.h5"
+    rbh_find "rbh:mongo:$testdb" -path '/file*' | sort |
+        difflines "/file-0.h5" "/file-1.txt"
+}
+
+test_pattern()
+{
+    touch "file-0" "file-10" "data"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -name 'file-?' | difflines "/file-0"
+    rbh_find "rbh:mongo:$testdb" -name '*le*0' | sort |
+        difflines "/file-0" "/file-10"
+    rbh_find "rbh:mongo:$testdb" -iname 'FILE-0' | difflines "/file-0"
+}
+
+test_dots()
+{
+    touch "a.b.c.d.e.f.g.h.i.j" "axbxcxdxexfxgxhxixj" "a.b.c.d.e.f.g.h.i.jk"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    # Every '.' is escaped, which takes room in the regex
+    rbh_find "rbh:mongo:$testdb" -name 'a.b.c.d.e.f.g.h.i.?' |
+        difflines "/a.b.c.d.e.f.g.h.i.j"
+    rbh_find "rbh:mongo:$testdb" -path '/a.b.c.d.e.f.g.h.i.?' |
+        difflines "/a.b.c.d.e.f.g.h.i.j"
+}
+
+################################################################################
+#                                     MAIN                                     #
+################################################################################
+
+declare -a tests=(test_literal test_prefix_and_suffix test_pattern test_dots)
+
+tmpdir=$(mktemp --directory)
+trap -- "rm -rf '$tmpdir'" EXIT
+cd "$tmpdir"
+
+run_tests ${tests[@]}
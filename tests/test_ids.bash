@@ -0,0 +1,100 @@
+#!/usr/bin/env bash
+
+# This file is part of rbh-find.
+# Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+#                    alternatives
+#
+# SPDX-License-Identifer: LGPL-3.0-or-later
+
+if ! command -v rbh-sync &> /dev/null; then
+    echo "This test requires rbh-sync to be installed" >&2
+    exit 1
+fi
+
+test_dir=$(dirname $(readlink -e $0))
+. $test_dir/test_utils.bash
+
+################################################################################
+#                                    TESTS                                     #
+################################################################################
+
+test_uid_gid()
+{
+    touch "file"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -name file -uid "$(id -u)" -gid "$(id -g)" |
+        difflines "/file"
+    rbh_find "rbh:mongo:$testdb" -name file -uid "+$(id -u)" | difflines
+}
+
+test_user_group()
+{
+    touch "file"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -name file -user "$(id -un)" \
+        -group "$(id -gn)" | difflines "/file"
+    rbh_find "rbh:mongo:$testdb" -name file -user "$(id -u)" |
+        difflines "/file"
+    ! rbh_find "rbh:mongo:$testdb" -user "no-such-user-$RANDOM" 2> /dev/null ||
+        error "-user should reject unknown users"
+}
+
+test_prefetch_ids()
+{
+    touch "file"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -prefetch-ids -name file -printf '%u:%g\n' |
+        difflines "$(stat -c '%U:%G' file)"
+    diff <(rbh_find "rbh:mongo:$testdb" -name file -ls) \
+         <(rbh_find "rbh:mongo:$testdb" -prefetch-ids -name file -ls)
+}
+
+test_inum_links()
+{
+    touch "file"
+    ln "file" "link"
+    touch "other"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -inum "$(stat -c %i other)" |
+        difflines "/other"
+    rbh_find "rbh:mongo:$testdb" -type f -links +1 -sort name |
+        difflines "/file" "/link"
+}
+
+test_empty()
+{
+    touch "empty"
+    echo "data" > "full"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -empty | difflines "/empty"
+}
+
+test_newer()
+{
+    touch "old"
+    sleep 1
+    touch "reference"
+    sleep 1
+    touch "new"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -type f -newer "reference" | difflines "/new"
+}
+
+################################################################################
+#                                     MAIN                                     #
+################################################################################
+
+declare -a tests=(test_uid_gid test_user_group test_prefetch_ids
+                  test_inum_links test_empty test_newer)
+
+tmpdir=$(mktemp --directory)
+trap -- "rm -rf '$tmpdir'" EXIT
+cd "$tmpdir"
+
+run_tests ${tests[@]}
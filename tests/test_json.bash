@@ -0,0 +1,86 @@
+#!/usr/bin/env bash
+
+# This file is part of rbh-find.
+# Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+#                    alternatives
+#
+# SPDX-License-Identifer: LGPL-3.0-or-later
+
+if ! command -v rbh-sync &> /dev/null; then
+    echo "This test requires rbh-sync to be installed" >&2
+    exit 1
+fi
+
+test_dir=$(dirname $(readlink -e $0))
+. $test_dir/test_utils.bash
+
+# Print the path, name, size and mode of each object of an NDJSON stream
+read_objects()
+{
+    python3 -c '
+import json, sys
+
+for line in sys.stdin:
+    entry = json.loads(line)
+    print(entry["ns_xattrs"]["path"], entry["name"], entry["statx"]["size"],
+          oct(entry["statx"]["mode"]))
+'
+}
+
+################################################################################
+#                                    TESTS                                     #
+################################################################################
+
+test_json()
+{
+    truncate --size 1025 "file-0"
+    touch "file-1"
+    chmod 640 "file-1"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -name 'file-*' -sort name -json |
+        read_objects | difflines "/file-0 file-0 1025 0o644" \
+                                 "/file-1 file-1 0 0o640"
+}
+
+test_fjson()
+{
+    touch "file"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -name file -fjson "$tmpdir/out" |
+        difflines
+    read_objects < "$tmpdir/out" | difflines "/file file 0 0o644"
+}
+
+test_invalid_utf8()
+{
+    touch $'file-\xff'
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -name 'file-*' -json |
+        python3 -c '
+import json, sys
+
+name = json.loads(sys.stdin.readline())["name"]
+sys.stdout.buffer.write(name.encode("utf-8", "surrogateescape"))' |
+        od -An -c | difflines "   f   i   l   e   - 377"
+}
+
+test_missing_argument()
+{
+    ! rbh_find "rbh:mongo:$testdb" -fjson 2> /dev/null ||
+        error "-fjson without a file should be rejected"
+}
+
+################################################################################
+#                                     MAIN                                     #
+################################################################################
+
+declare -a tests=(test_json test_fjson test_invalid_utf8 test_missing_argument)
+
+tmpdir=$(mktemp --directory)
+trap -- "rm -rf '$tmpdir'" EXIT
+cd "$tmpdir"
+
+run_tests ${tests[@]}
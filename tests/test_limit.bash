@@ -0,0 +1,94 @@
+#!/usr/bin/env bash
+
+# This file is part of rbh-find.
+# Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+#                    alternatives
+#
+# SPDX-License-Identifer: LGPL-3.0-or-later
+
+if ! command -v rbh-sync &> /dev/null; then
+    echo "This test requires rbh-sync to be installed" >&2
+    exit 1
+fi
+
+test_dir=$(dirname $(readlink -e $0))
+. $test_dir/test_utils.bash
+
+################################################################################
+#                                    TESTS                                     #
+################################################################################
+
+test_limit()
+{
+    touch "file-0" "file-1" "file-2"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -limit 2 -name 'file-*' | wc -l |
+        difflines "2"
+}
+
+test_limit_count()
+{
+    touch "file-0" "file-1" "file-2"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -name 'file-*' -limit 1 -count |
+        difflines "1 matching entries"
+}
+
+test_quit()
+{
+    touch "file-0" "file-1"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -name 'file-*' -quit -print | difflines
+}
+
+test_quit_no_match()
+{
+    touch "file"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -name 'missing' -quit -o -name 'file' -print |
+        difflines "/file"
+}
+
+test_batch_size_prefetch()
+{
+    touch "file-0" "file-1" "file-2" "file-3" "file-4"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -batch-size 2 -prefetch 3 -name 'file-*' |
+        sort | difflines "/file-0" "/file-1" "/file-2" "/file-3" "/file-4"
+    rbh_find "rbh:mongo:$testdb" -batch-size 2 -prefetch 0 -limit 3 \
+            -name 'file-*' | wc -l | difflines "3"
+}
+
+test_top()
+{
+    for i in $(seq 0 9); do
+        truncate --size $i "file-$i"
+    done
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -rsort size -limit 3 -type f |
+        difflines "/file-9" "/file-8" "/file-7"
+    # The first entries of each URI are merged
+    rbh_find "rbh:mongo:$testdb" "rbh:mongo:$testdb" -rsort size -limit 3 \
+            -type f | difflines "/file-9" "/file-9" "/file-8"
+    rbh_find "rbh:mongo:$testdb" -partition size 4 -sort size -limit 2 \
+            -type f | difflines "/file-0" "/file-1"
+}
+
+################################################################################
+#                                     MAIN                                     #
+################################################################################
+
+declare -a tests=(test_limit test_limit_count test_quit test_quit_no_match
+                  test_batch_size_prefetch test_top)
+
+tmpdir=$(mktemp --directory)
+trap -- "rm -rf '$tmpdir'" EXIT
+cd "$tmpdir"
+
+run_tests ${tests[@]}
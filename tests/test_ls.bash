@@ -0,0 +1,65 @@
+#!/usr/bin/env bash
+
+# This file is part of rbh-find.
+# Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+#                    alternatives
+#
+# SPDX-License-Identifer: LGPL-3.0-or-later
+
+if ! command -v rbh-sync &> /dev/null; then
+    echo "This test requires rbh-sync to be installed" >&2
+    exit 1
+fi
+
+test_dir=$(dirname $(readlink -e $0))
+. $test_dir/test_utils.bash
+
+################################################################################
+#                                    TESTS                                     #
+################################################################################
+
+# The day of the month of the last Sunday of $1 this year, when the time
+# changes in Europe
+last_sunday()
+{
+    local day
+
+    for day in $(seq 31 -1 25); do
+        [ "$(date -d "$(date +%Y)-$1-$day" +%u)" = 7 ] && echo "$day" && return
+    done
+}
+
+test_dst()
+{
+    local year=$(date +%Y)
+    local march=$(last_sunday 03)
+    local october=$(last_sunday 10)
+
+    # Entries right after a time change come first, so that the day of the
+    # others is computed after theirs
+    export TZ=Europe/Paris
+    touch -d "$year-03-$march 12:00" "file-0"
+    touch -d "$year-03-$((march - 1)) 23:30" "file-1"
+    touch -d "$year-10-$october 12:00" "file-2"
+    touch -d "$year-10-$october 01:30" "file-3"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -name 'file-*' -sort name -ls |
+        awk '{ print $8, $9, $10, $11 }' |
+        difflines "Mar $march 12:00 /file-0" \
+                  "Mar $((march - 1)) 23:30 /file-1" \
+                  "Oct $october 12:00 /file-2" \
+                  "Oct $october 01:30 /file-3"
+}
+
+################################################################################
+#                                     MAIN                                     #
+################################################################################
+
+declare -a tests=(test_dst)
+
+tmpdir=$(mktemp --directory)
+trap -- "rm -rf '$tmpdir'" EXIT
+cd "$tmpdir"
+
+run_tests ${tests[@]}
@@ -0,0 +1,68 @@
+#!/usr/bin/env bash
+
+# This file is part of rbh-find.
+# Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+#                    alternatives
+#
+# SPDX-License-Identifer: LGPL-3.0-or-later
+
+if ! command -v rbh-sync &> /dev/null; then
+    echo "This test requires rbh-sync to be installed" >&2
+    exit 1
+fi
+
+test_dir=$(dirname $(readlink -e $0))
+. $test_dir/test_utils.bash
+
+################################################################################
+#                                    TESTS                                     #
+################################################################################
+
+test_partition()
+{
+    for i in $(seq 0 99); do
+        touch "file-$i"
+    done
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    diff <(rbh_find "rbh:mongo:$testdb" -name 'file-*' | sort) \
+         <(rbh_find "rbh:mongo:$testdb" -partition ino 4 -name 'file-*' |
+               sort) ||
+        error "partitioned and unpartitioned queries should match"
+    rbh_find "rbh:mongo:$testdb" -partition size 3 -print | wc -l |
+        difflines 101
+}
+
+test_sorted()
+{
+    for i in $(seq 0 9); do
+        truncate --size $i "file-$i"
+    done
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    diff <(rbh_find "rbh:mongo:$testdb" -sort name -type f) \
+         <(rbh_find "rbh:mongo:$testdb" -partition size 4 -sort name -type f) ||
+        error "partitioned queries should still be sorted"
+}
+
+test_invalid()
+{
+    ! rbh_find "rbh:mongo:$testdb" -partition name 4 -print ||
+        error "a field other than a statx one should be rejected"
+    ! rbh_find "rbh:mongo:$testdb" -partition ino 4096 -print ||
+        error "too many partitions should be rejected"
+    ! rbh_find "rbh:mongo:$testdb" -partition ino ||
+        error "a missing count should be rejected"
+}
+
+################################################################################
+#                                     MAIN                                     #
+################################################################################
+
+declare -a tests=(test_partition test_sorted test_invalid)
+
+tmpdir=$(mktemp --directory)
+trap -- "rm -rf '$tmpdir'" EXIT
+cd "$tmpdir"
+
+run_tests ${tests[@]}
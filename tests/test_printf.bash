@@ -0,0 +1,112 @@
+#!/usr/bin/env bash
+
+# This file is part of rbh-find.
+# Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+#                    alternatives
+#
+# SPDX-License-Identifer: LGPL-3.0-or-later
+
+if ! command -v rbh-sync &> /dev/null; then
+    echo "This test requires rbh-sync to be installed" >&2
+    exit 1
+fi
+
+test_dir=$(dirname $(readlink -e $0))
+. $test_dir/test_utils.bash
+
+################################################################################
+#                                    TESTS                                     #
+################################################################################
+
+test_path()
+{
+    mkdir "dir"
+    touch "dir/file"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -name file -printf '%p %f %h %d\n' |
+        difflines "/dir/file file /dir 2"
+}
+
+test_statx()
+{
+    truncate --size 1025 "file"
+    chmod 640 "file"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -name file \
+        -printf '%s %m %M %y %n %i %U %G\n' |
+        difflines "1025 640 -rw-r----- f 1 $(stat -c '%i %u %g' file)"
+}
+
+test_names()
+{
+    touch "file"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -name file -printf '%u:%g\n' |
+        difflines "$(stat -c '%U:%G' file)"
+}
+
+test_time()
+{
+    touch --date="@1000000000" "file"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    TZ=UTC rbh_find "rbh:mongo:$testdb" -name file -printf '%T@|%TY|%t\n' |
+        difflines "1000000000.0000000000|2001|Sun Sep  9 01:46:40 2001"
+}
+
+test_width_and_escapes()
+{
+    touch "file"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -name file -printf '[%-6f]\t[%6f]\101%%\n' |
+        difflines "$(printf '[file  ]\t[  file]A%%')"
+
+    # Directives rbh-find formats in a buffer of its own
+    chmod 640 "file"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+    rbh_find "rbh:mongo:$testdb" -name file -printf '[%-12M][%3y]\n' |
+        difflines "[-rw-r-----  ][  f]"
+}
+
+test_fprintf()
+{
+    touch "file"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    # The format is not mistaken for the next predicate or action
+    rbh_find "rbh:mongo:$testdb" -name file -fprintf out '%f %y\n' \
+        -printf '%p\n' | difflines "/file"
+    difflines "file f" < out
+}
+
+test_stop()
+{
+    touch "file"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -name file -printf '%f\n\cignored' |
+        difflines "file"
+}
+
+test_invalid()
+{
+    ! rbh_find "rbh:mongo:$testdb" -printf '%z' 2> /dev/null ||
+        error "an invalid directive should be rejected"
+}
+
+################################################################################
+#                                     MAIN                                     #
+################################################################################
+
+declare -a tests=(test_path test_statx test_names test_time
+                  test_width_and_escapes test_fprintf test_stop test_invalid)
+
+tmpdir=$(mktemp --directory)
+trap -- "rm -rf '$tmpdir'" EXIT
+cd "$tmpdir"
+
+run_tests ${tests[@]}
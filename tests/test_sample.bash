@@ -0,0 +1,87 @@
+#!/usr/bin/env bash
+
+# This file is part of rbh-find.
+# Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+#                    alternatives
+#
+# SPDX-License-Identifer: LGPL-3.0-or-later
+
+if ! command -v rbh-sync &> /dev/null; then
+    echo "This test requires rbh-sync to be installed" >&2
+    exit 1
+fi
+
+test_dir=$(dirname $(readlink -e $0))
+. $test_dir/test_utils.bash
+
+################################################################################
+#                                    TESTS                                     #
+################################################################################
+
+test_sample_print()
+{
+    touch file-{1..100}
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    local sample="$(rbh_find "rbh:mongo:$testdb" -sample 50% -name 'file-*')"
+    local count=$(wc -l <<< "$sample")
+
+    (( count > 0 && count < 100 )) ||
+        error "sampling half of 100 entries picked $count of them"
+
+    # The same entries are picked every time
+    rbh_find "rbh:mongo:$testdb" -sample 0.5 -name 'file-*' |
+        difflines "$sample"
+}
+
+test_sample_count()
+{
+    touch file-{1..100}
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -sample 0.5 -name 'file-*' -count |
+        grep --quiet '^~[0-9]* (95% CI: [0-9]* to [0-9]*) matching entries$' ||
+        error "-count should print an estimate"
+
+    rbh_find "rbh:mongo:$testdb" -sample 1 -name 'file-*' -count |
+        difflines "100 matching entries"
+}
+
+test_sample_limit()
+{
+    touch file-{1..100}
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    # The limit applies to the sampled entries, not to what they are drawn from
+    local sample="$(rbh_find "rbh:mongo:$testdb" -sample 50% -name 'file-*')"
+    local count=$(wc -l <<< "$sample")
+
+    (( count > 10 )) || error "sampling half of 100 entries picked $count"
+
+    rbh_find "rbh:mongo:$testdb" -sample 50% -name 'file-*' -limit 10 |
+        difflines "$(head -n 10 <<< "$sample")"
+
+    rbh_find "rbh:mongo:$testdb" -sample 50% -name 'file-*' -limit 1 |
+        difflines "$(head -n 1 <<< "$sample")"
+}
+
+test_invalid_rate()
+{
+    ! rbh_find "rbh:mongo:$testdb" -sample 0 -count 2> /dev/null ||
+        error "-sample 0 should be rejected"
+    ! rbh_find "rbh:mongo:$testdb" -sample 200% -count 2> /dev/null ||
+        error "-sample 200% should be rejected"
+}
+
+################################################################################
+#                                     MAIN                                     #
+################################################################################
+
+declare -a tests=(test_sample_print test_sample_count test_sample_limit
+                  test_invalid_rate)
+
+tmpdir=$(mktemp --directory)
+trap -- "rm -rf '$tmpdir'" EXIT
+cd "$tmpdir"
+
+run_tests ${tests[@]}
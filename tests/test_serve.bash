@@ -0,0 +1,85 @@
+#!/usr/bin/env bash
+
+# This file is part of rbh-find.
+# Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+#                    alternatives
+#
+# SPDX-License-Identifer: LGPL-3.0-or-later
+
+if ! command -v rbh-sync &> /dev/null; then
+    echo "This test requires rbh-sync to be installed" >&2
+    exit 1
+fi
+
+test_dir=$(dirname $(readlink -e $0))
+. $test_dir/test_utils.bash
+
+# Start a server of the test's backend, and stop it when the test is done
+start_server()
+{
+    socket="$tmpdir/$testdb.socket"
+
+    "$__rbh_find" --serve "$socket" "rbh:mongo:$testdb" &
+    server=$!
+    trap -- "kill $server; teardown" EXIT
+
+    for i in $(seq 50); do
+        [ -S "$socket" ] && return 0
+        sleep 0.1
+    done
+    error "the server did not start"
+}
+
+################################################################################
+#                                    TESTS                                     #
+################################################################################
+
+test_request()
+{
+    touch "file-0" "file-1"
+    mkdir "dir"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+    start_server
+
+    rbh_find --connect "$socket" "rbh:mongo:$testdb" -type f -sort name |
+        difflines "/file-0" "/file-1"
+    # The server keeps serving requests
+    rbh_find --connect "$socket" "rbh:mongo:$testdb" -type d -sort name |
+        difflines "/" "/dir"
+}
+
+test_status()
+{
+    touch "file"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+    start_server
+
+    local status=0
+
+    rbh_find --connect "$socket" "rbh:mongo:$testdb" -fprint 2> /dev/null ||
+        status=$?
+    [ $status -eq 64 ] || error "a usage error should be reported to the client"
+
+    # The working directory of the client is that of the request
+    rbh_find --connect "$socket" "rbh:mongo:$testdb" -mount-root . -name file \
+        -delete
+    [ ! -e "file" ] || error "the request should have deleted 'file'"
+}
+
+test_no_server()
+{
+    ! rbh_find --connect "$tmpdir/missing" "rbh:mongo:$testdb" 2> /dev/null ||
+        error "sending a request without a server should fail"
+}
+
+################################################################################
+#                                     MAIN                                     #
+################################################################################
+
+declare -a tests=(test_request test_status test_no_server)
+
+tmpdir=$(mktemp --directory)
+trap -- "rm -rf '$tmpdir'" EXIT
+cd "$tmpdir"
+
+run_tests ${tests[@]}
@@ -0,0 +1,87 @@
+#!/usr/bin/env bash
+
+# This file is part of rbh-find.
+# Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+#                    alternatives
+#
+# SPDX-License-Identifer: LGPL-3.0-or-later
+
+if ! command -v rbh-sync &> /dev/null; then
+    echo "This test requires rbh-sync to be installed" >&2
+    exit 1
+fi
+
+test_dir=$(dirname $(readlink -e $0))
+. $test_dir/test_utils.bash
+
+################################################################################
+#                                    TESTS                                     #
+################################################################################
+
+test_fprint()
+{
+    touch "a.h" "b.c" "c.txt"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -single-scan -name '*.h' -fprint h.out -o \
+        -name '*.c' -fprint c.out | difflines
+
+    sort h.out | difflines "/a.h"
+    sort c.out | difflines "/b.c"
+}
+
+test_or()
+{
+    touch "xy" "x" "y"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -single-scan -name 'x*' -print -o \
+        -name '*y' -print | sort | difflines "/x" "/xy" "/y"
+}
+
+test_same_as_multiple_scans()
+{
+    mkdir "dir"
+    touch "dir/file" "file"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    diff <(rbh_find "rbh:mongo:$testdb" -type d -print -type f -print |
+           sort) \
+         <(rbh_find "rbh:mongo:$testdb" -single-scan -type d -print \
+           -type f -print | sort)
+}
+
+test_count()
+{
+    touch "a.c" "b.c" "c.h"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -single-scan -name '*.c' -count -o \
+        -name '*.h' -count | difflines "2 matching entries" \
+                                       "1 matching entries"
+}
+
+test_quit()
+{
+    touch "a.c" "b.h" "c.c"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    # The other actions are done with before -quit exits
+    rbh_find "rbh:mongo:$testdb" -single-scan -sort name -name 'b.h' -quit -o \
+        -type f -fprint files -count | difflines "1 matching entries"
+
+    difflines "/a.c" < files
+}
+
+################################################################################
+#                                     MAIN                                     #
+################################################################################
+
+declare -a tests=(test_fprint test_or test_same_as_multiple_scans test_count
+                  test_quit)
+
+tmpdir=$(mktemp --directory)
+trap -- "rm -rf '$tmpdir'" EXIT
+cd "$tmpdir"
+
+run_tests ${tests[@]}
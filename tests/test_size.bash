@@ -101,6 +101,20 @@ test_plus_1M_minus_2G()
         difflines "/1.xM" "/4M"
 }
 
+test_plus_1K_plus_3M()
+{
+    touch "empty"
+    truncate --size 1M "1M"
+    truncate --size 4M "4M"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    # Only the tightest of the two lower bounds should be kept
+    rbh_find "rbh:mongo:$testdb" -size +1k -size +3M -D tree -print 2>&1 |
+        grep -c "statx.size >" | difflines "1"
+    rbh_find "rbh:mongo:$testdb" -size +1k -size +3M | sort |
+        difflines "/4M"
+}
+
 test_branch_equal_1K()
 {
     touch "file"
@@ -201,7 +215,8 @@ test_branch_plus_1M_minus_2G()
 
 declare -a tests=(test_equal_1K test_plus_1K test_plus_1K_minus_1M
                   test_equal_1M test_minus_1M test_plus_3M
-                  test_plus_1M_minus_2G test_branch_equal_1K
+                  test_plus_1M_minus_2G test_plus_1K_plus_3M
+                  test_branch_equal_1K
                   test_branch_plus_1K test_branch_plus_1K_minus_1M
                   test_branch_equal_1M test_branch_minus_1M
                   test_branch_plus_3M test_branch_plus_1M_minus_2G)
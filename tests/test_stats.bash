@@ -0,0 +1,82 @@
+#!/usr/bin/env bash
+
+# This file is part of rbh-find.
+# Copyright (C) 2022 Commissariat a l'energie atomique et aux energies
+#                    alternatives
+#
+# SPDX-License-Identifer: LGPL-3.0-or-later
+
+if ! command -v rbh-sync &> /dev/null; then
+    echo "This test requires rbh-sync to be installed" >&2
+    exit 1
+fi
+
+test_dir=$(dirname $(readlink -e $0))
+. $test_dir/test_utils.bash
+
+################################################################################
+#                                    TESTS                                     #
+################################################################################
+
+test_text()
+{
+    touch "file-0" "file-1" "file-2"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -stats text -name 'file-*' 2>&1 >/dev/null |
+        grep -o '^-print: [0-9]* entries' | difflines "-print: 3 entries"
+    rbh_find "rbh:mongo:$testdb" -stats text -name 'file-*' 2>&1 >/dev/null |
+        grep -o '^  rbh:mongo:[^:]*: [0-9]* entries' |
+        difflines "  rbh:mongo:$testdb: 3 entries"
+}
+
+test_bytes()
+{
+    touch "file-0" "file-1"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    # "/file-0\n/file-1\n"
+    rbh_find "rbh:mongo:$testdb" -stats text -name 'file-*' 2>&1 >/dev/null |
+        grep -o '[0-9]* bytes written' | difflines "16 bytes written"
+}
+
+test_json()
+{
+    touch "file"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    rbh_find "rbh:mongo:$testdb" -stats json -name file -print -count \
+        2>&1 >/dev/null | python3 -c '
+import json, sys
+stats = json.load(sys.stdin)
+assert [action["action"] for action in stats["actions"]] == ["-print",
+                                                             "-count"]
+assert stats["actions"][0]["entries"] == 1
+assert stats["actions"][0]["backends"][0]["entries"] == 1
+'
+}
+
+test_environment()
+{
+    touch "file"
+    rbh-sync "rbh:posix:." "rbh:mongo:$testdb"
+
+    RBH_FIND_STATS=text rbh_find "rbh:mongo:$testdb" -name file 2>&1 \
+            >/dev/null | grep -q '^-print: 1 entries' ||
+        error "RBH_FIND_STATS should enable statistics"
+
+    ! RBH_FIND_STATS=xml rbh_find "rbh:mongo:$testdb" -name file ||
+        error "an invalid format should be rejected"
+}
+
+################################################################################
+#                                     MAIN                                     #
+################################################################################
+
+declare -a tests=(test_text test_bytes test_json test_environment)
+
+tmpdir=$(mktemp --directory)
+trap -- "rm -rf '$tmpdir'" EXIT
+cd "$tmpdir"
+
+run_tests ${tests[@]}